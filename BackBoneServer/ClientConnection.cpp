@@ -14,10 +14,35 @@ ClientConnection::ClientConnection( const std::string& technicalId,
    technicalId( technicalId ),
    connectionManager( connectionManager ),
    connection( connection ),
-   message(),
+   mailbox( SerialMailbox::create( connectionManager->getWorkerPool() ) ),
+   inbound(),
+   inboundScheduled( false ),
+   messages(),
    login(),
    currentState( INIT ),
-   load( 0 )
+   load( 0 ),
+   games(),
+   consumedKinds(),
+   providedKinds(),
+   removed( false ),
+   binaryProtocol( false ),
+   compression( false ),
+   coalescedMessages(),
+   coalescedByKey(),
+   coalescedBytes( 0 ),
+   congested( false ),
+   disconnecting( false ),
+   backpressureStatistics(),
+   lastActivity( connectionManager->getHeartbeatTick() ),
+   pingTick( 0 ),
+   sessionToken(),
+   parked( false ),
+   parkedMessages(),
+   parkedBytes( 0 ),
+   parkedOverflow( false ),
+   frozen( false ),
+   readStopped( false ),
+   readCancelled( false )
 {
    AsyncLogger::getInstance()->log( "ClientConnection> New client connection created> " + technicalId );
 }
@@ -32,6 +57,12 @@ const std::string& ClientConnection::getTechnicalId() const
    return technicalId;
 }
 
+// apply the socket options of the role of the client
+void ClientConnection::applySocketProfile( const SocketProfile& profile )
+{
+   connection->applySocketProfile( profile );
+}
+
 const std::string& ClientConnection::getLogin() const
 {
    return login;
@@ -45,41 +76,295 @@ void ClientConnection::close()
 void ClientConnection::waitForData()
 {
 	// Call the async listen using the connection
-	connection->asyncRead( message, 
+	connection->asyncRead( messages, 
 		                    boost::bind( &ClientConnection::handleRead, 
                                        shared_from_this(),
 		                                 boost::asio::placeholders::error ) );
 }
 
+// note the reads are stopped and listen again if the connection was thawed meanwhile
+// the thaw and the stopped read race for readStopped so only one of them listens again
+void ClientConnection::stopReading()
+{
+   readStopped.store( true );
+   if (  ( frozen.load() == false )
+       &&( readStopped.exchange( false ) == true )  )
+   {
+      waitForData();
+   }
+}
+
 void ClientConnection::askForLogin()
 {
-   // send a login demand
+   // send a login demand (telling the binary protocol and the compression are accepted)
    currentState = WAITING_FOR_LOGIN;
-   sendMessage( MESSAGE_LOGIN_ASKED );
+   std::string loginAsked = MESSAGE_LOGIN_ASKED;
+   if ( binaryProtocol == true )
+   {
+      loginAsked += " " + BINARY_PROTOCOL;
+   }
+   if ( compression == true )
+   {
+      loginAsked += " " + COMPRESSION;
+   }
+   sendMessage( loginAsked );
+}
+
+// return true if the messages of the connection are binary
+bool ClientConnection::isBinaryProtocol() const
+{
+   return (  ( binaryProtocol == true )
+           &&( currentState == CONNECTED )  );
 }
 
 void ClientConnection::sendMessage(const std::string& message)
 {
+#ifdef __DEBUG__
    AsyncLogger::getInstance()->log( "WRITING TO (" + technicalId + "): " + message );
+#endif
+
+   // binary peer, encode the message
+   if ( isBinaryProtocol() == true )
+   {
+      SharedBuffer frame = BufferPool::getInstance().acquire( message.size() );
+      BinaryTranscoder::encode( message,
+                                *frame );
+      sendMessage( SharedMessage( frame ) );
+      return;
+   }
+
+   // parked, the message is held in a shared buffer
+   if ( isParked() == true )
+   {
+      sendMessage( BufferPool::getInstance().copy( message ) );
+      return;
+   }
 
    // send the message on the network
-   connection->asyncWrite( message + '\0',
-		                     boost::bind( &ClientConnection::handleWrite, 
+   connection->asyncWrite( message,
+		                     boost::bind( &ClientConnection::handleWriteOf,
+                                        shared_from_this(),
+		                                  boost::asio::placeholders::error ) );
+}
+
+void ClientConnection::sendMessage( SharedMessage message )
+{
+#ifdef __DEBUG__
+   AsyncLogger::getInstance()->log( "WRITING TO (" + technicalId + "): " + *message );
+#endif
+
+   if ( holdIfParked( message ) == true )
+   {
+      return;
+   }
+
+   // queue the shared buffer on the network
+   connection->asyncWrite( message,
+		                     boost::bind( &ClientConnection::handleWriteOf,
                                         shared_from_this(),
 		                                  boost::asio::placeholders::error ) );
 }
 
+// send the form of the message matching the protocol of the connection
+void ClientConnection::sendMessage( const BroadcastMessage& message )
+{
+   sendMessage( getForm( message ) );
+}
+
+// get the form of the message matching the protocol of the connection
+const SharedMessage& ClientConnection::getForm( const BroadcastMessage& message ) const
+{
+   if ( isBinaryProtocol() == false )
+   {
+      return message.getText();
+   }
+   else if ( compression == true )
+   {
+      return message.getCompressed();
+   }
+   return message.getBinary();
+}
+
+// send a game message relayed to a consumer
+// the message is subject to the overflow policy when the outbound queue is over the high water mark
+void ClientConnection::sendGameMessage( const BroadcastMessage& message )
+{
+   const BackpressureSettings& settings = connectionManager->getBackpressureSettings();
+   size_t bytesPending = connection->getBytesPending();
+   bool disconnectNeeded = false;
+
+   backpressureMutex.lock();
+   /*|*/ // check the high water mark
+   /*|*/ if (  ( congested == false )
+   /*|*/     &&( bytesPending > settings.highWaterMark )  )
+   /*|*/ {
+   /*|*/    congested = true;
+   /*|*/    backpressureStatistics.congestions++;
+   /*|*/ }
+   /*|*/
+   /*|*/ if ( congested == false )
+   /*|*/ {
+   /*|*/    // queue the message, under the backpressure mutex to stay behind the released messages
+   /*|*/    sendMessage( message );
+   /*|*/ }
+   /*|*/ else if ( settings.policy == OVERFLOW_COALESCE )
+   /*|*/ {
+   /*|*/    coalesce( message );
+   /*|*/ }
+   /*|*/ else
+   /*|*/ {
+   /*|*/    backpressureStatistics.droppedMessages++;
+   /*|*/
+   /*|*/    if (  ( settings.policy == OVERFLOW_DISCONNECT )
+   /*|*/        &&( disconnecting == false )  )
+   /*|*/    {
+   /*|*/       disconnecting = true;
+   /*|*/       disconnectNeeded = true;
+   /*|*/       backpressureStatistics.disconnections++;
+   /*|*/    }
+   /*|*/ }
+   backpressureMutex.unlock();
+
+   // the caller may hold the lock of the connection manager, close the connection later
+   if ( disconnectNeeded == true )
+   {
+      mailbox->post( boost::bind( &ClientConnection::disconnect,
+                                  shared_from_this() ) );
+   }
+}
+
+// hold the game message until the connection is no more congested, replacing the previous one of the same key
+// the key is the header of the binary frame: game, verb and leading integers ('CELL_UPDATED x y' for a cell update,
+// 'COMPUTE_RESULT' for a result), taken from the form the message already has so nothing is decoded to coalesce it
+// a message without key (a batch, a compressed frame) is held without replacing any other
+// should be call inside the backpressure mutex
+void ClientConnection::coalesce( const BroadcastMessage& message )
+{
+   std::string key;
+   bool keyed = message.getCoalesceKey( key );
+   SharedMessage form = getForm( message );
+
+   // replace the previous message of the key, the new one goes at the end to keep the order
+   if ( keyed == true )
+   {
+      std::map< std::string, CoalescedList::iterator >::iterator itKey = coalescedByKey.find( key );
+      if ( itKey != coalescedByKey.end() )
+      {
+         coalescedBytes -= itKey->second->second->size();
+         coalescedMessages.erase( itKey->second );
+         coalescedByKey.erase( itKey );
+         backpressureStatistics.coalescedMessages++;
+      }
+   }
+   coalescedMessages.push_back( CoalescedList::value_type( key,
+                                                           form ) );
+   if ( keyed == true )
+   {
+      coalescedByKey.insert( std::make_pair( key,
+                                             --coalescedMessages.end() ) );
+   }
+   coalescedBytes += form->size();
+
+   // the held messages are bounded too, drop the oldest ones
+   while ( coalescedBytes > connectionManager->getBackpressureSettings().highWaterMark )
+   {
+      coalescedBytes -= coalescedMessages.front().second->size();
+      if ( coalescedMessages.front().first.empty() == false )
+      {
+         coalescedByKey.erase( coalescedMessages.front().first );
+      }
+      coalescedMessages.pop_front();
+      backpressureStatistics.droppedMessages++;
+   }
+}
+
+// send the held game messages if the outbound queue is under the low water mark
+void ClientConnection::releaseCongestion()
+{
+   backpressureMutex.lock();
+   /*|*/ if (  ( congested == true )
+   /*|*/     &&( connection->getBytesPending() <= connectionManager->getBackpressureSettings().lowWaterMark )  )
+   /*|*/ {
+   /*|*/    congested = false;
+   /*|*/
+   /*|*/    // send the held messages before any new game message
+   /*|*/    for ( CoalescedList::const_iterator it = coalescedMessages.begin();
+   /*|*/          it != coalescedMessages.end();
+   /*|*/          it++ )
+   /*|*/    {
+   /*|*/       sendMessage( it->second );
+   /*|*/    }
+   /*|*/    coalescedMessages.clear();
+   /*|*/    coalescedByKey.clear();
+   /*|*/    coalescedBytes = 0;
+   /*|*/ }
+   backpressureMutex.unlock();
+}
+
+// close the connection of a consumer too slow to read its messages, run in the mailbox
+void ClientConnection::disconnect()
+{
+   AsyncLogger::getInstance()->log( "ClientConnection (" + technicalId + ") > too slow to read its messages, disconnected" );
+   connectionManager->closeConnection( shared_from_this() );
+   close();
+}
+
+// get how often the overflow policies fired for this connection
+BackpressureStatistics ClientConnection::getBackpressureStatistics() const
+{
+   boost::mutex::scoped_lock lock( backpressureMutex );
+   return backpressureStatistics;
+}
+
 void ClientConnection::handleRead( const boost::system::error_code& error )
 {
+   // the read cancelled by a freeze, the bytes not read yet stay in the socket
+   if (  ( error == boost::asio::error::operation_aborted )
+       &&( readCancelled.exchange( false ) == true )  )
+   {
+      stopReading();
+      return;
+   }
+
 	if ( error == 0)
 	{
-      // invoke a thread to handle the message
-      boost::thread worker( &ClientConnection::handleReadInThread,
-                            this,
-                            message );
+      // any message proves the peer is alive
+      lastActivity.store( connectionManager->getHeartbeatTick(),
+                          boost::memory_order_relaxed );
+
+      // queue the messages of the read for the mailbox
+      // the messages are handled in order by the worker pool (login sequence included)
+      bool needSchedule = false;
+      inboundMutex.lock();
+      /*|*/ for ( std::vector< SharedMessage >::const_iterator it = messages.begin();
+      /*|*/       it != messages.end();
+      /*|*/       it++ )
+      /*|*/ {
+      /*|*/    inbound.push_back( *it );
+      /*|*/ }
+      /*|*/ if (  ( inbound.empty() == false )
+      /*|*/     &&( inboundScheduled == false )  )
+      /*|*/ {
+      /*|*/    inboundScheduled = true;
+      /*|*/    needSchedule = true;
+      /*|*/ }
+      inboundMutex.unlock();
 
-		// back to listen
-		waitForData();
+      if ( needSchedule == true )
+      {
+         mailbox->post( boost::bind( &ClientConnection::handleInbound,
+                                     shared_from_this() ) );
+      }
+
+		// back to listen, unless the connection is handed over
+      if ( frozen.load() == true )
+      {
+         stopReading();
+      }
+      else
+      {
+		   waitForData();
+      }
 	}
 	else
 	{
@@ -88,19 +373,62 @@ void ClientConnection::handleRead( const boost::system::error_code& error )
       stream << "ClientConnection (" << technicalId << ") > handleRead call with error code: " << error.value() << " --> " << error.message();
       AsyncLogger::getInstance()->log( stream.str() );
 
-      connectionManager->closeConnection( shared_from_this() );
+      // the link is lost, the session may be resumed
+      connectionManager->closeConnection( shared_from_this(),
+                                          true );
 	}
 }
 
+// handle the received messages in order in the mailbox, a bounded number per task to share the workers
+void ClientConnection::handleInbound( ClientConnectionPtr connection )
+{
+   for ( size_t i = 0;
+         i < INBOUND_MESSAGES_PER_TASK;
+         ++i )
+   {
+      SharedMessage message;
+
+      connection->inboundMutex.lock();
+      /*|*/ if ( connection->inbound.empty() == true )
+      /*|*/ {
+      /*|*/    connection->inboundScheduled = false;
+      /*|*/    connection->inboundMutex.unlock();
+      /*|*/    return;
+      /*|*/ }
+      /*|*/ message.swap( connection->inbound.front() );
+      /*|*/ connection->inbound.pop_front();
+      connection->inboundMutex.unlock();
+
+      connection->handleReadInThread( message );
+   }
+
+   // still scheduled, queued behind the other tasks of the mailbox
+   connection->mailbox->post( boost::bind( &ClientConnection::handleInbound,
+                                           connection ) );
+}
+
 // callback of handle result in a separate thread
-void ClientConnection::handleReadInThread( const std::string& messageToTreat )
+void ClientConnection::handleReadInThread( SharedMessage message )
 {
+   const std::string& messageToTreat = *message;
+
    // check if it's the init message
    if (  ( currentState == INIT )
        &&( messageToTreat == MESSAGE_INIT )  )
    {
       askForLogin();
    }
+   // check if it's the init message asking for the binary protocol (and the compression)
+   else if (  ( currentState == INIT )
+            &&(  ( messageToTreat == MESSAGE_INIT + " " + BINARY_PROTOCOL )
+               ||( messageToTreat == MESSAGE_INIT + " " + BINARY_PROTOCOL + " " + COMPRESSION )  )  )
+   {
+      // the binary frames may contain '\0' so the legacy framing keeps the text protocol
+      binaryProtocol = ( connection->getFramingMode() == SimpleTcpConnection::FRAMING_LENGTH_PREFIXED );
+      compression = (  ( binaryProtocol == true )
+                     &&( messageToTreat != MESSAGE_INIT + " " + BINARY_PROTOCOL )  );
+      askForLogin();
+   }
    // check if it's a login message
    else if ( currentState == WAITING_FOR_LOGIN )
    {
@@ -112,11 +440,11 @@ void ClientConnection::handleReadInThread( const std::string& messageToTreat )
       if ( connectionManager->isValidLogin( login,
                                             passwd ) == true )
       {
+         // send the acceptance message (still in text)
+         sendMessage( MESSAGE_LOGIN_ACCEPTED );
+
          // connection accepted
          currentState = CONNECTED;
-
-         // send the acceptance message
-         sendMessage( MESSAGE_LOGIN_ACCEPTED );
       }
       else
       {
@@ -128,10 +456,37 @@ void ClientConnection::handleReadInThread( const std::string& messageToTreat )
          connectionManager->closeConnection( shared_from_this() );
       }
    }
+   else if (  ( currentState == CONNECTED )
+            &&( binaryProtocol == true )  )
+   {
+      // the answer of a ping, its reception was enough
+      if (  ( messageToTreat.size() == 1 )
+          &&( messageToTreat[ 0 ] == BinaryProtocol::OP_PONG )  )
+      {
+      }
+      // check the close connection frame
+      else if (  ( messageToTreat.size() == 1 )
+               &&( messageToTreat[ 0 ] == BinaryProtocol::OP_CLOSE_CONNECTION )  )
+      {
+         // close the communication
+         AsyncLogger::getInstance()->log( "ClientConnection (" + technicalId + ") > close connection" );
+         connectionManager->closeConnection( shared_from_this() );
+      }
+      else
+      {
+		   // forward the frame to the connection manager
+		   connectionManager->handleBinaryMessage( shared_from_this(),
+                                                 message );
+      }
+   }
    else if ( currentState == CONNECTED )
    {
+      // the answer of a ping, its reception was enough
+      if ( messageToTreat == MESSAGE_PONG )
+      {
+      }
       // check the close connection message
-      if ( message == MESSAGE_CLOSE )
+      else if ( messageToTreat == MESSAGE_CLOSE )
       {
          // close the communication
          AsyncLogger::getInstance()->log( "ClientConnection (" + technicalId + ") > close connection" );
@@ -141,11 +496,71 @@ void ClientConnection::handleReadInThread( const std::string& messageToTreat )
       {
 		   // forward the message to the connection manager
 		   connectionManager->handleMessage( shared_from_this(),
-                                           messageToTreat );
+                                           message );
       }
    }
 }
 
+// check the connection is alive at the heartbeat tick now
+// ping it once it is idle for idleTimeout ticks and close it if it stays silent idleTimeout ticks more
+// next is set to the tick of the next check unless the connection is closed
+HeartbeatResult ClientConnection::checkHeartbeat( boost::uint64_t now,
+                                                  boost::uint64_t idleTimeout,
+                                                  boost::uint64_t& next )
+{
+   // a message recently or since the ping (its answer may come in the tick of the ping)
+   boost::uint64_t last = lastActivity.load( boost::memory_order_relaxed );
+   if (  ( last + idleTimeout > now )
+       ||(  ( pingTick != 0 )
+          &&( last >= pingTick )  )  )
+   {
+      pingTick = 0;
+      next = last + idleTimeout;
+      return HEARTBEAT_ALIVE;
+   }
+
+   // idle, ask the peer
+   if ( pingTick == 0 )
+   {
+      pingTick = now;
+      next = now + idleTimeout;
+      mailbox->post( boost::bind( &ClientConnection::ping,
+                                  shared_from_this() ) );
+      return HEARTBEAT_PINGED;
+   }
+
+   // no answer
+   mailbox->post( boost::bind( &ClientConnection::reap,
+                               shared_from_this() ) );
+   return HEARTBEAT_REAPED;
+}
+
+// send a ping to the idle connection, run in the mailbox
+// the connections still in the login sequence are not pinged, they are closed if they stay silent
+void ClientConnection::ping()
+{
+   if ( currentState == CONNECTED )
+   {
+      sendMessage( MESSAGE_PING );
+   }
+}
+
+// close the connection which missed the heartbeat deadline, run in the mailbox
+void ClientConnection::reap()
+{
+   AsyncLogger::getInstance()->log( "ClientConnection (" + technicalId + ") > missed the heartbeat deadline, disconnected" );
+   connectionManager->closeConnection( shared_from_this(),
+                                       true );
+   close();
+}
+
+// the callback given with each write
+void ClientConnection::handleWriteOf( ClientConnectionPtr connection,
+                                      const boost::system::error_code& error )
+{
+   connection->handleWrite( error );
+}
+
 void ClientConnection::handleWrite( const boost::system::error_code& error )
 {
    // if an error occurs, close the connection
@@ -155,8 +570,96 @@ void ClientConnection::handleWrite( const boost::system::error_code& error )
       stream << "ClientConnection (" << technicalId << ") > handleWrite call with error code: " << error.value() << " --> " << error.message();
       AsyncLogger::getInstance()->log( stream.str() );
 
-      connectionManager->closeConnection( shared_from_this() );
+      // the link is lost, the session may be resumed
+      connectionManager->closeConnection( shared_from_this(),
+                                          true );
 	}
+   else
+   {
+      // the queue shrinks, check the low water mark
+      releaseCongestion();
+   }
+}
+
+// get the token of the session of the connection (empty if none)
+std::string ClientConnection::getSessionToken() const
+{
+   boost::mutex::scoped_lock lock( sessionMutex );
+   return sessionToken;
+}
+
+// set the token of the session of the connection
+void ClientConnection::setSessionToken( const std::string& token )
+{
+   boost::mutex::scoped_lock lock( sessionMutex );
+   sessionToken = token;
+}
+
+// close the socket of the connection whose link is lost and hold the messages sent to it
+void ClientConnection::park()
+{
+   parked.store( true );
+   close();
+}
+
+// return true if the link is lost and the connection kept for its session
+bool ClientConnection::isParked() const
+{
+   return parked.load();
+}
+
+// return true if messages were lost while parked
+bool ClientConnection::hasParkedOverflow() const
+{
+   boost::mutex::scoped_lock lock( sessionMutex );
+   return parkedOverflow;
+}
+
+// move the messages held while parked to messages
+void ClientConnection::takeParkedMessages( std::vector< SharedMessage >& messages )
+{
+   sessionMutex.lock();
+   /*|*/ messages.insert( messages.end(),
+   /*|*/                  parkedMessages.begin(),
+   /*|*/                  parkedMessages.end() );
+   /*|*/ parkedMessages.clear();
+   /*|*/ parkedBytes = 0;
+   sessionMutex.unlock();
+}
+
+// hold the message if the connection is parked, return false if it can be sent
+// the held messages are bounded by the high water mark, a session which lost some can not be resumed
+bool ClientConnection::holdIfParked( SharedMessage message )
+{
+   if ( isParked() == false )
+   {
+      return false;
+   }
+
+   sessionMutex.lock();
+   /*|*/ if ( parkedBytes + message->size() > connectionManager->getBackpressureSettings().highWaterMark )
+   /*|*/ {
+   /*|*/    parkedOverflow = true;
+   /*|*/ }
+   /*|*/ else if ( parkedOverflow == false )
+   /*|*/ {
+   /*|*/    parkedMessages.push_back( message );
+   /*|*/    parkedBytes += message->size();
+   /*|*/ }
+   sessionMutex.unlock();
+   return true;
+}
+
+// return true if the compression of the big game frames was negotiated
+bool ClientConnection::isCompressionNegotiated() const
+{
+   return compression;
+}
+
+// set the load of the provider (taken from the connection of a resumed session)
+void ClientConnection::setLoad( size_t load )
+{
+   this->load = load;
 }
 
 // increase the load of the provider
@@ -179,3 +682,188 @@ size_t ClientConnection::getLoad() const
 {
    return load;
 }
+
+// add a game the connection provides or plays (called by the game)
+void ClientConnection::addGame( size_t number )
+{
+   games.insert( number );
+}
+
+// remove a game the connection provides or plays (called by the game)
+void ClientConnection::removeGame( size_t number )
+{
+   games.erase( number );
+}
+
+// get the numbers of the games the connection provides or plays
+const std::set< size_t >& ClientConnection::getGames() const
+{
+   return games;
+}
+
+// add a kind the connection is registered for as consumer
+void ClientConnection::addConsumedKind( const std::string& kind )
+{
+   consumedKinds.insert( kind );
+}
+
+// add a kind the connection is registered for as provider
+void ClientConnection::addProvidedKind( const std::string& kind )
+{
+   providedKinds.insert( kind );
+}
+
+// get the kinds the connection is registered for as consumer
+const std::set< std::string >& ClientConnection::getConsumedKinds() const
+{
+   return consumedKinds;
+}
+
+// get the kinds the connection is registered for as provider
+const std::set< std::string >& ClientConnection::getProvidedKinds() const
+{
+   return providedKinds;
+}
+
+// mark the connection as removed by the manager
+void ClientConnection::markRemoved()
+{
+   removed = true;
+}
+
+// return true if the manager removed the connection
+bool ClientConnection::isRemoved() const
+{
+   return removed;
+}
+
+// get the number of messages waiting to be sent
+size_t ClientConnection::getOutboundQueueDepth() const
+{
+   return connection->getQueueDepth();
+}
+
+// get the number of bytes waiting to be sent
+size_t ClientConnection::getOutboundBytesPending() const
+{
+   return connection->getBytesPending();
+}
+
+// get the number of received messages waiting for a worker
+size_t ClientConnection::getInboundBacklog() const
+{
+   boost::mutex::scoped_lock lock( inboundMutex );
+   return inbound.size();
+}
+
+// stop reading once the current read is done and the writes are sent, called until the connection is drained
+// the read is only cancelled once nothing is written as the cancellation aborts the writes too
+void ClientConnection::freeze()
+{
+   frozen.store( true );
+   if (  ( readStopped.load() == false )
+       &&( connection->getBytesPending() == 0 )  )
+   {
+      readCancelled.store( true );
+      connection->cancelRead();
+   }
+}
+
+// read again after a freeze
+void ClientConnection::thaw()
+{
+   frozen.store( false );
+   readCancelled.store( false );
+   if ( readStopped.exchange( false ) == true )
+   {
+      waitForData();
+   }
+}
+
+// return true if the frozen connection has nothing left to read, handle or send
+bool ClientConnection::isDrained() const
+{
+   if ( mailbox->isIdle() == false )
+   {
+      return false;
+   }
+
+   if ( isParked() == true )
+   {
+      return true;
+   }
+
+   boost::mutex::scoped_lock lock( backpressureMutex );
+   return (  ( readStopped.load() == true )
+           &&( connection->getBytesPending() == 0 )
+           &&( congested == false )  );
+}
+
+// return true if the connection can be handed over to another process
+// the shared memory of a connection is bound to this process
+bool ClientConnection::canBeHandedOver() const
+{
+   return (  ( isParked() == true )
+           ||( connection->getTransport() != SimpleTcpConnection::TRANSPORT_SHARED_MEMORY )  );
+}
+
+// close the connection which can not be handed over, its session is kept to be resumed on the new process
+void ClientConnection::dropForRestart()
+{
+   AsyncLogger::getInstance()->log( "ClientConnection (" + technicalId + ") > can not be handed over, disconnected" );
+   connectionManager->closeConnection( shared_from_this(),
+                                       true );
+   close();
+}
+
+// fill the snapshot with the state of the drained connection
+void ClientConnection::takeSnapshot( ConnectionSnapshot& snapshot ) const
+{
+   snapshot.technicalId = technicalId;
+   snapshot.login = login;
+   snapshot.state = currentState;
+   snapshot.binaryProtocol = binaryProtocol;
+   snapshot.compression = compression;
+   snapshot.framingMode = connection->getFramingMode();
+   snapshot.transport = connection->getTransport();
+   snapshot.unreadInput = connection->getUnreadInput();
+   snapshot.parked = isParked();
+
+   boost::mutex::scoped_lock lock( sessionMutex );
+   snapshot.sessionToken = sessionToken;
+   snapshot.parkedMessages.clear();
+   for ( std::deque< SharedMessage >::const_iterator it = parkedMessages.begin();
+         it != parkedMessages.end();
+         it++ )
+   {
+      snapshot.parkedMessages.push_back( **it );
+   }
+   snapshot.parkedOverflow = parkedOverflow;
+}
+
+// set the state of a connection handed over by the previous process
+void ClientConnection::restoreState( const ConnectionSnapshot& snapshot )
+{
+   login = snapshot.login;
+   currentState = snapshot.state;
+   binaryProtocol = snapshot.binaryProtocol;
+   compression = snapshot.compression;
+   sessionToken = snapshot.sessionToken;
+   parked.store( snapshot.parked );
+   for ( std::vector< std::string >::const_iterator it = snapshot.parkedMessages.begin();
+         it != snapshot.parkedMessages.end();
+         it++ )
+   {
+      parkedMessages.push_back( BufferPool::getInstance().copy( *it ) );
+      parkedBytes += it->size();
+   }
+   parkedOverflow = snapshot.parkedOverflow;
+}
+
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+// get the descriptor of the socket
+int ClientConnection::getNativeHandle() const
+{
+   return connection->getNativeHandle();
+}
+#endif
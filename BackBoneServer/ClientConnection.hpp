@@ -2,13 +2,205 @@
 
 #include <boost/asio/ip/tcp.hpp>
 #include <boost/enable_shared_from_this.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/atomic.hpp>
 #include <set>
 #include <map>
+#include <list>
+#include <deque>
 
 #include "network/SimpleTcpConnection.hpp"
+#include "network/BinaryProtocol.hpp"
+#include "network/FrameCompressor.hpp"
+#include "thread/SerialMailbox.hpp"
+#include "container/RingQueue.hpp"
+#include "ServerSnapshot.hpp"
 
 class ConnectionManager;
 
+// what to do with the game traffic of a connection whose outbound queue is over the high water mark
+// the policy applies until the queue goes back under the low water mark
+enum OverflowPolicy
+{
+   OVERFLOW_COALESCE = 0,  // keep only the last game message of each key (the game messages are state updates)
+   OVERFLOW_DROP,          // drop the game messages
+   OVERFLOW_DISCONNECT     // close the connection
+};
+
+// the limits of the outbound queue of a connection
+struct BackpressureSettings
+{
+   // the number of pending bytes over which the connection is congested
+   size_t highWaterMark;
+
+   // the number of pending bytes under which the connection is no more congested
+   size_t lowWaterMark;
+
+   // the policy applied to the game traffic of a congested connection
+   OverflowPolicy policy;
+};
+
+// what the heartbeat did with a connection
+enum HeartbeatResult
+{
+   // a message was received recently
+   HEARTBEAT_ALIVE = 0,
+   // idle, a ping is sent
+   HEARTBEAT_PINGED,
+   // no answer to the ping, the connection is closed
+   HEARTBEAT_REAPED
+};
+
+// how often the overflow policies fired
+struct BackpressureStatistics
+{
+   // the number of times the high water mark was crossed
+   size_t congestions;
+
+   // the number of game messages replaced by a newer one
+   size_t coalescedMessages;
+
+   // the number of game messages dropped
+   size_t droppedMessages;
+
+   // the number of connections closed
+   size_t disconnections;
+
+   // all the counters at 0
+   BackpressureStatistics()
+   :
+      congestions( 0 ),
+      coalescedMessages( 0 ),
+      droppedMessages( 0 ),
+      disconnections( 0 )
+   {
+   }
+
+   // add the counters of another connection
+   void add( const BackpressureStatistics& other )
+   {
+      congestions += other.congestions;
+      coalescedMessages += other.coalescedMessages;
+      droppedMessages += other.droppedMessages;
+      disconnections += other.disconnections;
+   }
+};
+
+// a message sent to many connections in the text, binary and compressed forms
+// each form is built once on first use and shared by all the write queues
+class BroadcastMessage
+{
+   // the text form
+   mutable SharedMessage text;
+
+   // the binary form
+   mutable SharedMessage binary;
+
+   // the binary form with its payload compressed (the binary form itself when not worth it)
+   mutable SharedMessage compressed;
+
+   // the kind of the game of the binary form, used to give back the text id of the game
+   std::string gameKind;
+
+public:
+   // create the message from its text form
+   explicit BroadcastMessage( const std::string& text )
+   :
+      text( BufferPool::getInstance().copy( text ) ),
+      binary(),
+      compressed(),
+      gameKind()
+   {
+   }
+
+   // create the message from its text form already in a buffer (relayed without copy)
+   explicit BroadcastMessage( SharedMessage text )
+   :
+      text( text ),
+      binary(),
+      compressed(),
+      gameKind()
+   {
+   }
+
+   // create the message from its binary or compressed form (relayed without copy) sent in a game of the kind
+   BroadcastMessage( SharedMessage frame,
+                     const std::string& gameKind )
+   :
+      text(),
+      binary( ( FrameCompressor::isCompressed( *frame ) == false ) ? frame : SharedMessage() ),
+      compressed( ( FrameCompressor::isCompressed( *frame ) == true ) ? frame : SharedMessage() ),
+      gameKind( gameKind )
+   {
+   }
+
+   // get the text form
+   const SharedMessage& getText() const
+   {
+      if ( text == NULL )
+      {
+         const SharedMessage& frame = getBinary();
+         SharedBuffer decoded = BufferPool::getInstance().acquire( 2 * frame->size() + 32 );
+         BinaryTranscoder::decode( *frame,
+                                   GameIdOfKind( gameKind ),
+                                   *decoded );
+         text = decoded;
+      }
+      return text;
+   }
+
+   // get the binary form
+   const SharedMessage& getBinary() const
+   {
+      if (  ( binary == NULL )
+          &&( compressed != NULL )  )
+      {
+         // a corrupted compressed frame is given as an empty message
+         binary = FrameCompressor::getInstance().decompress( compressed );
+         if ( binary == NULL )
+         {
+            binary = BufferPool::getInstance().acquire( 0 );
+         }
+      }
+      else if ( binary == NULL )
+      {
+         SharedBuffer encoded = BufferPool::getInstance().acquire( text->size() );
+         BinaryTranscoder::encode( *text,
+                                   *encoded );
+         binary = encoded;
+      }
+      return binary;
+   }
+
+   // get the key used to coalesce the message (see BinaryTranscoder::getGameMessageKey)
+   // the key is read from the form already built, the message is never decoded nor inflated for it
+   // a message only known in its compressed form has no key (its verb is deflated)
+   bool getCoalesceKey( std::string& key ) const
+   {
+      if ( binary != NULL )
+      {
+         return BinaryTranscoder::getGameMessageKey( *binary,
+                                                     key );
+      }
+      else if ( text != NULL )
+      {
+         return BinaryTranscoder::getGameMessageKeyOfText( *text,
+                                                           key );
+      }
+      return false;
+   }
+
+   // get the compressed form
+   const SharedMessage& getCompressed() const
+   {
+      if ( compressed == NULL )
+      {
+         compressed = FrameCompressor::getInstance().compress( getBinary() );
+      }
+      return compressed;
+   }
+};
+
 // this class is use to represent a client connection
 class ClientConnection : public boost::enable_shared_from_this< ClientConnection >
 {
@@ -16,12 +208,28 @@ private:
    // the Connection manager
    ConnectionManager* connectionManager;
 
-   // the buffer used to receive message
-   std::string message;
+   // the buffer used to receive the messages of a read
+   std::vector< SharedMessage > messages;
 
    // the connection use to read / write on the network
 	connection_ptr connection;
 
+   // the mailbox running the received messages in order on the worker pool
+   SerialMailboxPtr mailbox;
+
+   // the received messages waiting for the mailbox, a single handleInbound task is queued for all of them
+   // so a message costs no closure, only its place in the ring
+   RingQueue< SharedMessage > inbound;
+
+   // true while a handleInbound task is queued or runs in the mailbox
+   bool inboundScheduled;
+
+   // the mutex of the received messages
+   mutable boost::mutex inboundMutex;
+
+   // the number of received messages handled by a task before giving back the worker
+   static const size_t INBOUND_MESSAGES_PER_TASK = 32;
+
    // the name of the connection (internal id)
    std::string technicalId;
 
@@ -31,9 +239,83 @@ private:
    // the current status of the connection
    int currentState;
 
-   // the load of the client (if it's a provider)
+   // the load of the client (if it's a provider), the number of games it provides
+   // changed only inside the manager mutex, with the heaps of the manager
    size_t load;
 
+   // the numbers of the games the connection provides or plays (used inside the manager mutex)
+   std::set< size_t > games;
+
+   // the kinds the connection is registered for as consumer and as provider (used inside the manager mutex)
+   std::set< std::string > consumedKinds;
+   std::set< std::string > providedKinds;
+
+   // true once the manager removed the connection, the game tasks still queued for it ignore it (used inside the manager mutex)
+   bool removed;
+
+   // true if the binary protocol was negotiated in the init message
+   // the messages are binary once the login is accepted
+   bool binaryProtocol;
+
+   // true if the compression of the big game frames was negotiated with the binary protocol
+   bool compression;
+
+   // the game messages held while the connection is congested (coalesce policy)
+   // in arrival order with the key used to replace them (empty for a message held without key)
+   typedef std::list< std::pair< std::string, SharedMessage > > CoalescedList;
+   CoalescedList coalescedMessages;
+
+   // the held game messages indexed by their key
+   std::map< std::string, CoalescedList::iterator > coalescedByKey;
+
+   // the size of the held game messages
+   size_t coalescedBytes;
+
+   // true while the outbound queue is over the high water mark (until it goes under the low water mark)
+   bool congested;
+
+   // true once the connection is closed by the disconnect policy
+   bool disconnecting;
+
+   // how often the overflow policies fired for this connection
+   BackpressureStatistics backpressureStatistics;
+
+   // the mutex of the backpressure state
+   mutable boost::mutex backpressureMutex;
+
+   // the heartbeat tick of the last message received, set by the reactor threads
+   boost::atomic< boost::uint64_t > lastActivity;
+
+   // the heartbeat tick of the ping waiting for an answer (0 if none), only used by the heartbeat
+   boost::uint64_t pingTick;
+
+   // the token of the session of the connection (empty if none)
+   std::string sessionToken;
+
+   // true once the link is lost and the connection kept for its session
+   boost::atomic< bool > parked;
+
+   // the messages sent while the connection is parked, replayed on the connection resuming the session
+   std::deque< SharedMessage > parkedMessages;
+
+   // the size of the parked messages, bounded by the high water mark
+   size_t parkedBytes;
+
+   // true if messages were lost while parked, the session can not be resumed
+   bool parkedOverflow;
+
+   // the mutex of the session state
+   mutable boost::mutex sessionMutex;
+
+   // true while the connection is handed over to another process, the reads stop after the current one
+   boost::atomic< bool > frozen;
+
+   // true once the reads are stopped (no read pending on the socket)
+   boost::atomic< bool > readStopped;
+
+   // true while the pending read is cancelled by a freeze
+   boost::atomic< bool > readCancelled;
+
    enum State
    {
       INIT = 0,
@@ -60,18 +342,79 @@ public:
 		return session;
 	}
 
+   // creator of a connection handed over by the previous process
+   // the socket is already adopted by the tcp connection, a parked connection has none
+	static InternalClientConnectionPtr restore( const ConnectionSnapshot& snapshot,
+                                               ConnectionManager* connectionManager,
+                                               connection_ptr tcp_connection )
+	{
+		InternalClientConnectionPtr session( new ClientConnection( snapshot.technicalId,
+                                                                 connectionManager,
+                                                                 tcp_connection ) );
+      session->restoreState( snapshot );
+      if ( snapshot.parked == false )
+      {
+		   session->waitForData();
+      }
+		return session;
+	}
+
    // send a message on the network
 	void sendMessage(const std::string& message);
 
+   // send a shared message on the network without copying it
+   // used to broadcast the same message to many connections
+	void sendMessage( SharedMessage message );
+
+   // send the form of the message matching the protocol of the connection
+	void sendMessage( const BroadcastMessage& message );
+
+   // return true if the messages of the connection are binary
+   bool isBinaryProtocol() const;
+
+   // send a game message relayed to a consumer
+   // the message is subject to the overflow policy when the outbound queue is over the high water mark
+   void sendGameMessage( const BroadcastMessage& message );
+
+   // get how often the overflow policies fired for this connection
+   BackpressureStatistics getBackpressureStatistics() const;
+
    // return the client name
    const std::string& getTechnicalId() const;
 
+   // apply the socket options of the role of the client
+   void applySocketProfile( const SocketProfile& profile );
+
    // return the client name
    const std::string& getLogin() const;
 
    // close the connection
    void close();
 
+   // get the token of the session of the connection (empty if none)
+   std::string getSessionToken() const;
+
+   // set the token of the session of the connection
+   void setSessionToken( const std::string& token );
+
+   // close the socket of the connection whose link is lost and hold the messages sent to it
+   void park();
+
+   // return true if the link is lost and the connection kept for its session
+   bool isParked() const;
+
+   // return true if messages were lost while parked
+   bool hasParkedOverflow() const;
+
+   // move the messages held while parked to messages
+   void takeParkedMessages( std::vector< SharedMessage >& messages );
+
+   // return true if the compression of the big game frames was negotiated
+   bool isCompressionNegotiated() const;
+
+   // set the load of the provider (taken from the connection of a resumed session)
+   void setLoad( size_t load );
+
    // increase the load of the provider
    void incLoad();
 
@@ -81,6 +424,64 @@ public:
    // get the load of the provider
    size_t getLoad() const;
 
+   // add or remove a game the connection provides or plays (called by the game)
+   void addGame( size_t number );
+   void removeGame( size_t number );
+
+   // get the numbers of the games the connection provides or plays
+   const std::set< size_t >& getGames() const;
+
+   // add a kind the connection is registered for as consumer or as provider
+   void addConsumedKind( const std::string& kind );
+   void addProvidedKind( const std::string& kind );
+
+   // get the kinds the connection is registered for as consumer or as provider
+   const std::set< std::string >& getConsumedKinds() const;
+   const std::set< std::string >& getProvidedKinds() const;
+
+   // mark the connection as removed by the manager or return true if it is (used inside the manager mutex)
+   void markRemoved();
+   bool isRemoved() const;
+
+   // get the number of messages waiting to be sent
+   size_t getOutboundQueueDepth() const;
+
+   // get the number of bytes waiting to be sent
+   size_t getOutboundBytesPending() const;
+
+   // get the number of received messages waiting for a worker
+   size_t getInboundBacklog() const;
+
+   // stop reading once the current read is done and the writes are sent, called until the connection is drained
+   void freeze();
+
+   // read again after a freeze
+   void thaw();
+
+   // return true if the frozen connection has nothing left to read, handle or send
+   bool isDrained() const;
+
+   // return true if the connection can be handed over to another process (not in shared memory)
+   bool canBeHandedOver() const;
+
+   // close the connection which can not be handed over, its session is kept to be resumed on the new process
+   void dropForRestart();
+
+   // fill the snapshot with the state of the drained connection
+   void takeSnapshot( ConnectionSnapshot& snapshot ) const;
+
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+   // get the descriptor of the socket
+   int getNativeHandle() const;
+#endif
+
+   // check the connection is alive at the heartbeat tick now
+   // ping it once it is idle for idleTimeout ticks and close it if it stays silent idleTimeout ticks more
+   // next is set to the tick of the next check unless the connection is closed
+   HeartbeatResult checkHeartbeat( boost::uint64_t now,
+                                   boost::uint64_t idleTimeout,
+                                   boost::uint64_t& next );
+
 private:
    // the real ctor in the private zone as we use the shared ptr mechanism
 	ClientConnection( const std::string& name,
@@ -90,17 +491,55 @@ private:
    // listen on the socket using the tcp connection
 	void waitForData(); 
 
+   // note the reads are stopped and listen again if the connection was thawed meanwhile
+   void stopReading();
+
+   // set the state of a connection handed over by the previous process
+   void restoreState( const ConnectionSnapshot& snapshot );
+
    // callback of write result
 	void handleWrite( const boost::system::error_code& error );
 
+   // the callback given with each write, a function and the shared pointer fit in the buffer of a WriteHandler
+   // so queuing a message allocates nothing (a bound member function does not fit)
+   static void handleWriteOf( InternalClientConnectionPtr connection,
+                              const boost::system::error_code& error );
+
    // callback of read result
 	void handleRead( const boost::system::error_code& error );
 
-   // callback of handle result in a separate thread
-	void handleReadInThread( const std::string& messageToTreat );
+   // callback of handle result in the mailbox of the connection (worker pool)
+	void handleReadInThread( SharedMessage message );
+
+   // handle the received messages in order in the mailbox, a bounded number per task to share the workers
+   // the task given to the mailbox fits in the buffer of a Task as handleWriteOf
+   static void handleInbound( InternalClientConnectionPtr connection );
 
    // ask the login of the client
    void askForLogin();
+
+   // send a ping to the idle connection, run in the mailbox
+   void ping();
+
+   // close the connection which missed the heartbeat deadline, run in the mailbox
+   void reap();
+
+   // hold the message if the connection is parked, return false if it can be sent
+   bool holdIfParked( SharedMessage message );
+
+   // get the form of the message matching the protocol of the connection
+   const SharedMessage& getForm( const BroadcastMessage& message ) const;
+
+   // hold the game message until the connection is no more congested, replacing the previous one of the same key
+   // a message without key is held without replacing any other
+   // should be call inside the backpressure mutex
+   void coalesce( const BroadcastMessage& message );
+
+   // send the held game messages if the outbound queue is under the low water mark
+   void releaseCongestion();
+
+   // close the connection of a consumer too slow to read its messages, run in the mailbox
+   void disconnect();
 };
 
 // the related typedef to ease the manipulation
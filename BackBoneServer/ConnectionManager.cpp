@@ -1,77 +1,1157 @@
 #define _WIN32_WINNT 0x0501
 
 #include <stdio.h>
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#endif
 #include <boost/bind.hpp>
 #include <boost/thread.hpp>
+#include <boost/atomic.hpp>
+#include <boost/uuid/uuid_io.hpp>
 
 #include "string/StringUtils.hpp"
 #include "network/NetworkMessage.hpp"
+#include "network/ReactorBackend.hpp"
+#include "network/SocketHandoff.hpp"
 #include "logger/asyncLogger.hpp"
 
 #include "ConnectionManager.hpp"
 #include "Game.hpp"
 #include "ClientConnection.hpp"
 
+// the number of the next client name, handed over on a hot restart
+// the acceptors complete on many reactor threads, the counter is atomic to keep the names unique
+static boost::atomic< int > clientNumber( 0 );
 std::string createNewClientName()
 {
-   static int id = 0;
    char result[20];
    sprintf_s( result,
               20,
               "client_%d",
-              id++ );
+              clientNumber.fetch_add( 1 ) );
    return result;
 }
 
+// the bytes exchanged on the restart socket
+//     the new process asks to take over, then acknowledges once the sockets are taken
+static const char RESTART_REQUEST = 'R';
+static const char RESTART_ACKNOWLEDGE = 'A';
+
+#ifdef SO_REUSEPORT
+// the option sharing a port between many sockets of the process
+typedef boost::asio::detail::socket_option::boolean< SOL_SOCKET, SO_REUSEPORT > ReusePort;
+#endif
+
 ConnectionManager::ConnectionManager( boost::asio::io_service&              boostReactor, 
-                                      const boost::asio::ip::tcp::endpoint& endpoint )
+                                      const boost::asio::ip::tcp::endpoint& endpoint,
+                                      size_t                                numberOfAcceptors,
+                                      size_t                                numberOfWorkers,
+                                      const BackpressureSettings&           backpressureSettings,
+                                      const HeartbeatSettings&              heartbeatSettings,
+                                      const std::string&                    localPath,
+                                      const std::string&                    restartPath,
+                                      const SocketProfile&                  consumerProfile,
+                                      const SocketProfile&                  providerProfile )
 :
    boostReactor( boostReactor ),
-   connectionAcceptor( boostReactor, 
-                       endpoint ),
+   connectionAcceptors(),
+   acceptBackoffs(),
+   restartPath( restartPath ),
+   handingOff( false ),
+   handoffForced( false ),
+   handoffDeadline(),
+   handoffTimer( boostReactor ),
+   restartTimer( boostReactor ),
+   workerPool( numberOfWorkers ),
    connections(),
    consumerByGame(),
    providerByGame(),
+   providersByLoad(),
    gameDefinitions(),
-   games()
+   games(),
+   gameShards(),
+   openGames(),
+   backpressureSettings( backpressureSettings ),
+   closedBackpressureStatistics(),
+   consumerProfile( consumerProfile ),
+   providerProfile( providerProfile ),
+   heartbeatSettings( heartbeatSettings ),
+   heartbeatTimer( boostReactor ),
+   heartbeatStart( boost::chrono::steady_clock::now() ),
+   heartbeatTick( 0 ),
+   heartbeatWheel(),
+   pings( 0 ),
+   reapedConnections( 0 ),
+   sessions(),
+   parkedSessions(),
+   sessionGenerator(),
+   acceptedByAcceptor(),
+   acceptedConnections( 0 ),
+   firstAccept(),
+   currentSecond(),
+   acceptedInCurrentSecond( 0 ),
+   peakAcceptRate( 0 )
+{
+   AsyncLogger::getInstance()->log( std::string( "ConnectionManager> Reactor backend> " ) + getReactorBackendName() );
+
+   // each shard of the games runs its tasks on the worker pool
+   for ( size_t i = 0;
+         i < GAME_SHARDS;
+         ++i )
+   {
+      gameShards[ i ].manager = this;
+      gameShards[ i ].scheduled = false;
+   }
+
+#ifndef SO_REUSEPORT
+   // the port can not be shared
+   numberOfAcceptors = 1;
+#endif
+   if ( numberOfAcceptors == 0 )
+   {
+      numberOfAcceptors = 1;
+   }
+
+   // take the listening sockets, the connections and the games of the previous process if any
+   if (  ( restartPath.empty() == false )
+       &&( takeOver( endpoint,
+                     localPath ) == true )  )
+   {
+      AsyncLogger::getInstance()->log( "ConnectionManager> Took over the previous process" );
+      dumpCurrentState();
+   }
+
+   // bind the acceptors on the same endpoint, the kernel gives each incoming connection to one of them
+   // (the ones of the previous process are already there)
+   while ( connectionAcceptors.size() < numberOfAcceptors )
+   {
+      boost::shared_ptr< boost::asio::ip::tcp::acceptor > acceptor( new boost::asio::ip::tcp::acceptor( boostReactor ) );
+      acceptor->open( endpoint.protocol() );
+      acceptor->set_option( boost::asio::ip::tcp::acceptor::reuse_address( true ) );
+#ifdef SO_REUSEPORT
+      acceptor->set_option( ReusePort( true ) );
+#endif
+      // the connections inherit the buffers of the listening socket from their SYN, before their role is known,
+      // so it gets the buffers of the providers which need the largest window (a consumer keeps them as its limit)
+      SocketTuning::applyBuffers( *acceptor,
+                                  providerProfile );
+      acceptor->bind( endpoint );
+      acceptor->listen();
+      connectionAcceptors.push_back( acceptor );
+   }
+   acceptedByAcceptor.resize( connectionAcceptors.size(), 0 );
+   acceptBackoffs.resize( connectionAcceptors.size() + 1 );
+   for ( size_t i = 0;
+         i < acceptBackoffs.size();
+         ++i )
+   {
+      acceptBackoffs[ i ].timer.reset( new boost::asio::deadline_timer( boostReactor ) );
+      acceptBackoffs[ i ].delay = 0;
+   }
+
+   std::stringstream stream;
+   stream << "ConnectionManager> Listening on " << endpoint << " with " << connectionAcceptors.size() << " acceptors";
+   AsyncLogger::getInstance()->log( stream.str() );
+
+   // the dead connections and the expired sessions are looked for every second
+   if (  ( heartbeatSettings.idleTimeout > 0 )
+       ||( heartbeatSettings.sessionGrace > 0 )  )
+   {
+      waitForHeartbeat();
+   }
+
+   // waiting for the connection
+   for ( size_t i = 0;
+         i < connectionAcceptors.size();
+         ++i )
+   {
+	   waitForConnection( i );
+   }
+
+   // and for the local ones
+   if ( localPath.empty() == false )
+   {
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+      if ( localAcceptor == NULL )
+      {
+         // remove the socket left by a previous run
+         ::unlink( localPath.c_str() );
+         localAcceptor.reset( new boost::asio::local::stream_protocol::acceptor( boostReactor,
+                                                                                boost::asio::local::stream_protocol::endpoint( localPath ) ) );
+      }
+      AsyncLogger::getInstance()->log( "ConnectionManager> Listening on " + localPath );
+      waitForLocalConnection();
+#else
+      std::cerr << "ConnectionManager> " << "unix domain sockets are not supported, " << localPath << " ignored" << std::endl;
+#endif
+   }
+
+   // and for the next process
+   if ( restartPath.empty() == false )
+   {
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+      ::unlink( restartPath.c_str() );
+      restartAcceptor.reset( new boost::asio::local::stream_protocol::acceptor( boostReactor,
+                                                                               boost::asio::local::stream_protocol::endpoint( restartPath ) ) );
+      // only this user may connect, the peer is checked again on accept
+      ::chmod( restartPath.c_str(),
+               S_IRUSR | S_IWUSR );
+      AsyncLogger::getInstance()->log( "ConnectionManager> Waiting for a restart on " + restartPath );
+      waitForRestart();
+#else
+      std::cerr << "ConnectionManager> " << "unix domain sockets are not supported, hot restart on " << restartPath << " ignored" << std::endl;
+#endif
+   }
+}
+
+// get the pool of workers handling the received messages
+WorkerPool& ConnectionManager::getWorkerPool()
+{
+   return workerPool;
+}
+
+// get the limits of the outbound queue of each connection
+const BackpressureSettings& ConnectionManager::getBackpressureSettings() const
+{
+   return backpressureSettings;
+}
+
+void ConnectionManager::waitForConnection( size_t acceptorIndex )
+{
+	// the framing is detected on the first received byte to keep the legacy clients working
+	connection_ptr new_connection(new SimpleTcpConnection( boostReactor,
+                                                          SimpleTcpConnection::FRAMING_AUTO ) );
+
+	// Attente d'une nouvelle connection
+	connectionAcceptors[ acceptorIndex ]->async_accept( new_connection->getSocket(),
+		                                                 boost::bind( &ConnectionManager::handle_accept, 
+                                                                    this,
+		                                                              boost::asio::placeholders::error,
+                                                                    new_connection,
+                                                                    acceptorIndex ) );
+}
+
+void ConnectionManager::waitForLocalConnection()
+{
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+	// the framing is detected on the first received byte as for the tcp connections
+   // the peer may also ask to move the connection in shared memory with its first bytes
+	connection_ptr new_connection( new SimpleTcpConnection( boostReactor,
+                                                           SimpleTcpConnection::FRAMING_AUTO,
+                                                           SimpleTcpConnection::TRANSPORT_LOCAL ) );
+
+	localAcceptor->async_accept( new_connection->getLocalSocket(),
+		                          boost::bind( &ConnectionManager::handle_accept, 
+                                             this,
+		                                       boost::asio::placeholders::error,
+                                             new_connection,
+                                             0 ) );
+#endif
+}
+
+void ConnectionManager::handle_accept( const boost::system::error_code& error, 
+                                       connection_ptr new_connection,
+                                       size_t acceptorIndex )
+{
+   // the acceptor is closed with the server
+   if ( error == boost::asio::error::operation_aborted )
+   {
+      return;
+   }
+
+   // the local acceptor is after the tcp ones
+   size_t backoffIndex = acceptorIndex;
+   if ( new_connection->getTransport() == SimpleTcpConnection::TRANSPORT_LOCAL )
+   {
+      backoffIndex = connectionAcceptors.size();
+   }
+
+   // an acceptor stays armed after an error (out of file descriptors ...) so it does not die in a storm
+   // but it pauses first, an immediate retry fails the same way in a loop taking a reactor thread
+   AcceptBackoff& backoff = acceptBackoffs[ backoffIndex ];
+   if ( error != 0 )
+   {
+      if ( backoff.delay == 0 )
+      {
+         std::cerr << "ConnectionManager> " << "Connection refused: " << error.message() << ", accepts paused" << std::endl;
+         backoff.delay = ACCEPT_BACKOFF_MIN;
+      }
+      else
+      {
+         backoff.delay = std::min( backoff.delay * 2, static_cast< long >( ACCEPT_BACKOFF_MAX ) );
+      }
+
+      std::stringstream stream;
+      stream << "ConnectionManager> Connection refused: " << error.message() << ", next accept in " << backoff.delay << " ms";
+      AsyncLogger::getInstance()->log( stream.str() );
+      backoff.timer->expires_from_now( boost::posix_time::milliseconds( backoff.delay ) );
+      backoff.timer->async_wait( boost::bind( &ConnectionManager::handleAcceptBackoff,
+                                              this,
+                                              boost::asio::placeholders::error,
+                                              backoffIndex ) );
+      return;
+   }
+
+   // back to client acceptance on the same socket first, the other connections of a storm wait for it
+   backoff.delay = 0;
+   acceptNext( backoffIndex );
+
+	if ( error == 0)
+	{
+      countAccept( new_connection,
+                   acceptorIndex );
+
+      // create the unique id
+      std::string newClientName = createNewClientName();
+		AsyncLogger::getInstance()->log( "ConnectionManager> Connection accepted> " + newClientName );
+
+      // most of the connections are consumers, the providers are tuned again when they register
+      new_connection->applySocketProfile( consumerProfile );
+
+      // create the client
+		ClientConnectionPtr client = ClientConnection::create( newClientName, 
+                                                             this,
+                                                             new_connection );
+
+      watchConnection( client );
+	}
+}
+
+// arm the acceptor of the backoff index again (the tcp acceptor of the index or the local acceptor after them)
+// the acceptors stay idle while the connections are handed over, the new process accepts the next ones
+void ConnectionManager::acceptNext( size_t backoffIndex )
+{
+   if ( handingOff.load() == true )
+   {
+      return;
+   }
+
+   if ( backoffIndex == connectionAcceptors.size() )
+   {
+      waitForLocalConnection();
+   }
+   else
+   {
+      waitForConnection( backoffIndex );
+   }
+}
+
+// arm the acceptor again once its pause after a failed accept is over
+void ConnectionManager::handleAcceptBackoff( const boost::system::error_code& error,
+                                             size_t                           backoffIndex )
+{
+   if ( error == boost::asio::error::operation_aborted )
+   {
+      return;
+   }
+
+   acceptNext( backoffIndex );
+}
+
+// count an accepted connection in the statistics
+void ConnectionManager::countAccept( connection_ptr connection,
+                                     size_t acceptorIndex )
+{
+   boost::chrono::steady_clock::time_point now = boost::chrono::steady_clock::now();
+
+   acceptMutex.lock();
+   /*|*/ if ( acceptedConnections == 0 )
+   /*|*/ {
+   /*|*/    firstAccept = now;
+   /*|*/    currentSecond = now;
+   /*|*/ }
+   /*|*/ acceptedConnections++;
+   /*|*/ if ( connection->getTransport() == SimpleTcpConnection::TRANSPORT_TCP )
+   /*|*/ {
+   /*|*/    acceptedByAcceptor[ acceptorIndex ]++;
+   /*|*/ }
+   /*|*/
+   /*|*/ // the accepts are counted by one second windows to get the peak rate
+   /*|*/ if ( now - currentSecond >= boost::chrono::seconds( 1 ) )
+   /*|*/ {
+   /*|*/    currentSecond = now;
+   /*|*/    acceptedInCurrentSecond = 0;
+   /*|*/ }
+   /*|*/ acceptedInCurrentSecond++;
+   /*|*/ peakAcceptRate = std::max( peakAcceptRate, acceptedInCurrentSecond );
+   acceptMutex.unlock();
+}
+
+// get how fast the connections are accepted
+AcceptStatistics ConnectionManager::getAcceptStatistics() const
+{
+   boost::mutex::scoped_lock lock( acceptMutex );
+
+   AcceptStatistics statistics;
+   statistics.acceptedConnections = acceptedConnections;
+   statistics.acceptedByAcceptor = acceptedByAcceptor;
+   statistics.peakAcceptRate = peakAcceptRate;
+   statistics.meanAcceptRate = 0.0;
+   if ( acceptedConnections > 0 )
+   {
+      boost::chrono::duration< double > elapsed = boost::chrono::steady_clock::now() - firstAccept;
+      statistics.meanAcceptRate = ( elapsed.count() > 1.0 ) ? acceptedConnections / elapsed.count() : acceptedConnections;
+   }
+   return statistics;
+}
+
+// get the current tick of the heartbeat
+boost::uint64_t ConnectionManager::getHeartbeatTick() const
+{
+   return heartbeatTick.load( boost::memory_order_relaxed );
+}
+
+// get what the heartbeat did
+HeartbeatStatistics ConnectionManager::getHeartbeatStatistics() const
+{
+   boost::mutex::scoped_lock lock( heartbeatMutex );
+
+   HeartbeatStatistics statistics;
+   statistics.watchedConnections = heartbeatWheel.size();
+   statistics.pings = pings;
+   statistics.reapedConnections = reapedConnections;
+   return statistics;
+}
+
+// follow the activity of a new connection
+void ConnectionManager::watchConnection( ClientConnectionPtr connection )
+{
+   if ( heartbeatSettings.idleTimeout == 0 )
+   {
+      return;
+   }
+
+   heartbeatMutex.lock();
+   /*|*/ heartbeatWheel.schedule( connection,
+   /*|*/                          getHeartbeatTick() + heartbeatSettings.idleTimeout );
+   heartbeatMutex.unlock();
+}
+
+// wait for the next tick of the heartbeat
+void ConnectionManager::waitForHeartbeat()
+{
+   heartbeatTimer.expires_from_now( boost::posix_time::seconds( 1 ) );
+   heartbeatTimer.async_wait( boost::bind( &ConnectionManager::handleHeartbeat,
+                                           this,
+                                           boost::asio::placeholders::error ) );
+}
+
+// move the heartbeat to the current tick, ping the idle connections and close the silent ones
+// a message costs a store of the tick in its connection, a connection only costs something
+// when its check comes, so a tick costs the number of connections to check whatever the total
+void ConnectionManager::handleHeartbeat( const boost::system::error_code& error )
+{
+   // the heartbeat stops while the connections are handed over, it is armed again if the handoff fails
+   if (  ( error == boost::asio::error::operation_aborted )
+       ||( handingOff.load() == true )  )
+   {
+      return;
+   }
+
+   // the tick is computed from the clock so a late timer does not slow the heartbeat down
+   boost::chrono::seconds elapsed = boost::chrono::duration_cast< boost::chrono::seconds >( boost::chrono::steady_clock::now() - heartbeatStart );
+   boost::uint64_t now = elapsed.count();
+   heartbeatTick.store( now );
+
+   std::vector< boost::weak_ptr< ClientConnection > > expired;
+   heartbeatMutex.lock();
+   /*|*/ heartbeatWheel.advance( now,
+   /*|*/                         expired );
+   heartbeatMutex.unlock();
+
+   // check the connections outside the lock, the accepts keep going
+   std::vector< std::pair< ClientConnectionPtr, boost::uint64_t > > alive;
+   size_t newPings = 0;
+   size_t newReaped = 0;
+   for ( std::vector< boost::weak_ptr< ClientConnection > >::const_iterator it = expired.begin();
+         it != expired.end();
+         it++ )
+   {
+      // the closed connections and the parked ones leave the wheel
+      ClientConnectionPtr connection = it->lock();
+      if (  ( connection == NULL )
+          ||( connection->isParked() == true )  )
+      {
+         continue;
+      }
+
+      boost::uint64_t next = 0;
+      HeartbeatResult result = connection->checkHeartbeat( now,
+                                                           heartbeatSettings.idleTimeout,
+                                                           next );
+      if ( result == HEARTBEAT_REAPED )
+      {
+         newReaped++;
+         continue;
+      }
+
+      if ( result == HEARTBEAT_PINGED )
+      {
+         newPings++;
+      }
+      alive.push_back( std::make_pair( connection,
+                                       next ) );
+   }
+
+   heartbeatMutex.lock();
+   /*|*/ for ( size_t i = 0;
+   /*|*/       i < alive.size();
+   /*|*/       ++i )
+   /*|*/ {
+   /*|*/    heartbeatWheel.schedule( alive[ i ].first,
+   /*|*/                             alive[ i ].second );
+   /*|*/ }
+   /*|*/ pings += newPings;
+   /*|*/ reapedConnections += newReaped;
+   heartbeatMutex.unlock();
+
+   // the parked sessions not resumed in time
+   expireSessions( now );
+
+   waitForHeartbeat();
+}
+
+// take the sockets and the state over from the process listening on the restart path
+// the new process asks, the previous one drains its connections, sends its listening sockets,
+// the sockets of its connections and the snapshot of its state, then stops once acknowledged
+// return false if no process listens, throw if the handoff breaks
+bool ConnectionManager::takeOver( const boost::asio::ip::tcp::endpoint& endpoint,
+                                  const std::string& localPath )
+{
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+   boost::asio::local::stream_protocol::socket link( boostReactor );
+   boost::system::error_code error;
+   link.connect( boost::asio::local::stream_protocol::endpoint( restartPath ),
+                 error );
+   if ( error )
+   {
+      AsyncLogger::getInstance()->log( "ConnectionManager> No process to take over on " + restartPath );
+      return false;
+   }
+
+   // only a process of this user hands its sockets over
+   if ( SocketHandoff::isSameUser( link.native_handle() ) == false )
+   {
+      throw std::exception( std::string( "The process listening on " + restartPath + " runs as another user" ).c_str() );
+   }
+
+   // ask for the sockets and wait for them, the previous process drains its connections meanwhile
+   // the wait is bounded by the longest drain of the previous process
+   AsyncLogger::getInstance()->log( "ConnectionManager> Taking over the process listening on " + restartPath );
+   SocketHandoff::setTimeout( link.native_handle(),
+                              HANDOFF_TAKEOVER_TIMEOUT );
+   std::vector< int > descriptors;
+   std::string data;
+   ServerSnapshot snapshot;
+   boost::asio::write( link,
+                       boost::asio::buffer( &RESTART_REQUEST, 1 ),
+                       error );
+   if (  ( error )
+       ||( SocketHandoff::receive( link.native_handle(),
+                                   descriptors,
+                                   data ) == false )
+       ||( snapshot.read( data ) == false )
+       ||( descriptors.size() < snapshot.tcpListeners + ( ( snapshot.localListener == true ) ? 1 : 0 ) )  )
+   {
+      SocketHandoff::closeAll( descriptors );
+      throw std::exception( std::string( "The handoff of the process listening on " + restartPath + " failed" ).c_str() );
+   }
+
+   // the listening sockets, the connections waiting in their backlog are accepted by this process
+   // the taken descriptors are set to -1
+   size_t next = 0;
+   for ( ;
+         next < snapshot.tcpListeners;
+         ++next )
+   {
+      boost::shared_ptr< boost::asio::ip::tcp::acceptor > acceptor( new boost::asio::ip::tcp::acceptor( boostReactor ) );
+      acceptor->assign( endpoint.protocol(),
+                        descriptors[ next ] );
+      connectionAcceptors.push_back( acceptor );
+      descriptors[ next ] = -1;
+   }
+   if (  ( snapshot.localListener == true )
+       &&( localPath.empty() == false )  )
+   {
+      localAcceptor.reset( new boost::asio::local::stream_protocol::acceptor( boostReactor ) );
+      localAcceptor->assign( boost::asio::local::stream_protocol(),
+                             descriptors[ next ] );
+      descriptors[ next ] = -1;
+   }
+
+   // the connections and the games
+   managerMutex.lock();
+   /*|*/ restoreSnapshot( snapshot,
+   /*|*/                  descriptors );
+   managerMutex.unlock();
+
+   // close the sockets nobody took (the local listener no more configured ...)
+   for ( size_t i = 0;
+         i < descriptors.size();
+         ++i )
+   {
+      if ( descriptors[ i ] >= 0 )
+      {
+         ::close( descriptors[ i ] );
+      }
+   }
+
+   // the previous process stops once it knows the sockets are taken
+   boost::asio::write( link,
+                       boost::asio::buffer( &RESTART_ACKNOWLEDGE, 1 ),
+                       error );
+   if ( error )
+   {
+      throw std::exception( std::string( "The process listening on " + restartPath + " is gone during the handoff" ).c_str() );
+   }
+   return true;
+#else
+   std::cerr << "ConnectionManager> " << "unix domain sockets are not supported, no process to take over" << std::endl;
+   return false;
+#endif
+}
+
+// add the connections of the restored lists to the aggregat, the unknown ones are skipped
+static void restoreAggregat( const ServerSnapshot::Aggregat& restoredAggregat,
+                             const std::map< std::string, ClientConnectionPtr >& restored,
+                             ClientAggregat& aggregat )
+{
+   for ( ServerSnapshot::Aggregat::const_iterator itAgg = restoredAggregat.begin();
+         itAgg != restoredAggregat.end();
+         itAgg++ )
+   {
+      for ( std::vector< std::string >::const_iterator itId = itAgg->second.begin();
+            itId != itAgg->second.end();
+            itId++ )
+      {
+         std::map< std::string, ClientConnectionPtr >::const_iterator itClient = restored.find( *itId );
+         if ( itClient != restored.end() )
+         {
+            aggregat[ itAgg->first ].insert( itClient->second );
+         }
+      }
+   }
+}
+
+// rebuild the connections, the lists and the games of the snapshot on the handed descriptors
+// the taken descriptors are set to -1
+// should be call inside the manager mutex
+void ConnectionManager::restoreSnapshot( const ServerSnapshot& snapshot,
+                                         std::vector< int >& descriptors )
+{
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+   // the names and the numbers go on from the previous process
+   clientNumber.store( static_cast< int >( snapshot.nextClientNumber ) );
+   Game::setNextNumber( snapshot.nextGameNumber );
+
+   for ( std::vector< GameDefinition >::const_iterator it = snapshot.gameDefinitions.begin();
+         it != snapshot.gameDefinitions.end();
+         it++ )
+   {
+      gameDefinitions.insert( GameDefinitionMap::value_type( it->kind,
+                                                             *it ) );
+   }
+
+   // the connections on their sockets, the parked ones have none until their client resumes the session
+   std::map< std::string, ClientConnectionPtr > restored;
+   for ( std::vector< ConnectionSnapshot >::const_iterator it = snapshot.connections.begin();
+         it != snapshot.connections.end();
+         it++ )
+   {
+      connection_ptr socket( new SimpleTcpConnection( boostReactor,
+                                                      static_cast< SimpleTcpConnection::FramingMode >( it->framingMode ),
+                                                      ( it->parked == true ) ? SimpleTcpConnection::TRANSPORT_TCP : static_cast< SimpleTcpConnection::Transport >( it->transport ) ) );
+      if ( it->parked == false )
+      {
+         if (  ( it->descriptor >= descriptors.size() )
+             ||( descriptors[ it->descriptor ] < 0 )  )
+         {
+            AsyncLogger::getInstance()->log( "ConnectionManager> No socket handed for " + it->technicalId );
+            continue;
+         }
+         socket->adopt( descriptors[ it->descriptor ] );
+         descriptors[ it->descriptor ] = -1;
+         socket->restoreInput( it->unreadInput );
+         socket->applySocketProfile( consumerProfile );
+      }
+
+      ClientConnectionPtr connection = ClientConnection::restore( *it,
+                                                                 this,
+                                                                 socket );
+      restored.insert( std::make_pair( it->technicalId,
+                                       connection ) );
+      if ( it->registered == true )
+      {
+         connections.insert( connection );
+      }
+      if ( it->sessionToken.empty() == false )
+      {
+         sessions.insert( SessionMap::value_type( it->sessionToken,
+                                                  connection ) );
+         if ( it->parked == true )
+         {
+            parkedSessions.insert( std::make_pair( it->sessionToken,
+                                                   getHeartbeatTick() + it->sessionGraceLeft ) );
+         }
+      }
+      if ( it->parked == false )
+      {
+         watchConnection( connection );
+      }
+   }
+
+   // the lists by game kind, the connections know their kinds again and the providers get their socket options back
+   restoreAggregat( snapshot.consumerByGame,
+                    restored,
+                    consumerByGame );
+   restoreAggregat( snapshot.providerByGame,
+                    restored,
+                    providerByGame );
+   for ( ClientAggregat::const_iterator itAgg = consumerByGame.begin();
+         itAgg != consumerByGame.end();
+         itAgg++ )
+   {
+      for ( ClientList::const_iterator it = itAgg->second.begin();
+            it != itAgg->second.end();
+            it++ )
+      {
+         (*it)->addConsumedKind( itAgg->first );
+      }
+   }
+   for ( ClientAggregat::const_iterator itAgg = providerByGame.begin();
+         itAgg != providerByGame.end();
+         itAgg++ )
+   {
+      for ( ClientList::const_iterator it = itAgg->second.begin();
+            it != itAgg->second.end();
+            it++ )
+      {
+         (*it)->addProvidedKind( itAgg->first );
+         (*it)->applySocketProfile( providerProfile );
+         providersByLoad[ itAgg->first ].set( *it,
+                                              (*it)->getLoad() );
+      }
+   }
+
+   // the games, the peers already know them
+   for ( std::vector< GameSnapshot >::const_iterator it = snapshot.games.begin();
+         it != snapshot.games.end();
+         it++ )
+   {
+      std::map< std::string, ClientConnectionPtr >::const_iterator itProvider = restored.find( it->provider );
+      GameDefinitionMap::const_iterator itDefinition = gameDefinitions.find( it->kind );
+      if (  ( itProvider == restored.end() )
+          ||( itDefinition == gameDefinitions.end() )  )
+      {
+         continue;
+      }
+
+      ClientList consumers;
+      for ( std::vector< std::string >::const_iterator itId = it->consumers.begin();
+            itId != it->consumers.end();
+            itId++ )
+      {
+         std::map< std::string, ClientConnectionPtr >::const_iterator itConsumer = restored.find( *itId );
+         if ( itConsumer != restored.end() )
+         {
+            consumers.insert( itConsumer->second );
+         }
+      }
+
+      addGame( new Game( it->number,
+                         itDefinition->second,
+                         itProvider->second,
+                         consumers ) );
+   }
+
+   std::stringstream stream;
+   stream << "ConnectionManager> Restored " << restored.size() << " connections (" << parkedSessions.size() << " parked) and " << games.size() << " games";
+   AsyncLogger::getInstance()->log( stream.str() );
+#endif
+}
+
+// wait for a new process on the restart path
+void ConnectionManager::waitForRestart()
+{
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+   restartLink.reset( new boost::asio::local::stream_protocol::socket( boostReactor ) );
+   restartAcceptor->async_accept( *restartLink,
+                                  boost::bind( &ConnectionManager::handleRestart,
+                                               this,
+                                               boost::asio::placeholders::error ) );
+#endif
+}
+
+// handle a process connected on the restart socket
+// only a process of this user is listened to, and only for HANDOFF_REQUEST_TIMEOUT seconds
+void ConnectionManager::handleRestart( const boost::system::error_code& error )
+{
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+   if ( error == boost::asio::error::operation_aborted )
+   {
+      return;
+   }
+
+   if (  ( error != boost::system::errc::success )
+       ||( SocketHandoff::isSameUser( restartLink->native_handle() ) == false )  )
+   {
+      AsyncLogger::getInstance()->log( "ConnectionManager> Refused peer on the restart socket" );
+      waitForRestart();
+      return;
+   }
+
+   // the new process asks first
+   restartRequest = 0;
+   restartTimer.expires_from_now( boost::posix_time::seconds( HANDOFF_REQUEST_TIMEOUT ) );
+   restartTimer.async_wait( boost::bind( &ConnectionManager::handleRestartTimeout,
+                                         this,
+                                         boost::asio::placeholders::error ) );
+   boost::asio::async_read( *restartLink,
+                            boost::asio::buffer( &restartRequest, 1 ),
+                            boost::bind( &ConnectionManager::handleRestartRequest,
+                                         this,
+                                         boost::asio::placeholders::error ) );
+#endif
+}
+
+// close the restart link of a process which did not ask in time, its read completes with operation_aborted
+void ConnectionManager::handleRestartTimeout( const boost::system::error_code& error )
+{
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+   if ( error == boost::asio::error::operation_aborted )
+   {
+      return;
+   }
+
+   boost::system::error_code ignored;
+   restartLink->close( ignored );
+#endif
+}
+
+// handle the request of a new process to take over
+// stop accepting (the next connections wait in the backlog of the listening sockets for the new process),
+// stop the heartbeat and drain the connections before handing them over
+void ConnectionManager::handleRestartRequest( const boost::system::error_code& error )
+{
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+   boost::system::error_code ignored;
+   restartTimer.cancel( ignored );
+   if (  ( error != boost::system::errc::success )
+       ||( restartRequest != RESTART_REQUEST )  )
+   {
+      AsyncLogger::getInstance()->log( "ConnectionManager> Unexpected peer on the restart socket" );
+      waitForRestart();
+      return;
+   }
+
+   AsyncLogger::getInstance()->log( "ConnectionManager> A new process takes over, draining the connections" );
+   handingOff.store( true );
+   handoffForced = false;
+   handoffDeadline = boost::chrono::steady_clock::now() + boost::chrono::seconds( HANDOFF_DRAIN_TIMEOUT );
+
+   for ( AcceptorList::const_iterator it = connectionAcceptors.begin();
+         it != connectionAcceptors.end();
+         it++ )
+   {
+      (*it)->cancel( ignored );
+   }
+   if ( localAcceptor != NULL )
+   {
+      localAcceptor->cancel( ignored );
+   }
+   for ( size_t i = 0;
+         i < acceptBackoffs.size();
+         ++i )
+   {
+      acceptBackoffs[ i ].timer->cancel( ignored );
+      acceptBackoffs[ i ].delay = 0;
+   }
+   heartbeatTimer.cancel( ignored );
+
+   checkHandoff( boost::system::error_code() );
+#endif
+}
+
+// check the connections are drained, then hand them over
+// a connection is drained once its reads are stopped, its messages handled and its writes sent
+// the ones not drained in time are dropped (their clients resume their sessions on the new process), then the restart is aborted
+void ConnectionManager::checkHandoff( const boost::system::error_code& error )
+{
+   if ( error == boost::asio::error::operation_aborted )
+   {
+      return;
+   }
+
+   ClientList handed;
+   getHandedConnections( handed );
+
+   // a message handled during the pass may write on a connection already checked, the pass only counts if no task ran
+   // and the shards relayed or changed all their games
+   size_t executedTasks = workerPool.getStatistics().executedTasks;
+   std::vector< ClientConnectionPtr > undrained;
+   bool dropped = false;
+   for ( ClientList::const_iterator it = handed.begin();
+         it != handed.end();
+         it++ )
+   {
+      if ( (*it)->canBeHandedOver() == false )
+      {
+         (*it)->dropForRestart();
+         dropped = true;
+         continue;
+      }
+
+      (*it)->freeze();
+      if ( (*it)->isDrained() == false )
+      {
+         undrained.push_back( *it );
+      }
+   }
+
+   if (  ( undrained.empty() == true )
+       &&( dropped == false )
+       &&( areShardsIdle() == true )
+       &&( workerPool.getStatistics().executedTasks == executedTasks )  )
+   {
+      completeHandoff();
+      return;
+   }
+
+   if ( boost::chrono::steady_clock::now() >= handoffDeadline )
+   {
+      if ( handoffForced == true )
+      {
+         AsyncLogger::getInstance()->log( "ConnectionManager> The connections did not drain, restart aborted" );
+         abortHandoff();
+         return;
+      }
+
+      // drop the connections still busy
+      std::stringstream stream;
+      stream << "ConnectionManager> " << undrained.size() << " connections not drained in time, dropped";
+      AsyncLogger::getInstance()->log( stream.str() );
+      for ( std::vector< ClientConnectionPtr >::const_iterator it = undrained.begin();
+            it != undrained.end();
+            it++ )
+      {
+         (*it)->dropForRestart();
+      }
+      handoffForced = true;
+      handoffDeadline = boost::chrono::steady_clock::now() + boost::chrono::seconds( HANDOFF_DRAIN_TIMEOUT );
+   }
+
+   handoffTimer.expires_from_now( boost::posix_time::milliseconds( HANDOFF_CHECK_INTERVAL ) );
+   handoffTimer.async_wait( boost::bind( &ConnectionManager::checkHandoff,
+                                         this,
+                                         boost::asio::placeholders::error ) );
+}
+
+// send the sockets and the snapshot to the new process and stop once it took them over
+// the connections are drained so nothing is read or written until the new process runs them
+void ConnectionManager::completeHandoff()
 {
-   // waiting for the connection
-	waitForConnection();
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+   ServerSnapshot snapshot;
+   std::vector< int > descriptors;
+   managerMutex.lock();
+   /*|*/ takeSnapshot( snapshot,
+   /*|*/               descriptors );
+   managerMutex.unlock();
+
+   std::string data;
+   snapshot.write( data );
+
+   // the link is used synchronously, the new process answers once the sockets are taken
+   boost::system::error_code ignored;
+   restartLink->non_blocking( false,
+                              ignored );
+   int link = restartLink->native_handle();
+   SocketHandoff::setTimeout( link,
+                              HANDOFF_ACK_TIMEOUT );
+
+   char answer = 0;
+   if (  ( SocketHandoff::send( link,
+                                descriptors,
+                                data ) == true )
+       &&( ::recv( link, &answer, 1, 0 ) == 1 )
+       &&( answer == RESTART_ACKNOWLEDGE )  )
+   {
+      std::stringstream stream;
+      stream << "ConnectionManager> Handed over " << descriptors.size() << " sockets (" << snapshot.connections.size() << " connections, " << snapshot.games.size() << " games), stopping";
+      AsyncLogger::getInstance()->log( stream.str() );
+      boostReactor.stop();
+      return;
+   }
+
+   AsyncLogger::getInstance()->log( "ConnectionManager> The new process did not take over, restart aborted" );
+   abortHandoff();
+#endif
 }
 
-void ConnectionManager::waitForConnection()
+// go back to work after a failed handoff, the connections read again and the acceptors accept again
+void ConnectionManager::abortHandoff()
 {
-	connection_ptr new_connection(new SimpleTcpConnection( boostReactor ) );
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+   ClientList handed;
+   getHandedConnections( handed );
+   for ( ClientList::const_iterator it = handed.begin();
+         it != handed.end();
+         it++ )
+   {
+      (*it)->thaw();
+   }
 
-	// Attente d'une nouvelle connection
-	connectionAcceptor.async_accept( new_connection->getSocket(),
-		                              boost::bind( &ConnectionManager::handle_accept, 
-                                                 this,
-		                                           boost::asio::placeholders::error,
-                                                 new_connection ) );
+   handingOff.store( false );
+   for ( size_t i = 0;
+         i < connectionAcceptors.size();
+         ++i )
+   {
+	   waitForConnection( i );
+   }
+   if ( localAcceptor != NULL )
+   {
+      waitForLocalConnection();
+   }
+   if (  ( heartbeatSettings.idleTimeout > 0 )
+       ||( heartbeatSettings.sessionGrace > 0 )  )
+   {
+      waitForHeartbeat();
+   }
+
+   // and for another try, the link with the failed process is closed
+   waitForRestart();
+#endif
 }
 
-void ConnectionManager::handle_accept( const boost::system::error_code& error, 
-                                       connection_ptr new_connection )
+// get the connections to hand over, the registered ones and the ones with a session
+void ConnectionManager::getHandedConnections( ClientList& handed )
 {
-	if ( error == 0)
-	{
-      // create the unique id
-      std::string newClientName = createNewClientName();
-		AsyncLogger::getInstance()->log( "ConnectionManager> Connection accepted> " + newClientName );
+   boost::mutex::scoped_lock lock( managerMutex );
 
-      // create the client
-		ClientConnectionPtr client = ClientConnection::create( newClientName, 
-                                                             this,
-                                                             new_connection );
+   handed = connections;
+   for ( SessionMap::const_iterator it = sessions.begin();
+         it != sessions.end();
+         it++ )
+   {
+      handed.insert( it->second );
+   }
+}
 
-      // and back to client acceptance
-		waitForConnection();
-	}
-	else 
+// fill the snapshot of the drained manager and the list of descriptors to hand over
+// the descriptors are the tcp listeners, the local listener if any, then the sockets of the connections not parked
+// should be call inside the manager mutex
+void ConnectionManager::takeSnapshot( ServerSnapshot& snapshot,
+                                      std::vector< int >& descriptors )
+{
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+   for ( AcceptorList::const_iterator it = connectionAcceptors.begin();
+         it != connectionAcceptors.end();
+         it++ )
    {
-		std::cerr << "ConnectionManager> " << "Connection refused" << std::endl;
-	}
+      descriptors.push_back( (*it)->native_handle() );
+   }
+   snapshot.tcpListeners = connectionAcceptors.size();
+   snapshot.localListener = ( localAcceptor != NULL );
+   if ( localAcceptor != NULL )
+   {
+      descriptors.push_back( localAcceptor->native_handle() );
+   }
+
+   snapshot.nextGameNumber = Game::getNextNumber();
+   snapshot.nextClientNumber = clientNumber.load();
+
+   for ( GameDefinitionMap::const_iterator it = gameDefinitions.begin();
+         it != gameDefinitions.end();
+         it++ )
+   {
+      snapshot.gameDefinitions.push_back( it->second );
+   }
+
+   // the connections with their sockets, the parked ones have none
+   ClientList handed = connections;
+   for ( SessionMap::const_iterator it = sessions.begin();
+         it != sessions.end();
+         it++ )
+   {
+      handed.insert( it->second );
+   }
+   boost::uint64_t now = getHeartbeatTick();
+   for ( ClientList::const_iterator it = handed.begin();
+         it != handed.end();
+         it++ )
+   {
+      snapshot.connections.push_back( ConnectionSnapshot() );
+      ConnectionSnapshot& connection = snapshot.connections.back();
+      (*it)->takeSnapshot( connection );
+      connection.registered = ( connections.find( *it ) != connections.end() );
+      connection.descriptor = 0;
+      connection.sessionGraceLeft = 0;
+
+      std::map< std::string, boost::uint64_t >::const_iterator itParked = parkedSessions.find( connection.sessionToken );
+      if (  ( itParked != parkedSessions.end() )
+          &&( itParked->second > now )  )
+      {
+         connection.sessionGraceLeft = itParked->second - now;
+      }
+
+      if ( connection.parked == false )
+      {
+         // a socket already closed can not be handed over
+         int handle = (*it)->getNativeHandle();
+         if ( handle < 0 )
+         {
+            snapshot.connections.pop_back();
+            continue;
+         }
+         connection.descriptor = descriptors.size();
+         descriptors.push_back( handle );
+      }
+   }
+
+   // the lists by game kind and the games
+   ServerSnapshot::Aggregat* restoredAggregats[] = { &snapshot.consumerByGame, &snapshot.providerByGame };
+   ClientAggregat* aggregats[] = { &consumerByGame, &providerByGame };
+   for ( size_t i = 0;
+         i < 2;
+         ++i )
+   {
+      for ( ClientAggregat::const_iterator itAgg = aggregats[ i ]->begin();
+            itAgg != aggregats[ i ]->end();
+            itAgg++ )
+      {
+         std::vector< std::string >& ids = (*restoredAggregats[ i ])[ itAgg->first ];
+         for ( ClientList::const_iterator it = itAgg->second.begin();
+               it != itAgg->second.end();
+               it++ )
+         {
+            ids.push_back( (*it)->getTechnicalId() );
+         }
+      }
+   }
+
+   for ( GameMap::const_iterator itGame = games.begin();
+         itGame != games.end();
+         itGame++ )
+   {
+      Game* game = itGame->second;
+      ClientList consumers = game->getClients();
+
+      snapshot.games.push_back( GameSnapshot() );
+      GameSnapshot& restoredGame = snapshot.games.back();
+      restoredGame.number = game->getNumber();
+      restoredGame.kind = game->getKind();
+      restoredGame.provider = game->getProvider()->getTechnicalId();
+      for ( ClientList::const_iterator it = consumers.begin();
+            it != consumers.end();
+            it++ )
+      {
+         restoredGame.consumers.push_back( (*it)->getTechnicalId() );
+      }
+   }
+#endif
 }
 
 // used to handle message from a ClientConnection
@@ -83,52 +1163,166 @@ void ConnectionManager::handle_accept( const boost::system::error_code& error,
 //     'SYSTEM_JOIN_GAME GameId'
 //     'SYSTEM_LEAVE_GAME GameId'
 //     '<gameId> MESSAGE'
+// each of them may be sent in a request with an id, echoed in its reply
+//     'SYSTEM_REQUEST id <message>'
+//             'SYSTEM_REPLY id <reply>'
 void ConnectionManager::handleMessage( ClientConnectionPtr connection,
-                                       const std::string& message )
+                                       SharedMessage message,
+                                       RequestId requestId )
 {
+   const std::string& text = *message;
+
+#ifdef __DEBUG__
    // log the message
-   AsyncLogger::getInstance()->log( "RECEIVE FROM (" + connection->getLogin() + ") : " + message );
+   AsyncLogger::getInstance()->log( "RECEIVE FROM (" + connection->getLogin() + ") : " + text );
+#endif
+
+   // a message sent in a request, handled with the id of the request
+   //     'SYSTEM_REQUEST id <message>'
+   if (  ( requestId == NO_REQUEST_ID )
+       &&( text.compare( 0, SYSTEM_REQUEST.size() + 1, SYSTEM_REQUEST + " " ) == 0 )  )
+   {
+      size_t idStart = SYSTEM_REQUEST.size() + 1;
+      size_t idEnd = text.find( ' ', idStart );
+      RequestId id = BinaryProtocol::parseRequestId( text.substr( idStart,
+                                                                  ( idEnd != std::string::npos ) ? idEnd - idStart : std::string::npos ) );
+      if (  ( id != NO_REQUEST_ID )
+          &&( idEnd != std::string::npos )  )
+      {
+         handleMessage( connection,
+                        BufferPool::getInstance().copy( text.substr( idEnd + 1 ) ),
+                        id );
+      }
+      return;
+   }
+
+   // the game messages are most of the traffic, find the shard of their game without exploding them
+   // and post the received buffer itself to it, the shard relays it without any lock
+   //     'GAME_MESSAGE gameId ...'
+   if (  ( text.size() > GAME_MESSAGE.size() )
+       &&( text.compare( 0, GAME_MESSAGE.size(), GAME_MESSAGE ) == 0 )
+       &&( text[ GAME_MESSAGE.size() ] == ' ' )  )
+   {
+      size_t idStart = GAME_MESSAGE.size() + 1;
+      size_t idEnd = text.find( ' ', idStart );
+      size_t idLength = ( ( idEnd != std::string::npos ) ? idEnd : text.size() ) - idStart;
+
+      boost::uint64_t number = 0;
+      if ( BinaryProtocol::parseGameNumber( text,
+                                            idStart,
+                                            idLength,
+                                            number ) == true )
+      {
+         postRelayToShard( connection,
+                           static_cast< size_t >( number ),
+                           message,
+                           requestId,
+                           false );
+         return;
+      }
+      acknowledge( connection,
+                   requestId );
+      return;
+   }
+
+   // get the lock on the manager state
+   boost::mutex::scoped_lock lock( managerMutex );
+
+   // the sessions
+   //     'SYSTEM_OPEN_SESSION'
+   //     'SYSTEM_RESUME_SESSION token'
+   if ( text == SYSTEM_OPEN_SESSION )
+   {
+      openSession( connection,
+                   requestId );
+      return;
+   }
+   if (  ( text.size() > SYSTEM_RESUME_SESSION.size() + 1 )
+       &&( text.compare( 0, SYSTEM_RESUME_SESSION.size() + 1, SYSTEM_RESUME_SESSION + " " ) == 0 )  )
+   {
+      resumeSession( connection,
+                     text.substr( SYSTEM_RESUME_SESSION.size() + 1 ),
+                     requestId );
+      dumpCurrentState();
+      return;
+   }
 
    // explode the message to be able to check the kind 
    std::vector< std::string > messageParts;
-   if ( StringUtils::explode( message,
+   if ( StringUtils::explode( text,
                               ' ',
                               messageParts,
                               2 ) == 2 )
    {
       if ( messageParts[ 0 ] == SYSTEM_REGISTER )
       {
+         std::vector< std::string > registerParts;
+         StringUtils::explode( messageParts[ 1 ],
+                               ' ',
+                               registerParts );
          registerConnection( connection,
-                              messageParts[ 1 ] );
+                             registerParts,
+                             requestId );
          dumpCurrentState();
       }
       else if ( messageParts[ 0 ] == SYSTEM_REQUEST_GAME )
       {
          requestGame( connection,
-                        messageParts[ 1 ] );
+                        messageParts[ 1 ],
+                        requestId );
          dumpCurrentState();
       }
       else if ( messageParts[ 0 ] == SYSTEM_REQUEST_GAME_LIST )
       {
          requestGameList( connection,
-                           messageParts[ 1 ] );
+                           messageParts[ 1 ],
+                           requestId );
       }
       else if ( messageParts[ 0 ] == SYSTEM_JOIN_OR_REQUEST_GAME )
       {
          joinOrRequestGame( connection,
-                              messageParts[ 1 ] );
+                              messageParts[ 1 ],
+                              requestId );
          dumpCurrentState();
       }
       else if ( messageParts[ 0 ] == SYSTEM_JOIN_GAME )
       {
-         joinGame( connection,
-                     messageParts[ 1 ] );
+         Game* game = findGame( messageParts[ 1 ] );
+         if ( game != NULL )
+         {
+            postToShard( game->getNumber(),
+                         boost::bind( &ConnectionManager::joinGame,
+                                      this,
+                                      connection,
+                                      game->getNumber(),
+                                      messageParts[ 1 ],
+                                      requestId ) );
+         }
+         else
+         {
+            reply( connection,
+                   requestId,
+                   GAME_MESSAGE + " " + GAME_JOIN_REFUSED + " " + messageParts[ 1 ] + " The game is unknown" );
+         }
          dumpCurrentState();
       }
       else if ( messageParts[ 0 ] == SYSTEM_LEAVE_GAME )
       {
-         leaveGame( connection,
-                     messageParts[ 1 ] );
+         Game* game = findGame( messageParts[ 1 ] );
+         if ( game != NULL )
+         {
+            postToShard( game->getNumber(),
+                         boost::bind( &ConnectionManager::leaveGame,
+                                      this,
+                                      connection,
+                                      game->getNumber(),
+                                      requestId ) );
+         }
+         else
+         {
+            acknowledge( connection,
+                         requestId );
+         }
          dumpCurrentState();
       }
       else if ( messageParts[ 0 ] == SYSTEM_GAME_CREATION_REFUSED )
@@ -141,176 +1335,524 @@ void ConnectionManager::handleMessage( ClientConnectionPtr connection,
                                  2 );
 
          // and close the game
-         closeGame( connection,
-                     messageInformation[ 0 ],
-                     messageInformation[ 1 ] );
+         Game* game = findGame( messageInformation[ 0 ] );
+         if ( game != NULL )
+         {
+            postToShard( game->getNumber(),
+                         boost::bind( &ConnectionManager::closeGame,
+                                      this,
+                                      connection,
+                                      game->getNumber(),
+                                      messageInformation[ 1 ],
+                                      requestId ) );
+         }
+         else
+         {
+            acknowledge( connection,
+                         requestId );
+         }
          dumpCurrentState();
       }
-      else if ( messageParts[ 0 ] == GAME_MESSAGE )
+      else
       {
-         // get the relevant information
-         std::vector< std::string > messageInformation;
-         StringUtils::explode( messageParts[ 1 ],
-                                 ' ',
-                                 messageInformation,
-                                 2 );
+         acknowledge( connection,
+                      requestId );
+      }
+   }
+   else
+   {
+      acknowledge( connection,
+                   requestId );
+   }
+}
+
+// used to handle a binary frame from a ClientConnection which negotiated the binary protocol
+// the frames are the same messages as handleMessage ones read directly from the opcode
+void ConnectionManager::handleBinaryMessage( ClientConnectionPtr connection,
+                                             SharedMessage frame,
+                                             RequestId requestId )
+{
+   BinaryReader reader( *frame );
+   BinaryProtocol::Opcode opcode = reader.readOpcode();
+
+   // a frame sent in a request, handled with the id of the request
+   if (  ( opcode == BinaryProtocol::OP_REQUEST )
+       &&( requestId == NO_REQUEST_ID )  )
+   {
+      RequestId id = reader.readUInt();
+      if (  ( reader.isValid() == true )
+          &&( id != NO_REQUEST_ID )  )
+      {
+         handleBinaryMessage( connection,
+                              BufferPool::getInstance().copy( frame->substr( frame->size() - reader.remaining() ) ),
+                              id );
+      }
+      return;
+   }
+
+   // a message without binary form, handled as text
+   if ( opcode == BinaryProtocol::OP_TEXT )
+   {
+      std::string message = reader.readString();
+      if ( reader.isValid() == true )
+      {
+         handleMessage( connection,
+                        BufferPool::getInstance().copy( message ),
+                        requestId );
+      }
+      return;
+   }
+
+   // the game frames are most of the traffic, posted to the shard of the game which relays them without any lock
+   // the received buffer is forwarded as is (still compressed), the other forms are only built for the peers needing them
+   if (  ( opcode == BinaryProtocol::OP_GAME_MESSAGE )
+       ||( opcode == BinaryProtocol::OP_COMPRESSED_GAME_MESSAGE )  )
+   {
+      size_t number = static_cast< size_t >( reader.readUInt() );
+      if ( reader.isValid() == true )
+      {
+         postRelayToShard( connection,
+                           number,
+                           frame,
+                           requestId,
+                           true );
+         return;
+      }
+      acknowledge( connection,
+                   requestId );
+      return;
+   }
+
+   // get the lock on the manager state
+   boost::mutex::scoped_lock lock( managerMutex );
+
+   switch ( opcode )
+   {
+   case BinaryProtocol::OP_REGISTER:
+   {
+      std::vector< std::string > registerParts;
+      while (  ( reader.hasMore() == true )
+             &&( reader.isValid() == true )  )
+      {
+         registerParts.push_back( std::string() );
+         reader.readToken( registerParts.back() );
+      }
+      if ( reader.isValid() == true )
+      {
+         registerConnection( connection,
+                             registerParts,
+                             requestId );
+         dumpCurrentState();
+      }
+      break;
+   }
+   case BinaryProtocol::OP_REQUEST_GAME:
+   case BinaryProtocol::OP_REQUEST_GAME_LIST:
+   case BinaryProtocol::OP_JOIN_OR_REQUEST_GAME:
+   {
+      std::string gameKind = reader.readString();
+      if ( reader.isValid() == false )
+      {
+         break;
+      }
 
-         // and forward the message (gameId, message)
-         handleGameMessage( connection,
-                              messageInformation[ 0 ],
-                              message );
+      if ( opcode == BinaryProtocol::OP_REQUEST_GAME )
+      {
+         requestGame( connection,
+                      gameKind,
+                      requestId );
+         dumpCurrentState();
+      }
+      else if ( opcode == BinaryProtocol::OP_REQUEST_GAME_LIST )
+      {
+         requestGameList( connection,
+                          gameKind,
+                          requestId );
+      }
+      else
+      {
+         joinOrRequestGame( connection,
+                            gameKind,
+                            requestId );
+         dumpCurrentState();
+      }
+      break;
+   }
+   case BinaryProtocol::OP_JOIN_GAME:
+   {
+      size_t number = static_cast< size_t >( reader.readUInt() );
+      if ( reader.isValid() == true )
+      {
+         postToShard( number,
+                      boost::bind( &ConnectionManager::joinGame,
+                                   this,
+                                   connection,
+                                   number,
+                                   std::string(),
+                                   requestId ) );
+         dumpCurrentState();
+      }
+      break;
+   }
+   case BinaryProtocol::OP_LEAVE_GAME:
+   {
+      size_t number = static_cast< size_t >( reader.readUInt() );
+      if ( reader.isValid() == true )
+      {
+         postToShard( number,
+                      boost::bind( &ConnectionManager::leaveGame,
+                                   this,
+                                   connection,
+                                   number,
+                                   requestId ) );
+         dumpCurrentState();
+      }
+      break;
+   }
+   case BinaryProtocol::OP_GAME_CREATION_REFUSED:
+   {
+      size_t number = static_cast< size_t >( reader.readUInt() );
+      std::string reason = reader.readString();
+      if ( reader.isValid() == true )
+      {
+         postToShard( number,
+                      boost::bind( &ConnectionManager::closeGame,
+                                   this,
+                                   connection,
+                                   number,
+                                   reason,
+                                   requestId ) );
+         dumpCurrentState();
       }
+      break;
+   }
+   default:
+      AsyncLogger::getInstance()->log( "ConnectionManager> unexpected binary frame from " + connection->getTechnicalId() );
+      acknowledge( connection,
+                   requestId );
+      break;
    }
 }
 
-void ConnectionManager::closeConnection( ClientConnectionPtr connection )
+// close and remove a ClientConnection
+// a lost link (read or write error, missed heartbeat) with a session is parked during the grace window instead
+void ConnectionManager::closeConnection( ClientConnectionPtr connection,
+                                         bool linkLost )
 {
-   std::set< std::string > gameToCloseList;
+   // get the lock on the manager state
+   boost::mutex::scoped_lock lock( managerMutex );
 
-   // find all the game related to this connection
-   for ( GameMap::iterator itGame = games.begin();
-         itGame != games.end();
-         )
+   if (  ( linkLost == true )
+       &&( parkConnection( connection ) == true )  )
    {
-      // get the current game
-      Game* game = itGame->second;
+      return;
+   }
+
+   removeConnection( connection );
+}
 
-      // check the contains status
-      if ( game->contains( connection ) == true )
+// remove the connection from the lists of the given kinds, the empty lists are erased
+static void removeFromAggregat( ClientAggregat& aggregat,
+                                const std::set< std::string >& kinds,
+                                ClientConnectionPtr connection )
+{
+   for ( std::set< std::string >::const_iterator itKind = kinds.begin();
+         itKind != kinds.end();
+         itKind++ )
+   {
+      ClientAggregat::iterator itAgg = aggregat.find( *itKind );
+      if ( itAgg != aggregat.end() )
       {
-         // remove the connection from the game
-         if ( game->remove( connection ) == true )
-         {
-            // if the connection was the provider, close the game
-            gameToCloseList.insert( game->getId() );
-            delete game;
-            itGame = games.erase( itGame );
-            continue;
-         }
-         else if ( game->getClients().size() == 0 )
+         itAgg->second.erase( connection );
+         if ( itAgg->second.size() == 0 )
          {
-            // if there is no more players
-            gameToCloseList.insert( game->getId() );
-            delete game;
-            itGame = games.erase( itGame );
-            continue;
+            aggregat.erase( itAgg );
          }
       }
+   }
+}
 
-      // go to the next game
-      itGame++;
+// remove the connection from the games and the lists, closing the games it provides
+// the shards of its games leave them once the tasks posted to them ran
+// should be call inside the manager mutex
+void ConnectionManager::removeConnection( ClientConnectionPtr connection )
+{
+   // the tasks of the shards still queued for the connection ignore it now
+   connection->markRemoved();
+
+   // forget its session
+   SessionMap::iterator itSession = sessions.find( connection->getSessionToken() );
+   if (  ( itSession != sessions.end() )
+       &&( itSession->second == connection )  )
+   {
+      parkedSessions.erase( itSession->first );
+      sessions.erase( itSession );
    }
 
-   // check if there is some game to close
-   if ( gameToCloseList.size() > 0 )
+   // walk only the games of the connection, one task for the games of each shard
+   postByShard( connection->getGames(),
+                boost::bind( &ConnectionManager::removeFromGames,
+                             this,
+                             connection,
+                             _1 ) );
+
+   // remove the connection from the lists of the kinds it is registered for
+   removeFromAggregat( consumerByGame,
+                       connection->getConsumedKinds(),
+                       connection );
+   removeFromAggregat( providerByGame,
+                       connection->getProvidedKinds(),
+                       connection );
+   const std::set< std::string >& providedKinds = connection->getProvidedKinds();
+   for ( std::set< std::string >::const_iterator itKind = providedKinds.begin();
+         itKind != providedKinds.end();
+         itKind++ )
    {
-      // create the close message
-      std::string closeMessage( GAME_MESSAGE + " " + CLOSE_MESSAGE + " " );
-      size_t i = 0;
-      for ( std::set< std::string >::const_iterator it = gameToCloseList.begin();
-            it != gameToCloseList.end();
-            it++ )
+      ProviderHeapMap::iterator itHeap = providersByLoad.find( *itKind );
+      if ( itHeap != providersByLoad.end() )
       {
-         closeMessage += *it;
-         if ( i++ < gameToCloseList.size() - 1 )
+         itHeap->second.erase( connection );
+         if ( itHeap->second.empty() == true )
          {
-            closeMessage += "|";
+            providersByLoad.erase( itHeap );
          }
       }
-      closeMessage += " Client close its connection and end the game" ;
+   }
 
-      // and send it to everyone
-      for ( ClientList::const_iterator itClient = connections.begin();
-            itClient != connections.end();
-            itClient++ )
-      {
-         (*itClient)->sendMessage( closeMessage );
-      }
+   // remove the connections from the list and keep its counters
+   if ( connections.erase( connection ) > 0 )
+   {
+      closedBackpressureStatistics.add( connection->getBackpressureStatistics() );
+   }
+
+   dumpCurrentState();
+}
+
+// give a session token to the connection so it can be resumed on a new connection
+//     'SYSTEM_OPEN_SESSION'
+//             'SYSTEM_SESSION token' or 'SYSTEM_SESSION_EXPIRED' if the sessions are disabled
+void ConnectionManager::openSession( ClientConnectionPtr connection,
+                                     RequestId requestId )
+{
+   if ( heartbeatSettings.sessionGrace == 0 )
+   {
+      reply( connection,
+             requestId,
+             SYSTEM_SESSION_EXPIRED );
+      return;
+   }
+
+   if ( connection->getSessionToken().empty() == true )
+   {
+      std::string token = boost::uuids::to_string( sessionGenerator() );
+      connection->setSessionToken( token );
+      sessions.insert( SessionMap::value_type( token,
+                                               connection ) );
+   }
+   reply( connection,
+          requestId,
+          SYSTEM_SESSION + " " + connection->getSessionToken() );
+}
+
+// move the session to the new connection of its client, with the games, the load and the held messages
+//     'SYSTEM_RESUME_SESSION token'
+//             'SYSTEM_SESSION token' followed by the held messages or 'SYSTEM_SESSION_EXPIRED'
+void ConnectionManager::resumeSession( ClientConnectionPtr connection,
+                                       const std::string& token,
+                                       RequestId requestId )
+{
+   SessionMap::iterator itSession = sessions.find( token );
+   if (  ( itSession == sessions.end() )
+       ||( itSession->second == connection )  )
+   {
+      reply( connection,
+             requestId,
+             SYSTEM_SESSION_EXPIRED );
+      return;
+   }
+
+   // the held messages are in the form of the previous connection
+   ClientConnectionPtr previous = itSession->second;
+   if (  ( previous->isBinaryProtocol() != connection->isBinaryProtocol() )
+       ||( previous->isCompressionNegotiated() != connection->isCompressionNegotiated() )  )
+   {
+      AsyncLogger::getInstance()->log( "ConnectionManager> " + connection->getTechnicalId() + " can not resume " + previous->getTechnicalId() + " with another protocol" );
+      reply( connection,
+             requestId,
+             SYSTEM_SESSION_EXPIRED );
+      return;
+   }
+
+   // the previous link may still look alive (half open), it is parked now
+   parkConnection( previous );
+   if ( previous->hasParkedOverflow() == true )
+   {
+      AsyncLogger::getInstance()->log( "ConnectionManager> " + previous->getTechnicalId() + " held too many messages, session lost" );
+      removeConnection( previous );
+      reply( connection,
+             requestId,
+             SYSTEM_SESSION_EXPIRED );
+      return;
    }
+   parkedSessions.erase( token );
 
-   // remove the connection from the client aggregat
-   for ( ClientAggregat::iterator itAgg = consumerByGame.begin();
-         itAgg != consumerByGame.end();
-         )
+   // the new connection takes the place of the previous one
+   replaceConnection( previous,
+                      connection );
+   connection->setSessionToken( token );
+   itSession->second = connection;
+
+   // then gets what was sent during the gap, in order
+   reply( connection,
+          requestId,
+          SYSTEM_SESSION + " " + token );
+   std::vector< SharedMessage > heldMessages;
+   previous->takeParkedMessages( heldMessages );
+   for ( std::vector< SharedMessage >::const_iterator it = heldMessages.begin();
+         it != heldMessages.end();
+         it++ )
    {
-      for ( ClientList::iterator itClient = itAgg->second.begin();
-            itClient != itAgg->second.end();
-            itClient++ )
-      {
-         // check the client
-         if ( *itClient == connection )
-         {
-            // remove it
-            itAgg->second.erase( itClient );
+      connection->sendMessage( *it );
+   }
 
-            // and break as there is only one occurence of client per game
-            break;
-         }
-      }
+   std::stringstream stream;
+   stream << "ConnectionManager> " << connection->getTechnicalId() << " resumed the session of " << previous->getTechnicalId() << " (" << heldMessages.size() << " held messages)";
+   AsyncLogger::getInstance()->log( stream.str() );
+}
 
-      // check if there is still some client for the game
-      if ( itAgg->second.size() == 0 )
-      {
-         itAgg = consumerByGame.erase( itAgg );
-         continue;
-      }
+// keep the connection, its games and the messages sent to it during the grace window
+// return false if the connection has no session
+// should be call inside the manager mutex
+bool ConnectionManager::parkConnection( ClientConnectionPtr connection )
+{
+   SessionMap::iterator itSession = sessions.find( connection->getSessionToken() );
+   if (  ( itSession == sessions.end() )
+       ||( itSession->second != connection )  )
+   {
+      return false;
+   }
 
-      // and next game
-      itAgg++;
+   if ( parkedSessions.find( itSession->first ) == parkedSessions.end() )
+   {
+      AsyncLogger::getInstance()->log( "ConnectionManager> " + connection->getTechnicalId() + " lost its link, session kept" );
+      parkedSessions.insert( std::make_pair( itSession->first,
+                                             getHeartbeatTick() + heartbeatSettings.sessionGrace ) );
+      connection->park();
    }
+   return true;
+}
 
-   // remove the connection from the provider aggregat
-   for ( ClientAggregat::iterator itAgg = providerByGame.begin();
-         itAgg != providerByGame.end();
+// close the parked sessions which were not resumed in the grace window
+void ConnectionManager::expireSessions( boost::uint64_t now )
+{
+   boost::mutex::scoped_lock lock( managerMutex );
+
+   std::vector< ClientConnectionPtr > expired;
+   for ( std::map< std::string, boost::uint64_t >::iterator it = parkedSessions.begin();
+         it != parkedSessions.end();
          )
    {
-      for ( ClientList::iterator itClient = itAgg->second.begin();
-            itClient != itAgg->second.end();
-            itClient++ )
+      // a parked token without session has nothing left to expire
+      SessionMap::const_iterator itSession = sessions.find( it->first );
+      if ( itSession == sessions.end() )
       {
-         // check the client
-         if ( *itClient == connection )
-         {
-            // remove it
-            itAgg->second.erase( itClient );
-
-            // and break as there is only one occurence of client per game
-            break;
-         }
+         parkedSessions.erase( it++ );
+         continue;
       }
 
-      // check if there is still some client for the game
-      if ( itAgg->second.size() == 0 )
+      ClientConnectionPtr connection = itSession->second;
+      if (  ( it->second <= now )
+          ||( connection->hasParkedOverflow() == true )  )
       {
-         itAgg = providerByGame.erase( itAgg );
-         continue;
+         expired.push_back( connection );
       }
+      it++;
+   }
+
+   for ( std::vector< ClientConnectionPtr >::const_iterator it = expired.begin();
+         it != expired.end();
+         it++ )
+   {
+      AsyncLogger::getInstance()->log( "ConnectionManager> session of " + (*it)->getTechnicalId() + " expired" );
+      removeConnection( *it );
+   }
+}
 
-      // and next game
-      itAgg++;
+// put the new connection in place of the previous one in the games and the lists
+// should be call inside the manager mutex
+void ConnectionManager::replaceConnection( ClientConnectionPtr previous,
+                                           ClientConnectionPtr connection )
+{
+   if ( connections.erase( previous ) > 0 )
+   {
+      closedBackpressureStatistics.add( previous->getBackpressureStatistics() );
+      connections.insert( connection );
    }
 
-   // remove the connections from the list 
-   connections.erase( connection );
+   // the load moves with the session
+   connection->setLoad( previous->getLoad() );
+   previous->setLoad( 0 );
 
-   dumpCurrentState();
+   // the lists of the kinds the previous connection is registered for
+   const std::set< std::string >& consumedKinds = previous->getConsumedKinds();
+   for ( std::set< std::string >::const_iterator itKind = consumedKinds.begin();
+         itKind != consumedKinds.end();
+         itKind++ )
+   {
+      ClientList& consumers = consumerByGame[ *itKind ];
+      consumers.erase( previous );
+      consumers.insert( connection );
+      connection->addConsumedKind( *itKind );
+   }
+   const std::set< std::string >& providedKinds = previous->getProvidedKinds();
+   for ( std::set< std::string >::const_iterator itKind = providedKinds.begin();
+         itKind != providedKinds.end();
+         itKind++ )
+   {
+      ClientList& providers = providerByGame[ *itKind ];
+      providers.erase( previous );
+      providers.insert( connection );
+      connection->addProvidedKind( *itKind );
+      ProviderHeap& heap = providersByLoad[ *itKind ];
+      heap.erase( previous );
+      heap.set( connection,
+                connection->getLoad() );
+   }
+
+   // the games of the previous connection are the ones of the connection now (copied as the set changes)
+   // their shards put it in place of the previous one once the tasks posted to them ran
+   std::set< size_t > previousGames = previous->getGames();
+   for ( std::set< size_t >::const_iterator itNumber = previousGames.begin();
+         itNumber != previousGames.end();
+         itNumber++ )
+   {
+      previous->removeGame( *itNumber );
+      connection->addGame( *itNumber );
+   }
+   postByShard( previousGames,
+                boost::bind( &ConnectionManager::replaceInGames,
+                             this,
+                             previous,
+                             connection,
+                             _1 ) );
+
+   // the previous connection is out of the manager, the tasks of the shards still queued for it ignore it
+   previous->markRemoved();
 }
 
 // register a new connection on consumer or provider of game
 //     'SYSTEM_REGISTER CONSUMER [Game]' --> no answer
 //     'SYSTEM_REGISTER PROVIDER [GameName MinPlayer MaxPlayer IAAvailable]' --> no answer
 void ConnectionManager::registerConnection( ClientConnectionPtr connection,
-                                            const std::string& message )
+                                            const std::vector< std::string >& messageParts,
+                                            RequestId requestId )
 {
    // check if the connection already exist
    if ( connections.find( connection ) == connections.end() )
    {
       // register only if there is at least one game to consume/provide
-      std::vector< std::string > messageParts;
-      size_t size;
-      if ( ( size = StringUtils::explode( message,
-                                          ' ',
-                                          messageParts ) ) > 1 )
+      size_t size = messageParts.size();
+      if ( size > 1 )
       {
          // get the kind of the client
          if ( messageParts[ 0 ] == CONSUMER_PART )
@@ -325,10 +1867,13 @@ void ConnectionManager::registerConnection( ClientConnectionPtr connection,
                ClientAggregat::iterator it = consumerByGame.insert( ClientAggregat::value_type( messageParts[ i ],
                                                                                                 ClientList() ) ).first;
                it->second.insert( connection );
+               connection->addConsumedKind( messageParts[ i ] );
             }
          }
          else if ( messageParts[ 0 ] == PROVIDER_PART )
          {
+            connection->applySocketProfile( providerProfile );
+
             for ( size_t i = 1;
                   i < size;
                   i += 4 )
@@ -349,6 +1894,9 @@ void ConnectionManager::registerConnection( ClientConnectionPtr connection,
                ClientAggregat::iterator it = providerByGame.insert( ClientAggregat::value_type( messageParts[ i ],
                                                                                                 ClientList() ) ).first;
                it->second.insert( connection );
+               connection->addProvidedKind( messageParts[ i ] );
+               providersByLoad[ messageParts[ i ] ].set( connection,
+                                                         connection->getLoad() );
             }
          }
          else
@@ -360,6 +1908,9 @@ void ConnectionManager::registerConnection( ClientConnectionPtr connection,
          connections.insert( connection );
       }
    }
+
+   acknowledge( connection,
+                requestId );
 }
 
 // request a game to the server given its kind
@@ -369,7 +1920,8 @@ void ConnectionManager::registerConnection( ClientConnectionPtr connection,
 //             'SYSTEM_REQUEST_GAME_REFUSED ErrorMessage'
 //             'SYSTEM_REQUEST_GAME_ACCEPTED GameId #Consumer [Consumer]'
 void ConnectionManager::requestGame( ClientConnectionPtr connection,
-                                     const std::string& gameKind )
+                                     const std::string& gameKind,
+                                     RequestId requestId )
 {
    // first check if there is at least one provider for it
    ClientAggregat::iterator itProviders = providerByGame.find( gameKind );
@@ -383,22 +1935,25 @@ void ConnectionManager::requestGame( ClientConnectionPtr connection,
 
       // create the game
       Game* game = new Game( gameDef, 
-                             findLessLoadedProvider( itProviders->second ) );
+                             findLessLoadedProvider( gameKind ) );
 
       // store it
-      games.insert( GameMap::value_type( game->getId(),
-                                         game ) );
+      addGame( game );
 
       // alert the provider about a new game creation
       // it can send back a GAME_CREATION_REFUSED which will leads to close the game
       game->getProvider()->sendMessage( GAME_MESSAGE + " " + GAME_CREATED + " " + game->getId()  + " " + gameDef.kind );
 
       // and send the accept message to the client
-      connection->sendMessage( GAME_MESSAGE + " " + GAME_ACCEPTED + " " + game->getId() + " " + gameDef.kind );
+      reply( connection,
+             requestId,
+             GAME_MESSAGE + " " + GAME_ACCEPTED + " " + game->getId() + " " + gameDef.kind );
    }
    else
    {
-      connection->sendMessage( GAME_MESSAGE + " " + GAME_REFUSED + " No server found to handle this game" );
+      reply( connection,
+             requestId,
+             GAME_MESSAGE + " " + GAME_REFUSED + " No server found to handle this game" );
    }
 }
 
@@ -407,26 +1962,26 @@ void ConnectionManager::requestGame( ClientConnectionPtr connection,
 //     'SYSTEM_REQUEST_GAME_LIST GameKind'
 //             'SYSTEM_REQUEST_GAME_LIST_RESULT [game]'
 void ConnectionManager::requestGameList( ClientConnectionPtr connection,
-                                         const std::string& gameKind ) const
+                                         const std::string& gameKind,
+                                         RequestId requestId ) const
 {
    std::string responseMessage( SYSTEM_REQUEST_GAME_LIST_RESULT );
 
-   // check if there is avaialble game 
-   for ( GameMap::const_iterator itGame = games.begin();
-         itGame != games.end();
-         itGame++ )
+   // the open games of the kind
+   OpenGameMap::const_iterator itKind = openGames.find( gameKind );
+   if ( itKind != openGames.end() )
    {
-      Game* game = itGame->second;
-
-      // check if the game is of good kind and if there is enough places
-      if (  ( game->getKind() == gameKind )
-          &&( game->placeAvailable() == true )  )
+      for ( GameNumberMap::const_iterator itGame = itKind->second.begin();
+            itGame != itKind->second.end();
+            itGame++ )
       {
-         responseMessage += " " + game->getId();
+         responseMessage += " " + itGame->second->getId();
       }
    }
 
-   connection->sendMessage( responseMessage );
+   reply( connection,
+          requestId,
+          responseMessage );
 }
 
 // join the first non full game
@@ -437,148 +1992,596 @@ void ConnectionManager::requestGameList( ClientConnectionPtr connection,
 //             'SYSTEM_REQUEST_GAME_REFUSED ErrorMessage'
 //             'SYSTEM_REQUEST_GAME_ACCEPTED GameId #Consumer [Consumer]'
 void ConnectionManager::joinOrRequestGame( ClientConnectionPtr connection,
-                                           const std::string& gameKind )
+                                           const std::string& gameKind,
+                                           RequestId requestId )
 {
-   bool gameFound = false;
-
-   // check if there is avaialble game 
-   for ( GameMap::iterator itGame = games.begin();
-         itGame != games.end();
-         itGame++ )
+   // the oldest open game of the kind
+   OpenGameMap::const_iterator itKind = openGames.find( gameKind );
+   if ( itKind != openGames.end() )
    {
-      Game* game = itGame->second;
-
-      // check if the game is of good kind and if there is enough places
-      if (  ( game->getKind() == gameKind )
-          &&( game->placeAvailable() == true )  )
-      {
-         // send the accept message to the client
-         connection->sendMessage( GAME_MESSAGE + " " + GAME_ACCEPTED + " " + game->getId() + " " + gameKind );
-
-         // and quit the function
-         gameFound = true;
-         break;
-      }
+      // send the accept message to the client
+      reply( connection,
+             requestId,
+             GAME_MESSAGE + " " + GAME_ACCEPTED + " " + itKind->second.begin()->second->getId() + " " + gameKind );
    }
-
-   // check if there is a need of a new game
-   if ( gameFound == false )
+   else
    {
+      // no game or all are full, request a new one
       requestGame( connection,
-                   gameKind );
+                   gameKind,
+                   requestId );
    }
 }
 
-// join a known game given its gameId
+// join a known game, run by the shard of the game
+// the game may be gone since the request, it is refused in text if the game id is given, in binary if not
 //     'SYSTEM_JOIN_GAME GameId'
 //          'SYSTEM_JOIN_GAME_REFUSED message'
 void ConnectionManager::joinGame( ClientConnectionPtr connection,
-                                  const std::string& gameId )
+                                  size_t number,
+                                  const std::string& gameId,
+                                  RequestId requestId )
 {
-   // find the game
-   GameMap::iterator itGame = games.find( gameId );
-   if ( itGame != games.end() )
+   // the players change inside the manager mutex too, the indexes of the manager read them
+   boost::mutex::scoped_lock lock( managerMutex );
+
+   // the connection left the manager since the request, its games are already walked
+   if ( connection->isRemoved() == true )
    {
-      Game* game = itGame->second;
+      return;
+   }
 
-      // check if there is enough places
-      if ( game->placeAvailable() == true )
-      {
-         // add the player to the game
-         game->addConsumer( connection );
-      }
-      else
+   Game* game = findGame( number );
+   if ( game == NULL )
+   {
+      if ( gameId.empty() == false )
       {
-         connection->sendMessage( GAME_MESSAGE + " " + GAME_JOIN_REFUSED + " " + gameId + " The game is full" );
+         reply( connection,
+                requestId,
+                GAME_MESSAGE + " " + GAME_JOIN_REFUSED + " " + gameId + " The game is unknown" );
+         return;
       }
+
+      SharedBuffer refusal = BufferPool::getInstance().acquire( 32 );
+      BinaryWriter writer( *refusal );
+      writer.writeOpcode( BinaryProtocol::OP_GAME_JOIN_REFUSED );
+      writer.writeUInt( number );
+      writer.writeString( "The game is unknown" );
+      reply( connection,
+             requestId,
+             SharedMessage( refusal ) );
+      return;
+   }
+
+   // check if there is enough places
+   if ( game->placeAvailable() == true )
+   {
+      // add the player to the game
+      game->addConsumer( connection );
+      setGameOpen( game,
+                   game->placeAvailable() );
+      acknowledge( connection,
+                   requestId );
    }
    else
    {
-      connection->sendMessage( GAME_MESSAGE + " " + GAME_JOIN_REFUSED + " " + gameId + " The game is unknown" );
+      reply( connection,
+             requestId,
+             GAME_MESSAGE + " " + GAME_JOIN_REFUSED + " " + game->getId() + " The game is full" );
    }
 }
 
-// leave a current game given its gameId
+// leave a current game, run by the shard of the game
 //     'SYSTEM_LEAVE_GAME GameId'
 void ConnectionManager::leaveGame( ClientConnectionPtr connection,
-                                   const std::string& gameId )
+                                   size_t number,
+                                   RequestId requestId )
 {
-   // find the game
-   GameMap::iterator itGame = games.find( gameId );
-   if ( itGame != games.end() )
+   // the players change inside the manager mutex too, the indexes of the manager read them
+   boost::mutex::scoped_lock lock( managerMutex );
+
+   // a removed connection leaves its games through removeFromGames
+   Game* game = findGame( number );
+   if (  ( game != NULL )
+       &&( connection->isRemoved() == false )  )
    {
-      Game* game = itGame->second;
       if ( game->remove( connection ) == true )
       {
          // if the connection was the provider, close the game
+         updateProviderLoad( connection );
          game->close( "Provider leave the network" );
-         delete game;
-         games.erase( itGame );
+         destroyGame( game );
       }
       else if ( game->getClients().size() == 0 )
       {
          // if there is no more players
          game->close( "No more players" );
-         delete game;
-         games.erase( itGame );
+         destroyGame( game );
+      }
+      else
+      {
+         // a player left, there is room again
+         setGameOpen( game,
+                      game->placeAvailable() );
       }
    }
+
+   acknowledge( connection,
+                requestId );
 }
 
-// close a current game given its gameId
+// close a current game, run by the shard of the game
 //     'SYSTEM_GAME_CREATION_REFUSED GameId reason'
 void ConnectionManager::closeGame( ClientConnectionPtr connection,
-                                   const std::string& gameId,
-                                   const std::string& reason )
+                                   size_t number,
+                                   const std::string& reason,
+                                   RequestId requestId )
 {
-   // find the game
-   GameMap::iterator itGame = games.find( gameId );
-   if ( itGame != games.end() )
-   {
-      Game* game = itGame->second;
+   boost::mutex::scoped_lock lock( managerMutex );
 
+   Game* game = findGame( number );
+   if ( game != NULL )
+   {
       // and close it
       game->close( reason );
-      delete game;
-      games.erase( itGame );
+      destroyGame( game );
    }
+
+   acknowledge( connection,
+                requestId );
 }
 
-// forward the message to the game given its ID
+// relay the text game message if its id is the one of the game of the number, run by the shard of the game
+// only the shard changes its games, the relay takes no lock
 //     '<gameId> MESSAGE'
+void ConnectionManager::relayGameMessage( ClientConnectionPtr connection,
+                                          size_t number,
+                                          SharedMessage message,
+                                          RequestId requestId )
+{
+   // the number may be the one of a game id of another kind, the whole id is checked in place
+   const std::string& text = *message;
+   size_t idStart = GAME_MESSAGE.size() + 1;
+   size_t idEnd = text.find( ' ', idStart );
+   Game* game = findGame( number );
+   if (  ( game != NULL )
+       &&( text.compare( idStart,
+                         ( idEnd != std::string::npos ) ? idEnd - idStart : std::string::npos,
+                         game->getId() ) == 0 )  )
+   {
+      handleGameMessage( connection,
+                         game,
+                         BroadcastMessage( message ) );
+   }
+   acknowledge( connection,
+                requestId );
+}
+
+// relay the binary game frame to the game of the number, run by the shard of the game
+// only the shard changes its games, the relay takes no lock
+void ConnectionManager::relayBinaryGameMessage( ClientConnectionPtr connection,
+                                                size_t number,
+                                                SharedMessage frame,
+                                                RequestId requestId )
+{
+   Game* game = findGame( number );
+   if ( game != NULL )
+   {
+      handleGameMessage( connection,
+                         game,
+                         BroadcastMessage( frame,
+                                           game->getKind() ) );
+   }
+   acknowledge( connection,
+                requestId );
+}
+
+// remove the removed connection from its games of a shard, run by the shard
+// the games it provided or left empty are closed and the players of all the connections told so
+void ConnectionManager::removeFromGames( ClientConnectionPtr connection,
+                                         const std::vector< size_t >& numbers )
+{
+   boost::mutex::scoped_lock lock( managerMutex );
+
+   std::set< std::string > gameToCloseList;
+   for ( std::vector< size_t >::const_iterator itNumber = numbers.begin();
+         itNumber != numbers.end();
+         itNumber++ )
+   {
+      // get the current game
+      Game* game = findGame( *itNumber );
+      if ( game == NULL )
+      {
+         continue;
+      }
+
+      // remove the connection from the game
+      // and close the game if the connection was the provider or if there is no more players
+      if (  ( game->remove( connection ) == true )
+          ||( game->getClients().size() == 0 )  )
+      {
+         gameToCloseList.insert( game->getId() );
+         destroyGame( game );
+      }
+      else
+      {
+         // a player left, there is room again
+         setGameOpen( game,
+                      game->placeAvailable() );
+      }
+   }
+
+   // check if there is some game to close
+   if ( gameToCloseList.size() > 0 )
+   {
+      // create the close message
+      std::string closeMessage( GAME_MESSAGE + " " + CLOSE_MESSAGE + " " );
+      size_t i = 0;
+      for ( std::set< std::string >::const_iterator it = gameToCloseList.begin();
+            it != gameToCloseList.end();
+            it++ )
+      {
+         closeMessage += *it;
+         if ( i++ < gameToCloseList.size() - 1 )
+         {
+            closeMessage += "|";
+         }
+      }
+      closeMessage += " Client close its connection and end the game" ;
+
+      // and send it to everyone (built once, shared by all the write queues)
+      BroadcastMessage sharedCloseMessage( closeMessage );
+      for ( ClientList::const_iterator itClient = connections.begin();
+            itClient != connections.end();
+            itClient++ )
+      {
+         (*itClient)->sendMessage( sharedCloseMessage );
+      }
+   }
+
+   dumpCurrentState();
+}
+
+// put the connection resuming a session in place of the previous one in its games of a shard, run by the shard
+// the messages parked for the previous connection until then are sent first
+void ConnectionManager::replaceInGames( ClientConnectionPtr previous,
+                                        ClientConnectionPtr connection,
+                                        const std::vector< size_t >& numbers )
+{
+   boost::mutex::scoped_lock lock( managerMutex );
+
+   // the games of the shard relayed to the previous connection until now, their messages go first in order
+   std::vector< SharedMessage > heldMessages;
+   previous->takeParkedMessages( heldMessages );
+   for ( std::vector< SharedMessage >::const_iterator it = heldMessages.begin();
+         it != heldMessages.end();
+         it++ )
+   {
+      connection->sendMessage( *it );
+   }
+
+   for ( std::vector< size_t >::const_iterator itNumber = numbers.begin();
+         itNumber != numbers.end();
+         itNumber++ )
+   {
+      Game* game = findGame( *itNumber );
+      if ( game != NULL )
+      {
+         game->replace( previous,
+                        connection );
+      }
+   }
+}
+
+// send the reply of a request, tagged with its id if any
+//     'SYSTEM_REPLY id <reply>'
+void ConnectionManager::reply( ClientConnectionPtr connection,
+                               RequestId requestId,
+                               const std::string& message ) const
+{
+   if ( requestId == NO_REQUEST_ID )
+   {
+      connection->sendMessage( message );
+      return;
+   }
+
+   std::stringstream stream;
+   stream << SYSTEM_REPLY << " " << requestId << " " << message;
+   connection->sendMessage( stream.str() );
+}
+
+// send the reply of a request already in the binary form, tagged with its id if any
+void ConnectionManager::reply( ClientConnectionPtr connection,
+                               RequestId requestId,
+                               SharedMessage frame ) const
+{
+   if ( requestId == NO_REQUEST_ID )
+   {
+      connection->sendMessage( frame );
+      return;
+   }
+
+   SharedBuffer tagged = BufferPool::getInstance().acquire( frame->size() + 16 );
+   BinaryWriter writer( *tagged );
+   writer.writeOpcode( BinaryProtocol::OP_REPLY );
+   writer.writeUInt( requestId );
+   tagged->append( *frame );
+   connection->sendMessage( SharedMessage( tagged ) );
+}
+
+// tell the request without answer is done, only if it has an id
+//     'SYSTEM_REPLY id SYSTEM_REQUEST_DONE'
+void ConnectionManager::acknowledge( ClientConnectionPtr connection,
+                                     RequestId requestId ) const
+{
+   if ( requestId != NO_REQUEST_ID )
+   {
+      reply( connection,
+             requestId,
+             SYSTEM_REQUEST_DONE );
+   }
+}
+
+// forward the message to the game (NULL if unknown)
+// should be call by a task of the shard of the game
 void ConnectionManager::handleGameMessage( ClientConnectionPtr connection,
-                                           const std::string& gameId,
-                                           const std::string& fullMessage )
+                                           Game* game,
+                                           const BroadcastMessage& message )
 {
-   // find the game
-   GameMap::iterator itGame = games.find( gameId );
-   if ( itGame != games.end() )
+   if ( game != NULL )
    {
-      Game* game = itGame->second;
       game->handleMessage( connection,
-                           fullMessage );
+                           message );
+   }
+}
+
+// find a game given its id, return NULL if unknown
+Game* ConnectionManager::findGame( const std::string& gameId ) const
+{
+   GameMap::const_iterator itGame = games.find( gameId );
+   return ( itGame != games.end() ) ? itGame->second : NULL;
+}
+
+// find a game given its unique number, return NULL if unknown
+// should be call by a task of the shard of the game
+Game* ConnectionManager::findGame( size_t number ) const
+{
+   const GameNumberMap& gamesByNumber = gameShards[ number % GAME_SHARDS ].gamesByNumber;
+   GameNumberMap::const_iterator itGame = gamesByNumber.find( number );
+   return ( itGame != gamesByNumber.end() ) ? itGame->second : NULL;
+}
+
+// get the shard of the games of the number
+ConnectionManager::GameShard& ConnectionManager::getGameShard( size_t number )
+{
+   return gameShards[ number % GAME_SHARDS ];
+}
+
+// queue the task in the shard of the games of the number
+void ConnectionManager::postToShard( size_t number,
+                                     const Task& task )
+{
+   GameShard& shard = getGameShard( number );
+
+   shard.tasksMutex.lock();
+   /*|*/ shard.tasks.push_back().task = task;
+   /*|*/ bool first = ( shard.scheduled == false );
+   /*|*/ shard.scheduled = true;
+   shard.tasksMutex.unlock();
+
+   scheduleShard( shard,
+                  first );
+}
+
+// queue the game message in the shard of its game
+// the message is stored in the ring of the shard, the relay allocates nothing
+void ConnectionManager::postRelayToShard( ClientConnectionPtr connection,
+                                          size_t number,
+                                          SharedMessage message,
+                                          RequestId requestId,
+                                          bool binary )
+{
+   GameShard& shard = getGameShard( number );
+
+   shard.tasksMutex.lock();
+   /*|*/ ShardTask& task = shard.tasks.push_back();
+   /*|*/ task.connection.swap( connection );
+   /*|*/ task.message.swap( message );
+   /*|*/ task.number = number;
+   /*|*/ task.requestId = requestId;
+   /*|*/ task.binary = binary;
+   /*|*/ bool first = ( shard.scheduled == false );
+   /*|*/ shard.scheduled = true;
+   shard.tasksMutex.unlock();
+
+   scheduleShard( shard,
+                  first );
+}
+
+// schedule the shard on the worker pool if the task just queued is the first one
+// outside the tasks mutex as the pool takes its own lock
+void ConnectionManager::scheduleShard( GameShard& shard,
+                                       bool first )
+{
+   if ( first == true )
+   {
+      workerPool.post( boost::bind( &ConnectionManager::runShard,
+                                    &shard ) );
+   }
+}
+
+// run the tasks of the shard in order, reschedule it if there are too many
+void ConnectionManager::runShard( GameShard* shard )
+{
+   ConnectionManager* manager = shard->manager;
+   for ( size_t i = 0;
+         i < SHARD_TASKS_PER_RUN;
+         ++i )
+   {
+      ShardTask task;
+
+      shard->tasksMutex.lock();
+      /*|*/ if ( shard->tasks.empty() == true )
+      /*|*/ {
+      /*|*/    shard->scheduled = false;
+      /*|*/    shard->tasksMutex.unlock();
+      /*|*/    return;
+      /*|*/ }
+      /*|*/ ShardTask& front = shard->tasks.front();
+      /*|*/ task.task.swap( front.task );
+      /*|*/ task.connection.swap( front.connection );
+      /*|*/ task.message.swap( front.message );
+      /*|*/ task.number = front.number;
+      /*|*/ task.requestId = front.requestId;
+      /*|*/ task.binary = front.binary;
+      /*|*/ shard->tasks.pop_front();
+      shard->tasksMutex.unlock();
+
+      if ( task.task )
+      {
+         task.task();
+      }
+      else if ( task.binary == true )
+      {
+         manager->relayBinaryGameMessage( task.connection,
+                                          task.number,
+                                          task.message,
+                                          task.requestId );
+      }
+      else
+      {
+         manager->relayGameMessage( task.connection,
+                                    task.number,
+                                    task.message,
+                                    task.requestId );
+      }
+   }
+
+   // still scheduled, give the worker back to the other shards and connections
+   manager->workerPool.post( boost::bind( &ConnectionManager::runShard,
+                                          shard ) );
+}
+
+// post the handler to the shard of each of the games with the numbers of its games
+void ConnectionManager::postByShard( const std::set< size_t >& numbers,
+                                     const ShardHandler& handler )
+{
+   std::map< size_t, std::vector< size_t > > numbersByShard;
+   for ( std::set< size_t >::const_iterator itNumber = numbers.begin();
+         itNumber != numbers.end();
+         itNumber++ )
+   {
+      numbersByShard[ *itNumber % GAME_SHARDS ].push_back( *itNumber );
+   }
+   for ( std::map< size_t, std::vector< size_t > >::const_iterator itShard = numbersByShard.begin();
+         itShard != numbersByShard.end();
+         itShard++ )
+   {
+      postToShard( itShard->first,
+                   boost::bind( handler,
+                                itShard->second ) );
+   }
+}
+
+// return true if no task of a shard waits or runs
+bool ConnectionManager::areShardsIdle() const
+{
+   for ( size_t i = 0;
+         i < GAME_SHARDS;
+         ++i )
+   {
+      boost::mutex::scoped_lock lock( gameShards[ i ].tasksMutex );
+      if ( gameShards[ i ].scheduled == true )
+      {
+         return false;
+      }
    }
+   return true;
 }
 
-// find the less loaded provider in the list of provider
-ClientConnectionPtr ConnectionManager::findLessLoadedProvider( const ClientList& providers ) const
+// store a new game, its shard knows it once the task posted to it ran
+// the task is queued before any message or request about the game can be
+// should be call inside the manager mutex
+void ConnectionManager::addGame( Game* game )
 {
-   // get the first provider
-   ClientList::iterator itProvider = providers.begin();
-   ClientConnectionPtr lessLoadedProvider = *itProvider;
+   games.insert( GameMap::value_type( game->getId(),
+                                      game ) );
+   postToShard( game->getNumber(),
+                boost::bind( &ConnectionManager::storeGameInShard,
+                             this,
+                             game ) );
+   setGameOpen( game,
+                game->placeAvailable() );
+   updateProviderLoad( game->getProvider() );
+}
+
+// add the game to its shard, run by the shard
+void ConnectionManager::storeGameInShard( Game* game )
+{
+   getGameShard( game->getNumber() ).gamesByNumber.insert( GameNumberMap::value_type( game->getNumber(),
+                                                                                      game ) );
+}
+
+// forget and delete a game
+// should be call by a task of the shard of the game, inside the manager mutex
+void ConnectionManager::destroyGame( Game* game )
+{
+   setGameOpen( game,
+                false );
+   games.erase( game->getId() );
+   getGameShard( game->getNumber() ).gamesByNumber.erase( game->getNumber() );
+   ClientConnectionPtr provider = game->getProvider();
+   delete game;
+   if ( provider != NULL )
+   {
+      updateProviderLoad( provider );
+   }
+}
+
+// put the game in or out of the open games of its kind
+void ConnectionManager::setGameOpen( Game* game,
+                                     bool open )
+{
+   if ( open == true )
+   {
+      openGames[ game->getKind() ].insert( GameNumberMap::value_type( game->getNumber(),
+                                                                      game ) );
+      return;
+   }
 
-   // and found the less loaded
-   while( itProvider != providers.end() )
+   OpenGameMap::iterator itKind = openGames.find( game->getKind() );
+   if ( itKind != openGames.end() )
    {
-      if ( (*itProvider)->getLoad() < lessLoadedProvider->getLoad() )
+      itKind->second.erase( game->getNumber() );
+      if ( itKind->second.size() == 0 )
       {
-         lessLoadedProvider = *itProvider;
+         openGames.erase( itKind );
       }
-      itProvider++;
    }
+}
+
+// find the less loaded provider of the game kind, there must be one
+ClientConnectionPtr ConnectionManager::findLessLoadedProvider( const std::string& gameKind ) const
+{
+   return providersByLoad.find( gameKind )->second.top();
+}
 
-   // return it
-   return lessLoadedProvider;
+// move the provider in the heaps of its kinds after a change of its load
+void ConnectionManager::updateProviderLoad( ClientConnectionPtr provider )
+{
+   const std::set< std::string >& providedKinds = provider->getProvidedKinds();
+   for ( std::set< std::string >::const_iterator itKind = providedKinds.begin();
+         itKind != providedKinds.end();
+         itKind++ )
+   {
+      ProviderHeapMap::iterator itHeap = providersByLoad.find( *itKind );
+      if (  ( itHeap != providersByLoad.end() )
+          &&( itHeap->second.contains( provider ) == true )  )
+      {
+         itHeap->second.set( provider,
+                             provider->getLoad() );
+      }
+   }
 }
 
 // return true if the login:password is valid
@@ -592,6 +2595,8 @@ bool ConnectionManager::isValidLogin( const std::string& login,
 // connectiosn, games ...
 void ConnectionManager::dumpCurrentState() const
 {
+   // built only when the logger writes, it walks the whole state
+#ifdef __DEBUG__
    std::stringstream stream;
    stream << std::endl;
    stream << "----------------------------------------------------------------------------------------" << std::endl;
@@ -600,13 +2605,47 @@ void ConnectionManager::dumpCurrentState() const
    stream << "consumerByGame:  " << consumerByGame.size() << std::endl;
    stream << "providerByGame:  " << providerByGame.size() << std::endl;
    stream << "games:           " << games.size() << std::endl;
+   WorkerPoolStatistics poolStatistics = workerPool.getStatistics();
+   stream << "reactor:         " << getReactorBackendName() << std::endl;
+   HeartbeatStatistics heartbeatStatistics = getHeartbeatStatistics();
+   stream << "sessions:        " << sessions.size() << " (parked: " << parkedSessions.size() << ")" << std::endl;
+   stream << "heartbeat:       " << heartbeatStatistics.watchedConnections << " watched (pings: " << heartbeatStatistics.pings << ", reaped: " << heartbeatStatistics.reapedConnections << ")" << std::endl;
+   AcceptStatistics acceptStatistics = getAcceptStatistics();
+   stream << "accepts:         " << acceptStatistics.acceptedConnections << " (mean rate: " << acceptStatistics.meanAcceptRate << " /s, peak: " << acceptStatistics.peakAcceptRate << " /s, by acceptor:";
+   for ( size_t i = 0;
+         i < acceptStatistics.acceptedByAcceptor.size();
+         ++i )
+   {
+      stream << " " << acceptStatistics.acceptedByAcceptor[ i ];
+   }
+   stream << ")" << std::endl;
+   stream << "workers:         " << poolStatistics.workers << " (queue: " << poolStatistics.queueLength << " / max " << poolStatistics.maxQueueLength << ", executed: " << poolStatistics.executedTasks << ", mean service: " << poolStatistics.meanServiceTime << " us)" << std::endl;
+   BackpressureStatistics backpressureStatistics = closedBackpressureStatistics;
+   for ( ClientList::const_iterator it = connections.begin();
+         it != connections.end();
+         it++ )
+   {
+      backpressureStatistics.add( (*it)->getBackpressureStatistics() );
+   }
+   stream << "backpressure:    " << backpressureStatistics.congestions << " congestions (coalesced: " << backpressureStatistics.coalescedMessages << ", dropped: " << backpressureStatistics.droppedMessages << ", disconnected: " << backpressureStatistics.disconnections << ")" << std::endl;
+   CompressionStatistics compressionStatistics = FrameCompressor::getInstance().getStatistics();
+   stream << "compression:     " << compressionStatistics.compressedFrames << " frames (ratio: " << compressionStatistics.ratio << ", mean time: " << compressionStatistics.meanCompressionTime << " us), " << compressionStatistics.decompressedFrames << " decompressed (mean time: " << compressionStatistics.meanDecompressionTime << " us)" << std::endl;
+   stream << "buffer pool:     hit rate " << BufferPool::getInstance().getHitRate() << std::endl;
+   std::vector< BufferPoolStatistics > bufferStatistics = BufferPool::getInstance().getStatistics();
+   for ( std::vector< BufferPoolStatistics >::const_iterator it = bufferStatistics.begin();
+         it != bufferStatistics.end();
+         it++ )
+   {
+      stream << "\t" << it->bufferSize << " bytes: " << it->acquired << " acquired (hits: " << it->hits << ", free: " << it->freeBuffers << ")" << std::endl;
+   }
    stream << "----------------------------------------------------------------------------------------" << std::endl;
    stream << "CONNECTIONS: " << std::endl;
    for ( ClientList::const_iterator it = connections.begin();
          it != connections.end();
          it++ )
    {
-      stream << "\t" << (*it)->getTechnicalId() << "\t" << (*it)->getLogin() << std::endl;
+      BackpressureStatistics connectionStatistics = (*it)->getBackpressureStatistics();
+      stream << "\t" << (*it)->getTechnicalId() << "\t" << (*it)->getLogin() << "\tin: " << (*it)->getInboundBacklog() << " msg\tout: " << (*it)->getOutboundQueueDepth() << " msg / " << (*it)->getOutboundBytesPending() << " bytes\tcongestions: " << connectionStatistics.congestions << " (coalesced: " << connectionStatistics.coalescedMessages << ", dropped: " << connectionStatistics.droppedMessages << ")" << std::endl;
    }
    stream << "----------------------------------------------------------------------------------------" << std::endl;
    stream << "GAME DEFINITION: " << std::endl;
@@ -665,4 +2704,5 @@ void ConnectionManager::dumpCurrentState() const
    }
    stream << "----------------------------------------------------------------------------------------" << std::endl;
    AsyncLogger::getInstance()->log( stream.str() );
+#endif
 }
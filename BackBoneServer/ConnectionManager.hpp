@@ -1,12 +1,94 @@
 #pragma once 
 
 #include <boost/asio.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/weak_ptr.hpp>
+#include <boost/atomic.hpp>
+#include <boost/chrono.hpp>
+#include <boost/array.hpp>
 #include <set>
+#include <boost/uuid/random_generator.hpp>
 #include "ClientConnection.hpp"
 #include "GameDefinition.hpp"
+#include "ServerSnapshot.hpp"
+#include "network/SocketTuning.hpp"
+#include "thread/WorkerPool.hpp"
+#include "thread/TimerWheel.hpp"
+#include "container/IndexedHeap.hpp"
+#include "container/RingQueue.hpp"
 
 class Game;
 
+// the number of seconds the connections get to drain before a hot restart drops the remaining ones
+// (their sessions are resumed on the new process), then as long again before the restart is aborted
+#define HANDOFF_DRAIN_TIMEOUT 5
+
+// the number of milliseconds between two checks of the drain
+#define HANDOFF_CHECK_INTERVAL 10
+
+// the number of seconds the new process gets to take the handed sockets over
+#define HANDOFF_ACK_TIMEOUT 10
+
+// the number of seconds a process connected on the restart socket gets to ask for the takeover
+#define HANDOFF_REQUEST_TIMEOUT 2
+
+// the number of seconds a new process waits for the sockets (the drain, the forced drain, then the send)
+#define HANDOFF_TAKEOVER_TIMEOUT ( 2 * HANDOFF_DRAIN_TIMEOUT + HANDOFF_ACK_TIMEOUT )
+
+// the number of milliseconds an acceptor pauses after a failed accept (out of descriptors ...)
+// doubled on each failure in a row up to the maximum, an accept resets it
+#define ACCEPT_BACKOFF_MIN 10
+#define ACCEPT_BACKOFF_MAX 100
+
+// the number of parts of the games, each running the game traffic of its games in order on the worker pool
+#define GAME_SHARDS 32
+
+// the number of tasks run by a shard before giving back the worker
+#define SHARD_TASKS_PER_RUN 32
+
+// the detection of the dead connections (half open tcp connections, hung peers ...)
+struct HeartbeatSettings
+{
+   // the number of seconds without message after which a connection is pinged,
+   // it is closed if it stays silent as long again (0 disables the heartbeat)
+   size_t idleTimeout;
+
+   // the number of seconds a connection with a session is kept once its link is lost,
+   // waiting for its client to resume it on a new connection (0 disables the sessions)
+   size_t sessionGrace;
+};
+
+// what the heartbeat did
+struct HeartbeatStatistics
+{
+   // the number of connections followed by the heartbeat
+   size_t watchedConnections;
+
+   // the number of pings sent
+   size_t pings;
+
+   // the number of connections closed as they missed the deadline
+   size_t reapedConnections;
+};
+
+// how fast the connections are accepted, used to size the acceptors for the reconnection storms
+struct AcceptStatistics
+{
+   // the number of tcp and local connections accepted
+   size_t acceptedConnections;
+
+   // the number of tcp connections accepted by each acceptor
+   std::vector< size_t > acceptedByAcceptor;
+
+   // the mean number of connections accepted per second since the first one
+   double meanAcceptRate;
+
+   // the highest number of connections accepted in one second
+   size_t peakAcceptRate;
+};
+
 // this class while listen on the given endpoint, accept the incoming connection
 // and create a ClientConnection for each 
 class ConnectionManager
@@ -17,8 +99,57 @@ class ConnectionManager
 	// the boost reactor
 	boost::asio::io_service& boostReactor;
 
-   // the boost acceptor used to listen on the socket for incoming connection
-	boost::asio::ip::tcp::acceptor connectionAcceptor;
+   // the boost acceptors used to listen on the socket for incoming connection
+   // they are bound on the same endpoint with SO_REUSEPORT so the kernel spreads the incoming connections
+   typedef std::vector< boost::shared_ptr< boost::asio::ip::tcp::acceptor > > AcceptorList;
+	AcceptorList connectionAcceptors;
+
+   // the pause of an acceptor after a failed accept, one per tcp acceptor then one for the local acceptor
+   // each is only used by the completions of its acceptor
+   struct AcceptBackoff
+   {
+      // the timer arming the acceptor again
+      boost::shared_ptr< boost::asio::deadline_timer > timer;
+
+      // the current pause in milliseconds (0 while the accepts succeed)
+      long delay;
+   };
+   std::vector< AcceptBackoff > acceptBackoffs;
+
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+   // the boost acceptor used to listen on the unix domain socket for the peers on the same host (NULL if none)
+   boost::scoped_ptr< boost::asio::local::stream_protocol::acceptor > localAcceptor;
+
+   // the unix domain socket a new process connects to for taking over this one (NULL if none)
+   boost::scoped_ptr< boost::asio::local::stream_protocol::acceptor > restartAcceptor;
+
+   // the link with the new process taking over
+   boost::scoped_ptr< boost::asio::local::stream_protocol::socket > restartLink;
+
+   // the request received on the restart link
+   char restartRequest;
+#endif
+
+   // the path of the restart socket (empty if the hot restart is disabled)
+   std::string restartPath;
+
+   // true while the connections drain before being handed over to a new process
+   boost::atomic< bool > handingOff;
+
+   // true once the connections not drained in time are dropped
+   bool handoffForced;
+
+   // the time the drain gives up
+   boost::chrono::steady_clock::time_point handoffDeadline;
+
+   // the timer checking the drain
+   boost::asio::deadline_timer handoffTimer;
+
+   // the timer closing the restart link if the request does not come
+   boost::asio::deadline_timer restartTimer;
+
+   // the pool of workers handling the received messages
+   WorkerPool workerPool;
 
    // the list of current connection
    ClientList connections;
@@ -29,6 +160,11 @@ class ConnectionManager
    // the list of server indexed by game kind
    ClientAggregat providerByGame;
 
+   // the same servers by load for each game kind, the less loaded on top
+   typedef IndexedHeap< ClientConnectionPtr, size_t > ProviderHeap;
+   typedef std::map< std::string, ProviderHeap > ProviderHeapMap;
+   ProviderHeapMap providersByLoad;
+
    // the list of defined game
    GameDefinitionMap gameDefinitions;
 
@@ -36,13 +172,155 @@ class ConnectionManager
    typedef std::map< std::string, Game* > GameMap;
    GameMap games;
 
+   // the same games indexed by their unique number (the game ids of the binary protocol)
+   typedef std::map< size_t, Game* > GameNumberMap;
+
+   // a work item of a shard: a game message to relay, stored by value so a relay costs no closure,
+   // or any other task about the games of the shard (join, leave, close, removal or replacement of a connection)
+   struct ShardTask
+   {
+      // the task, empty for a relay
+      Task task;
+
+      // the relayed message with its sender, the number of its game and the id of its request
+      ClientConnectionPtr connection;
+      SharedMessage message;
+      size_t number;
+      RequestId requestId;
+
+      // true if the relayed message is a binary frame
+      bool binary;
+   };
+
+   // a part of the games, the ones whose number falls in it, indexed by number
+   // a shard is a mailbox owning its games: they are found, relayed, changed (players) or deleted
+   // only by the tasks posted to it, which run one after the other on the worker pool
+   // the game traffic runs there without any lock, the tasks changing a game also take the manager mutex
+   // for the indexes shared by the shards, so the games can still be read inside the manager mutex
+   struct GameShard
+   {
+      // the manager running the shard
+      ConnectionManager* manager;
+
+      // the tasks waiting for the shard in order, in a ring which stops allocating once it reached the longest backlog
+      RingQueue< ShardTask > tasks;
+
+      // true while the shard is scheduled on the worker pool
+      bool scheduled;
+
+      // the mutex of the tasks (not of the games)
+      mutable boost::mutex tasksMutex;
+
+      // the games of the shard
+      GameNumberMap gamesByNumber;
+   };
+   boost::array< GameShard, GAME_SHARDS > gameShards;
+
+   // the games with room for a player indexed by kind then by number, the oldest first
+   typedef std::map< std::string, GameNumberMap > OpenGameMap;
+   OpenGameMap openGames;
+
+   // the limits of the outbound queue of each connection
+   BackpressureSettings backpressureSettings;
+
+   // how often the overflow policies fired for the closed connections
+   BackpressureStatistics closedBackpressureStatistics;
+
+   // the socket options of the accepted connections, switched to the provider ones on registration
+   SocketProfile consumerProfile;
+   SocketProfile providerProfile;
+
+   // the detection of the dead connections
+   HeartbeatSettings heartbeatSettings;
+
+   // the timer moving the heartbeat every second
+   boost::asio::deadline_timer heartbeatTimer;
+
+   // the time of the tick 0 of the heartbeat
+   boost::chrono::steady_clock::time_point heartbeatStart;
+
+   // the current tick of the heartbeat (seconds since heartbeatStart), read by the reactor threads
+   boost::atomic< boost::uint64_t > heartbeatTick;
+
+   // the connections indexed by the tick of their next check
+   // the wheel does not keep the connections alive, a closed connection leaves at its next check
+   TimerWheel< boost::weak_ptr< ClientConnection > > heartbeatWheel;
+
+   // heartbeat statistics
+   size_t pings;
+   size_t reapedConnections;
+
+   // the mutex of the wheel and the heartbeat statistics
+   mutable boost::mutex heartbeatMutex;
+
+   // the connections with a session indexed by their token
+   typedef std::map< std::string, ClientConnectionPtr > SessionMap;
+   SessionMap sessions;
+
+   // the tokens of the sessions whose link is lost with the tick they expire at
+   std::map< std::string, boost::uint64_t > parkedSessions;
+
+   // the generator of the session tokens, used inside the manager mutex
+   boost::uuids::random_generator sessionGenerator;
+
+   // accept statistics
+   std::vector< size_t > acceptedByAcceptor;
+   size_t acceptedConnections;
+   boost::chrono::steady_clock::time_point firstAccept;
+   boost::chrono::steady_clock::time_point currentSecond;
+   size_t acceptedInCurrentSecond;
+   size_t peakAcceptRate;
+
+   // the mutex of the accept statistics, the acceptors complete on any reactor thread
+   mutable boost::mutex acceptMutex;
+
+   // the mutex of the manager state
+   // the messages are handled on many threads (reactor pool and message threads)
+   // the game traffic runs on the shards without it
+   // a task of a shard may take it but the manager never waits for a shard
+   boost::mutex managerMutex;
+
 public:
 	// ctor with the used information
+   // the manager also listens on the unix domain socket localPath if it is not empty
+   // a manager with a restartPath takes over the process listening on it (listening sockets, connections and games)
+   // then listens on it for the next one, it starts empty if no process listens
+   // the accepted tcp sockets get the consumer profile, then the provider one when they register as provider
+   // numberOfAcceptors acceptors listen on the endpoint (a single one where SO_REUSEPORT does not exist)
 	ConnectionManager( boost::asio::io_service&              boostReactor, 
-					       const boost::asio::ip::tcp::endpoint& endpoint );
+					       const boost::asio::ip::tcp::endpoint& endpoint,
+                      size_t                                numberOfAcceptors,
+                      size_t                                numberOfWorkers,
+                      const BackpressureSettings&           backpressureSettings,
+                      const HeartbeatSettings&              heartbeatSettings,
+                      const std::string&                    localPath = std::string(),
+                      const std::string&                    restartPath = std::string(),
+                      const SocketProfile&                  consumerProfile = SocketTuning::getConsumerProfile(),
+                      const SocketProfile&                  providerProfile = SocketTuning::getProviderProfile() );
+
+   // get the pool of workers handling the received messages
+   WorkerPool& getWorkerPool();
+
+   // return true if no task of a shard of the games waits or runs
+   bool areShardsIdle() const;
+
+   // get the limits of the outbound queue of each connection
+   const BackpressureSettings& getBackpressureSettings() const;
+
+   // get how fast the connections are accepted
+   AcceptStatistics getAcceptStatistics() const;
+
+   // get the current tick of the heartbeat
+   boost::uint64_t getHeartbeatTick() const;
+
+   // get what the heartbeat did
+   HeartbeatStatistics getHeartbeatStatistics() const;
 		
-	// used to wait for an incoming connection
-	void waitForConnection();
+	// used to wait for an incoming connection on an acceptor
+	void waitForConnection( size_t acceptorIndex );
+
+   // used to wait for an incoming connection on the unix domain socket
+   void waitForLocalConnection();
 
    // used to handle message from a ClientConnection
    // those message can be 
@@ -53,11 +331,23 @@ public:
    //     'SYSTEM_JOIN_GAME GameId'
    //     'SYSTEM_LEAVE_GAME GameId'
    //     '<gameId> MESSAGE'
+   // each of them may be sent in a request with an id, echoed in its reply
+   //     'SYSTEM_REQUEST id <message>'
+   //             'SYSTEM_REPLY id <reply>'
    void handleMessage( ClientConnectionPtr connection,
-                       const std::string& message );
+                       SharedMessage message,
+                       RequestId requestId = NO_REQUEST_ID );
+
+   // used to handle a binary frame from a ClientConnection which negotiated the binary protocol
+   // the frames are the same messages as handleMessage ones read directly from the opcode
+   void handleBinaryMessage( ClientConnectionPtr connection,
+                             SharedMessage frame,
+                             RequestId requestId = NO_REQUEST_ID );
 
    // close an dremove a ClientConnection
-   void closeConnection( ClientConnectionPtr connection );
+   // a connection with a session whose link is lost (linkLost) is only parked until it is resumed or expires
+   void closeConnection( ClientConnectionPtr connection,
+                         bool linkLost = false );
 
    // return true if the login:password is valid
    bool isValidLogin( const std::string& login,
@@ -69,13 +359,103 @@ private:
    //-------------
 
 	// handle call when a connection is accepted on the socket
+   // the acceptor index is the one of the tcp acceptor, ignored for the local connections
 	void handle_accept( const boost::system::error_code&  error,
-						     connection_ptr                    connection );
+						     connection_ptr                    connection,
+                       size_t                            acceptorIndex );
+
+   // arm the acceptor of the backoff index again (the tcp acceptor of the index or the local acceptor after them)
+   // nothing is done while the connections are handed over
+   void acceptNext( size_t backoffIndex );
+
+   // arm the acceptor again once its pause after a failed accept is over
+   void handleAcceptBackoff( const boost::system::error_code& error,
+                             size_t                           backoffIndex );
+
+   // follow the activity of a new connection
+   void watchConnection( ClientConnectionPtr connection );
+
+   // move the heartbeat to the current tick, ping the idle connections and close the silent ones
+   void handleHeartbeat( const boost::system::error_code& error );
+
+   // wait for the next tick of the heartbeat
+   void waitForHeartbeat();
+
+   // take the sockets and the state over from the process listening on the restart path
+   // return false if no process listens, throw if the handoff breaks
+   bool takeOver( const boost::asio::ip::tcp::endpoint& endpoint,
+                  const std::string& localPath );
+
+   // rebuild the connections, the lists and the games of the snapshot on the handed descriptors
+   void restoreSnapshot( const ServerSnapshot& snapshot,
+                         std::vector< int >& descriptors );
+
+   // wait for a new process on the restart path
+   void waitForRestart();
+
+   // handle a process connected on the restart socket, check its user and wait for its request
+   void handleRestart( const boost::system::error_code& error );
+
+   // handle the request of a new process to take over, stop accepting and drain the connections
+   void handleRestartRequest( const boost::system::error_code& error );
+
+   // close the restart link of a process which did not ask in time
+   void handleRestartTimeout( const boost::system::error_code& error );
+
+   // check the connections are drained, then hand them over
+   // drop the ones not drained in time, then abort the restart
+   void checkHandoff( const boost::system::error_code& error );
+
+   // send the sockets and the snapshot to the new process and stop once it took them over
+   void completeHandoff();
+
+   // go back to work after a failed handoff
+   void abortHandoff();
+
+   // get the connections to hand over, the registered ones and the ones with a session
+   void getHandedConnections( ClientList& handed );
+
+   // fill the snapshot of the drained manager and the list of descriptors to hand over
+   // should be call inside the manager mutex
+   void takeSnapshot( ServerSnapshot& snapshot,
+                      std::vector< int >& descriptors );
+
+   // count an accepted connection in the statistics
+   void countAccept( connection_ptr connection,
+                     size_t acceptorIndex );
+
+   // give a session token to the connection
+   //     'SYSTEM_OPEN_SESSION'
+   //             'SYSTEM_SESSION token' or 'SYSTEM_SESSION_EXPIRED'
+   void openSession( ClientConnectionPtr connection,
+                     RequestId requestId );
+
+   // move the session of the token to the connection
+   //     'SYSTEM_RESUME_SESSION token'
+   //             'SYSTEM_SESSION token' followed by the held messages or 'SYSTEM_SESSION_EXPIRED'
+   void resumeSession( ClientConnectionPtr connection,
+                       const std::string& token,
+                       RequestId requestId );
+
+   // keep the connection with its games until its session is resumed or expires
+   // return false if the connection has no session
+   bool parkConnection( ClientConnectionPtr connection );
+
+   // close the parked sessions not resumed in the grace window
+   void expireSessions( boost::uint64_t now );
+
+   // put the connection in place of the previous one in the games and the lists
+   void replaceConnection( ClientConnectionPtr previous,
+                           ClientConnectionPtr connection );
+
+   // remove the connection from the games and the lists, closing the games it provides
+   void removeConnection( ClientConnectionPtr connection );
 
    // register a new connection on consumer or provider of game
    //     'SYSTEM_REGISTER <CONSUMER | PROVIDER> #Game [Game]' --> no answer
    void registerConnection( ClientConnectionPtr connection,
-                            const std::string& message );
+                            const std::vector< std::string >& messageParts,
+                            RequestId requestId );
 
    // request a game to the server given its kind
    // respond to the connection
@@ -83,14 +463,16 @@ private:
    //             'SYSTEM_REQUEST_GAME_REFUSED ErrorMessage'
    //             'SYSTEM_REQUEST_GAME_ACCEPTED GameId #Consumer [Consumer]'
    void requestGame( ClientConnectionPtr connection,
-                     const std::string& gameKind );
+                     const std::string& gameKind,
+                     RequestId requestId );
 
    // request a list of game to the server given its kind
    // respond to the connection
    //     'SYSTEM_REQUEST_GAME_LIST GameKind'
    //             'SYSTEM_REQUEST_GAME_LIST_RESULT [game]'
    void requestGameList( ClientConnectionPtr connection,
-                         const std::string& gameKind ) const;
+                         const std::string& gameKind,
+                         RequestId requestId ) const;
 
    // join the first non full game
    // or request a game to the server given its kind if no game exist or all is full
@@ -100,33 +482,131 @@ private:
    //             'SYSTEM_REQUEST_GAME_REFUSED ErrorMessage'
    //             'SYSTEM_REQUEST_GAME_ACCEPTED GameId #Consumer [Consumer]'
    void joinOrRequestGame( ClientConnectionPtr connection,
-                           const std::string& gameKind );
+                           const std::string& gameKind,
+                           RequestId requestId );
 
-   // join a known game given its gameId
+   // join a known game, run by the shard of the game
+   // the game may be gone since the request, it is refused in text if the game id is given, in binary if not
    //     'SYSTEM_JOIN_GAME GameId'
    //          'SYSTEM_JOIN_GAME_REFUSED message'
    void joinGame( ClientConnectionPtr connection,
-                  const std::string& gameId );
+                  size_t number,
+                  const std::string& gameId,
+                  RequestId requestId );
 
-   // leave a current game given its gameId
+   // leave a current game, run by the shard of the game
    //     'SYSTEM_LEAVE_GAME GameId'
    void leaveGame( ClientConnectionPtr connection,
-                   const std::string& gameId );
+                   size_t number,
+                   RequestId requestId );
 
-   // close a current game given its gameId
+   // close a current game, run by the shard of the game
    //     'SYSTEM_GAME_CREATION_REFUSED GameId reason'
    void closeGame( ClientConnectionPtr connection,
-                   const std::string& gameId,
-                   const std::string& reason );
+                   size_t number,
+                   const std::string& reason,
+                   RequestId requestId );
 
-   // forward the message to the game given its ID
+   // relay the text game message if its id is the one of the game of the number, run by the shard of the game
    //     '<gameId> MESSAGE'
+   void relayGameMessage( ClientConnectionPtr connection,
+                          size_t number,
+                          SharedMessage message,
+                          RequestId requestId );
+
+   // relay the binary game frame to the game of the number, run by the shard of the game
+   void relayBinaryGameMessage( ClientConnectionPtr connection,
+                                size_t number,
+                                SharedMessage frame,
+                                RequestId requestId );
+
+   // forward the message to the game (NULL if unknown)
+   // should be call by a task of the shard of the game
    void handleGameMessage( ClientConnectionPtr connection,
-                           const std::string& gameId,
-                           const std::string& fullMessage );
+                           Game* game,
+                           const BroadcastMessage& message );
+
+   // remove the removed connection from its games of a shard, run by the shard
+   // the games it provided or left empty are closed and the players of all the connections told so
+   void removeFromGames( ClientConnectionPtr connection,
+                         const std::vector< size_t >& numbers );
+
+   // put the connection resuming a session in place of the previous one in its games of a shard, run by the shard
+   // the messages parked for the previous connection until then are sent first
+   void replaceInGames( ClientConnectionPtr previous,
+                        ClientConnectionPtr connection,
+                        const std::vector< size_t >& numbers );
+
+   // send the reply of a request, tagged with its id if any
+   //     'SYSTEM_REPLY id <reply>'
+   void reply( ClientConnectionPtr connection,
+               RequestId requestId,
+               const std::string& message ) const;
+
+   // send the reply of a request already in the binary form, tagged with its id if any
+   void reply( ClientConnectionPtr connection,
+               RequestId requestId,
+               SharedMessage frame ) const;
+
+   // tell the request without answer is done, only if it has an id
+   //     'SYSTEM_REPLY id SYSTEM_REQUEST_DONE'
+   void acknowledge( ClientConnectionPtr connection,
+                     RequestId requestId ) const;
+
+   // find a game given its id, return NULL if unknown
+   Game* findGame( const std::string& gameId ) const;
+
+   // find a game given its unique number, return NULL if unknown
+   // should be call by a task of the shard of the game
+   Game* findGame( size_t number ) const;
+
+   // get the shard of the games of the number
+   GameShard& getGameShard( size_t number );
+
+   // queue the task in the shard of the games of the number
+   void postToShard( size_t number,
+                     const Task& task );
+
+   // queue the game message in the shard of its game, relayed there by relayGameMessage or relayBinaryGameMessage
+   void postRelayToShard( ClientConnectionPtr connection,
+                          size_t number,
+                          SharedMessage message,
+                          RequestId requestId,
+                          bool binary );
+
+   // schedule the shard on the worker pool if the task just queued is the first one
+   // the task given to the pool is a function with the shard, it fits in the buffer of a Task
+   void scheduleShard( GameShard& shard,
+                       bool first );
+
+   // run the tasks of the shard in order, reschedule it if there are too many
+   static void runShard( GameShard* shard );
+
+   // post the handler to the shard of each of the games with the numbers of its games
+   typedef boost::function< void ( const std::vector< size_t >& ) > ShardHandler;
+   void postByShard( const std::set< size_t >& numbers,
+                     const ShardHandler& handler );
+
+   // store a new game, its shard knows it once the task posted to it ran
+   // should be call inside the manager mutex
+   void addGame( Game* game );
+
+   // add the game to its shard, run by the shard
+   void storeGameInShard( Game* game );
+
+   // forget and delete a game
+   // should be call by a task of the shard of the game, inside the manager mutex
+   void destroyGame( Game* game );
+
+   // put the game in or out of the open games of its kind
+   void setGameOpen( Game* game,
+                     bool open );
+
+   // find the less loaded provider of the game kind, there must be one
+   ClientConnectionPtr findLessLoadedProvider( const std::string& gameKind ) const;
 
-   // find the less loaded provider in the list of provider
-   ClientConnectionPtr findLessLoadedProvider( const ClientList& providers ) const;
+   // move the provider in the heaps of its kinds after a change of its load
+   void updateProviderLoad( ClientConnectionPtr provider );
 
    // display on std::cout the current state of the provider
    // connectiosn, games ...
@@ -5,14 +5,15 @@
 
 // unique identifier creation
 static size_t uniqueIdentifier = 0;
-static std::string createUniqueId( const std::string& name )
+static std::string createUniqueId( const std::string& name,
+                                   size_t number )
 {
    char tmp[1024];
    sprintf_s( tmp,
               1024,
               "%s_%d",
               name.c_str(),
-              uniqueIdentifier++ );
+              number );
    return std::string( tmp );
 }
 
@@ -20,12 +21,39 @@ static std::string createUniqueId( const std::string& name )
 Game::Game( const GameDefinition& gameDefinition,
             ClientConnectionPtr provider )
 :
+   number( uniqueIdentifier++ ),
+   id( createUniqueId( gameDefinition.kind,
+                       number ) ),
    gameDefinition( gameDefinition ),
-   id( createUniqueId( gameDefinition.kind ) ),
    provider( provider ),
    consumers()
 {
    provider->incLoad();
+   provider->addGame( number );
+}
+
+// create a game handed over by the previous process with its number, its provider and its consumers
+// nothing is sent, the peers already know the game
+Game::Game( size_t number,
+            const GameDefinition& gameDefinition,
+            ClientConnectionPtr provider,
+            const ClientList& consumers )
+:
+   number( number ),
+   id( createUniqueId( gameDefinition.kind,
+                       number ) ),
+   gameDefinition( gameDefinition ),
+   provider( provider ),
+   consumers( consumers )
+{
+   provider->incLoad();
+   provider->addGame( number );
+   for( ClientList::const_iterator itConsumer = consumers.begin();
+        itConsumer != consumers.end();
+        itConsumer++ )
+   {
+      (*itConsumer)->addGame( number );
+   }
 }
 
 // dtor
@@ -34,23 +62,49 @@ Game::~Game()
    if ( provider != NULL )
    {
       provider->decLoad();
+      provider->removeGame( number );
       provider = NULL;
    }
+   for( ClientList::const_iterator itConsumer = consumers.begin();
+        itConsumer != consumers.end();
+        itConsumer++ )
+   {
+      (*itConsumer)->removeGame( number );
+   }
    consumers.clear();
 }
 
+// get the number of the next game
+size_t Game::getNextNumber()
+{
+   return uniqueIdentifier;
+}
+
+// set the number of the next game (taken from the previous process so the ids stay unique)
+void Game::setNextNumber( size_t number )
+{
+   uniqueIdentifier = number;
+}
+
 // get the id of the game
 const std::string& Game::getId() const
 {
    return id;
 }
 
+// get the unique number of the game
+size_t Game::getNumber() const
+{
+   return number;
+}
+
 // add consumer
 void Game::addConsumer( ClientConnectionPtr consumer )
 {
    if ( consumers.find( consumer ) == consumers.end() )
    {
       consumers.insert( consumer );
+      consumer->addGame( number );
 
       // send the add consumer message to the provider
       provider->sendMessage( GAME_MESSAGE + " " + id + " " + PLAYER_JOIN_MESSAGE + " " + consumer->getLogin() );
@@ -59,17 +113,12 @@ void Game::addConsumer( ClientConnectionPtr consumer )
 
 // handle communication forward from P to C* or from C to S
 void Game::handleMessage( ClientConnectionPtr connection,
-                          const std::string& message )
+                          const BroadcastMessage& message )
 {
    if ( connection == provider )
    {
       // forward to all clients
-      for( ClientList::iterator itConsumer = consumers.begin();
-           itConsumer != consumers.end();
-           itConsumer++ )
-      {
-         (*itConsumer)->sendMessage( message );
-      }
+      broadcast( message );
    }
    else
    {
@@ -88,18 +137,7 @@ bool Game::contains( ClientConnectionPtr connection ) const
    }
    
    // check the consumers
-   for( ClientList::iterator itConsumer = consumers.begin();
-         itConsumer != consumers.end();
-         itConsumer++ )
-   {
-      if ( *itConsumer == connection )
-      {
-         return true;
-      }
-   }
-
-   // none found
-   return false;
+   return ( consumers.find( connection ) != consumers.end() );
 }
 
 // remove the connection from the game and return true if the connection was the provider
@@ -109,43 +147,65 @@ bool Game::remove( ClientConnectionPtr connection )
    {
       // don't delete the provider as we aren't the owners, the connection manager is
       provider->decLoad();
+      provider->removeGame( number );
       provider = NULL;
       return true;
    }
    
    // check the consumers
-   for( ClientList::iterator itConsumer = consumers.begin();
-         itConsumer != consumers.end();
-         itConsumer++ )
+   if ( consumers.erase( connection ) > 0 )
    {
-      if ( *itConsumer == connection )
-      {
-         consumers.erase( itConsumer );
+      connection->removeGame( number );
 
-         // send the add consumer message to the provider
-         provider->sendMessage( GAME_MESSAGE + " " + id + " " + PLAYER_LEAVE_MESSAGE + " " + connection->getLogin() );
-
-         break;
-      }
+      // send the leave consumer message to the provider
+      provider->sendMessage( GAME_MESSAGE + " " + id + " " + PLAYER_LEAVE_MESSAGE + " " + connection->getLogin() );
    }
    return false;
 }
 
+// put the connection resuming a session in place of the previous one, the load of the provider moves with the session
+// the manager already moved the game from the games of the previous connection to the ones of the new connection
+void Game::replace( ClientConnectionPtr previous,
+                    ClientConnectionPtr connection )
+{
+   if ( provider == previous )
+   {
+      provider = connection;
+   }
+   else if ( consumers.erase( previous ) > 0 )
+   {
+      consumers.insert( connection );
+   }
+}
+
 // close the game, ie send the close message to all consumers and to the provider
 void Game::close( const std::string& reason )
 {
+   BroadcastMessage closeMessage( GAME_MESSAGE + " " + CLOSE_MESSAGE + " " + id + " " + reason );
+
    // close the provider if any 
    if ( provider != NULL )
    {
-      provider->sendMessage( GAME_MESSAGE + " " + CLOSE_MESSAGE + " " + id + " " + reason );
+      provider->sendMessage( closeMessage );
    }
 
-   // close the consumers
-   for( ClientList::iterator itConsumer = consumers.begin();
-         itConsumer != consumers.end();
-         itConsumer++ )
+   // close the consumers (the close message is never held by the overflow policy)
+   for( ClientList::const_iterator itConsumer = consumers.begin();
+        itConsumer != consumers.end();
+        itConsumer++ )
+   {
+      (*itConsumer)->sendMessage( closeMessage );
+   }
+}
+
+// send the message to all consumers, each form of the message is built once and shared
+void Game::broadcast( const BroadcastMessage& message ) const
+{
+   for( ClientList::const_iterator itConsumer = consumers.begin();
+        itConsumer != consumers.end();
+        itConsumer++ )
    {
-      (*itConsumer)->sendMessage( GAME_MESSAGE + " " + CLOSE_MESSAGE + " " + id + " " + reason );
+      (*itConsumer)->sendGameMessage( message );
    }
 }
 
@@ -6,6 +6,9 @@
 // a game representation from the server PoV
 class Game
 {
+   // the unique number of the game (used as id by the binary protocol)
+   size_t number;
+
    // the identifier
    std::string id;
 
@@ -23,18 +26,35 @@ public:
    Game( const GameDefinition& gameDefinition,
          ClientConnectionPtr provider );
 
+   // create a game handed over by the previous process with its number, its provider and its consumers
+   // nothing is sent, the peers already know the game
+   Game( size_t number,
+         const GameDefinition& gameDefinition,
+         ClientConnectionPtr provider,
+         const ClientList& consumers );
+
    // dtor
    ~Game();
 
+   // get the number of the next game
+   static size_t getNextNumber();
+
+   // set the number of the next game (taken from the previous process so the ids stay unique)
+   static void setNextNumber( size_t number );
+
    // get the id of the game
    const std::string& getId() const;
 
+   // get the unique number of the game
+   size_t getNumber() const;
+
    // add consumer
    void addConsumer( ClientConnectionPtr consumer );
 
    // handle communication forward from P to C* or from C to S
+   // each peer receives the message in its protocol, a binary frame goes as is to the binary peers
    void handleMessage( ClientConnectionPtr connection,
-                       const std::string& message );
+                       const BroadcastMessage& message );
 
    // return true if the game use the connection
    bool contains( ClientConnectionPtr connection ) const;
@@ -42,9 +62,18 @@ public:
    // remove the connection from the game and return true if the connection was the provider
    bool remove( ClientConnectionPtr connection );
 
+   // put the connection resuming a session in place of the previous one, the load of the provider moves with the session
+   // the manager moves the game in the games of the connections
+   void replace( ClientConnectionPtr previous,
+                 ClientConnectionPtr connection );
+
    // close the game, ie send the close message to all consumers and to the provider
    void close( const std::string& reason );
 
+   // send the message to all consumers, each form of the message is built once and shared
+   // a slow consumer gets the message according to the overflow policy
+   void broadcast( const BroadcastMessage& message ) const;
+
    // return true if there is still some room for a player in the game
    bool placeAvailable() const;
 
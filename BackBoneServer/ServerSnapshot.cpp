@@ -0,0 +1,226 @@
+#define _WIN32_WINNT 0x0501
+
+#include "ServerSnapshot.hpp"
+#include "network/BinaryProtocol.hpp"
+
+// the header of a snapshot, a new process refuses the snapshot of another version
+static const std::string SNAPSHOT_MAGIC( "BACKBONE_SNAPSHOT" );
+static const boost::uint64_t SNAPSHOT_VERSION = 1;
+
+// write a list of strings with its size
+static void writeStrings( BinaryWriter& writer,
+                          const std::vector< std::string >& values )
+{
+   writer.writeUInt( values.size() );
+   for ( size_t i = 0;
+         i < values.size();
+         ++i )
+   {
+      writer.writeString( values[ i ] );
+   }
+}
+
+// read a list of strings written by writeStrings
+static void readStrings( BinaryReader& reader,
+                         std::vector< std::string >& values )
+{
+   size_t count = static_cast< size_t >( reader.readUInt() );
+   for ( size_t i = 0;
+         (  ( i < count )
+          &&( reader.isValid() == true )  );
+         ++i )
+   {
+      values.push_back( reader.readString() );
+   }
+}
+
+// write the lists of an aggregat
+static void writeAggregat( BinaryWriter& writer,
+                           const ServerSnapshot::Aggregat& aggregat )
+{
+   writer.writeUInt( aggregat.size() );
+   for ( ServerSnapshot::Aggregat::const_iterator it = aggregat.begin();
+         it != aggregat.end();
+         it++ )
+   {
+      writer.writeString( it->first );
+      writeStrings( writer,
+                    it->second );
+   }
+}
+
+// read the lists of an aggregat written by writeAggregat
+static void readAggregat( BinaryReader& reader,
+                          ServerSnapshot::Aggregat& aggregat )
+{
+   size_t count = static_cast< size_t >( reader.readUInt() );
+   for ( size_t i = 0;
+         (  ( i < count )
+          &&( reader.isValid() == true )  );
+         ++i )
+   {
+      std::string kind = reader.readString();
+      readStrings( reader,
+                   aggregat[ kind ] );
+   }
+}
+
+// an empty snapshot
+ServerSnapshot::ServerSnapshot()
+:
+   tcpListeners( 0 ),
+   localListener( false ),
+   nextGameNumber( 0 ),
+   nextClientNumber( 0 ),
+   gameDefinitions(),
+   connections(),
+   consumerByGame(),
+   providerByGame(),
+   games()
+{
+}
+
+// write the snapshot at the end of out
+void ServerSnapshot::write( std::string& out ) const
+{
+   BinaryWriter writer( out );
+   writer.writeString( SNAPSHOT_MAGIC );
+   writer.writeUInt( SNAPSHOT_VERSION );
+
+   writer.writeUInt( tcpListeners );
+   writer.writeUInt( localListener ? 1 : 0 );
+   writer.writeUInt( nextGameNumber );
+   writer.writeUInt( nextClientNumber );
+
+   writer.writeUInt( gameDefinitions.size() );
+   for ( std::vector< GameDefinition >::const_iterator it = gameDefinitions.begin();
+         it != gameDefinitions.end();
+         it++ )
+   {
+      writer.writeString( it->kind );
+      writer.writeUInt( it->minPlayer );
+      writer.writeUInt( it->maxPlayer );
+      writer.writeUInt( it->iaAvailable ? 1 : 0 );
+   }
+
+   writer.writeUInt( connections.size() );
+   for ( std::vector< ConnectionSnapshot >::const_iterator it = connections.begin();
+         it != connections.end();
+         it++ )
+   {
+      writer.writeString( it->technicalId );
+      writer.writeString( it->login );
+      writer.writeUInt( it->state );
+      writer.writeUInt( it->binaryProtocol ? 1 : 0 );
+      writer.writeUInt( it->compression ? 1 : 0 );
+      writer.writeUInt( it->framingMode );
+      writer.writeUInt( it->transport );
+      writer.writeString( it->unreadInput );
+      writer.writeUInt( it->registered ? 1 : 0 );
+      writer.writeString( it->sessionToken );
+      writer.writeUInt( it->parked ? 1 : 0 );
+      writeStrings( writer,
+                    it->parkedMessages );
+      writer.writeUInt( it->parkedOverflow ? 1 : 0 );
+      writer.writeUInt( it->sessionGraceLeft );
+      writer.writeUInt( it->descriptor );
+   }
+
+   writeAggregat( writer,
+                  consumerByGame );
+   writeAggregat( writer,
+                  providerByGame );
+
+   writer.writeUInt( games.size() );
+   for ( std::vector< GameSnapshot >::const_iterator it = games.begin();
+         it != games.end();
+         it++ )
+   {
+      writer.writeUInt( it->number );
+      writer.writeString( it->kind );
+      writer.writeString( it->provider );
+      writeStrings( writer,
+                    it->consumers );
+   }
+}
+
+// read the snapshot written by write, return false if it is not valid
+bool ServerSnapshot::read( const std::string& in )
+{
+   BinaryReader reader( in );
+   if (  ( reader.readString() != SNAPSHOT_MAGIC )
+       ||( reader.readUInt() != SNAPSHOT_VERSION )  )
+   {
+      return false;
+   }
+
+   tcpListeners = static_cast< size_t >( reader.readUInt() );
+   localListener = ( reader.readUInt() != 0 );
+   nextGameNumber = static_cast< size_t >( reader.readUInt() );
+   nextClientNumber = static_cast< size_t >( reader.readUInt() );
+
+   size_t count = static_cast< size_t >( reader.readUInt() );
+   for ( size_t i = 0;
+         (  ( i < count )
+          &&( reader.isValid() == true )  );
+         ++i )
+   {
+      std::string kind = reader.readString();
+      int minPlayer = static_cast< int >( reader.readUInt() );
+      int maxPlayer = static_cast< int >( reader.readUInt() );
+      int iaAvailable = static_cast< int >( reader.readUInt() );
+      gameDefinitions.push_back( GameDefinition( kind,
+                                                 minPlayer,
+                                                 maxPlayer,
+                                                 iaAvailable ) );
+   }
+
+   count = static_cast< size_t >( reader.readUInt() );
+   for ( size_t i = 0;
+         (  ( i < count )
+          &&( reader.isValid() == true )  );
+         ++i )
+   {
+      connections.push_back( ConnectionSnapshot() );
+      ConnectionSnapshot& connection = connections.back();
+      connection.technicalId = reader.readString();
+      connection.login = reader.readString();
+      connection.state = static_cast< int >( reader.readUInt() );
+      connection.binaryProtocol = ( reader.readUInt() != 0 );
+      connection.compression = ( reader.readUInt() != 0 );
+      connection.framingMode = static_cast< int >( reader.readUInt() );
+      connection.transport = static_cast< int >( reader.readUInt() );
+      connection.unreadInput = reader.readString();
+      connection.registered = ( reader.readUInt() != 0 );
+      connection.sessionToken = reader.readString();
+      connection.parked = ( reader.readUInt() != 0 );
+      readStrings( reader,
+                   connection.parkedMessages );
+      connection.parkedOverflow = ( reader.readUInt() != 0 );
+      connection.sessionGraceLeft = reader.readUInt();
+      connection.descriptor = static_cast< size_t >( reader.readUInt() );
+   }
+
+   readAggregat( reader,
+                 consumerByGame );
+   readAggregat( reader,
+                 providerByGame );
+
+   count = static_cast< size_t >( reader.readUInt() );
+   for ( size_t i = 0;
+         (  ( i < count )
+          &&( reader.isValid() == true )  );
+         ++i )
+   {
+      games.push_back( GameSnapshot() );
+      GameSnapshot& game = games.back();
+      game.number = static_cast< size_t >( reader.readUInt() );
+      game.kind = reader.readString();
+      game.provider = reader.readString();
+      readStrings( reader,
+                   game.consumers );
+   }
+
+   return (  ( reader.isValid() == true )
+           &&( reader.hasMore() == false )  );
+}
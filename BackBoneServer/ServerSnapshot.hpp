@@ -0,0 +1,105 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <boost/cstdint.hpp>
+#include "GameDefinition.hpp"
+
+// the state of a connection handed over to the next process on a hot restart
+struct ConnectionSnapshot
+{
+   // the name of the connection (internal id), the games and the lists refer to it
+   std::string technicalId;
+
+   // the login of the user
+   std::string login;
+
+   // the state of the login sequence
+   int state;
+
+   // the negotiated protocol
+   bool binaryProtocol;
+   bool compression;
+
+   // the framing and the transport of the socket (see SimpleTcpConnection)
+   int framingMode;
+   int transport;
+
+   // the bytes received but not handled yet (the start of a frame)
+   std::string unreadInput;
+
+   // true if the connection is in the lists (registered as consumer or provider)
+   bool registered;
+
+   // the token of the session of the connection (empty if none)
+   std::string sessionToken;
+
+   // true if the link is lost and the connection kept for its session (no socket)
+   bool parked;
+
+   // the messages held while parked and if some were lost
+   std::vector< std::string > parkedMessages;
+   bool parkedOverflow;
+
+   // the number of seconds before the parked session expires
+   boost::uint64_t sessionGraceLeft;
+
+   // the index of the socket in the handed descriptors (unused if parked)
+   size_t descriptor;
+};
+
+// the state of a game handed over to the next process
+struct GameSnapshot
+{
+   // the unique number of the game, its id is built from it
+   size_t number;
+
+   // the kind of the game, its definition is in the handed definitions
+   std::string kind;
+
+   // the technical id of the provider
+   std::string provider;
+
+   // the technical ids of the consumers
+   std::vector< std::string > consumers;
+};
+
+// the state of the connection manager handed over to the next process with its sockets
+// the descriptors are the tcp listeners, then the local one if any, then the connection sockets
+class ServerSnapshot
+{
+public:
+   // the number of tcp listeners at the start of the descriptors
+   size_t tcpListeners;
+
+   // true if the local listener follows them
+   bool localListener;
+
+   // the number of the next game and of the next connection, so the ids stay unique
+   size_t nextGameNumber;
+   size_t nextClientNumber;
+
+   // the defined games
+   std::vector< GameDefinition > gameDefinitions;
+
+   // the connections
+   std::vector< ConnectionSnapshot > connections;
+
+   // the technical ids of the consumers and the providers indexed by game kind
+   typedef std::map< std::string, std::vector< std::string > > Aggregat;
+   Aggregat consumerByGame;
+   Aggregat providerByGame;
+
+   // the current games
+   std::vector< GameSnapshot > games;
+
+   // an empty snapshot
+   ServerSnapshot();
+
+   // write the snapshot at the end of out
+   void write( std::string& out ) const;
+
+   // read the snapshot written by write, return false if it is not valid
+   bool read( const std::string& in );
+};
@@ -2,27 +2,126 @@
 
 #include <iostream>
 #include <boost/asio/ip/tcp.hpp>
+#include <boost/thread.hpp>
 #include "ConnectionManager.hpp"
 
-int main( int argc, 
+int main( int argc,
           char* argv[] )
 {
-   if ( argc != 3 )
+   if (  ( argc < 3 )
+       ||( argc > 10 )  )
    {
-      std::cout << "USAGE: BackBoneServer <host> <port>" << std::endl;
+      std::cout << "USAGE: BackBoneServer <host>[,unix:<path>] <port> [reactorThreads] [workerThreads] [highWaterKB] [coalesce|drop|disconnect] [idleSeconds] [sessionGraceSeconds] [restartPath]" << std::endl;
       return 1;
    }
 
+   // get the number of thread running the reactor (one per core by default)
+   size_t reactorThreads = boost::thread::hardware_concurrency();
+   if ( argc >= 4 )
+   {
+      reactorThreads = atoi( argv[ 3 ] );
+   }
+   if ( reactorThreads == 0 )
+   {
+      reactorThreads = 1;
+   }
+
+   // get the number of thread handling the received messages (one per core by default)
+   size_t workerThreads = boost::thread::hardware_concurrency();
+   if ( argc >= 5 )
+   {
+      workerThreads = atoi( argv[ 4 ] );
+   }
+
+   // get the limits of the outbound queue of each connection (4 MB by default, released under a quarter)
+   BackpressureSettings backpressureSettings;
+   backpressureSettings.highWaterMark = 4 * 1024 * 1024;
+   if ( argc >= 6 )
+   {
+      backpressureSettings.highWaterMark = atoi( argv[ 5 ] ) * 1024;
+   }
+   backpressureSettings.lowWaterMark = backpressureSettings.highWaterMark / 4;
+
+   // get the policy applied to the game traffic of a slow consumer (coalesce by default)
+   backpressureSettings.policy = OVERFLOW_COALESCE;
+   if ( argc >= 7 )
+   {
+      std::string policy( argv[ 6 ] );
+      if ( policy == "drop" )
+      {
+         backpressureSettings.policy = OVERFLOW_DROP;
+      }
+      else if ( policy == "disconnect" )
+      {
+         backpressureSettings.policy = OVERFLOW_DISCONNECT;
+      }
+   }
+
+   // get the number of seconds without message after which a connection is pinged then closed (disabled by default)
+   // opt-in as the clients which do not answer SYSTEM_PING would be closed
+   HeartbeatSettings heartbeatSettings;
+   heartbeatSettings.idleTimeout = 0;
+   if ( argc >= 8 )
+   {
+      heartbeatSettings.idleTimeout = atoi( argv[ 7 ] );
+   }
+
+   // get the number of seconds a session whose link is lost waits to be resumed (30 by default, 0 disables)
+   heartbeatSettings.sessionGrace = 30;
+   if ( argc >= 9 )
+   {
+      heartbeatSettings.sessionGrace = atoi( argv[ 8 ] );
+   }
+
+   // get the unix domain socket of the hot restart (none by default)
+   // a server started with the path of a running one takes its sockets, connections and games over, then the old one stops
+   std::string restartPath;
+   if ( argc == 10 )
+   {
+      restartPath = argv[ 9 ];
+   }
+
+   // the host may be followed by a unix domain socket for the providers on the same host
+   //     '127.0.0.1,unix:/tmp/backbone.sock'
+   std::string host( argv[ 1 ] );
+   std::string localPath;
+   size_t separator = host.find( ',' );
+   if ( separator != std::string::npos )
+   {
+      std::string localAddress = host.substr( separator + 1 );
+      host = host.substr( 0, separator );
+      if ( SimpleTcpConnection::isLocalAddress( localAddress ) == true )
+      {
+         localPath = SimpleTcpConnection::getLocalPath( localAddress );
+      }
+   }
+
    // create the boost reactor
    boost::asio::io_service io_service;
 
    // create a connection manager on the host and port given in the argument
+   // with an acceptor per reactor thread to spread the reconnection storms
    ConnectionManager connectionManager( io_service,
-                                        boost::asio::ip::tcp::endpoint( boost::asio::ip::address::from_string( argv[ 1 ] ),
-                                                                        atoi( argv[ 2 ] ) ) );
+                                        boost::asio::ip::tcp::endpoint( boost::asio::ip::address::from_string( host ),
+                                                                        atoi( argv[ 2 ] ) ),
+                                        reactorThreads,
+                                        workerThreads,
+                                        backpressureSettings,
+                                        heartbeatSettings,
+                                        localPath,
+                                        restartPath );
 
-   // launch the boost reactor
-   io_service.run();
+   // launch the boost reactor on the pool of threads
+   // each connection uses its own strand so its messages stay ordered
+   boost::thread_group reactorPool;
+   for ( size_t i = 0;
+         i < reactorThreads;
+         ++i )
+   {
+      reactorPool.create_thread( boost::bind( &boost::asio::io_service::run,
+                                              &io_service ) );
+   }
+   reactorPool.join_all();
 
    return 0;
-}
\ No newline at end of file
+}
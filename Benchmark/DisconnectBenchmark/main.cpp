@@ -0,0 +1,148 @@
+#define _WIN32_WINNT 0x0501
+
+// cost of a disconnect by number of games on the server
+// a manager gets a provider, a consumer requesting the games and a consumer joining some of them,
+// then consumers each joining one of those games disconnect, their games stay open
+// the teardown walks the games and kinds of the leaving connection, so its cost should stay flat with the games
+// the games are left by the tasks of their shards, a disconnect is measured until the shards are idle again
+// the connections have no socket and the reactor is not run, only the manager work is measured
+//
+// build: with the server sources, all the .cpp of BackBoneServer but its main.cpp, and the ones of
+//        helper/logger, helper/network and helper/thread
+//        g++ -O2 -I ../../helper -I ../../BackBoneServer main.cpp <sources>
+//            -lboost_thread -lboost_system -lboost_chrono -lpthread -lz -lrt -o DisconnectBenchmark
+// run:   ./DisconnectBenchmark
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+#include <unistd.h>
+#include <boost/chrono.hpp>
+#include <boost/thread/thread.hpp>
+#include "network/BufferPool.hpp"
+#include "ConnectionManager.hpp"
+#include "ClientConnection.hpp"
+#include "Game.hpp"
+
+// the number of connections disconnecting at each size
+#define LEAVING_CONNECTIONS 200
+
+// the kind of the games
+static const std::string KIND( "Benchmark" );
+
+// create a connection without socket on the manager
+static ClientConnectionPtr createConnection( ConnectionManager& manager,
+                                             boost::asio::io_service& reactor,
+                                             size_t index )
+{
+   std::stringstream name;
+   name << "client" << index;
+   return ClientConnection::create( name.str(),
+                                    &manager,
+                                    connection_ptr( new SimpleTcpConnection( reactor ) ) );
+}
+
+// send a control message to the manager as if the connection sent it
+static void send( ConnectionManager& manager,
+                  ClientConnectionPtr connection,
+                  const std::string& message )
+{
+   manager.handleMessage( connection,
+                          BufferPool::getInstance().copy( message ) );
+}
+
+// wait for the shards of the games to run their tasks
+static void waitForShards( const ConnectionManager& manager )
+{
+   while ( manager.areShardsIdle() == false )
+   {
+      boost::this_thread::yield();
+   }
+}
+
+// get the microseconds of a disconnect on a manager with the number of games
+// the manager is left to the process, its connections have nothing to close
+static double measure( boost::asio::io_service& reactor,
+                       size_t numberOfGames )
+{
+   BackpressureSettings backpressureSettings;
+   backpressureSettings.highWaterMark = 1024 * 1024 * 1024;
+   backpressureSettings.lowWaterMark = backpressureSettings.highWaterMark / 4;
+   backpressureSettings.policy = OVERFLOW_COALESCE;
+   HeartbeatSettings heartbeatSettings;
+   heartbeatSettings.idleTimeout = 0;
+   heartbeatSettings.sessionGrace = 0;
+   ConnectionManager* manager = new ConnectionManager( reactor,
+                                                       boost::asio::ip::tcp::endpoint( boost::asio::ip::address::from_string( "127.0.0.1" ), 0 ),
+                                                       1,
+                                                       1,
+                                                       backpressureSettings,
+                                                       heartbeatSettings );
+
+   size_t index = 0;
+   ClientConnectionPtr provider = createConnection( *manager, reactor, index++ );
+   ClientConnectionPtr requester = createConnection( *manager, reactor, index++ );
+   ClientConnectionPtr stayer = createConnection( *manager, reactor, index++ );
+   send( *manager, provider, "SYSTEM_REGISTER PROVIDER " + KIND + " 1 -1 0" );
+   send( *manager, requester, "SYSTEM_REGISTER CONSUMER " + KIND );
+   send( *manager, stayer, "SYSTEM_REGISTER CONSUMER " + KIND );
+
+   // the games are numbered from the next number ('<kind>_<number>')
+   size_t firstNumber = Game::getNextNumber();
+   for ( size_t i = 0;
+         i < numberOfGames;
+         ++i )
+   {
+      send( *manager, requester, "SYSTEM_REQUEST_GAME " + KIND );
+   }
+
+   std::vector< ClientConnectionPtr > leaving;
+   for ( size_t i = 0;
+         i < LEAVING_CONNECTIONS;
+         ++i )
+   {
+      std::stringstream gameId;
+      gameId << KIND << "_" << firstNumber + i * numberOfGames / LEAVING_CONNECTIONS;
+
+      ClientConnectionPtr connection = createConnection( *manager, reactor, index++ );
+      send( *manager, connection, "SYSTEM_REGISTER CONSUMER " + KIND );
+      send( *manager, stayer, "SYSTEM_JOIN_GAME " + gameId.str() );
+      send( *manager, connection, "SYSTEM_JOIN_GAME " + gameId.str() );
+      leaving.push_back( connection );
+   }
+   waitForShards( *manager );
+
+   boost::chrono::steady_clock::time_point start = boost::chrono::steady_clock::now();
+   for ( size_t i = 0;
+         i < leaving.size();
+         ++i )
+   {
+      manager->closeConnection( leaving[ i ] );
+   }
+   waitForShards( *manager );
+   boost::chrono::nanoseconds spent = boost::chrono::steady_clock::now() - start;
+   return static_cast< double >( spent.count() ) / 1000 / leaving.size();
+}
+
+int main( int argc,
+          char* argv[] )
+{
+   boost::asio::io_service reactor;
+
+   std::cout << std::setw( 10 ) << "games" << std::setw( 16 ) << "us/disconnect" << std::endl;
+   static const size_t sizes[] = { 100, 1000, 10000, 100000 };
+   for ( size_t i = 0;
+         i < sizeof( sizes ) / sizeof( sizes[ 0 ] );
+         ++i )
+   {
+      double cost = measure( reactor,
+                             sizes[ i ] );
+      std::cout << std::setw( 10 ) << sizes[ i ]
+                << std::setw( 16 ) << std::fixed << std::setprecision( 2 ) << cost << std::endl;
+   }
+
+   // the managers and their connections are left as they are
+   std::cout.flush();
+   _exit( 0 );
+}
@@ -0,0 +1,157 @@
+#define _WIN32_WINNT 0x0501
+
+// cells painted per second by the graph provider, by protocol and by number of cells per message
+// each message paints cells of a 32x32 grid with CHANGE_CELL_STATE, alone or in a GAME_BATCH,
+// in the text form (exploded by handleGameMessage) or the binary form (read in place by handleBinaryGameMessage)
+// the terrain alternates between the passes so every cell really changes
+// the provider has no manager: the messages are handed to it directly and the CELL_UPDATED replies are not sent,
+// a batch still keeps its updates until its end, so only the parse and the grid work are measured
+//
+// build: with the graph sources, the .cpp of GraphDisplayProvider/graph and the ones of
+//        helper/logger, helper/network, helper/provider and helper/thread
+//        g++ -O2 -I ../../helper -I ../../GraphDisplayProvider/graph main.cpp <sources>
+//            -lboost_thread -lboost_system -lboost_chrono -lpthread -lz -lrt -o GraphCellBenchmark
+// run:   ./GraphCellBenchmark [cellsPerRun]
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+#include <cstdlib>
+#include <boost/chrono.hpp>
+#include "network/NetworkMessage.hpp"
+#include "network/BinaryProtocol.hpp"
+#include "network/BufferPool.hpp"
+#include "GraphGridProvider.hpp"
+
+// the size of the grid of the provider
+#define GRID_SIZE 32
+
+// the terrains painted in turn
+static const char* TERRAINS[] = { "FOREST", "WATER" };
+
+// the messages painting a pass on the grid, in both forms
+struct Pass
+{
+   std::vector< std::string > texts;
+   std::vector< SharedMessage > frames;
+   std::vector< size_t > payloadOffsets;
+};
+
+// build the messages painting the whole grid with the terrain, cellsPerMessage cells in each message
+static void buildPass( Pass& pass,
+                       const std::string& terrain,
+                       size_t cellsPerMessage )
+{
+   size_t cells = GRID_SIZE * GRID_SIZE;
+   for ( size_t first = 0;
+         first < cells;
+         first += cellsPerMessage )
+   {
+      std::stringstream text;
+      SharedBuffer frame = BufferPool::getInstance().acquire( 16 + 8 * cellsPerMessage );
+      BinaryWriter writer( *frame );
+      writer.writeOpcode( BinaryProtocol::OP_GAME_MESSAGE );
+      writer.writeUInt( 1 );
+      size_t payloadOffset = frame->size();
+      if ( cellsPerMessage > 1 )
+      {
+         text << GAME_BATCH << ' ';
+         writer.writeToken( GAME_BATCH );
+      }
+      for ( size_t cell = first;
+            ( cell < first + cellsPerMessage ) && ( cell < cells );
+            ++cell )
+      {
+         if ( cell > first )
+         {
+            text << GAME_BATCH_SEPARATOR << ' ';
+            writer.writeToken( GAME_BATCH_SEPARATOR );
+         }
+         text << "CHANGE_CELL_STATE " << cell % GRID_SIZE << ' ' << cell / GRID_SIZE << ' ' << terrain << ' ';
+         writer.writeToken( "CHANGE_CELL_STATE" );
+         writer.writeTokenUInt( cell % GRID_SIZE );
+         writer.writeTokenUInt( cell / GRID_SIZE );
+         writer.writeToken( terrain );
+      }
+      std::string textMessage = text.str();
+      pass.texts.push_back( textMessage.substr( 0, textMessage.size() - 1 ) );
+      pass.frames.push_back( SharedMessage( frame ) );
+      pass.payloadOffsets.push_back( payloadOffset );
+   }
+}
+
+// get the cells painted per second, in the binary form or the text one
+static double measure( size_t cellsPerMessage,
+                       bool binary,
+                       size_t numberOfCells )
+{
+   GraphGridProvider provider( GRID_SIZE,
+                               GRID_SIZE );
+   Pass passes[ 2 ];
+   for ( size_t i = 0;
+         i < 2;
+         ++i )
+   {
+      buildPass( passes[ i ],
+                 TERRAINS[ i ],
+                 cellsPerMessage );
+   }
+
+   size_t painted = 0;
+   boost::chrono::steady_clock::time_point start = boost::chrono::steady_clock::now();
+   for ( size_t turn = 0;
+         painted < numberOfCells;
+         ++turn )
+   {
+      const Pass& pass = passes[ turn % 2 ];
+      for ( size_t i = 0;
+            i < pass.texts.size();
+            ++i )
+      {
+         if ( binary == true )
+         {
+            provider.handleBinaryGameMessage( pass.frames[ i ],
+                                              pass.payloadOffsets[ i ] );
+         }
+         else
+         {
+            provider.handleGameMessage( pass.texts[ i ] );
+         }
+      }
+      painted += GRID_SIZE * GRID_SIZE;
+   }
+   boost::chrono::nanoseconds spent = boost::chrono::steady_clock::now() - start;
+   return static_cast< double >( painted ) * 1000000000 / spent.count();
+}
+
+int main( int argc,
+          char* argv[] )
+{
+   size_t numberOfCells = 2000000;
+   if ( argc >= 2 )
+   {
+      numberOfCells = atoi( argv[ 1 ] );
+   }
+
+   std::cout << numberOfCells << " cells painted on a " << GRID_SIZE << "x" << GRID_SIZE << " grid per run" << std::endl;
+   std::cout << std::setw( 16 ) << "cells/message"
+             << std::setw( 16 ) << "text cells/s"
+             << std::setw( 16 ) << "binary cells/s" << std::endl;
+   static const size_t sizes[] = { 1, 16, 256 };
+   for ( size_t i = 0;
+         i < sizeof( sizes ) / sizeof( sizes[ 0 ] );
+         ++i )
+   {
+      double text = measure( sizes[ i ],
+                             false,
+                             numberOfCells );
+      double binary = measure( sizes[ i ],
+                               true,
+                               numberOfCells );
+      std::cout << std::setw( 16 ) << sizes[ i ]
+                << std::setw( 16 ) << std::fixed << std::setprecision( 0 ) << text
+                << std::setw( 16 ) << binary << std::endl;
+   }
+   return 0;
+}
@@ -0,0 +1,193 @@
+#define _WIN32_WINNT 0x0501
+
+// cost of the heartbeat of the server by number of connections
+// the heartbeat of ConnectionManager::handleHeartbeat is replayed on a TimerWheel:
+// each second the wheel gives back the connections whose deadline is reached, their last activity is checked
+// and they are scheduled again, the messages only store their tick in the connection
+// it is compared with a heartbeat scanning every connection each second
+// the cost of a tick should grow with the connections expiring in it, so the cost by connection stays flat
+//
+// build: g++ -O2 -I ../../helper main.cpp -lboost_chrono -lboost_system -o HeartbeatBenchmark
+// run:   ./HeartbeatBenchmark [idleSeconds]
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <cstdlib>
+#include <boost/chrono.hpp>
+#include <boost/cstdint.hpp>
+#include "thread/TimerWheel.hpp"
+
+// the heartbeat state of a connection, as in ClientConnection
+struct Connection
+{
+   // the tick of the last message
+   boost::uint64_t lastActivity;
+
+   // the tick of the ping waiting for an answer (0 if none)
+   boost::uint64_t pingTick;
+};
+
+// the number of simulated seconds measured, after a first round of idleSeconds
+#define MEASURED_TICKS 120
+
+// the connections receiving a message each second, in percent
+#define ACTIVE_PERCENT 90
+
+// check the connection as ClientConnection::checkHeartbeat and return the tick of its next check
+// a pinged connection answers at once so none is closed
+static boost::uint64_t answer( Connection& connection,
+                               boost::uint64_t now,
+                               boost::uint64_t idleTimeout )
+{
+   if ( connection.lastActivity + idleTimeout > now )
+   {
+      connection.pingTick = 0;
+      return connection.lastActivity + idleTimeout;
+   }
+   connection.pingTick = now;
+   connection.lastActivity = now;
+   return now + idleTimeout;
+}
+
+// the activity of the connections in a second
+static void receive( std::vector< Connection >& connections,
+                     boost::uint64_t now )
+{
+   for ( size_t i = 0;
+         i < connections.size();
+         ++i )
+   {
+      if ( static_cast< size_t >( rand() % 100 ) < ACTIVE_PERCENT )
+      {
+         connections[ i ].lastActivity = now;
+      }
+   }
+}
+
+// get the nanoseconds of a heartbeat tick with the wheel
+static double measureWheel( size_t numberOfConnections,
+                            boost::uint64_t idleTimeout )
+{
+   std::vector< Connection > connections( numberOfConnections );
+   TimerWheel< size_t > wheel;
+   for ( size_t i = 0;
+         i < numberOfConnections;
+         ++i )
+   {
+      connections[ i ].lastActivity = 0;
+      connections[ i ].pingTick = 0;
+      wheel.schedule( i,
+                      1 + rand() % idleTimeout );
+   }
+
+   boost::chrono::nanoseconds spent( 0 );
+   std::vector< size_t > expired;
+   for ( boost::uint64_t now = 1;
+         now <= idleTimeout + MEASURED_TICKS;
+         ++now )
+   {
+      receive( connections,
+               now );
+
+      boost::chrono::steady_clock::time_point start = boost::chrono::steady_clock::now();
+      expired.clear();
+      wheel.advance( now,
+                     expired );
+      for ( size_t i = 0;
+            i < expired.size();
+            ++i )
+      {
+         wheel.schedule( expired[ i ],
+                         answer( connections[ expired[ i ] ],
+                                 now,
+                                 idleTimeout ) );
+      }
+      if ( now > idleTimeout )
+      {
+         spent += boost::chrono::steady_clock::now() - start;
+      }
+   }
+   return static_cast< double >( spent.count() ) / MEASURED_TICKS;
+}
+
+// get the nanoseconds of a heartbeat tick scanning every connection
+static double measureScan( size_t numberOfConnections,
+                           boost::uint64_t idleTimeout )
+{
+   std::vector< Connection > connections( numberOfConnections );
+   for ( size_t i = 0;
+         i < numberOfConnections;
+         ++i )
+   {
+      connections[ i ].lastActivity = 0;
+      connections[ i ].pingTick = 0;
+   }
+
+   boost::chrono::nanoseconds spent( 0 );
+   volatile size_t checked = 0;
+   for ( boost::uint64_t now = 1;
+         now <= idleTimeout + MEASURED_TICKS;
+         ++now )
+   {
+      receive( connections,
+               now );
+
+      boost::chrono::steady_clock::time_point start = boost::chrono::steady_clock::now();
+      for ( size_t i = 0;
+            i < connections.size();
+            ++i )
+      {
+         if ( connections[ i ].lastActivity + idleTimeout <= now )
+         {
+            answer( connections[ i ],
+                    now,
+                    idleTimeout );
+         }
+         checked++;
+      }
+      if ( now > idleTimeout )
+      {
+         spent += boost::chrono::steady_clock::now() - start;
+      }
+   }
+   return static_cast< double >( spent.count() ) / MEASURED_TICKS;
+}
+
+int main( int argc,
+          char* argv[] )
+{
+   boost::uint64_t idleTimeout = 30;
+   if ( argc >= 2 )
+   {
+      idleTimeout = atoi( argv[ 1 ] );
+   }
+   if ( idleTimeout == 0 )
+   {
+      idleTimeout = 1;
+   }
+
+   std::cout << "idle timeout " << idleTimeout << " s, " << ACTIVE_PERCENT << "% of the connections active each second" << std::endl;
+   std::cout << std::setw( 12 ) << "connections"
+             << std::setw( 16 ) << "wheel us/tick"
+             << std::setw( 18 ) << "wheel ns/conn/s"
+             << std::setw( 16 ) << "scan us/tick"
+             << std::setw( 18 ) << "scan ns/conn/s" << std::endl;
+
+   static const size_t sizes[] = { 1000, 10000, 100000 };
+   for ( size_t i = 0;
+         i < sizeof( sizes ) / sizeof( sizes[ 0 ] );
+         ++i )
+   {
+      double wheel = measureWheel( sizes[ i ],
+                                   idleTimeout );
+      double scan = measureScan( sizes[ i ],
+                                 idleTimeout );
+      std::cout << std::setw( 12 ) << sizes[ i ]
+                << std::setw( 16 ) << std::fixed << std::setprecision( 1 ) << wheel / 1000
+                << std::setw( 18 ) << std::setprecision( 2 ) << wheel / sizes[ i ]
+                << std::setw( 16 ) << std::setprecision( 1 ) << scan / 1000
+                << std::setw( 18 ) << std::setprecision( 2 ) << scan / sizes[ i ] << std::endl;
+   }
+   return 0;
+}
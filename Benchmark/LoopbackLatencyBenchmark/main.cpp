@@ -0,0 +1,310 @@
+#define _WIN32_WINNT 0x0501
+
+// latency of a tcp connection of SimpleTcpConnection on the loopback by socket profile
+// an echo side is accepted as the server accepts its connections and sends back every message it reads,
+// both sides are tuned with the profile (SocketTuning::apply once connected, as the server and the clients do)
+// the round trip of a small message is measured one message at a time (median and 99th percentile),
+// then the throughput of big messages all queued at once
+// the profiles compare the kernel defaults, the consumer profile with and without TCP_QUICKACK set again
+// after each read, and the provider profile with its buffers set before the connection (on the listening socket
+// and before connect, so the window announced in the SYN matches them) or only once connected
+// the cost of the system call setting TCP_QUICKACK again is measured alone
+//
+// build: with the sources of helper/logger, helper/network and helper/thread
+//        g++ -O2 -I ../../helper main.cpp <sources>
+//            -lboost_thread -lboost_system -lboost_chrono -lpthread -lz -lrt -o LoopbackLatencyBenchmark
+// run:   ./LoopbackLatencyBenchmark [port] [roundTrips] [messagesPerRun]
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+#include <unistd.h>
+#include <boost/atomic.hpp>
+#include <boost/bind.hpp>
+#include <boost/chrono.hpp>
+#include <boost/thread/thread.hpp>
+#include "network/SimpleTcpConnection.hpp"
+#include "network/SocketTuning.hpp"
+#include "network/BufferPool.hpp"
+
+// the size of the messages of the round trips
+#define SMALL_MESSAGE 64
+
+// the size of the messages of the throughput runs
+#define BIG_MESSAGE ( 64 * 1024 )
+
+// the calls measuring the cost of setting TCP_QUICKACK again
+#define REARM_CALLS 100000
+
+// nothing to do once a message is written, a failure shows on the reads
+static void ignoreWrite( const boost::system::error_code& error )
+{
+}
+
+// a side of the connection reading in a loop, the echo side sends back what it reads, the other one counts it
+class Peer
+{
+   // the connection
+   connection_ptr connection;
+
+   // the messages of a read
+   std::vector< SharedMessage > messages;
+
+   // true if the messages are sent back
+   bool echo;
+
+   // the number of messages read
+   boost::atomic< size_t > received;
+
+public:
+   // a side on the connection
+   Peer( connection_ptr connection,
+         bool echo )
+   :
+      connection( connection ),
+      messages(),
+      echo( echo ),
+      received( 0 )
+   {
+   }
+
+   // get the connection
+   connection_ptr getConnection() const
+   {
+      return connection;
+   }
+
+   // get the number of messages read
+   size_t getReceived() const
+   {
+      return received.load();
+   }
+
+   // read the next messages
+   void read()
+   {
+      connection->asyncRead( messages,
+                             boost::bind( &Peer::handleRead,
+                                          this,
+                                          boost::asio::placeholders::error ) );
+   }
+
+private:
+   // send back or count the messages read and read again, run in the strand of the connection
+   void handleRead( const boost::system::error_code& error )
+   {
+      if ( error )
+      {
+         return;
+      }
+      for ( size_t i = 0;
+            i < messages.size();
+            ++i )
+      {
+         if ( echo == true )
+         {
+            connection->asyncWrite( messages[ i ],
+                                    &ignoreWrite );
+         }
+      }
+      received.fetch_add( messages.size() );
+      read();
+   }
+};
+
+// a profile keeping every kernel default
+static SocketProfile getDefaultProfile()
+{
+   SocketProfile profile;
+   profile.name = "default";
+   profile.noDelay = false;
+   profile.sendBufferSize = 0;
+   profile.receiveBufferSize = 0;
+   profile.quickAck = false;
+   profile.quickAckRearm = false;
+   profile.keepAlive = false;
+   profile.keepAliveIdle = 0;
+   profile.keepAliveInterval = 0;
+   profile.keepAliveCount = 0;
+   profile.busyPoll = 0;
+   return profile;
+}
+
+// connect a client to an echo side accepted in the process, both tuned with the profile, return the client
+// the buffers of the profile are set before the connection if asked, otherwise only once connected
+// the echo side is left to the process
+static Peer* connectPair( boost::asio::io_service& reactor,
+                          int port,
+                          const SocketProfile& profile,
+                          bool buffersBeforeConnect )
+{
+   connection_ptr echo( new SimpleTcpConnection( reactor,
+                                                 SimpleTcpConnection::FRAMING_AUTO ) );
+   connection_ptr client( new SimpleTcpConnection( reactor ) );
+
+   boost::asio::ip::tcp::endpoint endpoint( boost::asio::ip::address::from_string( "127.0.0.1" ), port );
+   boost::asio::ip::tcp::acceptor acceptor( reactor );
+   acceptor.open( endpoint.protocol() );
+   acceptor.set_option( boost::asio::ip::tcp::acceptor::reuse_address( true ) );
+   client->getSocket().open( endpoint.protocol() );
+   if ( buffersBeforeConnect == true )
+   {
+      SocketTuning::applyBuffers( acceptor,
+                                  profile );
+      SocketTuning::applyBuffers( client->getSocket(),
+                                  profile );
+   }
+   acceptor.bind( endpoint );
+   acceptor.listen();
+   client->getSocket().connect( endpoint );
+   acceptor.accept( echo->getSocket() );
+
+   echo->applySocketProfile( profile );
+   client->applySocketProfile( profile );
+
+   Peer* echoPeer = new Peer( echo,
+                              true );
+   echoPeer->read();
+   Peer* clientPeer = new Peer( client,
+                                false );
+   clientPeer->read();
+   return clientPeer;
+}
+
+// wait for the client to read the number of messages
+static void waitFor( const Peer& client,
+                     size_t numberOfMessages )
+{
+   while ( client.getReceived() < numberOfMessages )
+   {
+      boost::this_thread::yield();
+   }
+}
+
+// measure the round trips one message at a time, give back the median and the 99th percentile in microseconds
+static void measureRoundTrips( Peer& client,
+                               size_t roundTrips,
+                               double& median,
+                               double& percentile99 )
+{
+   SharedMessage message = BufferPool::getInstance().copy( std::string( SMALL_MESSAGE, 'x' ) );
+   std::vector< double > times( roundTrips );
+   for ( size_t warmUp = 0;
+         warmUp < 2;
+         ++warmUp )
+   {
+      for ( size_t i = 0;
+            i < roundTrips;
+            ++i )
+      {
+         size_t expected = client.getReceived() + 1;
+         boost::chrono::steady_clock::time_point start = boost::chrono::steady_clock::now();
+         client.getConnection()->asyncWrite( message,
+                                             &ignoreWrite );
+         waitFor( client,
+                  expected );
+         boost::chrono::nanoseconds spent = boost::chrono::steady_clock::now() - start;
+         times[ i ] = static_cast< double >( spent.count() ) / 1000;
+      }
+   }
+   std::sort( times.begin(),
+              times.end() );
+   median = times[ roundTrips / 2 ];
+   percentile99 = times[ roundTrips * 99 / 100 ];
+}
+
+// get the bytes echoed per second with all the big messages of the run queued at once
+static double measureThroughput( Peer& client,
+                                 size_t numberOfMessages )
+{
+   SharedMessage message = BufferPool::getInstance().copy( std::string( BIG_MESSAGE, 'x' ) );
+   size_t first = client.getReceived();
+   boost::chrono::steady_clock::time_point start = boost::chrono::steady_clock::now();
+   for ( size_t i = 0;
+         i < numberOfMessages;
+         ++i )
+   {
+      client.getConnection()->asyncWrite( message,
+                                          &ignoreWrite );
+   }
+   waitFor( client,
+            first + numberOfMessages );
+   boost::chrono::nanoseconds spent = boost::chrono::steady_clock::now() - start;
+   return static_cast< double >( numberOfMessages ) * BIG_MESSAGE * 1000000000 / spent.count();
+}
+
+// get the cost of setting TCP_QUICKACK again on a connected socket in nanoseconds
+static double measureRearm( Peer& client )
+{
+   boost::chrono::steady_clock::time_point start = boost::chrono::steady_clock::now();
+   for ( size_t i = 0;
+         i < REARM_CALLS;
+         ++i )
+   {
+      SocketTuning::rearmQuickAck( client.getConnection()->getSocket() );
+   }
+   boost::chrono::nanoseconds spent = boost::chrono::steady_clock::now() - start;
+   return static_cast< double >( spent.count() ) / REARM_CALLS;
+}
+
+int main( int argc,
+          char* argv[] )
+{
+   int port = ( argc >= 2 ) ? atoi( argv[ 1 ] ) : 19700;
+   size_t roundTrips = ( argc >= 3 ) ? atoi( argv[ 2 ] ) : 20000;
+   size_t numberOfMessages = ( argc >= 4 ) ? atoi( argv[ 3 ] ) : 20000;
+
+   boost::asio::io_service reactor;
+   boost::asio::io_service::work work( reactor );
+   boost::thread reactorThread( boost::bind( &boost::asio::io_service::run,
+                                             &reactor ) );
+
+   SocketProfile rearmed = SocketTuning::getConsumerProfile();
+   rearmed.name = "consumer+rearm";
+   rearmed.quickAckRearm = true;
+   const SocketProfile profiles[] = { getDefaultProfile(),
+                                      SocketTuning::getConsumerProfile(),
+                                      rearmed,
+                                      SocketTuning::getProviderProfile(),
+                                      SocketTuning::getProviderProfile() };
+   const bool buffersBeforeConnect[] = { true, true, true, true, false };
+
+   std::cout << roundTrips << " round trips of " << SMALL_MESSAGE << " bytes, "
+             << numberOfMessages << " messages of " << BIG_MESSAGE << " bytes per throughput run" << std::endl;
+   std::cout << std::setw( 16 ) << "profile"
+             << std::setw( 10 ) << "buffers"
+             << std::setw( 14 ) << "median (us)"
+             << std::setw( 14 ) << "p99 (us)"
+             << std::setw( 10 ) << "MB/s" << std::endl;
+   Peer* client = NULL;
+   for ( size_t i = 0;
+         i < sizeof( profiles ) / sizeof( profiles[ 0 ] );
+         ++i )
+   {
+      client = connectPair( reactor,
+                            port + static_cast< int >( i ),
+                            profiles[ i ],
+                            buffersBeforeConnect[ i ] );
+      double median = 0;
+      double percentile99 = 0;
+      measureRoundTrips( *client,
+                         roundTrips,
+                         median,
+                         percentile99 );
+      double throughput = measureThroughput( *client,
+                                             numberOfMessages );
+      std::cout << std::setw( 16 ) << profiles[ i ].name
+                << std::setw( 10 ) << ( ( buffersBeforeConnect[ i ] == true ) ? "before" : "after" )
+                << std::setw( 14 ) << std::fixed << std::setprecision( 2 ) << median
+                << std::setw( 14 ) << percentile99
+                << std::setw( 10 ) << std::setprecision( 1 ) << throughput / ( 1024 * 1024 ) << std::endl;
+   }
+   std::cout << "TCP_QUICKACK set again: " << std::setprecision( 0 ) << measureRearm( *client ) << " ns per read" << std::endl;
+
+   // the connections are left as they are
+   std::cout.flush();
+   _exit( 0 );
+}
@@ -0,0 +1,378 @@
+#define _WIN32_WINNT 0x0501
+
+// heap allocations of the server per relayed game message
+// a manager listens on the loopback, a provider and a consumer connect with plain blocking sockets
+// and share a game, then the consumer sends game messages to the provider and the provider sends as many back
+// every operator new of the process is counted while the messages cross the server (read, mailbox of the
+// connection, shard of the game, write queue and gather write), the clients themselves do not allocate then
+// the messages are sent in bursts (many messages by read and by gather write) then one at a time,
+// each waiting for the previous one to be relayed (a read, a relay and a write for each message)
+// the check fails if the steady state allocates more than the given number per message
+//
+// build: with the server sources, all the .cpp of BackBoneServer but its main.cpp, and the ones of
+//        helper/logger, helper/network and helper/thread
+//        g++ -O2 -I ../../helper -I ../../BackBoneServer main.cpp <sources>
+//            -lboost_thread -lboost_system -lboost_chrono -lpthread -lz -lrt -o RelayAllocationCheck
+// run:   ./RelayAllocationCheck [port] [maxAllocationsPerMessage]
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <new>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <boost/atomic.hpp>
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+#include "ConnectionManager.hpp"
+
+// the number of messages crossing the server in each direction, after as many to warm the pools up
+#define MESSAGES 20000
+
+// the number of messages sent one at a time in each direction, after as many to warm up
+#define ONE_BY_ONE_MESSAGES 2000
+
+// the kind of the game
+static const std::string KIND( "AllocationCheck" );
+
+// the allocations of the process
+static boost::atomic< size_t > allocations( 0 );
+
+// count every allocation of the process
+void* operator new( size_t size )
+{
+   allocations.fetch_add( 1,
+                          boost::memory_order_relaxed );
+   void* memory = malloc( ( size > 0 ) ? size : 1 );
+   if ( memory == NULL )
+   {
+      throw std::bad_alloc();
+   }
+   return memory;
+}
+
+// the array form goes through the counted one
+void* operator new[]( size_t size )
+{
+   return operator new( size );
+}
+
+// give back the memory of operator new
+void operator delete( void* memory ) throw()
+{
+   free( memory );
+}
+
+// give back the memory of operator new[]
+void operator delete[]( void* memory ) throw()
+{
+   free( memory );
+}
+
+// a client of the server on a blocking socket, the frames are length prefixed
+class Client
+{
+   // the socket
+   int socketHandle;
+
+   // the bytes received and not consumed yet
+   std::vector< char > received;
+   size_t receivedSize;
+
+public:
+   // connect to the server on the loopback
+   explicit Client( int port )
+   :
+      socketHandle( socket( AF_INET, SOCK_STREAM, 0 ) ),
+      received( 1024 * 1024 ),
+      receivedSize( 0 )
+   {
+      sockaddr_in address;
+      memset( &address, 0, sizeof( address ) );
+      address.sin_family = AF_INET;
+      address.sin_port = htons( port );
+      address.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+      if ( connect( socketHandle, reinterpret_cast< sockaddr* >( &address ), sizeof( address ) ) != 0 )
+      {
+         throw std::exception();
+      }
+      int noDelay = 1;
+      setsockopt( socketHandle, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof( noDelay ) );
+   }
+
+   // append the framed message to out
+   static void frame( const std::string& message,
+                      std::string& out )
+   {
+      size_t size = message.size();
+      out += static_cast< char >( ( size >> 24 ) & 0xFF );
+      out += static_cast< char >( ( size >> 16 ) & 0xFF );
+      out += static_cast< char >( ( size >> 8 ) & 0xFF );
+      out += static_cast< char >( size & 0xFF );
+      out += message;
+   }
+
+   // write the bytes, already framed
+   void write( const std::string& bytes )
+   {
+      size_t done = 0;
+      while ( done < bytes.size() )
+      {
+         ssize_t written = ::send( socketHandle, bytes.data() + done, bytes.size() - done, 0 );
+         if ( written <= 0 )
+         {
+            throw std::exception();
+         }
+         done += written;
+      }
+   }
+
+   // send a single message
+   void send( const std::string& message )
+   {
+      std::string bytes;
+      frame( message,
+             bytes );
+      write( bytes );
+   }
+
+   // read the frames until one contains the text, return it (the frames before are skipped)
+   std::string waitFor( const std::string& text )
+   {
+      while ( true )
+      {
+         std::string message;
+         while ( next( message ) == false )
+         {
+            fill();
+         }
+         if ( message.find( text ) != std::string::npos )
+         {
+            return message;
+         }
+      }
+   }
+
+   // read and skip the number of frames without allocating
+   void skip( size_t numberOfFrames )
+   {
+      while ( numberOfFrames > 0 )
+      {
+         size_t offset = 0;
+         while (  ( receivedSize - offset >= 4 )
+                &&( numberOfFrames > 0 ) )
+         {
+            size_t size = frameSize( offset );
+            if ( receivedSize - offset < 4 + size )
+            {
+               break;
+            }
+            offset += 4 + size;
+            numberOfFrames--;
+         }
+         memmove( &received[ 0 ], &received[ offset ], receivedSize - offset );
+         receivedSize -= offset;
+         if ( numberOfFrames > 0 )
+         {
+            fill();
+         }
+      }
+   }
+
+private:
+   // get the size of the frame at the offset
+   size_t frameSize( size_t offset ) const
+   {
+      const unsigned char* header = reinterpret_cast< const unsigned char* >( &received[ offset ] );
+      return ( header[ 0 ] << 24 ) | ( header[ 1 ] << 16 ) | ( header[ 2 ] << 8 ) | header[ 3 ];
+   }
+
+   // take the first complete frame if any
+   bool next( std::string& message )
+   {
+      if (  ( receivedSize < 4 )
+          ||( receivedSize < 4 + frameSize( 0 ) )  )
+      {
+         return false;
+      }
+      size_t size = frameSize( 0 );
+      message.assign( &received[ 4 ], size );
+      memmove( &received[ 0 ], &received[ 4 + size ], receivedSize - 4 - size );
+      receivedSize -= 4 + size;
+      return true;
+   }
+
+   // read what the socket has
+   void fill()
+   {
+      ssize_t read = ::recv( socketHandle, &received[ receivedSize ], received.size() - receivedSize, 0 );
+      if ( read <= 0 )
+      {
+         throw std::exception();
+      }
+      receivedSize += read;
+   }
+};
+
+// log the client in the server
+static void login( Client& client,
+                   const std::string& name )
+{
+   client.send( "SYSTEM_INIT_CONNECTION" );
+   client.waitFor( "SYSTEM_LOGIN_ASKED" );
+   client.send( name + ":" + name );
+   client.waitFor( "SYSTEM_LOGIN_ACCEPTED" );
+}
+
+// true once the allocations before a run are counted
+static boost::atomic< bool > started( false );
+
+// send the prepared bytes of the messages of a run once it is started
+static void sendRun( Client* client,
+                     const std::string* bytes )
+{
+   while ( started.load() == false )
+   {
+      boost::this_thread::yield();
+   }
+   client->write( *bytes );
+}
+
+// count the allocations while a burst of messages crosses the server one way, return them by message
+static double measureBurst( Client& sender,
+                       Client& receiver,
+                       const std::string& bytes )
+{
+   // the writes and the reads of the run would block each other in a single thread
+   started.store( false );
+   boost::thread writer( boost::bind( &sendRun,
+                                      &sender,
+                                      &bytes ) );
+   usleep( 100000 );
+   size_t before = allocations.load();
+   started.store( true );
+   receiver.skip( MESSAGES );
+   size_t after = allocations.load();
+   writer.join();
+   return static_cast< double >( after - before ) / MESSAGES;
+}
+
+// count the allocations while the messages cross the server one way one at a time, return them by message
+static double measureOneByOne( Client& sender,
+                               Client& receiver,
+                               const std::string& bytes )
+{
+   size_t before = allocations.load();
+   for ( size_t i = 0;
+         i < ONE_BY_ONE_MESSAGES;
+         ++i )
+   {
+      sender.write( bytes );
+      receiver.skip( 1 );
+   }
+   size_t after = allocations.load();
+   return static_cast< double >( after - before ) / ONE_BY_ONE_MESSAGES;
+}
+
+int main( int argc,
+          char* argv[] )
+{
+   int port = ( argc >= 2 ) ? atoi( argv[ 1 ] ) : 19500;
+   double maximum = ( argc >= 3 ) ? atof( argv[ 2 ] ) : -1;
+
+   BackpressureSettings backpressureSettings;
+   backpressureSettings.highWaterMark = 256 * 1024 * 1024;
+   backpressureSettings.lowWaterMark = backpressureSettings.highWaterMark / 4;
+   backpressureSettings.policy = OVERFLOW_COALESCE;
+   HeartbeatSettings heartbeatSettings;
+   heartbeatSettings.idleTimeout = 0;
+   heartbeatSettings.sessionGrace = 0;
+   boost::asio::io_service reactor;
+   ConnectionManager manager( reactor,
+                              boost::asio::ip::tcp::endpoint( boost::asio::ip::address::from_string( "127.0.0.1" ), port ),
+                              1,
+                              1,
+                              backpressureSettings,
+                              heartbeatSettings );
+   boost::thread reactorThread( boost::bind( &boost::asio::io_service::run,
+                                             &reactor ) );
+
+   // a provider and a consumer in the same game
+   Client provider( port );
+   Client consumer( port );
+   login( provider, "provider" );
+   login( consumer, "consumer" );
+   provider.send( "SYSTEM_REGISTER PROVIDER " + KIND + " 1 -1 0" );
+   consumer.send( "SYSTEM_REGISTER CONSUMER " + KIND );
+   consumer.send( "SYSTEM_REQUEST_GAME " + KIND );
+   std::string accepted = consumer.waitFor( "GAME_ACCEPTED" );
+   std::string gameId = accepted.substr( accepted.find( KIND + "_" ) );
+   gameId = gameId.substr( 0, gameId.find( ' ' ) );
+   provider.waitFor( "GAME_CREATED" );
+   consumer.send( "SYSTEM_JOIN_GAME " + gameId );
+   provider.waitFor( "PLAYER_JOIN_MESSAGE" );
+
+   // the messages of a run in each direction
+   std::string toProvider;
+   std::string toConsumer;
+   Client::frame( "GAME_MESSAGE " + gameId + " CHANGE_CELL_STATE 1 2 FOREST",
+                  toProvider );
+   Client::frame( "GAME_MESSAGE " + gameId + " CELL_UPDATED 1 2 FOREST",
+                  toConsumer );
+   std::string burstToProvider;
+   std::string burstToConsumer;
+   for ( size_t i = 0;
+         i < MESSAGES;
+         ++i )
+   {
+      burstToProvider += toProvider;
+      burstToConsumer += toConsumer;
+   }
+
+   // a first run fills the pools and the queues, the second one is the steady state
+   double results[ 4 ];
+   for ( size_t run = 0;
+         run < 2;
+         ++run )
+   {
+      results[ 0 ] = measureBurst( consumer, provider, burstToProvider );
+      results[ 1 ] = measureBurst( provider, consumer, burstToConsumer );
+      results[ 2 ] = measureOneByOne( consumer, provider, toProvider );
+      results[ 3 ] = measureOneByOne( provider, consumer, toConsumer );
+   }
+
+   std::cout << "text game messages, allocations per relayed message" << std::endl;
+   std::cout << std::setw( 24 ) << ""
+             << std::setw( 16 ) << "burst"
+             << std::setw( 16 ) << "one by one" << std::endl;
+   std::cout << std::setw( 24 ) << "consumer to provider"
+             << std::setw( 16 ) << std::fixed << std::setprecision( 2 ) << results[ 0 ]
+             << std::setw( 16 ) << results[ 2 ] << std::endl;
+   std::cout << std::setw( 24 ) << "provider to consumer"
+             << std::setw( 16 ) << results[ 1 ]
+             << std::setw( 16 ) << results[ 3 ] << std::endl;
+   std::cout.flush();
+
+   bool passed = true;
+   for ( size_t i = 0;
+         i < 4;
+         ++i )
+   {
+      if (  ( maximum >= 0 )
+          &&( results[ i ] > maximum )  )
+      {
+         passed = false;
+      }
+   }
+   if ( passed == false )
+   {
+      std::cout << "FAILED: more than " << maximum << " allocations per message" << std::endl;
+   }
+   _exit( ( passed == true ) ? 0 : 1 );
+}
@@ -0,0 +1,180 @@
+#define _WIN32_WINNT 0x0501
+
+// throughput of the game relay by number of sender threads and workers
+// a manager gets a provider, a consumer requesting games and joining all of them, then sender threads
+// hand game messages to ConnectionManager::handleMessage as the reactor threads do
+// each message is posted to the mailbox of the shard of its game and relayed there to the provider without lock,
+// so the relays of games on different shards run in parallel on the workers
+// a run is measured until the shards are idle again, the relay scales with the cores of the machine only:
+// on a single core the threads take turns and the throughput stays flat
+// the connections have no socket and the reactor is not run, only the manager work is measured
+//
+// build: with the server sources, all the .cpp of BackBoneServer but its main.cpp, and the ones of
+//        helper/logger, helper/network and helper/thread
+//        g++ -O2 -I ../../helper -I ../../BackBoneServer main.cpp <sources>
+//            -lboost_thread -lboost_system -lboost_chrono -lpthread -lz -lrt -o ShardThroughputBenchmark
+// run:   ./ShardThroughputBenchmark [messagesPerRun]
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+#include <cstdlib>
+#include <unistd.h>
+#include <boost/chrono.hpp>
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+#include "network/BufferPool.hpp"
+#include "ConnectionManager.hpp"
+#include "ClientConnection.hpp"
+#include "Game.hpp"
+
+// the number of games, spread on all the shards
+#define GAMES 256
+
+// the kind of the games
+static const std::string KIND( "Benchmark" );
+
+// create a connection without socket on the manager
+static ClientConnectionPtr createConnection( ConnectionManager& manager,
+                                             boost::asio::io_service& reactor,
+                                             size_t index )
+{
+   std::stringstream name;
+   name << "client" << index;
+   return ClientConnection::create( name.str(),
+                                    &manager,
+                                    connection_ptr( new SimpleTcpConnection( reactor ) ) );
+}
+
+// send a control message to the manager as if the connection sent it
+static void send( ConnectionManager& manager,
+                  ClientConnectionPtr connection,
+                  const std::string& message )
+{
+   manager.handleMessage( connection,
+                          BufferPool::getInstance().copy( message ) );
+}
+
+// wait for the shards of the games to run their tasks
+static void waitForShards( const ConnectionManager& manager )
+{
+   while ( manager.areShardsIdle() == false )
+   {
+      boost::this_thread::yield();
+   }
+}
+
+// hand the messages of a sender to the manager, the sender takes the games of its turn
+static void sendGameMessages( ConnectionManager* manager,
+                              ClientConnectionPtr consumer,
+                              const std::vector< SharedMessage >* messages,
+                              size_t sender,
+                              size_t numberOfSenders,
+                              size_t numberOfMessages )
+{
+   for ( size_t i = sender;
+         i < numberOfMessages;
+         i += numberOfSenders )
+   {
+      manager->handleMessage( consumer,
+                              (*messages)[ i % messages->size() ] );
+   }
+}
+
+// get the relayed messages per second with the senders and workers
+// the manager is left to the process, its connections have nothing to close
+static double measure( boost::asio::io_service& reactor,
+                       size_t numberOfSenders,
+                       size_t numberOfWorkers,
+                       size_t numberOfMessages )
+{
+   BackpressureSettings backpressureSettings;
+   backpressureSettings.highWaterMark = 1024 * 1024 * 1024;
+   backpressureSettings.lowWaterMark = backpressureSettings.highWaterMark / 4;
+   backpressureSettings.policy = OVERFLOW_COALESCE;
+   HeartbeatSettings heartbeatSettings;
+   heartbeatSettings.idleTimeout = 0;
+   heartbeatSettings.sessionGrace = 0;
+   ConnectionManager* manager = new ConnectionManager( reactor,
+                                                       boost::asio::ip::tcp::endpoint( boost::asio::ip::address::from_string( "127.0.0.1" ), 0 ),
+                                                       1,
+                                                       numberOfWorkers,
+                                                       backpressureSettings,
+                                                       heartbeatSettings );
+
+   ClientConnectionPtr provider = createConnection( *manager, reactor, 0 );
+   ClientConnectionPtr consumer = createConnection( *manager, reactor, 1 );
+   send( *manager, provider, "SYSTEM_REGISTER PROVIDER " + KIND + " 1 -1 0" );
+   send( *manager, consumer, "SYSTEM_REGISTER CONSUMER " + KIND );
+
+   // the games are numbered from the next number ('<kind>_<number>')
+   size_t firstNumber = Game::getNextNumber();
+   std::vector< SharedMessage > messages;
+   for ( size_t i = 0;
+         i < GAMES;
+         ++i )
+   {
+      std::stringstream gameId;
+      gameId << KIND << "_" << firstNumber + i;
+      send( *manager, consumer, "SYSTEM_REQUEST_GAME " + KIND );
+      send( *manager, consumer, "SYSTEM_JOIN_GAME " + gameId.str() );
+      messages.push_back( BufferPool::getInstance().copy( "GAME_MESSAGE " + gameId.str() + " CHANGE_CELL_STATE 1 2 FOREST" ) );
+   }
+   waitForShards( *manager );
+
+   boost::chrono::steady_clock::time_point start = boost::chrono::steady_clock::now();
+   boost::thread_group senders;
+   for ( size_t i = 0;
+         i < numberOfSenders;
+         ++i )
+   {
+      senders.create_thread( boost::bind( &sendGameMessages,
+                                          manager,
+                                          consumer,
+                                          &messages,
+                                          i,
+                                          numberOfSenders,
+                                          numberOfMessages ) );
+   }
+   senders.join_all();
+   waitForShards( *manager );
+   boost::chrono::nanoseconds spent = boost::chrono::steady_clock::now() - start;
+   return static_cast< double >( numberOfMessages ) * 1000000000 / spent.count();
+}
+
+int main( int argc,
+          char* argv[] )
+{
+   size_t numberOfMessages = 200000;
+   if ( argc >= 2 )
+   {
+      numberOfMessages = atoi( argv[ 1 ] );
+   }
+
+   boost::asio::io_service reactor;
+
+   std::cout << boost::thread::hardware_concurrency() << " cores, "
+             << GAMES << " games on " << GAME_SHARDS << " shards, "
+             << numberOfMessages << " messages per run" << std::endl;
+   std::cout << std::setw( 10 ) << "senders"
+             << std::setw( 10 ) << "workers"
+             << std::setw( 16 ) << "messages/s" << std::endl;
+   static const size_t threads[] = { 1, 2, 4, 8 };
+   for ( size_t i = 0;
+         i < sizeof( threads ) / sizeof( threads[ 0 ] );
+         ++i )
+   {
+      double throughput = measure( reactor,
+                                   threads[ i ],
+                                   threads[ i ],
+                                   numberOfMessages );
+      std::cout << std::setw( 10 ) << threads[ i ]
+                << std::setw( 10 ) << threads[ i ]
+                << std::setw( 16 ) << std::fixed << std::setprecision( 0 ) << throughput << std::endl;
+   }
+
+   // the managers and their connections are left as they are
+   std::cout.flush();
+   _exit( 0 );
+}
@@ -0,0 +1,272 @@
+#define _WIN32_WINNT 0x0501
+
+// latency and throughput of the transports of SimpleTcpConnection on the same host: tcp on the loopback,
+// unix domain socket and shared memory (the rings of SharedMemoryLink, the unix domain socket carrying the doorbells)
+// an echo side is accepted as the server accepts its connections (the framing detected on the first byte, the shared
+// memory created by the accepting side when the peer asks for it) and sends back every message it reads
+// the round trip is measured one message at a time, the throughput with all the messages of a run queued at once
+// both sides run in the process on a single reactor thread, so the numbers compare the transports only
+//
+// build: with the sources of helper/logger, helper/network and helper/thread
+//        g++ -O2 -I ../../helper main.cpp <sources>
+//            -lboost_thread -lboost_system -lboost_chrono -lpthread -lz -lrt -o SharedMemoryBenchmark
+// run:   ./SharedMemoryBenchmark [port] [roundTrips] [messagesPerRun]
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <unistd.h>
+#include <boost/atomic.hpp>
+#include <boost/bind.hpp>
+#include <boost/chrono.hpp>
+#include <boost/thread/thread.hpp>
+#include "network/SimpleTcpConnection.hpp"
+#include "network/BufferPool.hpp"
+
+// the sizes of the messages measured
+static const size_t SIZES[] = { 64, 4096 };
+
+// nothing to do once a message is written, a failure shows on the reads
+static void ignoreWrite( const boost::system::error_code& error )
+{
+}
+
+// a side of the connection reading in a loop, the echo side sends back what it reads, the other one counts it
+class Peer
+{
+   // the connection
+   connection_ptr connection;
+
+   // the messages of a read
+   std::vector< SharedMessage > messages;
+
+   // true if the messages are sent back
+   bool echo;
+
+   // the number of messages read
+   boost::atomic< size_t > received;
+
+public:
+   // a side on the connection
+   Peer( connection_ptr connection,
+         bool echo )
+   :
+      connection( connection ),
+      messages(),
+      echo( echo ),
+      received( 0 )
+   {
+   }
+
+   // get the connection
+   connection_ptr getConnection() const
+   {
+      return connection;
+   }
+
+   // get the number of messages read
+   size_t getReceived() const
+   {
+      return received.load();
+   }
+
+   // read the next messages
+   void read()
+   {
+      connection->asyncRead( messages,
+                             boost::bind( &Peer::handleRead,
+                                          this,
+                                          boost::asio::placeholders::error ) );
+   }
+
+private:
+   // send back or count the messages read and read again, run in the strand of the connection
+   void handleRead( const boost::system::error_code& error )
+   {
+      if ( error )
+      {
+         return;
+      }
+      for ( size_t i = 0;
+            i < messages.size();
+            ++i )
+      {
+         if ( echo == true )
+         {
+            connection->asyncWrite( messages[ i ],
+                                    &ignoreWrite );
+         }
+      }
+      received.fetch_add( messages.size() );
+      read();
+   }
+};
+
+// connect a client of the transport to an echo side accepted in the process, return the client
+// the echo side is left to the process
+static Peer* connectPair( boost::asio::io_service& reactor,
+                          SimpleTcpConnection::Transport transport,
+                          int port,
+                          const std::string& path )
+{
+   connection_ptr echo( new SimpleTcpConnection( reactor,
+                                                 SimpleTcpConnection::FRAMING_AUTO,
+                                                 ( transport == SimpleTcpConnection::TRANSPORT_TCP ) ? SimpleTcpConnection::TRANSPORT_TCP : SimpleTcpConnection::TRANSPORT_LOCAL ) );
+   connection_ptr client( new SimpleTcpConnection( reactor,
+                                                   SimpleTcpConnection::FRAMING_LENGTH_PREFIXED,
+                                                   transport ) );
+   if ( transport == SimpleTcpConnection::TRANSPORT_TCP )
+   {
+      boost::asio::ip::tcp::endpoint endpoint( boost::asio::ip::address::from_string( "127.0.0.1" ), port );
+      boost::asio::ip::tcp::acceptor acceptor( reactor,
+                                               endpoint );
+      client->getSocket().connect( endpoint );
+      acceptor.accept( echo->getSocket() );
+      client->getSocket().set_option( boost::asio::ip::tcp::no_delay( true ) );
+      echo->getSocket().set_option( boost::asio::ip::tcp::no_delay( true ) );
+   }
+   else
+   {
+      ::unlink( path.c_str() );
+      boost::asio::local::stream_protocol::endpoint endpoint( path );
+      boost::asio::local::stream_protocol::acceptor acceptor( reactor,
+                                                              endpoint );
+      client->getLocalSocket().connect( endpoint );
+      acceptor.accept( echo->getLocalSocket() );
+      ::unlink( path.c_str() );
+   }
+
+   // the echo side reads first, it answers the shared memory preamble on the reactor thread
+   Peer* echoPeer = new Peer( echo,
+                              true );
+   echoPeer->read();
+   if ( transport == SimpleTcpConnection::TRANSPORT_SHARED_MEMORY )
+   {
+      client->startSharedMemory();
+   }
+   Peer* clientPeer = new Peer( client,
+                                false );
+   clientPeer->read();
+   return clientPeer;
+}
+
+// wait for the client to read the number of messages
+static void waitFor( const Peer& client,
+                     size_t numberOfMessages )
+{
+   while ( client.getReceived() < numberOfMessages )
+   {
+      boost::this_thread::yield();
+   }
+}
+
+// get the mean round trip of a message of the size in microseconds, one message at a time
+static double measureRoundTrip( Peer& client,
+                                size_t size,
+                                size_t roundTrips )
+{
+   SharedMessage message = BufferPool::getInstance().copy( std::string( size, 'x' ) );
+   for ( size_t warmUp = 0;
+         warmUp < 2;
+         ++warmUp )
+   {
+      size_t first = client.getReceived();
+      boost::chrono::steady_clock::time_point start = boost::chrono::steady_clock::now();
+      for ( size_t i = 1;
+            i <= roundTrips;
+            ++i )
+      {
+         client.getConnection()->asyncWrite( message,
+                                             &ignoreWrite );
+         waitFor( client,
+                  first + i );
+      }
+      boost::chrono::nanoseconds spent = boost::chrono::steady_clock::now() - start;
+      if ( warmUp == 1 )
+      {
+         return static_cast< double >( spent.count() ) / roundTrips / 1000;
+      }
+   }
+   return 0;
+}
+
+// get the messages of the size echoed per second, all the messages of the run queued at once
+static double measureThroughput( Peer& client,
+                                 size_t size,
+                                 size_t numberOfMessages )
+{
+   SharedMessage message = BufferPool::getInstance().copy( std::string( size, 'x' ) );
+   size_t first = client.getReceived();
+   boost::chrono::steady_clock::time_point start = boost::chrono::steady_clock::now();
+   for ( size_t i = 0;
+         i < numberOfMessages;
+         ++i )
+   {
+      client.getConnection()->asyncWrite( message,
+                                          &ignoreWrite );
+   }
+   waitFor( client,
+            first + numberOfMessages );
+   boost::chrono::nanoseconds spent = boost::chrono::steady_clock::now() - start;
+   return static_cast< double >( numberOfMessages ) * 1000000000 / spent.count();
+}
+
+int main( int argc,
+          char* argv[] )
+{
+   int port = ( argc >= 2 ) ? atoi( argv[ 1 ] ) : 19600;
+   size_t roundTrips = ( argc >= 3 ) ? atoi( argv[ 2 ] ) : 20000;
+   size_t numberOfMessages = ( argc >= 4 ) ? atoi( argv[ 3 ] ) : 200000;
+
+   boost::asio::io_service reactor;
+   boost::asio::io_service::work work( reactor );
+   boost::thread reactorThread( boost::bind( &boost::asio::io_service::run,
+                                             &reactor ) );
+
+   std::stringstream path;
+   path << "/tmp/SharedMemoryBenchmark_" << ::getpid() << ".sock";
+
+   static const SimpleTcpConnection::Transport transports[] = { SimpleTcpConnection::TRANSPORT_TCP,
+                                                                SimpleTcpConnection::TRANSPORT_LOCAL,
+                                                                SimpleTcpConnection::TRANSPORT_SHARED_MEMORY };
+   static const char* names[] = { "tcp loopback", "unix socket", "shared memory" };
+
+   std::cout << roundTrips << " round trips, " << numberOfMessages << " messages per throughput run" << std::endl;
+   std::cout << std::setw( 16 ) << "transport"
+             << std::setw( 10 ) << "bytes"
+             << std::setw( 18 ) << "round trip (us)"
+             << std::setw( 16 ) << "messages/s"
+             << std::setw( 10 ) << "MB/s" << std::endl;
+   for ( size_t t = 0;
+         t < sizeof( transports ) / sizeof( transports[ 0 ] );
+         ++t )
+   {
+      Peer* client = connectPair( reactor,
+                                  transports[ t ],
+                                  port,
+                                  path.str() );
+      for ( size_t s = 0;
+            s < sizeof( SIZES ) / sizeof( SIZES[ 0 ] );
+            ++s )
+      {
+         double roundTrip = measureRoundTrip( *client,
+                                              SIZES[ s ],
+                                              roundTrips );
+         double throughput = measureThroughput( *client,
+                                                SIZES[ s ],
+                                                numberOfMessages );
+         std::cout << std::setw( 16 ) << names[ t ]
+                   << std::setw( 10 ) << SIZES[ s ]
+                   << std::setw( 18 ) << std::fixed << std::setprecision( 2 ) << roundTrip
+                   << std::setw( 16 ) << std::setprecision( 0 ) << throughput
+                   << std::setw( 10 ) << std::setprecision( 1 ) << throughput * SIZES[ s ] / ( 1024 * 1024 ) << std::endl;
+      }
+   }
+
+   // the connections are left as they are
+   std::cout.flush();
+   _exit( 0 );
+}
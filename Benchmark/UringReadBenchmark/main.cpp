@@ -0,0 +1,303 @@
+#define _WIN32_WINNT 0x0501
+
+// reads of many idle tcp connections of SimpleTcpConnection on the loopback, on the epoll reactor or through
+// the io_uring reads of UringReadService (built with -DBACKBONE_IO_URING, see ReactorBackend.hpp)
+// the connections are accepted as the server accepts its connections and read in a loop, each one counting its
+// messages, the other sides are plain blocking sockets written by the main thread: a small message on every
+// connection in turn, round after round, so most connections wait for their next message as the clients of
+// the server do
+// the reads of a connection go through the ring if it's enabled when the connection starts reading, the connections
+// are created again for each backend
+// the connections need two descriptors each, the limit of descriptors is raised to its hard limit, the first count
+// it can't hold is measured with as many connections as it holds and the next ones are skipped
+//
+// build: with the sources of helper/logger, helper/network and helper/thread
+//        g++ -O2 -DBACKBONE_IO_URING -I ../../helper main.cpp <sources>
+//            -lboost_thread -lboost_system -lboost_chrono -lpthread -lz -lrt -o UringReadBenchmark
+// run:   ./UringReadBenchmark [port] [messagesPerRun]
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <boost/atomic.hpp>
+#include <boost/bind.hpp>
+#include <boost/chrono.hpp>
+#include <boost/thread/thread.hpp>
+#include "network/SimpleTcpConnection.hpp"
+#include "network/ReactorBackend.hpp"
+#include "network/UringReadService.hpp"
+
+// the size of the messages
+#define MESSAGE_SIZE 64
+
+// the descriptors kept for the process besides the connections (the listening socket, the ring, the logger ...)
+#define DESCRIPTOR_MARGIN 64
+
+// the counts of connections measured
+static const size_t CONNECTIONS[] = { 1000, 10000, 50000 };
+
+// the messages and the reads of all the connections of a run, the connections done reading
+static boost::atomic< size_t > received( 0 );
+static boost::atomic< size_t > reads( 0 );
+static boost::atomic< size_t > finished( 0 );
+
+// the accepted side of a connection, reading in a loop until the connection is closed
+class Reader
+{
+   // the connection
+   connection_ptr connection;
+
+   // the messages of a read
+   std::vector< SharedMessage > messages;
+
+public:
+   // a reader on the connection
+   explicit Reader( connection_ptr connection )
+   :
+      connection( connection ),
+      messages()
+   {
+   }
+
+   // get the connection
+   connection_ptr getConnection() const
+   {
+      return connection;
+   }
+
+   // read the next messages
+   void read()
+   {
+      connection->asyncRead( messages,
+                             boost::bind( &Reader::handleRead,
+                                          this,
+                                          boost::asio::placeholders::error ) );
+   }
+
+private:
+   // count the messages read and read again, run in the strand of the connection
+   void handleRead( const boost::system::error_code& error )
+   {
+      if ( error )
+      {
+         finished.fetch_add( 1 );
+         return;
+      }
+      received.fetch_add( messages.size() );
+      reads.fetch_add( 1 );
+      read();
+   }
+};
+
+// raise the limit of descriptors to its hard limit, return the limit
+static size_t raiseDescriptorLimit()
+{
+   struct rlimit limit;
+   if ( getrlimit( RLIMIT_NOFILE, &limit ) != 0 )
+   {
+      return 1024;
+   }
+   limit.rlim_cur = limit.rlim_max;
+   setrlimit( RLIMIT_NOFILE, &limit );
+   getrlimit( RLIMIT_NOFILE, &limit );
+   return static_cast< size_t >( limit.rlim_cur );
+}
+
+// get the cpu time spent by the process in microseconds
+static double getCpuTime()
+{
+   struct rusage usage;
+   getrusage( RUSAGE_SELF, &usage );
+   return static_cast< double >( usage.ru_utime.tv_sec + usage.ru_stime.tv_sec ) * 1000000
+        + usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+// connect the number of connections, the accepted sides reading, the connecting sides given back
+static void connectAll( boost::asio::io_service& reactor,
+                        int port,
+                        size_t numberOfConnections,
+                        std::vector< Reader* >& readers,
+                        std::vector< boost::asio::ip::tcp::socket* >& writers )
+{
+   boost::asio::ip::tcp::endpoint endpoint( boost::asio::ip::address::from_string( "127.0.0.1" ), port );
+   boost::asio::ip::tcp::acceptor acceptor( reactor );
+   acceptor.open( endpoint.protocol() );
+   acceptor.set_option( boost::asio::ip::tcp::acceptor::reuse_address( true ) );
+   acceptor.bind( endpoint );
+   acceptor.listen();
+   for ( size_t i = 0;
+         i < numberOfConnections;
+         ++i )
+   {
+      boost::asio::ip::tcp::socket* writer = new boost::asio::ip::tcp::socket( reactor );
+      writer->connect( endpoint );
+      writer->set_option( boost::asio::ip::tcp::no_delay( true ) );
+      writers.push_back( writer );
+
+      connection_ptr connection( new SimpleTcpConnection( reactor,
+                                                          SimpleTcpConnection::FRAMING_AUTO ) );
+      acceptor.accept( connection->getSocket() );
+      Reader* reader = new Reader( connection );
+      reader->read();
+      readers.push_back( reader );
+   }
+}
+
+// close both sides of the connections, the readers are left to the process
+static void closeAll( boost::asio::io_service& reactor,
+                      std::vector< Reader* >& readers,
+                      std::vector< boost::asio::ip::tcp::socket* >& writers )
+{
+   for ( size_t i = 0;
+         i < readers.size();
+         ++i )
+   {
+      reactor.post( boost::bind( &SimpleTcpConnection::close,
+                                 readers[ i ]->getConnection() ) );
+   }
+   while ( finished.load() < readers.size() )
+   {
+      boost::this_thread::yield();
+   }
+   for ( size_t i = 0;
+         i < writers.size();
+         ++i )
+   {
+      delete writers[ i ];
+   }
+   readers.clear();
+   writers.clear();
+}
+
+// write the messages on the connections in turn and wait for them to be read
+// give back the messages read per second, the cpu time per message in microseconds and the messages per read
+static void measure( std::vector< boost::asio::ip::tcp::socket* >& writers,
+                     size_t numberOfMessages,
+                     double& throughput,
+                     double& cpuPerMessage,
+                     double& messagesPerRead )
+{
+   // a length prefixed frame, the framing of the readers is detected on its first byte
+   std::string frame( 4, '\0' );
+   frame[ 3 ] = static_cast< char >( MESSAGE_SIZE );
+   frame.append( MESSAGE_SIZE, 'x' );
+
+   size_t rounds = std::max( numberOfMessages / writers.size(), static_cast< size_t >( 1 ) );
+   size_t total = rounds * writers.size();
+   received.store( 0 );
+   reads.store( 0 );
+   double cpuStart = getCpuTime();
+   boost::chrono::steady_clock::time_point start = boost::chrono::steady_clock::now();
+   for ( size_t round = 0;
+         round < rounds;
+         ++round )
+   {
+      for ( size_t i = 0;
+            i < writers.size();
+            ++i )
+      {
+         boost::asio::write( *writers[ i ],
+                             boost::asio::buffer( frame ) );
+      }
+   }
+   while ( received.load() < total )
+   {
+      boost::this_thread::yield();
+   }
+   boost::chrono::nanoseconds spent = boost::chrono::steady_clock::now() - start;
+   throughput = static_cast< double >( total ) * 1000000000 / spent.count();
+   cpuPerMessage = ( getCpuTime() - cpuStart ) / total;
+   messagesPerRead = static_cast< double >( total ) / std::max( reads.load(), static_cast< size_t >( 1 ) );
+}
+
+int main( int argc,
+          char* argv[] )
+{
+   int port = ( argc >= 2 ) ? atoi( argv[ 1 ] ) : 19800;
+   size_t numberOfMessages = ( argc >= 3 ) ? atoi( argv[ 2 ] ) : 200000;
+
+   size_t descriptorLimit = raiseDescriptorLimit();
+
+   boost::asio::io_service reactor;
+   boost::asio::io_service::work work( reactor );
+   boost::thread reactorThread( boost::bind( &boost::asio::io_service::run,
+                                             &reactor ) );
+
+   std::cout << "backend " << getReactorBackendName() << ", " << numberOfMessages << " messages of " << MESSAGE_SIZE
+             << " bytes per run, limit of descriptors " << descriptorLimit << std::endl;
+   std::cout << std::setw( 12 ) << "connections"
+             << std::setw( 10 ) << "reads"
+             << std::setw( 16 ) << "messages/s"
+             << std::setw( 18 ) << "cpu/message (us)"
+             << std::setw( 18 ) << "messages/read" << std::endl;
+   int run = 0;
+   bool clamped = false;
+   for ( size_t c = 0;
+         c < sizeof( CONNECTIONS ) / sizeof( CONNECTIONS[ 0 ] );
+         ++c )
+   {
+      // a count the limit can't hold is measured with as many connections as it can hold, the next ones skipped
+      size_t numberOfConnections = std::min( CONNECTIONS[ c ],
+                                             ( descriptorLimit - DESCRIPTOR_MARGIN ) / 2 );
+      if ( numberOfConnections < CONNECTIONS[ c ] )
+      {
+         if ( clamped == true )
+         {
+            std::cout << std::setw( 12 ) << CONNECTIONS[ c ] << "  skipped: needs " << 2 * CONNECTIONS[ c ] + DESCRIPTOR_MARGIN
+                      << " descriptors (raise the hard limit, ulimit -Hn)" << std::endl;
+            continue;
+         }
+         clamped = true;
+         std::cout << std::setw( 12 ) << CONNECTIONS[ c ] << "  measured with " << numberOfConnections
+                   << " connections: needs " << 2 * CONNECTIONS[ c ] + DESCRIPTOR_MARGIN
+                   << " descriptors (raise the hard limit, ulimit -Hn)" << std::endl;
+      }
+      for ( int uring = 0;
+            uring < 2;
+            ++uring )
+      {
+#ifdef BACKBONE_IO_URING
+         UringReadService::setEnabled( uring == 1 );
+#else
+         if ( uring == 1 )
+         {
+            std::cout << std::setw( 12 ) << CONNECTIONS[ c ] << "  io_uring: build with -DBACKBONE_IO_URING" << std::endl;
+            continue;
+         }
+#endif
+         std::vector< Reader* > readers;
+         std::vector< boost::asio::ip::tcp::socket* > writers;
+         finished.store( 0 );
+         connectAll( reactor,
+                     port + run++,
+                     numberOfConnections,
+                     readers,
+                     writers );
+         double throughput = 0;
+         double cpuPerMessage = 0;
+         double messagesPerRead = 0;
+         measure( writers,
+                  numberOfMessages,
+                  throughput,
+                  cpuPerMessage,
+                  messagesPerRead );
+         closeAll( reactor,
+                   readers,
+                   writers );
+         std::cout << std::setw( 12 ) << numberOfConnections
+                   << std::setw( 10 ) << ( ( uring == 1 ) ? "io_uring" : "epoll" )
+                   << std::setw( 16 ) << std::fixed << std::setprecision( 0 ) << throughput
+                   << std::setw( 18 ) << std::setprecision( 2 ) << cpuPerMessage
+                   << std::setw( 18 ) << messagesPerRead << std::endl;
+      }
+   }
+
+   // the readers are left as they are
+   std::cout.flush();
+   _exit( 0 );
+}
@@ -3,6 +3,7 @@
 #include "GraphGridProvider.hpp"
 #include "GraphGrid.hpp"
 #include "network/NetworkMessage.hpp"
+#include "network/BinaryProtocol.hpp"
 #include "provider/AbstractProviderManager.hpp"
 #include "string/StringUtils.hpp"
 #include "logger/asyncLogger.hpp"
@@ -20,12 +21,23 @@ static const std::string MANHATTAN( "MANHATTAN" );
 static const std::string EPSILON( "EPSILON" );
 static const std::string RESET_PATH( "RESET_PATH" );
 static const std::string CLEAR_GRAPH( "CLEAR_GRAPH" );
+static const std::string CELL_UPDATED( "CELL_UPDATED" );
+static const std::string COMPUTE_RESULT( "COMPUTE_RESULT" );
+static const std::string BATCH_REFUSED( "BATCH_REFUSED" );
+
+// the codes of the verbs in the binary protocol
+static const int CHANGE_CELL_STATE_WORD = BinaryProtocol::findWord( CHANGE_CELL_STATE );
+static const int CELL_UPDATED_WORD = BinaryProtocol::findWord( CELL_UPDATED );
+static const int COMPUTE_RESULT_WORD = BinaryProtocol::findWord( COMPUTE_RESULT );
+static const int GAME_BATCH_WORD = BinaryProtocol::findWord( GAME_BATCH );
+static const int GAME_BATCH_SEPARATOR_WORD = BinaryProtocol::findWord( GAME_BATCH_SEPARATOR );
 
 // default ctor
 GraphGridProvider::GraphGridProvider( size_t width,
                                       size_t height )
 :
-   AbstractGameProvider()
+   AbstractGameProvider(),
+   batching( false )
 {
    graphGrid.initializeGraph( this,
                               width,
@@ -43,7 +55,31 @@ void GraphGridProvider::sendMessageChangeCell( size_t x,
                                                size_t y,
                                                const std::string& value )
 {
-   if ( manager != NULL )
+   if ( batching == true )
+   {
+      // sent with the other changes at the end of the batch
+      CellUpdate update;
+      update.x = x;
+      update.y = y;
+      update.value = value;
+      cellUpdates.push_back( update );
+   }
+   else if (  ( manager != NULL )
+       &&( manager->isBinaryProtocol() == true )  )
+   {
+      // GAME_MESSAGE gameNumber CELL_UPDATED x y terrain
+      SharedBuffer frame = BufferPool::getInstance().acquire( 16 + value.size() );
+      BinaryWriter writer( *frame );
+      writer.writeOpcode( BinaryProtocol::OP_GAME_MESSAGE );
+      writer.writeUInt( gameNumber );
+      writer.writeTokenWord( CELL_UPDATED_WORD );
+      writer.writeTokenUInt( x );
+      writer.writeTokenUInt( y );
+      writer.writeToken( value );
+
+      manager->sendBinaryMessage( frame );
+   }
+   else if ( manager != NULL )
    {
       char message[ 1024 ];
       sprintf_s( message,
@@ -59,6 +95,71 @@ void GraphGridProvider::sendMessageChangeCell( size_t x,
    }
 }
 
+// start to aggregate the cell changes
+void GraphGridProvider::beginBatch()
+{
+   batching = true;
+   cellUpdates.clear();
+}
+
+// send the aggregated cell changes as a single batch and stop the aggregation
+void GraphGridProvider::flushCellUpdates()
+{
+   batching = false;
+   if (  ( cellUpdates.empty() == true )
+       ||( manager == NULL )  )
+   {
+      cellUpdates.clear();
+      return;
+   }
+
+   if ( manager->isBinaryProtocol() == true )
+   {
+      // GAME_MESSAGE gameNumber GAME_BATCH CELL_UPDATED x y terrain ; CELL_UPDATED x y terrain ...
+      SharedBuffer frame = BufferPool::getInstance().acquire( 16 + 24 * cellUpdates.size() );
+      BinaryWriter writer( *frame );
+      writer.writeOpcode( BinaryProtocol::OP_GAME_MESSAGE );
+      writer.writeUInt( gameNumber );
+      writer.writeTokenWord( GAME_BATCH_WORD );
+      for ( size_t i = 0;
+            i < cellUpdates.size();
+            ++i )
+      {
+         if ( i > 0 )
+         {
+            writer.writeTokenWord( GAME_BATCH_SEPARATOR_WORD );
+         }
+         writer.writeTokenWord( CELL_UPDATED_WORD );
+         writer.writeTokenUInt( cellUpdates[ i ].x );
+         writer.writeTokenUInt( cellUpdates[ i ].y );
+         writer.writeToken( cellUpdates[ i ].value );
+      }
+
+      manager->sendBinaryMessage( frame );
+   }
+   else
+   {
+      std::stringstream message;
+      message << GAME_MESSAGE << ' ' << gameId << ' ' << GAME_BATCH;
+      for ( size_t i = 0;
+            i < cellUpdates.size();
+            ++i )
+      {
+         if ( i > 0 )
+         {
+            message << ' ' << GAME_BATCH_SEPARATOR;
+         }
+         message << ' ' << CELL_UPDATED
+                 << ' ' << cellUpdates[ i ].x
+                 << ' ' << cellUpdates[ i ].y
+                 << ' ' << cellUpdates[ i ].value;
+      }
+
+      manager->sendMessage( message.str() );
+   }
+   cellUpdates.clear();
+}
+
 // call a DFS computation
 void GraphGridProvider::callComputation( ComputeFunctionPtr algorithm )
 {
@@ -99,12 +200,34 @@ void GraphGridProvider::callClear()
 // and send the message
 void GraphGridProvider::sendComputeResult( const std::string& result )
 {
+   // the cell changes of the batch made before the computation go first
+   if ( batching == true )
+   {
+      flushCellUpdates();
+      beginBatch();
+   }
+
    // get the graph description
    std::stringstream graphStr;
    graphGrid.display( graphStr );
 
    // send the message if the manager is present
-   if ( manager != NULL )
+   if (  ( manager != NULL )
+       &&( manager->isBinaryProtocol() == true )  )
+   {
+      // GAME_MESSAGE gameNumber COMPUTE_RESULT result graph, the graph being a single string
+      std::string graph = graphStr.str();
+      SharedBuffer frame = BufferPool::getInstance().acquire( 32 + result.size() + graph.size() );
+      BinaryWriter writer( *frame );
+      writer.writeOpcode( BinaryProtocol::OP_GAME_MESSAGE );
+      writer.writeUInt( gameNumber );
+      writer.writeTokenWord( COMPUTE_RESULT_WORD );
+      writer.writeToken( result );
+      writer.writeTokenString( graph );
+
+      manager->sendBinaryMessage( frame );
+   }
+   else if ( manager != NULL )
    {
       //int size = 256 + ( graphGrid.getNumberOfCells() * 2 );
       //char* message = new char( size );
@@ -167,8 +290,49 @@ void GraphGridProvider::handleGameMessage( const std::string& message )
                          ' ',
                          messageParts );
 
+   if (  ( messageParts.empty() == true )
+       ||( messageParts[ 0 ] != GAME_BATCH )  )
+   {
+      handleCommand( messageParts );
+      return;
+   }
+
+   // GAME_BATCH command ; command ; ... applied in one pass
+   beginBatch();
+   std::vector< std::string > commandParts;
+   for ( size_t i = 1;
+         i <= messageParts.size();
+         ++i )
+   {
+      if (  ( i == messageParts.size() )
+          ||( messageParts[ i ] == GAME_BATCH_SEPARATOR )  )
+      {
+         handleCommand( commandParts );
+         commandParts.clear();
+      }
+      else
+      {
+         commandParts.push_back( messageParts[ i ] );
+      }
+   }
+   flushCellUpdates();
+}
+
+// apply a single command of the game
+void GraphGridProvider::handleCommand( const std::vector< std::string >& messageParts )
+{
+   if ( messageParts.empty() == true )
+   {
+      return;
+   }
+
    if ( messageParts[ 0 ] == CHANGE_CELL_STATE )
    {
+      if ( messageParts.size() < 4 )
+      {
+         return;
+      }
+
       graphGrid.setValueAt( atoi( messageParts[ 1 ].c_str() ),
                             atoi( messageParts[ 2 ].c_str() ),
                             messageParts[ 3 ] );
@@ -210,6 +374,149 @@ void GraphGridProvider::handleGameMessage( const std::string& message )
    }
 }
 
+// apply the commands of a batch in the binary form, the cell changes are read directly from the frame
+// the frame can not be read past a malformed token, the commands before it are applied and the sender told
+void GraphGridProvider::handleBinaryBatch( BinaryReader& reader )
+{
+   beginBatch();
+   size_t command = 0;
+   while (  ( reader.isValid() == true )
+          &&( reader.hasMore() == true )  )
+   {
+      std::vector< std::string > commandParts;
+      int verb = -1;
+      if ( reader.peekTag() == BinaryProtocol::TAG_WORD )
+      {
+         verb = reader.readTokenWord();
+      }
+
+      if ( verb == CHANGE_CELL_STATE_WORD )
+      {
+         // CHANGE_CELL_STATE x y terrain, a terrain outside the dictionary is written as a string
+         size_t x = static_cast< size_t >( reader.readTokenUInt() );
+         size_t y = static_cast< size_t >( reader.readTokenUInt() );
+         int terrain = -1;
+         std::string terrainName;
+         if ( reader.peekTag() == BinaryProtocol::TAG_WORD )
+         {
+            terrain = reader.readTokenWord();
+         }
+         else
+         {
+            reader.readToken( terrainName );
+         }
+         if ( reader.isValid() == true )
+         {
+            graphGrid.setValueAt( x,
+                                  y,
+                                  ( terrain >= 0 ) ? BinaryProtocol::getWord( terrain ) : terrainName );
+         }
+      }
+      else if (  ( verb >= 0 )
+               &&( verb != GAME_BATCH_SEPARATOR_WORD )  )
+      {
+         commandParts.push_back( BinaryProtocol::getWord( verb ) );
+      }
+
+      // the rest of the command up to the separator
+      while (  ( verb != GAME_BATCH_SEPARATOR_WORD )
+             &&( reader.isValid() == true )
+             &&( reader.hasMore() == true )  )
+      {
+         std::string token;
+         reader.readToken( token );
+         if ( token == GAME_BATCH_SEPARATOR )
+         {
+            break;
+         }
+         commandParts.push_back( token );
+      }
+
+      if ( reader.isValid() == false )
+      {
+         break;
+      }
+      if ( verb != CHANGE_CELL_STATE_WORD )
+      {
+         handleCommand( commandParts );
+      }
+      command++;
+   }
+   flushCellUpdates();
+
+   if ( reader.isValid() == false )
+   {
+      sendBatchRefused( command,
+                        "Malformed command, the rest of the batch is not applied" );
+   }
+}
+
+// tell the players the batch stopped at the command (counted from 0), the commands before it are applied
+//     'GAME_MESSAGE gameId BATCH_REFUSED command reason'
+void GraphGridProvider::sendBatchRefused( size_t command,
+                                          const std::string& reason )
+{
+   if (  ( manager != NULL )
+       &&( manager->isBinaryProtocol() == true )  )
+   {
+      SharedBuffer frame = BufferPool::getInstance().acquire( 32 + reason.size() );
+      BinaryWriter writer( *frame );
+      writer.writeOpcode( BinaryProtocol::OP_GAME_MESSAGE );
+      writer.writeUInt( gameNumber );
+      writer.writeToken( BATCH_REFUSED );
+      writer.writeTokenUInt( command );
+      writer.writeTokenString( reason );
+
+      manager->sendBinaryMessage( frame );
+   }
+   else if ( manager != NULL )
+   {
+      std::stringstream message;
+      message << GAME_MESSAGE << ' ' << gameId << ' ' << BATCH_REFUSED << ' ' << command << ' ' << reason;
+      manager->sendMessage( message.str() );
+   }
+}
+
+// call back for message management in the binary form
+// the cell changes are read directly from the frame, the other messages go through handleCommand
+void GraphGridProvider::handleBinaryGameMessage( SharedMessage frame,
+                                                 size_t payloadOffset )
+{
+   BinaryReader reader( *frame,
+                        payloadOffset );
+   int verb = -1;
+   if ( reader.peekTag() == BinaryProtocol::TAG_WORD )
+   {
+      verb = reader.readTokenWord();
+   }
+
+   // GAME_BATCH command ; command ; ...
+   if ( verb == GAME_BATCH_WORD )
+   {
+      handleBinaryBatch( reader );
+      return;
+   }
+
+   // CHANGE_CELL_STATE x y terrain
+   if ( verb == CHANGE_CELL_STATE_WORD )
+   {
+      size_t x = static_cast< size_t >( reader.readTokenUInt() );
+      size_t y = static_cast< size_t >( reader.readTokenUInt() );
+      int terrain = reader.readTokenWord();
+      if ( reader.isValid() == true )
+      {
+         graphGrid.setValueAt( x,
+                               y,
+                               BinaryProtocol::getWord( terrain ) );
+         return;
+      }
+   }
+
+   // any other message
+   AbstractGameProvider::handleBinaryGameMessage( frame,
+                                                  payloadOffset );
+}
+
 // get the name of the provider
 const std::string& GraphGridProvider::getName()
 {
@@ -1,14 +1,31 @@
 #pragma once
 
+#include <vector>
 #include "GraphGrid.hpp"
 #include "provider/AbstractGameProvider.hpp"
 
+class BinaryReader;
+
 // provider for the graph display client
 class GraphGridProvider : public AbstractGameProvider
 {
    // the graph grid used (owned)
    GraphGrid graphGrid;
 
+   // a cell changed while a batch is applied
+   struct CellUpdate
+   {
+      size_t x;
+      size_t y;
+      std::string value;
+   };
+
+   // true while a batch is applied, the cell changes are sent in a single reply at its end
+   bool batching;
+
+   // the cell changes of the batch not sent yet
+   std::vector< CellUpdate > cellUpdates;
+
 public:
    // the name of the provider
    static const std::string NAME;
@@ -34,10 +51,33 @@ public:
    // call back for message managmeent
    virtual void handleGameMessage( const std::string& message );
 
+   // call back for message management in the binary form
+   // the cell changes are read directly from the frame, the other messages go through handleCommand
+   virtual void handleBinaryGameMessage( SharedMessage frame,
+                                         size_t payloadOffset );
+
    // get the name of the provider
    virtual const std::string& getName();
 
 private:
+   // apply a single command of the game
+   void handleCommand( const std::vector< std::string >& messageParts );
+
+   // apply the commands of a batch in the binary form, the cell changes are read directly from the frame
+   // the commands before a malformed one are applied, then the sender is told with BATCH_REFUSED
+   void handleBinaryBatch( BinaryReader& reader );
+
+   // tell the players the batch stopped at the command (counted from 0), the commands before it are applied
+   //     'GAME_MESSAGE gameId BATCH_REFUSED command reason'
+   void sendBatchRefused( size_t command,
+                          const std::string& reason );
+
+   // start to aggregate the cell changes
+   void beginBatch();
+
+   // send the aggregated cell changes as a single batch and stop the aggregation
+   void flushCellUpdates();
+
    // functor typepef for the computation call
    typedef bool (*ComputeFunctionPtr)( GraphGrid* );
 
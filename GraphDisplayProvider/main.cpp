@@ -2,26 +2,62 @@
 
 #include <boost/asio.hpp>
 #include <iostream>
+#include <boost/scoped_ptr.hpp>
 
 #include "network/SimpleTcpConnection.hpp"
 #include "network/client/ConnectionToServer.hpp"
+#include "thread/WorkerPool.hpp"
 #include "GraphProviderManager.hpp"
 
 int main( int argc, char* argv[] )
 {
-   if ( argc != 3 )
+   if (  ( argc < 3 )
+       ||( argc > 5 )  )
    {
-      std::cout << "USAGE: GraphDisplayProvider <host> <port>" << std::endl;
+      std::cout << "USAGE: GraphDisplayProvider <host|unix:path|shm:path> <port> [networkWorkers] [text|binary|deflate]" << std::endl;
       return 1;
    }
 
+   // the messages from the server are handled inline in the reactor thread
+   // unless a number of network workers is given
+   size_t networkWorkers = ( argc >= 4 ) ? atoi( argv[ 3 ] ) : 0;
+   boost::scoped_ptr< WorkerPool > networkPool;
+   Executor* networkExecutor = &InlineExecutor::getInstance();
+   if ( networkWorkers > 0 )
+   {
+      networkPool.reset( new WorkerPool( networkWorkers ) );
+      networkExecutor = networkPool.get();
+   }
+
+   // the compact binary protocol is asked to the server unless text is given
+   // with the compression of the big game frames if deflate is given
+   bool binaryProtocol = (  ( argc < 5 )
+                          ||( std::string( argv[ 4 ] ) != "text" )  );
+   bool compression = (  ( argc >= 5 )
+                       &&( std::string( argv[ 4 ] ) == "deflate" )  );
+
    // create the boost reactor
 	boost::asio::io_service io_service;
 
-   // create the connection to the server
-   connection_ptr new_connection( new SimpleTcpConnection( io_service ) );
+   // create the connection to the server, through its unix domain socket if a 'unix:<path>' host is given
+   // and through shared memory rings if a 'shm:<path>' host is given
+   SimpleTcpConnection::Transport transport = SimpleTcpConnection::TRANSPORT_TCP;
+   if ( SimpleTcpConnection::isLocalAddress( argv[ 1 ] ) == true )
+   {
+      transport = SimpleTcpConnection::TRANSPORT_LOCAL;
+   }
+   else if ( SimpleTcpConnection::isSharedMemoryAddress( argv[ 1 ] ) == true )
+   {
+      transport = SimpleTcpConnection::TRANSPORT_SHARED_MEMORY;
+   }
+   connection_ptr new_connection( new SimpleTcpConnection( io_service,
+                                                           SimpleTcpConnection::FRAMING_LENGTH_PREFIXED,
+                                                           transport ) );
    GraphProviderManager server( ConnectionToServer::create( "GraphDisplayProvider",
-                                                            new_connection ) );
+                                                            new_connection,
+                                                            *networkExecutor,
+                                                            binaryProtocol,
+                                                            compression ) );
    server.connect( argv[ 1 ],
                    atoi( argv[ 2 ] ) );
 
@@ -0,0 +1,202 @@
+#pragma once
+
+#include <vector>
+#include <map>
+#include <utility>
+#include <cstddef>
+
+// binary min-heap of keys by priority with the position of each key
+// so the priority of a key already in the heap can be changed or the key removed in O(log n)
+// each entry points to the node of its key in the positions, a move updates it without a lookup
+// the top is the key of lowest priority, the lowest key between equal priorities
+// the heap is not thread safe
+// this class is fully inline to ease the sharing
+template< typename Key,
+          typename Priority >
+class IndexedHeap
+{
+   // the position of each key in the entries
+   typedef std::map< Key, size_t > PositionMap;
+   PositionMap positions;
+
+   // a key (through its position) with its priority
+   struct Entry
+   {
+      Priority priority;
+      typename PositionMap::iterator itPosition;
+   };
+
+   // the entries in heap order
+   std::vector< Entry > entries;
+
+public:
+   // an empty heap
+   IndexedHeap()
+   :
+      positions(),
+      entries()
+   {
+   }
+
+   // copy, the entries point to the positions of the copy
+   IndexedHeap( const IndexedHeap& other )
+   :
+      positions( other.positions ),
+      entries( other.entries )
+   {
+      repoint();
+   }
+
+   // assign, the entries point to the positions of the copy
+   IndexedHeap& operator=( const IndexedHeap& other )
+   {
+      if ( this != &other )
+      {
+         positions = other.positions;
+         entries = other.entries;
+         repoint();
+      }
+      return *this;
+   }
+
+   // return true if there is no key in the heap
+   bool empty() const
+   {
+      return entries.empty();
+   }
+
+   // get the number of keys in the heap
+   size_t size() const
+   {
+      return entries.size();
+   }
+
+   // return true if the key is in the heap
+   bool contains( const Key& key ) const
+   {
+      return ( positions.find( key ) != positions.end() );
+   }
+
+   // get the key of lowest priority, the heap must not be empty
+   const Key& top() const
+   {
+      return entries.front().itPosition->first;
+   }
+
+   // add the key with its priority or change the priority of the key already in the heap
+   void set( const Key& key,
+             Priority priority )
+   {
+      typename PositionMap::iterator itPosition = positions.find( key );
+      if ( itPosition == positions.end() )
+      {
+         Entry entry;
+         entry.priority = priority;
+         entry.itPosition = positions.insert( typename PositionMap::value_type( key,
+                                                                                entries.size() ) ).first;
+         entries.push_back( entry );
+         siftUp( entries.size() - 1 );
+         return;
+      }
+
+      entries[ itPosition->second ].priority = priority;
+      siftUp( itPosition->second );
+      siftDown( itPosition->second );
+   }
+
+   // remove the key from the heap if it is in
+   void erase( const Key& key )
+   {
+      typename PositionMap::iterator itPosition = positions.find( key );
+      if ( itPosition == positions.end() )
+      {
+         return;
+      }
+
+      // the last entry takes the place of the removed one then goes up or down
+      size_t position = itPosition->second;
+      positions.erase( itPosition );
+      entries[ position ] = entries.back();
+      entries.pop_back();
+      if ( position < entries.size() )
+      {
+         typename PositionMap::iterator itMoved = entries[ position ].itPosition;
+         itMoved->second = position;
+         siftUp( position );
+         siftDown( itMoved->second );
+      }
+   }
+
+private:
+   // point the entries to the positions of this heap
+   void repoint()
+   {
+      for ( typename PositionMap::iterator itPosition = positions.begin();
+            itPosition != positions.end();
+            itPosition++ )
+      {
+         entries[ itPosition->second ].itPosition = itPosition;
+      }
+   }
+
+   // return true if the first entry goes before the second, by priority then by key
+   bool lower( size_t first,
+               size_t second ) const
+   {
+      if ( entries[ first ].priority != entries[ second ].priority )
+      {
+         return ( entries[ first ].priority < entries[ second ].priority );
+      }
+      return ( entries[ first ].itPosition->first < entries[ second ].itPosition->first );
+   }
+
+   // exchange two entries and their positions
+   void swapEntries( size_t first,
+                     size_t second )
+   {
+      std::swap( entries[ first ],
+                 entries[ second ] );
+      entries[ first ].itPosition->second = first;
+      entries[ second ].itPosition->second = second;
+   }
+
+   // move the entry up while it is lower than its parent
+   void siftUp( size_t position )
+   {
+      while (  ( position > 0 )
+             &&( lower( position, ( position - 1 ) / 2 ) == true )  )
+      {
+         swapEntries( position,
+                      ( position - 1 ) / 2 );
+         position = ( position - 1 ) / 2;
+      }
+   }
+
+   // move the entry down while one of its children is lower
+   void siftDown( size_t position )
+   {
+      while ( true )
+      {
+         size_t lowest = position;
+         size_t left = 2 * position + 1;
+         size_t right = left + 1;
+         if (  ( left < entries.size() )
+             &&( lower( left, lowest ) == true )  )
+         {
+            lowest = left;
+         }
+         if (  ( right < entries.size() )
+             &&( lower( right, lowest ) == true )  )
+         {
+            lowest = right;
+         }
+         if ( lowest == position )
+         {
+            return;
+         }
+         swapEntries( position,
+                      lowest );
+         position = lowest;
+      }
+   }
+};
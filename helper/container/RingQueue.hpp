@@ -0,0 +1,137 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <cstddef>
+
+// first in first out queue stored in a ring of slots which only grows
+// unlike a deque no memory is allocated once the ring reached the largest size of the queue,
+// a slot is given back empty (a default value is swapped in) so the references it held are released at once
+// the values are moved with swap when the ring grows (their own swap if they have one),
+// so a value with heap state is not copied then
+// the queue is not thread safe
+// this class is fully inline to ease the sharing
+template< typename Value >
+class RingQueue
+{
+   // the slots, their number is a power of 2
+   std::vector< Value > slots;
+
+   // the slot of the first value
+   size_t head;
+
+   // the number of values in the queue
+   size_t count;
+
+public:
+   // an empty queue, the ring is allocated with the first value
+   RingQueue()
+   :
+      slots(),
+      head( 0 ),
+      count( 0 )
+   {
+   }
+
+   // return true if there is no value in the queue
+   bool empty() const
+   {
+      return ( count == 0 );
+   }
+
+   // get the number of values in the queue
+   size_t size() const
+   {
+      return count;
+   }
+
+   // get the value at the position from the first one, the position must be lower than the size
+   Value& operator[]( size_t position )
+   {
+      return slots[ ( head + position ) & ( slots.size() - 1 ) ];
+   }
+
+   // get the value at the position from the first one, the position must be lower than the size
+   const Value& operator[]( size_t position ) const
+   {
+      return slots[ ( head + position ) & ( slots.size() - 1 ) ];
+   }
+
+   // get the first value, the queue must not be empty
+   Value& front()
+   {
+      return slots[ head ];
+   }
+
+   // get the last value, the queue must not be empty
+   Value& back()
+   {
+      return (*this)[ count - 1 ];
+   }
+
+   // add a copy of the value at the end
+   void push_back( const Value& value )
+   {
+      push_back() = value;
+   }
+
+   // add a default value at the end and return it, to be filled or swapped in place
+   Value& push_back()
+   {
+      if ( count == slots.size() )
+      {
+         grow();
+      }
+      count++;
+      return back();
+   }
+
+   // remove the first value, the queue must not be empty
+   void pop_front()
+   {
+      using std::swap;
+      Value empty;
+      swap( slots[ head ],
+            empty );
+      head = ( head + 1 ) & ( slots.size() - 1 );
+      count--;
+   }
+
+   // remove all the values, the ring is kept
+   void clear()
+   {
+      while ( count > 0 )
+      {
+         pop_front();
+      }
+      head = 0;
+   }
+
+   // exchange the content of the queues, rings included
+   void swap( RingQueue& other )
+   {
+      slots.swap( other.slots );
+      std::swap( head,
+                 other.head );
+      std::swap( count,
+                 other.count );
+   }
+
+private:
+   // double the ring, the values are swapped in the new one from its first slot
+   void grow()
+   {
+      using std::swap;
+      std::vector< Value > grown( std::max( slots.size() * 2,
+                                            static_cast< size_t >( 16 ) ) );
+      for ( size_t i = 0;
+            i < count;
+            ++i )
+      {
+         swap( grown[ i ],
+               (*this)[ i ] );
+      }
+      slots.swap( grown );
+      head = 0;
+   }
+};
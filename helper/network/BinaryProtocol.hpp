@@ -0,0 +1,958 @@
+#pragma once
+
+#include <string>
+#include <sstream>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <boost/cstdint.hpp>
+#include <boost/function.hpp>
+#include "NetworkMessage.hpp"
+#include "../string/StringUtils.hpp"
+
+// compact binary encoding of the messages, negotiated during the MESSAGE_INIT handshake
+// ('SYSTEM_INIT_CONNECTION BINARY' answered by 'SYSTEM_LOGIN_ASKED BINARY')
+// the handshake itself stays in text, the binary frames are used once the login is accepted
+//
+// a frame is a one byte opcode followed by its fields:
+//     integers and game ids are varints (7 bits per byte, low bits first)
+//     strings are a varint size followed by the bytes
+//     game payloads are a list of tokens, each token being
+//         0x80 | code  a word of the dictionary (verbs, terrains ...)
+//         TAG_UINT     followed by a varint
+//         TAG_STRING   followed by a string
+// a game id 'kind_N' is sent as N, the unique number of the game
+class BinaryProtocol
+{
+public:
+   // the opcodes of the frames
+   enum Opcode
+   {
+      OP_TEXT = 0,                  // string: any other message
+      OP_CLOSE_CONNECTION,          //
+      OP_REGISTER,                  // tokens: CONSUMER | PROVIDER and the games
+      OP_REQUEST_GAME,              // string: kind
+      OP_REQUEST_GAME_LIST,         // string: kind
+      OP_REQUEST_GAME_LIST_RESULT,  // varint: count, varint: game *
+      OP_JOIN_OR_REQUEST_GAME,      // string: kind
+      OP_JOIN_GAME,                 // varint: game
+      OP_LEAVE_GAME,                // varint: game
+      OP_GAME_CREATION_REFUSED,     // varint: game, string: reason
+      OP_GAME_CREATED,              // varint: game, string: kind
+      OP_GAME_ACCEPTED,             // varint: game, string: kind
+      OP_GAME_REFUSED,              // string: reason
+      OP_GAME_JOIN_REFUSED,         // varint: game, string: reason
+      OP_GAME_CLOSE,                // varint: count, varint: game *, string: reason
+      OP_GAME_MESSAGE,              // varint: game, tokens: the game message
+      OP_COMPRESSED_GAME_MESSAGE,   // varint: game, varint: size of the tokens, deflated tokens (see FrameCompressor)
+      OP_PING,                      //
+      OP_PONG,                      //
+      OP_REQUEST,                   // varint: request id, the frame of the control message
+      OP_REPLY,                     // varint: request id, the frame of the reply
+      OP_LAST
+   };
+
+   // the tags of the tokens
+   enum Tag
+   {
+      TAG_UINT = 0x01,
+      TAG_STRING = 0x02,
+      TAG_WORD = 0x80
+   };
+
+   // the function giving back the text id of a game from its number
+   typedef boost::function< std::string ( boost::uint64_t ) > GameIdResolver;
+
+   // return the word of the dictionary given its code
+   static const std::string& getWord( int code )
+   {
+      return getDictionary()[ code ];
+   }
+
+   // return the code of the word or -1 if the word isn't in the dictionary
+   static int findWord( const std::string& word )
+   {
+      static const std::map< std::string, int > codes( buildCodes() );
+
+      std::map< std::string, int >::const_iterator it = codes.find( word );
+      return ( it != codes.end() ) ? it->second : -1;
+   }
+
+   // get the number of a game given its text id 'kind_N'
+   // return false if the id does not end with '_' followed by at most 19 digits
+   static bool parseGameNumber( const std::string& gameId,
+                                boost::uint64_t& number )
+   {
+      return parseGameNumber( gameId,
+                              0,
+                              gameId.size(),
+                              number );
+   }
+
+   // get the number of a game given its text id, the length bytes of the text from start
+   // the id is read in place so a received message is not copied
+   static bool parseGameNumber( const std::string& text,
+                                size_t start,
+                                size_t length,
+                                boost::uint64_t& number )
+   {
+      size_t end = start + length;
+      size_t separator = ( length > 0 ) ? text.rfind( '_', end - 1 ) : std::string::npos;
+      if (  ( separator == std::string::npos )
+          ||( separator < start )
+          ||( separator + 1 == end )
+          ||( end - separator - 1 > 19 )  )
+      {
+         return false;
+      }
+
+      boost::uint64_t value = 0;
+      for ( size_t i = separator + 1;
+            i < end;
+            ++i )
+      {
+         if (  ( text[ i ] < '0' )
+             ||( text[ i ] > '9' )  )
+         {
+            return false;
+         }
+         value = value * 10 + ( text[ i ] - '0' );
+      }
+      number = value;
+      return true;
+   }
+
+   // get the numbers of the game ids from the first one, return false if one of them is not a game id
+   static bool parseGameNumbers( const std::vector< std::string >& gameIds,
+                                 size_t first,
+                                 std::vector< boost::uint64_t >& numbers )
+   {
+      numbers.clear();
+      for ( size_t i = first;
+            i < gameIds.size();
+            ++i )
+      {
+         boost::uint64_t number = 0;
+         if ( parseGameNumber( gameIds[ i ],
+                               number ) == false )
+         {
+            return false;
+         }
+         numbers.push_back( number );
+      }
+      return true;
+   }
+
+   // return the request id written in the text, NO_REQUEST_ID if it is not a positive integer
+   static RequestId parseRequestId( const std::string& text )
+   {
+      RequestId id = 0;
+      if (  ( text.empty() == true )
+          ||( text.size() > 18 )  )
+      {
+         return NO_REQUEST_ID;
+      }
+      for ( size_t i = 0;
+            i < text.size();
+            ++i )
+      {
+         if (  ( text[ i ] < '0' )
+             ||( text[ i ] > '9' )  )
+         {
+            return NO_REQUEST_ID;
+         }
+         id = id * 10 + ( text[ i ] - '0' );
+      }
+      return id;
+   }
+
+   // return the text id of a game given its kind and number
+   static std::string makeGameId( const std::string& kind,
+                                  boost::uint64_t number )
+   {
+      std::stringstream stream;
+      stream << kind << "_" << number;
+      return stream.str();
+   }
+
+   // return the dictionary, the position of a word is its code
+   // the words are used by many threads, the statics are built by their initializer only
+   static const std::vector< std::string >& getDictionary()
+   {
+      // never remove or reorder a word, the codes are on the wire
+      static const char* words[] =
+      {
+         "CONSUMER", "PROVIDER", "PLAYER_JOIN_MESSAGE", "PLAYER_LEAVE_MESSAGE",
+         "CHANGE_CELL_STATE", "CELL_UPDATED", "COMPUTE_RESULT",
+         "COMPUTE_DFS", "COMPUTE_BFS", "COMPUTE_DIJ", "COMPUTE_ASTAR",
+         "EUCLIDE", "MANHATTAN", "EPSILON", "RESET_PATH", "CLEAR_GRAPH",
+         "OK", "KO", "RESET", "CLEAR",
+         "GRASS", "BLOCK", "START", "EXIT", "WATER", "ROAD", "FOREST", "MOUNTAIN", "VISITED", "PATH",
+         "GAME_BATCH", ";"
+      };
+      static const std::vector< std::string > dictionary( words,
+                                                          words + sizeof( words ) / sizeof( words[ 0 ] ) );
+      return dictionary;
+   }
+
+private:
+   // build the code of each word of the dictionary
+   static std::map< std::string, int > buildCodes()
+   {
+      std::map< std::string, int > codes;
+      const std::vector< std::string >& dictionary = getDictionary();
+      for ( size_t i = 0;
+            i < dictionary.size();
+            ++i )
+      {
+         codes[ dictionary[ i ] ] = static_cast< int >( i );
+      }
+      return codes;
+   }
+};
+
+// resolver giving back the text id of a game knowing its kind
+class GameIdOfKind
+{
+   // the kind of the game
+   std::string kind;
+
+public:
+   // resolve the games of the kind
+   explicit GameIdOfKind( const std::string& kind )
+   :
+      kind( kind )
+   {
+   }
+
+   // return the text id of the game
+   std::string operator()( boost::uint64_t number ) const
+   {
+      return BinaryProtocol::makeGameId( kind,
+                                         number );
+   }
+};
+
+// this class writes the fields of a binary frame at the end of a string
+class BinaryWriter
+{
+   // the frame being written (not owned)
+   std::string& out;
+
+public:
+   // write at the end of out
+   explicit BinaryWriter( std::string& out )
+   :
+      out( out )
+   {
+   }
+
+   // write the opcode of the frame
+   void writeOpcode( BinaryProtocol::Opcode opcode )
+   {
+      out += static_cast< char >( opcode );
+   }
+
+   // write an integer as a varint
+   void writeUInt( boost::uint64_t value )
+   {
+      while ( value >= 0x80 )
+      {
+         out += static_cast< char >( ( value & 0x7F ) | 0x80 );
+         value >>= 7;
+      }
+      out += static_cast< char >( value );
+   }
+
+   // write a string with its size
+   void writeString( const std::string& value )
+   {
+      writeUInt( value.size() );
+      out += value;
+   }
+
+   // write an integer token
+   void writeTokenUInt( boost::uint64_t value )
+   {
+      out += static_cast< char >( BinaryProtocol::TAG_UINT );
+      writeUInt( value );
+   }
+
+   // write a string token
+   void writeTokenString( const std::string& value )
+   {
+      out += static_cast< char >( BinaryProtocol::TAG_STRING );
+      writeString( value );
+   }
+
+   // write a word token given its code in the dictionary
+   void writeTokenWord( int code )
+   {
+      out += static_cast< char >( BinaryProtocol::TAG_WORD | code );
+   }
+
+   // write the token using the most compact form
+   void writeToken( const std::string& token )
+   {
+      int code = BinaryProtocol::findWord( token );
+      if ( code >= 0 )
+      {
+         writeTokenWord( code );
+      }
+      else if ( isCanonicalUInt( token ) == true )
+      {
+         boost::uint64_t value = 0;
+         for ( size_t i = 0;
+               i < token.size();
+               ++i )
+         {
+            value = value * 10 + ( token[ i ] - '0' );
+         }
+         writeTokenUInt( value );
+      }
+      else
+      {
+         writeTokenString( token );
+      }
+   }
+
+   // write the tokens of the parts starting at first
+   void writeTokens( const std::vector< std::string >& parts,
+                     size_t first )
+   {
+      for ( size_t i = first;
+            i < parts.size();
+            ++i )
+      {
+         writeToken( parts[ i ] );
+      }
+   }
+
+   // return true if the token is an integer written without leading 0 (so it's rendered back the same)
+   static bool isCanonicalUInt( const std::string& token )
+   {
+      if (  ( token.empty() == true )
+          ||( token.size() > 18 )
+          ||(  ( token[ 0 ] == '0' )
+             &&( token.size() > 1 )  )  )
+      {
+         return false;
+      }
+      for ( size_t i = 0;
+            i < token.size();
+            ++i )
+      {
+         if (  ( token[ i ] < '0' )
+             ||( token[ i ] > '9' )  )
+         {
+            return false;
+         }
+      }
+      return true;
+   }
+};
+
+// this class reads the fields of a binary frame
+// a read past the end or a malformed field makes the reader invalid and returns 0 / empty values
+class BinaryReader
+{
+   // the current position in the frame
+   const unsigned char* position;
+
+   // the end of the frame
+   const unsigned char* end;
+
+   // false once a read failed
+   bool valid;
+
+public:
+   // read the frame starting at offset
+   explicit BinaryReader( const std::string& frame,
+                          size_t offset = 0 )
+   :
+      position( reinterpret_cast< const unsigned char* >( frame.data() ) + std::min( offset, frame.size() ) ),
+      end( reinterpret_cast< const unsigned char* >( frame.data() ) + frame.size() ),
+      valid( true )
+   {
+   }
+
+   // return true if no read failed
+   bool isValid() const
+   {
+      return valid;
+   }
+
+   // return true if there is still something to read
+   bool hasMore() const
+   {
+      return position < end;
+   }
+
+   // return the number of bytes not read yet
+   size_t remaining() const
+   {
+      return end - position;
+   }
+
+   // read the opcode of the frame
+   BinaryProtocol::Opcode readOpcode()
+   {
+      if (  ( position >= end )
+          ||( *position >= BinaryProtocol::OP_LAST )  )
+      {
+         valid = false;
+         return BinaryProtocol::OP_TEXT;
+      }
+      return static_cast< BinaryProtocol::Opcode >( *position++ );
+   }
+
+   // read a varint
+   boost::uint64_t readUInt()
+   {
+      boost::uint64_t value = 0;
+      for ( int shift = 0;
+            shift < 64;
+            shift += 7 )
+      {
+         if ( position >= end )
+         {
+            break;
+         }
+         unsigned char byte = *position++;
+         value |= static_cast< boost::uint64_t >( byte & 0x7F ) << shift;
+         if ( ( byte & 0x80 ) == 0 )
+         {
+            return value;
+         }
+      }
+      valid = false;
+      return 0;
+   }
+
+   // read a string
+   std::string readString()
+   {
+      boost::uint64_t size = readUInt();
+      if (  ( valid == false )
+          ||( size > remaining() )  )
+      {
+         valid = false;
+         return std::string();
+      }
+      std::string value( reinterpret_cast< const char* >( position ),
+                         static_cast< size_t >( size ) );
+      position += size;
+      return value;
+   }
+
+   // return the tag of the next token without reading it
+   int peekTag() const
+   {
+      if ( position >= end )
+      {
+         return 0;
+      }
+      return ( ( *position & BinaryProtocol::TAG_WORD ) != 0 ) ? BinaryProtocol::TAG_WORD : *position;
+   }
+
+   // read a word token and return its code (-1 if the token isn't a word)
+   int readTokenWord()
+   {
+      if ( peekTag() != BinaryProtocol::TAG_WORD )
+      {
+         valid = false;
+         return -1;
+      }
+      int code = *position++ & ~BinaryProtocol::TAG_WORD;
+      if ( code >= static_cast< int >( BinaryProtocol::getDictionary().size() ) )
+      {
+         valid = false;
+         return -1;
+      }
+      return code;
+   }
+
+   // skip a string token without copying it
+   void skipTokenString()
+   {
+      if ( peekTag() != BinaryProtocol::TAG_STRING )
+      {
+         valid = false;
+         return;
+      }
+      position++;
+      boost::uint64_t size = readUInt();
+      if (  ( valid == false )
+          ||( size > remaining() )  )
+      {
+         valid = false;
+         position = end;
+         return;
+      }
+      position += size;
+   }
+
+   // read an integer token
+   boost::uint64_t readTokenUInt()
+   {
+      if ( peekTag() != BinaryProtocol::TAG_UINT )
+      {
+         valid = false;
+         return 0;
+      }
+      position++;
+      return readUInt();
+   }
+
+   // read any token and append its text form to out
+   void readToken( std::string& out )
+   {
+      int tag = peekTag();
+      if ( tag == BinaryProtocol::TAG_WORD )
+      {
+         int code = readTokenWord();
+         if ( code >= 0 )
+         {
+            out += BinaryProtocol::getWord( code );
+         }
+      }
+      else if ( tag == BinaryProtocol::TAG_UINT )
+      {
+         std::stringstream stream;
+         stream << readTokenUInt();
+         out += stream.str();
+      }
+      else if ( tag == BinaryProtocol::TAG_STRING )
+      {
+         position++;
+         out += readString();
+      }
+      else
+      {
+         valid = false;
+         position = end;
+      }
+   }
+
+   // read all the remaining tokens and append their text form separated by ' ' to out
+   void readTokens( std::string& out )
+   {
+      bool first = true;
+      while (  ( valid == true )
+             &&( hasMore() == true )  )
+      {
+         if ( first == false )
+         {
+            out += ' ';
+         }
+         first = false;
+         readToken( out );
+      }
+   }
+};
+
+// conversion between the text and the binary forms, used when the peers of a message don't speak the same protocol
+class BinaryTranscoder
+{
+public:
+   // encode the text message in its binary form at the end of out
+   static void encode( const std::string& text,
+                       std::string& out )
+   {
+      BinaryWriter writer( out );
+      std::vector< std::string > parts;
+      StringUtils::explode( text,
+                            ' ',
+                            parts );
+
+      // the game ids are sent as their number, a message with a malformed id is sent as text
+      boost::uint64_t number = 0;
+      std::vector< boost::uint64_t > numbers;
+
+      const std::string& verb = parts[ 0 ];
+      if ( verb == MESSAGE_CLOSE )
+      {
+         writer.writeOpcode( BinaryProtocol::OP_CLOSE_CONNECTION );
+      }
+      else if (  ( verb == MESSAGE_PING )
+               ||( verb == MESSAGE_PONG )  )
+      {
+         writer.writeOpcode( verb == MESSAGE_PING ? BinaryProtocol::OP_PING : BinaryProtocol::OP_PONG );
+      }
+      else if (  (  ( verb == SYSTEM_REQUEST )
+                  ||( verb == SYSTEM_REPLY )  )
+               &&( parts.size() >= 3 )
+               &&( BinaryProtocol::parseRequestId( parts[ 1 ] ) != NO_REQUEST_ID )  )
+      {
+         // the id then the message in its own binary form
+         writer.writeOpcode( verb == SYSTEM_REQUEST ? BinaryProtocol::OP_REQUEST : BinaryProtocol::OP_REPLY );
+         writer.writeUInt( BinaryProtocol::parseRequestId( parts[ 1 ] ) );
+         encode( remainder( text, 2 ),
+                 out );
+      }
+      else if ( verb == SYSTEM_REGISTER )
+      {
+         writer.writeOpcode( BinaryProtocol::OP_REGISTER );
+         writer.writeTokens( parts, 1 );
+      }
+      else if (  ( verb == SYSTEM_REQUEST_GAME )
+               ||( verb == SYSTEM_REQUEST_GAME_LIST )
+               ||( verb == SYSTEM_JOIN_OR_REQUEST_GAME )  )
+      {
+         writer.writeOpcode( verb == SYSTEM_REQUEST_GAME ? BinaryProtocol::OP_REQUEST_GAME :
+                             verb == SYSTEM_REQUEST_GAME_LIST ? BinaryProtocol::OP_REQUEST_GAME_LIST : BinaryProtocol::OP_JOIN_OR_REQUEST_GAME );
+         writer.writeString( remainder( text, 1 ) );
+      }
+      else if (  ( verb == SYSTEM_REQUEST_GAME_LIST_RESULT )
+               &&( BinaryProtocol::parseGameNumbers( parts,
+                                                     1,
+                                                     numbers ) == true )  )
+      {
+         writer.writeOpcode( BinaryProtocol::OP_REQUEST_GAME_LIST_RESULT );
+         writer.writeUInt( numbers.size() );
+         for ( size_t i = 0;
+               i < numbers.size();
+               ++i )
+         {
+            writer.writeUInt( numbers[ i ] );
+         }
+      }
+      else if (  (  ( verb == SYSTEM_JOIN_GAME )
+                  ||( verb == SYSTEM_LEAVE_GAME )  )
+               &&( parts.size() == 2 )
+               &&( BinaryProtocol::parseGameNumber( parts[ 1 ],
+                                                    number ) == true )  )
+      {
+         writer.writeOpcode( verb == SYSTEM_JOIN_GAME ? BinaryProtocol::OP_JOIN_GAME : BinaryProtocol::OP_LEAVE_GAME );
+         writer.writeUInt( number );
+      }
+      else if (  ( verb == SYSTEM_GAME_CREATION_REFUSED )
+               &&( parts.size() >= 2 )
+               &&( BinaryProtocol::parseGameNumber( parts[ 1 ],
+                                                    number ) == true )  )
+      {
+         writer.writeOpcode( BinaryProtocol::OP_GAME_CREATION_REFUSED );
+         writer.writeUInt( number );
+         writer.writeString( remainder( text, 2 ) );
+      }
+      else if (  ( verb == GAME_MESSAGE )
+               &&( parts.size() >= 3 )
+               &&( encodeGameMessage( text,
+                                      parts,
+                                      writer ) == true )  )
+      {
+         // written by encodeGameMessage
+      }
+      else
+      {
+         writer.writeOpcode( BinaryProtocol::OP_TEXT );
+         writer.writeString( text );
+      }
+   }
+
+   // decode the binary frame in its text form at the end of out
+   // the resolver gives back the text ids of the games
+   // return false if the frame is malformed
+   static bool decode( const std::string& frame,
+                       const BinaryProtocol::GameIdResolver& resolver,
+                       std::string& out )
+   {
+      BinaryReader reader( frame );
+      BinaryProtocol::Opcode opcode = reader.readOpcode();
+      switch ( opcode )
+      {
+      case BinaryProtocol::OP_TEXT:
+         out += reader.readString();
+         break;
+      case BinaryProtocol::OP_CLOSE_CONNECTION:
+         out += MESSAGE_CLOSE;
+         break;
+      case BinaryProtocol::OP_PING:
+         out += MESSAGE_PING;
+         break;
+      case BinaryProtocol::OP_PONG:
+         out += MESSAGE_PONG;
+         break;
+      case BinaryProtocol::OP_REQUEST:
+      case BinaryProtocol::OP_REPLY:
+      {
+         std::stringstream stream;
+         stream << ( opcode == BinaryProtocol::OP_REQUEST ? SYSTEM_REQUEST : SYSTEM_REPLY ) << " " << reader.readUInt() << " ";
+         out += stream.str();
+         return (  ( reader.isValid() == true )
+                 &&( decode( frame.substr( frame.size() - reader.remaining() ),
+                             resolver,
+                             out ) == true )  );
+      }
+      case BinaryProtocol::OP_REGISTER:
+         out += SYSTEM_REGISTER + " ";
+         reader.readTokens( out );
+         break;
+      case BinaryProtocol::OP_REQUEST_GAME:
+         out += SYSTEM_REQUEST_GAME + " " + reader.readString();
+         break;
+      case BinaryProtocol::OP_REQUEST_GAME_LIST:
+         out += SYSTEM_REQUEST_GAME_LIST + " " + reader.readString();
+         break;
+      case BinaryProtocol::OP_JOIN_OR_REQUEST_GAME:
+         out += SYSTEM_JOIN_OR_REQUEST_GAME + " " + reader.readString();
+         break;
+      case BinaryProtocol::OP_REQUEST_GAME_LIST_RESULT:
+      {
+         out += SYSTEM_REQUEST_GAME_LIST_RESULT;
+         boost::uint64_t count = reader.readUInt();
+         for ( boost::uint64_t i = 0;
+               (  ( i < count )
+                &&( reader.isValid() == true )  );
+               ++i )
+         {
+            out += " " + resolver( reader.readUInt() );
+         }
+         break;
+      }
+      case BinaryProtocol::OP_JOIN_GAME:
+         out += SYSTEM_JOIN_GAME + " " + resolver( reader.readUInt() );
+         break;
+      case BinaryProtocol::OP_LEAVE_GAME:
+         out += SYSTEM_LEAVE_GAME + " " + resolver( reader.readUInt() );
+         break;
+      case BinaryProtocol::OP_GAME_CREATION_REFUSED:
+         out += SYSTEM_GAME_CREATION_REFUSED + " " + resolver( reader.readUInt() );
+         out += " " + reader.readString();
+         break;
+      case BinaryProtocol::OP_GAME_CREATED:
+      case BinaryProtocol::OP_GAME_ACCEPTED:
+      {
+         boost::uint64_t number = reader.readUInt();
+         std::string kind = reader.readString();
+         out += GAME_MESSAGE + " " + ( opcode == BinaryProtocol::OP_GAME_CREATED ? GAME_CREATED : GAME_ACCEPTED ) + " " + BinaryProtocol::makeGameId( kind, number ) + " " + kind;
+         break;
+      }
+      case BinaryProtocol::OP_GAME_REFUSED:
+         out += GAME_MESSAGE + " " + GAME_REFUSED + " " + reader.readString();
+         break;
+      case BinaryProtocol::OP_GAME_JOIN_REFUSED:
+         out += GAME_MESSAGE + " " + GAME_JOIN_REFUSED + " " + resolver( reader.readUInt() );
+         out += " " + reader.readString();
+         break;
+      case BinaryProtocol::OP_GAME_CLOSE:
+      {
+         out += GAME_MESSAGE + " " + CLOSE_MESSAGE + " ";
+         boost::uint64_t count = reader.readUInt();
+         for ( boost::uint64_t i = 0;
+               (  ( i < count )
+                &&( reader.isValid() == true )  );
+               ++i )
+         {
+            if ( i > 0 )
+            {
+               out += "|";
+            }
+            out += resolver( reader.readUInt() );
+         }
+         out += " " + reader.readString();
+         break;
+      }
+      case BinaryProtocol::OP_GAME_MESSAGE:
+         out += GAME_MESSAGE + " " + resolver( reader.readUInt() ) + " ";
+         reader.readTokens( out );
+         break;
+      default:
+         return false;
+      }
+      return reader.isValid();
+   }
+
+   // get the key of a game message, two messages of the same key carry the same state and the last one replaces the first
+   // the key is the header of the OP_GAME_MESSAGE frame: the game number, the verb and the integers following it
+   // ('CELL_UPDATED x y' for a cell, 'COMPUTE_RESULT' for a result), read in place without decoding the payload
+   // return false if the frame has no key (not a game message, a batch or a malformed frame)
+   static bool getGameMessageKey( const std::string& frame,
+                                  std::string& key )
+   {
+      BinaryReader reader( frame );
+      if ( reader.readOpcode() != BinaryProtocol::OP_GAME_MESSAGE )
+      {
+         return false;
+      }
+      reader.readUInt();
+
+      // the verb is a word, or a string when it's not in the dictionary
+      if ( reader.peekTag() == BinaryProtocol::TAG_WORD )
+      {
+         if ( reader.readTokenWord() == BinaryProtocol::findWord( GAME_BATCH ) )
+         {
+            return false;
+         }
+      }
+      else if ( reader.peekTag() == BinaryProtocol::TAG_STRING )
+      {
+         reader.skipTokenString();
+      }
+      else
+      {
+         return false;
+      }
+
+      while ( reader.peekTag() == BinaryProtocol::TAG_UINT )
+      {
+         reader.readTokenUInt();
+      }
+      if ( reader.isValid() == false )
+      {
+         return false;
+      }
+      key.assign( frame,
+                  0,
+                  frame.size() - reader.remaining() );
+      return true;
+   }
+
+   // get the key of a 'GAME_MESSAGE gameId verb ...' text message, the one of its binary form
+   // only the tokens of the key are read, the rest of the message is not exploded
+   // return false if the message has no key (not a game message, a batch or a malformed game id)
+   static bool getGameMessageKeyOfText( const std::string& text,
+                                        std::string& key )
+   {
+      size_t gameStart = GAME_MESSAGE.size() + 1;
+      size_t gameEnd = text.find( ' ',
+                                  gameStart );
+      boost::uint64_t number = 0;
+      if (  ( text.compare( 0, GAME_MESSAGE.size(), GAME_MESSAGE ) != 0 )
+          ||( text.size() <= gameStart )
+          ||( text[ gameStart - 1 ] != ' ' )
+          ||( gameEnd == std::string::npos )
+          ||( BinaryProtocol::parseGameNumber( text,
+                                               gameStart,
+                                               gameEnd - gameStart,
+                                               number ) == false )  )
+      {
+         return false;
+      }
+
+      size_t verbStart = gameEnd + 1;
+      size_t verbEnd = std::min( text.find( ' ', verbStart ),
+                                 text.size() );
+      std::string verb( text,
+                        verbStart,
+                        verbEnd - verbStart );
+      if (  ( verb.empty() == true )
+          ||( verb == GAME_BATCH )
+          ||( BinaryWriter::isCanonicalUInt( verb ) == true )  )
+      {
+         return false;
+      }
+
+      key.clear();
+      BinaryWriter writer( key );
+      writer.writeOpcode( BinaryProtocol::OP_GAME_MESSAGE );
+      writer.writeUInt( number );
+      writer.writeToken( verb );
+      for ( size_t start = verbEnd + 1;
+            start < text.size(); )
+      {
+         size_t end = std::min( text.find( ' ', start ),
+                                text.size() );
+         std::string token( text,
+                            start,
+                            end - start );
+         if ( BinaryWriter::isCanonicalUInt( token ) == false )
+         {
+            break;
+         }
+         writer.writeToken( token );
+         start = end + 1;
+      }
+      return true;
+   }
+
+private:
+   // return the part of the text after the given number of separators
+   static std::string remainder( const std::string& text,
+                                 size_t numberOfParts )
+   {
+      size_t position = 0;
+      for ( size_t i = 0;
+            (  ( i < numberOfParts )
+             &&( position != std::string::npos )  );
+            ++i )
+      {
+         position = text.find( ' ', position );
+         if ( position != std::string::npos )
+         {
+            position++;
+         }
+      }
+      return ( position != std::string::npos ) ? text.substr( position ) : std::string();
+   }
+
+   // encode a 'GAME_MESSAGE ...' text message
+   // return false without writing anything if a game id is malformed
+   static bool encodeGameMessage( const std::string& text,
+                                  const std::vector< std::string >& parts,
+                                  BinaryWriter& writer )
+   {
+      boost::uint64_t number = 0;
+      std::vector< boost::uint64_t > numbers;
+
+      const std::string& action = parts[ 1 ];
+      if (  (  ( action == GAME_CREATED )
+             ||( action == GAME_ACCEPTED )  )
+          &&( parts.size() == 4 )
+          &&( BinaryProtocol::parseGameNumber( parts[ 2 ],
+                                               number ) == true )  )
+      {
+         writer.writeOpcode( action == GAME_CREATED ? BinaryProtocol::OP_GAME_CREATED : BinaryProtocol::OP_GAME_ACCEPTED );
+         writer.writeUInt( number );
+         writer.writeString( parts[ 3 ] );
+      }
+      else if ( action == GAME_REFUSED )
+      {
+         writer.writeOpcode( BinaryProtocol::OP_GAME_REFUSED );
+         writer.writeString( remainder( text, 2 ) );
+      }
+      else if (  ( action == GAME_JOIN_REFUSED )
+               &&( BinaryProtocol::parseGameNumber( parts[ 2 ],
+                                                    number ) == true )  )
+      {
+         writer.writeOpcode( BinaryProtocol::OP_GAME_JOIN_REFUSED );
+         writer.writeUInt( number );
+         writer.writeString( remainder( text, 3 ) );
+      }
+      else if ( action == CLOSE_MESSAGE )
+      {
+         std::vector< std::string > gameIds;
+         StringUtils::explode( parts[ 2 ],
+                               '|',
+                               gameIds );
+         if ( BinaryProtocol::parseGameNumbers( gameIds,
+                                                0,
+                                                numbers ) == false )
+         {
+            return false;
+         }
+
+         writer.writeOpcode( BinaryProtocol::OP_GAME_CLOSE );
+         writer.writeUInt( numbers.size() );
+         for ( size_t i = 0;
+               i < numbers.size();
+               ++i )
+         {
+            writer.writeUInt( numbers[ i ] );
+         }
+         writer.writeString( remainder( text, 3 ) );
+      }
+      else if ( BinaryProtocol::parseGameNumber( action,
+                                                 number ) == true )
+      {
+         writer.writeOpcode( BinaryProtocol::OP_GAME_MESSAGE );
+         writer.writeUInt( number );
+         writer.writeTokens( parts, 2 );
+      }
+      else
+      {
+         return false;
+      }
+      return true;
+   }
+};
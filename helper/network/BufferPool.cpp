@@ -0,0 +1,191 @@
+#define _WIN32_WINNT 0x0501
+
+#include <algorithm>
+#include <boost/pool/pool_alloc.hpp>
+#include "BufferPool.hpp"
+
+// the buffer sizes, each class is 4 times the previous one
+static const size_t SMALLEST_BUFFER_SIZE = 64;
+static const size_t NUMBER_OF_SIZE_CLASSES = 6;
+
+// the memory kept in the free list of each class
+static const size_t MAX_FREE_BYTES_BY_CLASS = 4 * 1024 * 1024;
+
+// the allocator of the reference counters of the buffers
+typedef boost::fast_pool_allocator< char > CounterAllocator;
+
+// recycle in the class
+BufferPool::Recycler::Recycler( BufferPool* pool,
+                                size_t classIndex )
+:
+   pool( pool ),
+   classIndex( classIndex )
+{
+}
+
+// called by the shared pointer
+void BufferPool::Recycler::operator()( std::string* buffer ) const
+{
+   pool->release( classIndex,
+                  buffer );
+}
+
+// get the pool of the process
+// the pool is never destroyed as buffers can be released during the exit
+BufferPool& BufferPool::getInstance()
+{
+   static BufferPool* instance = new BufferPool();
+   return *instance;
+}
+
+// create the size classes
+BufferPool::BufferPool()
+:
+   sizeClasses(),
+   oversizedBuffers( 0 )
+{
+   size_t bufferSize = SMALLEST_BUFFER_SIZE;
+   for ( size_t i = 0;
+         i < NUMBER_OF_SIZE_CLASSES;
+         ++i )
+   {
+      SizeClassPtr sizeClass( new SizeClass() );
+      sizeClass->bufferSize = bufferSize;
+      sizeClass->maxFreeBuffers = std::max( MAX_FREE_BYTES_BY_CLASS / bufferSize, static_cast< size_t >( 16 ) );
+      sizeClass->acquired = 0;
+      sizeClass->hits = 0;
+      sizeClasses.push_back( sizeClass );
+
+      bufferSize *= 4;
+   }
+}
+
+// get an empty buffer able to hold size bytes without reallocation
+SharedBuffer BufferPool::acquire( size_t size )
+{
+   // find the class of the size
+   size_t classIndex = 0;
+   while (  ( classIndex < sizeClasses.size() )
+          &&( sizeClasses[ classIndex ]->bufferSize < size )  )
+   {
+      classIndex++;
+   }
+
+   // too big to be pooled
+   if ( classIndex == sizeClasses.size() )
+   {
+      oversizedMutex.lock();
+      /*|*/ oversizedBuffers++;
+      oversizedMutex.unlock();
+
+      std::string* buffer = new std::string();
+      buffer->reserve( size );
+      return SharedBuffer( buffer );
+   }
+
+   // take a free buffer of the class or create it
+   SizeClass& sizeClass = *sizeClasses[ classIndex ];
+   std::string* buffer = NULL;
+
+   sizeClass.classMutex.lock();
+   /*|*/ sizeClass.acquired++;
+   /*|*/ if ( sizeClass.freeBuffers.empty() == false )
+   /*|*/ {
+   /*|*/    buffer = sizeClass.freeBuffers.back();
+   /*|*/    sizeClass.freeBuffers.pop_back();
+   /*|*/    sizeClass.hits++;
+   /*|*/ }
+   sizeClass.classMutex.unlock();
+
+   if ( buffer == NULL )
+   {
+      buffer = new std::string();
+      buffer->reserve( sizeClass.bufferSize );
+   }
+
+   return SharedBuffer( buffer,
+                        Recycler( this,
+                                  classIndex ),
+                        CounterAllocator() );
+}
+
+// get a buffer holding a copy of data
+SharedBuffer BufferPool::copy( const std::string& data )
+{
+   SharedBuffer buffer = acquire( data.size() );
+   buffer->assign( data );
+   return buffer;
+}
+
+// give back the buffer to its class
+void BufferPool::release( size_t classIndex,
+                          std::string* buffer )
+{
+   SizeClass& sizeClass = *sizeClasses[ classIndex ];
+
+   // the content is dropped but the capacity is kept for the next message
+   buffer->clear();
+
+   sizeClass.classMutex.lock();
+   /*|*/ if (  ( sizeClass.freeBuffers.size() < sizeClass.maxFreeBuffers )
+   /*|*/     &&( buffer->capacity() <= 4 * sizeClass.bufferSize )  )
+   /*|*/ {
+   /*|*/    sizeClass.freeBuffers.push_back( buffer );
+   /*|*/    buffer = NULL;
+   /*|*/ }
+   sizeClass.classMutex.unlock();
+
+   // the free list is full or the buffer grew too much for its class
+   delete buffer;
+}
+
+// get the statistics of each size class, the oversized buffers come last
+std::vector< BufferPoolStatistics > BufferPool::getStatistics() const
+{
+   std::vector< BufferPoolStatistics > statistics;
+   for ( std::vector< SizeClassPtr >::const_iterator it = sizeClasses.begin();
+         it != sizeClasses.end();
+         it++ )
+   {
+      SizeClass& sizeClass = **it;
+
+      BufferPoolStatistics classStatistics;
+      sizeClass.classMutex.lock();
+      /*|*/ classStatistics.bufferSize = sizeClass.bufferSize;
+      /*|*/ classStatistics.acquired = sizeClass.acquired;
+      /*|*/ classStatistics.hits = sizeClass.hits;
+      /*|*/ classStatistics.freeBuffers = sizeClass.freeBuffers.size();
+      sizeClass.classMutex.unlock();
+
+      statistics.push_back( classStatistics );
+   }
+
+   BufferPoolStatistics oversizedStatistics;
+   oversizedMutex.lock();
+   /*|*/ oversizedStatistics.bufferSize = 0;
+   /*|*/ oversizedStatistics.acquired = oversizedBuffers;
+   /*|*/ oversizedStatistics.hits = 0;
+   /*|*/ oversizedStatistics.freeBuffers = 0;
+   oversizedMutex.unlock();
+   statistics.push_back( oversizedStatistics );
+
+   return statistics;
+}
+
+// get the ratio of buffers given from a free list
+double BufferPool::getHitRate() const
+{
+   size_t acquired = 0;
+   size_t hits = 0;
+
+   std::vector< BufferPoolStatistics > statistics = getStatistics();
+   for ( std::vector< BufferPoolStatistics >::const_iterator it = statistics.begin();
+         it != statistics.end();
+         it++ )
+   {
+      acquired += it->acquired;
+      hits += it->hits;
+   }
+
+   return ( acquired > 0 ) ? static_cast< double >( hits ) / acquired : 0.0;
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+
+// an immutable message shared between the write queues of many connections
+typedef boost::shared_ptr< const std::string > SharedMessage;
+
+// a buffer of the pool being filled, converted to a SharedMessage once ready to be sent
+typedef boost::shared_ptr< std::string > SharedBuffer;
+
+// the statistics of a size class of the pool
+struct BufferPoolStatistics
+{
+   // the capacity of the buffers of the class (0 for the buffers too big to be pooled)
+   size_t bufferSize;
+
+   // the number of buffers given
+   size_t acquired;
+
+   // the number of buffers given from the free list
+   size_t hits;
+
+   // the number of buffers waiting in the free list
+   size_t freeBuffers;
+};
+
+// process wide pool of message buffers sorted in fixed size classes
+// a buffer goes back in the free list of its class when its last reference is released,
+// with the reference counter itself taken from a pool, so a message in steady state costs no heap allocation
+// the buffers are used by the transport for the received frames, by the relay and by the providers
+class BufferPool
+{
+   // the buffers of a size
+   struct SizeClass
+   {
+      // the capacity of the buffers
+      size_t bufferSize;
+
+      // the maximum number of buffers kept in the free list
+      size_t maxFreeBuffers;
+
+      // the buffers ready to be used
+      std::vector< std::string* > freeBuffers;
+
+      // statistics
+      size_t acquired;
+      size_t hits;
+
+      // the mutex of the class
+      boost::mutex classMutex;
+   };
+   typedef boost::shared_ptr< SizeClass > SizeClassPtr;
+
+   // give back the buffer to its class when the last reference is released
+   class Recycler
+   {
+      // the pool (never destroyed)
+      BufferPool* pool;
+
+      // the class of the buffer
+      size_t classIndex;
+
+   public:
+      // recycle in the class
+      Recycler( BufferPool* pool,
+                size_t classIndex );
+
+      // called by the shared pointer
+      void operator()( std::string* buffer ) const;
+   };
+
+   // the size classes sorted by buffer size
+   std::vector< SizeClassPtr > sizeClasses;
+
+   // the buffers bigger than the biggest class, never pooled
+   size_t oversizedBuffers;
+
+   // the mutex of the oversized counter
+   mutable boost::mutex oversizedMutex;
+
+public:
+   // get the pool of the process
+   static BufferPool& getInstance();
+
+   // get an empty buffer able to hold size bytes without reallocation
+   SharedBuffer acquire( size_t size );
+
+   // get a buffer holding a copy of data
+   SharedBuffer copy( const std::string& data );
+
+   // get the statistics of each size class, the oversized buffers come last
+   std::vector< BufferPoolStatistics > getStatistics() const;
+
+   // get the ratio of buffers given from a free list
+   double getHitRate() const;
+
+private:
+   // create the size classes
+   BufferPool();
+
+   // give back the buffer to its class
+   void release( size_t classIndex,
+                 std::string* buffer );
+};
@@ -0,0 +1,161 @@
+#define _WIN32_WINNT 0x0501
+
+#include <zlib.h>
+#include "FrameCompressor.hpp"
+#include "BinaryProtocol.hpp"
+#include "SimpleTcpConnection.hpp"
+
+// get the compressor of the process
+// the compressor is never destroyed as frames can be sent during the exit
+FrameCompressor& FrameCompressor::getInstance()
+{
+   static FrameCompressor* instance = new FrameCompressor();
+   return *instance;
+}
+
+// all the counters at 0
+FrameCompressor::FrameCompressor()
+:
+   compressedFrames( 0 ),
+   uncompressedBytes( 0 ),
+   compressedBytes( 0 ),
+   decompressedFrames( 0 ),
+   compressionTime( 0 ),
+   decompressionTime( 0 )
+{
+}
+
+// return true if the frame is a compressed game frame
+bool FrameCompressor::isCompressed( const std::string& frame )
+{
+   return (  ( frame.empty() == false )
+           &&( frame[ 0 ] == BinaryProtocol::OP_COMPRESSED_GAME_MESSAGE )  );
+}
+
+// get the compressed form of a game frame, the frame itself if it is not worth it
+SharedMessage FrameCompressor::compress( SharedMessage frame )
+{
+   // only the payload of the big game frames is compressed
+   if ( frame->size() < COMPRESSION_THRESHOLD )
+   {
+      return frame;
+   }
+
+   BinaryReader reader( *frame );
+   if ( reader.readOpcode() != BinaryProtocol::OP_GAME_MESSAGE )
+   {
+      return frame;
+   }
+   boost::uint64_t number = reader.readUInt();
+   if ( reader.isValid() == false )
+   {
+      return frame;
+   }
+   size_t payloadSize = reader.remaining();
+   const char* payload = frame->data() + frame->size() - payloadSize;
+
+   boost::chrono::steady_clock::time_point start = boost::chrono::steady_clock::now();
+
+   // the header is written in front of the deflated payload
+   uLongf deflatedSize = compressBound( static_cast< uLong >( payloadSize ) );
+   SharedBuffer compressed = BufferPool::getInstance().acquire( 32 + deflatedSize );
+   BinaryWriter writer( *compressed );
+   writer.writeOpcode( BinaryProtocol::OP_COMPRESSED_GAME_MESSAGE );
+   writer.writeUInt( number );
+   writer.writeUInt( payloadSize );
+   size_t headerSize = compressed->size();
+   compressed->resize( headerSize + deflatedSize );
+
+   int result = compress2( reinterpret_cast< Bytef* >( &( *compressed )[ headerSize ] ),
+                           &deflatedSize,
+                           reinterpret_cast< const Bytef* >( payload ),
+                           static_cast< uLong >( payloadSize ),
+                           Z_BEST_SPEED );
+
+   boost::chrono::nanoseconds elapsed = boost::chrono::steady_clock::now() - start;
+
+   // keep the frame as is if the payload does not shrink
+   bool worthIt = (  ( result == Z_OK )
+                   &&( headerSize + deflatedSize < frame->size() )  );
+
+   statisticsMutex.lock();
+   /*|*/ compressionTime += elapsed;
+   /*|*/ compressedFrames++;
+   /*|*/ uncompressedBytes += frame->size();
+   /*|*/ compressedBytes += ( worthIt == true ) ? headerSize + deflatedSize : frame->size();
+   statisticsMutex.unlock();
+
+   if ( worthIt == false )
+   {
+      return frame;
+   }
+
+   compressed->resize( headerSize + deflatedSize );
+   return compressed;
+}
+
+// get the OP_GAME_MESSAGE form of a compressed game frame, the frame itself if it is not compressed
+// return an empty pointer if the frame is corrupted
+SharedMessage FrameCompressor::decompress( SharedMessage frame )
+{
+   BinaryReader reader( *frame );
+   if ( reader.readOpcode() != BinaryProtocol::OP_COMPRESSED_GAME_MESSAGE )
+   {
+      return frame;
+   }
+   boost::uint64_t number = reader.readUInt();
+   boost::uint64_t payloadSize = reader.readUInt();
+   if (  ( reader.isValid() == false )
+       ||( payloadSize > MAX_FRAME_SIZE )  )
+   {
+      return SharedMessage();
+   }
+   size_t deflatedSize = reader.remaining();
+   const char* deflated = frame->data() + frame->size() - deflatedSize;
+
+   boost::chrono::steady_clock::time_point start = boost::chrono::steady_clock::now();
+
+   // rebuild the header of the game frame in front of the inflated payload
+   SharedBuffer inflated = BufferPool::getInstance().acquire( 16 + static_cast< size_t >( payloadSize ) );
+   BinaryWriter writer( *inflated );
+   writer.writeOpcode( BinaryProtocol::OP_GAME_MESSAGE );
+   writer.writeUInt( number );
+   size_t headerSize = inflated->size();
+   inflated->resize( headerSize + static_cast< size_t >( payloadSize ) );
+
+   uLongf inflatedSize = static_cast< uLongf >( payloadSize );
+   int result = uncompress( reinterpret_cast< Bytef* >( &( *inflated )[ headerSize ] ),
+                            &inflatedSize,
+                            reinterpret_cast< const Bytef* >( deflated ),
+                            static_cast< uLong >( deflatedSize ) );
+
+   boost::chrono::nanoseconds elapsed = boost::chrono::steady_clock::now() - start;
+
+   statisticsMutex.lock();
+   /*|*/ decompressionTime += elapsed;
+   /*|*/ decompressedFrames++;
+   statisticsMutex.unlock();
+
+   if (  ( result != Z_OK )
+       ||( inflatedSize != payloadSize )  )
+   {
+      return SharedMessage();
+   }
+   return inflated;
+}
+
+// get the current statistics
+CompressionStatistics FrameCompressor::getStatistics() const
+{
+   boost::mutex::scoped_lock lock( statisticsMutex );
+
+   CompressionStatistics statistics;
+   statistics.compressedFrames = compressedFrames;
+   statistics.uncompressedBytes = uncompressedBytes;
+   statistics.compressedBytes = compressedBytes;
+   statistics.decompressedFrames = decompressedFrames;
+   statistics.meanCompressionTime = ( compressedFrames > 0 ) ? compressionTime.count() / 1000.0 / compressedFrames : 0.0;
+   statistics.meanDecompressionTime = ( decompressedFrames > 0 ) ? decompressionTime.count() / 1000.0 / decompressedFrames : 0.0;
+   statistics.ratio = ( uncompressedBytes > 0 ) ? static_cast< double >( compressedBytes ) / uncompressedBytes : 1.0;
+   return statistics;
+}
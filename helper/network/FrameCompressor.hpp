@@ -0,0 +1,70 @@
+#pragma once
+
+#include <string>
+#include <boost/thread/mutex.hpp>
+#include <boost/chrono.hpp>
+#include "BufferPool.hpp"
+
+// the game frames smaller than this are never compressed (the deflate header would eat the gain)
+#define COMPRESSION_THRESHOLD 1024
+
+// the statistics of the compression, used to check the gain is worth the cpu
+struct CompressionStatistics
+{
+   // the number of game frames compressed
+   size_t compressedFrames;
+
+   // the size of the payloads before and after compression
+   size_t uncompressedBytes;
+   size_t compressedBytes;
+
+   // the number of game frames decompressed
+   size_t decompressedFrames;
+
+   // the mean time spent compressing and decompressing a frame (in microseconds)
+   double meanCompressionTime;
+   double meanDecompressionTime;
+
+   // the compressed size over the uncompressed size
+   double ratio;
+};
+
+// process wide compression of the big binary game frames, negotiated during the MESSAGE_INIT handshake
+// ('SYSTEM_INIT_CONNECTION BINARY DEFLATE' answered by 'SYSTEM_LOGIN_ASKED BINARY DEFLATE')
+// only the payload of an OP_GAME_MESSAGE frame over COMPRESSION_THRESHOLD is deflated,
+// the game number stays readable so the server routes and relays the frame without inflating it
+//     OP_COMPRESSED_GAME_MESSAGE, varint: game, varint: payload size, deflated payload
+class FrameCompressor
+{
+   // the mutex of the statistics
+   mutable boost::mutex statisticsMutex;
+
+   // statistics
+   size_t compressedFrames;
+   size_t uncompressedBytes;
+   size_t compressedBytes;
+   size_t decompressedFrames;
+   boost::chrono::nanoseconds compressionTime;
+   boost::chrono::nanoseconds decompressionTime;
+
+public:
+   // get the compressor of the process
+   static FrameCompressor& getInstance();
+
+   // return true if the frame is a compressed game frame
+   static bool isCompressed( const std::string& frame );
+
+   // get the compressed form of a game frame, the frame itself if it is not worth it
+   SharedMessage compress( SharedMessage frame );
+
+   // get the OP_GAME_MESSAGE form of a compressed game frame, the frame itself if it is not compressed
+   // return an empty pointer if the frame is corrupted
+   SharedMessage decompress( SharedMessage frame );
+
+   // get the current statistics
+   CompressionStatistics getStatistics() const;
+
+private:
+   // all the counters at 0
+   FrameCompressor();
+};
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <boost/type_traits/aligned_storage.hpp>
+
+// the size of the memory of a handler, enough for a socket operation with its bound handler
+#define HANDLER_MEMORY_SIZE 256
+
+// the memory of the handlers of an operation of which a single one is pending at a time (a read, a write ...)
+// boost asio recycles a single block of memory by thread, so the operations of a connection pending together
+// (and the handlers posted by the threads not running the reactor) allocate each time, the handlers of an operation
+// wrapped in a MemoryHandler take this block instead
+// the block is given back before the handler runs, so the handler can start the next operation with it
+// this class is fully inline to ease the sharing
+class HandlerMemory
+{
+   // the block
+   boost::aligned_storage< HANDLER_MEMORY_SIZE >::type storage;
+
+   // true while the block is given to a handler
+   bool used;
+
+   // not copyable, the handlers point to it
+   HandlerMemory( const HandlerMemory& );
+   HandlerMemory& operator=( const HandlerMemory& );
+
+public:
+   // the block is free
+   HandlerMemory()
+   :
+      storage(),
+      used( false )
+   {
+   }
+
+   // give the block if it is free and big enough, the heap otherwise
+   void* allocate( size_t size )
+   {
+      if (  ( used == false )
+          &&( size <= sizeof( storage ) )  )
+      {
+         used = true;
+         return &storage;
+      }
+      return ::operator new( size );
+   }
+
+   // take back the block or give back the memory to the heap
+   void deallocate( void* pointer )
+   {
+      if ( pointer == &storage )
+      {
+         used = false;
+         return;
+      }
+      ::operator delete( pointer );
+   }
+};
+
+// a handler allocating its operations in a HandlerMemory
+// the memory must outlive the handler (a member of the object the handler is bound to)
+template< typename Handler >
+class MemoryHandler
+{
+   // the memory of the operations
+   HandlerMemory* memory;
+
+   // the handler itself
+   Handler handler;
+
+public:
+   // wrap the handler
+   MemoryHandler( HandlerMemory& memory,
+                  const Handler& handler )
+   :
+      memory( &memory ),
+      handler( handler )
+   {
+   }
+
+   // the calls of boost asio
+   void operator()()
+   {
+      handler();
+   }
+
+   template< typename Argument1 >
+   void operator()( const Argument1& argument1 )
+   {
+      handler( argument1 );
+   }
+
+   template< typename Argument1, typename Argument2 >
+   void operator()( const Argument1& argument1,
+                    const Argument2& argument2 )
+   {
+      handler( argument1,
+               argument2 );
+   }
+
+   // get the memory of the operations
+   HandlerMemory& getMemory() const
+   {
+      return *memory;
+   }
+
+   // the memory hooks of boost asio
+   friend void* asio_handler_allocate( size_t size,
+                                       MemoryHandler* memoryHandler )
+   {
+      return memoryHandler->getMemory().allocate( size );
+   }
+   friend void asio_handler_deallocate( void* pointer,
+                                        size_t size,
+                                        MemoryHandler* memoryHandler )
+   {
+      memoryHandler->getMemory().deallocate( pointer );
+   }
+};
+
+// wrap the handler to allocate its operations in the memory
+template< typename Handler >
+inline MemoryHandler< Handler > makeMemoryHandler( HandlerMemory& memory,
+                                                   const Handler& handler )
+{
+   return MemoryHandler< Handler >( memory,
+                                    handler );
+}
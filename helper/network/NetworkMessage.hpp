@@ -1,6 +1,7 @@
 #pragma once
 
 #include <string>
+#include <boost/cstdint.hpp>
 
 static const std::string MESSAGE_INIT( "SYSTEM_INIT_CONNECTION" );
 static const std::string MESSAGE_LOGIN_ASKED( "SYSTEM_LOGIN_ASKED" );
@@ -8,6 +9,38 @@ static const std::string MESSAGE_LOGIN_ACCEPTED( "SYSTEM_LOGIN_ACCEPTED" );
 static const std::string MESSAGE_LOGIN_REFUSED( "SYSTEM_LOGIN_REFUSED" );
 static const std::string MESSAGE_CLOSE( "SYSTEM_CLOSE_CONNECTION" );
 
+// sent by the server to an idle connection, the peer answers at once or is closed
+static const std::string MESSAGE_PING( "SYSTEM_PING" );
+static const std::string MESSAGE_PONG( "SYSTEM_PONG" );
+
+// appended to MESSAGE_INIT to ask for the binary protocol and to MESSAGE_LOGIN_ASKED to accept it
+static const std::string BINARY_PROTOCOL( "BINARY" );
+
+// appended after BINARY_PROTOCOL to ask for and accept the compression of the big game frames
+static const std::string COMPRESSION( "DEFLATE" );
+
+// a session keeps the games of a connection whose link is lost until it is resumed on a new connection
+//     'SYSTEM_OPEN_SESSION'
+//             'SYSTEM_SESSION token' or 'SYSTEM_SESSION_EXPIRED'
+//     'SYSTEM_RESUME_SESSION token'
+//             'SYSTEM_SESSION token' followed by the held messages or 'SYSTEM_SESSION_EXPIRED'
+static const std::string SYSTEM_OPEN_SESSION( "SYSTEM_OPEN_SESSION" );
+static const std::string SYSTEM_RESUME_SESSION( "SYSTEM_RESUME_SESSION" );
+static const std::string SYSTEM_SESSION( "SYSTEM_SESSION" );
+static const std::string SYSTEM_SESSION_EXPIRED( "SYSTEM_SESSION_EXPIRED" );
+
+// a control message may carry a request id, echoed in its reply so a client can pipeline its requests
+// each request with an id gets exactly one reply, 'SYSTEM_REQUEST_DONE' if the message has no answer
+//     'SYSTEM_REQUEST id <control message>'
+//             'SYSTEM_REPLY id <reply>'
+static const std::string SYSTEM_REQUEST( "SYSTEM_REQUEST" );
+static const std::string SYSTEM_REPLY( "SYSTEM_REPLY" );
+static const std::string SYSTEM_REQUEST_DONE( "SYSTEM_REQUEST_DONE" );
+
+// the id of a request, a positive integer chosen by the client
+typedef boost::uint64_t RequestId;
+static const RequestId NO_REQUEST_ID = 0;
+
 static const std::string SYSTEM_REGISTER( "SYSTEM_REGISTER" );
 static const std::string SYSTEM_REQUEST_GAME( "SYSTEM_REQUEST_GAME" );
 static const std::string SYSTEM_REQUEST_GAME_LIST( "SYSTEM_REQUEST_GAME_LIST" );
@@ -29,5 +62,10 @@ static const std::string GAME_JOIN_REFUSED( "GAME_JOIN_REFUSED" );
 static const std::string CLOSE_MESSAGE( "CLOSE" );
 static const std::string GAME_MESSAGE( "GAME_MESSAGE" );
 
+// a game payload carrying many commands of the same game, routed as a single game message
+//     'GAME_MESSAGE gameId GAME_BATCH command ; command ; ...'
+static const std::string GAME_BATCH( "GAME_BATCH" );
+static const std::string GAME_BATCH_SEPARATOR( ";" );
+
 static const std::string PLAYER_JOIN_MESSAGE( "PLAYER_JOIN_MESSAGE" );
 static const std::string PLAYER_LEAVE_MESSAGE( "PLAYER_LEAVE_MESSAGE" );
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <boost/version.hpp>
+#include <boost/asio.hpp>
+
+// the backend of the socket operations is chosen when the whole process is built
+// the same macros must be given to every translation unit:
+//     epoll (default)          nothing
+//     io_uring reads           -DBACKBONE_IO_URING (linux 5.19 or newer, no library needed)
+// boost asio only drives its sockets with io_uring from 1.78, so the io_uring reads are done by UringReadService
+// with the raw system calls: the reads of the tcp connections are submitted to a ring in batches and the kernel
+// receives in registered buffers, the writes, accepts and connects stay on the epoll reactor
+// a kernel without io_uring (or with io_uring disabled) leaves the reads on the reactor at run time
+#if defined( BACKBONE_IO_URING ) && !defined( __linux__ )
+#error "the io_uring reads are only available on linux"
+#endif
+
+// return the name of the backend running the socket operations
+inline const char* getReactorBackendName()
+{
+#if defined( BACKBONE_IO_URING )
+   return "epoll with io_uring reads";
+#elif defined( BOOST_ASIO_HAS_EPOLL )
+   return "epoll";
+#elif defined( BOOST_ASIO_HAS_IOCP )
+   return "iocp";
+#elif defined( BOOST_ASIO_HAS_KQUEUE )
+   return "kqueue";
+#else
+   return "select";
+#endif
+}
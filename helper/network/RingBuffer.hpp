@@ -0,0 +1,162 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstring>
+#include <algorithm>
+#include <boost/asio/buffer.hpp>
+#include <boost/array.hpp>
+
+// this class is a growable circular byte buffer used to receive data from the network
+// the socket reads directly in the free area and the frames are extracted with at most two copies
+// this class is fully inline to ease the sharing
+class RingBuffer
+{
+private:
+   // the storage of the ring
+   std::vector< char > data;
+
+   // the index of the first readable byte
+   size_t head;
+
+   // the number of readable bytes
+   size_t used;
+
+public:
+   // the buffer sequence describing a region of the ring (at most 2 parts due to the wrap)
+   typedef boost::array< boost::asio::mutable_buffer, 2 > MutableRegion;
+
+   // create a ring with the given initial capacity
+   explicit RingBuffer( size_t capacity )
+   :
+      data( capacity ),
+      head( 0 ),
+      used( 0 )
+   {
+   }
+
+   // return the number of readable bytes
+   size_t size() const
+   {
+      return used;
+   }
+
+   // return the number of bytes that can be written without growing
+   size_t available() const
+   {
+      return data.size() - used;
+   }
+
+   // return the total size of the ring
+   size_t capacity() const
+   {
+      return data.size();
+   }
+
+   // return the free region of the ring to read into, grow the ring if less than minimum bytes are free
+   MutableRegion prepare( size_t minimum )
+   {
+      if ( available() < minimum )
+      {
+         grow( used + minimum );
+      }
+
+      MutableRegion region;
+      size_t tail = ( head + used ) % data.size();
+      if ( tail >= head && used != data.size() )
+      {
+         // free area is [tail, end) + [0, head)
+         region[ 0 ] = boost::asio::buffer( &data[ 0 ] + tail, data.size() - tail );
+         region[ 1 ] = boost::asio::buffer( &data[ 0 ], head );
+      }
+      else
+      {
+         // free area is [tail, head)
+         region[ 0 ] = boost::asio::buffer( &data[ 0 ] + tail, head - tail );
+         region[ 1 ] = boost::asio::mutable_buffer();
+      }
+      return region;
+   }
+
+   // mark numberOfBytes of the prepared region as readable
+   void commit( size_t numberOfBytes )
+   {
+      used += numberOfBytes;
+   }
+
+   // drop numberOfBytes from the front of the ring
+   void consume( size_t numberOfBytes )
+   {
+      head = ( head + numberOfBytes ) % data.size();
+      used -= numberOfBytes;
+
+      // restart from the beginning when empty to keep the next frames contiguous
+      if ( used == 0 )
+      {
+         head = 0;
+      }
+   }
+
+   // return the readable byte at the given offset from the front
+   char at( size_t offset ) const
+   {
+      return data[ ( head + offset ) % data.size() ];
+   }
+
+   // copy numberOfBytes starting at offset from the front in the out buffer
+   void copy( size_t offset,
+              char* out,
+              size_t numberOfBytes ) const
+   {
+      size_t start = ( head + offset ) % data.size();
+      size_t firstPart = std::min( numberOfBytes, data.size() - start );
+      memcpy( out, &data[ 0 ] + start, firstPart );
+      memcpy( out + firstPart, &data[ 0 ], numberOfBytes - firstPart );
+   }
+
+   // assign numberOfBytes starting at offset from the front to the out string
+   void copy( size_t offset,
+              std::string& out,
+              size_t numberOfBytes ) const
+   {
+      size_t start = ( head + offset ) % data.size();
+      size_t firstPart = std::min( numberOfBytes, data.size() - start );
+      out.assign( &data[ 0 ] + start, firstPart );
+      out.append( &data[ 0 ], numberOfBytes - firstPart );
+   }
+
+   // return the offset of the first occurence of value starting at offset from the front
+   // or std::string::npos if the value is not in the ring
+   size_t find( char value,
+                size_t offset = 0 ) const
+   {
+      while ( offset < used )
+      {
+         size_t start = ( head + offset ) % data.size();
+         size_t length = std::min( used - offset, data.size() - start );
+         const char* found = static_cast< const char* >( memchr( &data[ 0 ] + start, value, length ) );
+         if ( found != NULL )
+         {
+            return offset + ( found - ( &data[ 0 ] + start ) );
+         }
+         offset += length;
+      }
+      return std::string::npos;
+   }
+
+private:
+   // grow the ring to at least the given capacity and linearize the readable bytes
+   void grow( size_t minimumCapacity )
+   {
+      size_t newCapacity = data.size() * 2;
+      while ( newCapacity < minimumCapacity )
+      {
+         newCapacity *= 2;
+      }
+
+      std::vector< char > newData( newCapacity );
+      copy( 0, &newData[ 0 ], used );
+      data.swap( newData );
+      head = 0;
+   }
+};
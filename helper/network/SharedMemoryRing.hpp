@@ -0,0 +1,312 @@
+#pragma once
+
+#include <new>
+#include <string>
+#include <cstring>
+#include <sstream>
+#include <algorithm>
+#include <unistd.h>
+#include <boost/atomic.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/interprocess/shared_memory_object.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include "RingBuffer.hpp"
+
+#if BOOST_ATOMIC_INT32_LOCK_FREE != 2
+#error "the shared memory rings need lock free 32 bits atomics"
+#endif
+
+// the size of each ring of a shared memory link (a power of 2)
+#define SHARED_RING_SIZE ( 1 << 20 )
+
+// the prefix of the names of the shared memory links, followed by the pid of the creating process
+// ('BackBone_<pid>_<connection>'), a name without it is never mapped
+#define SHARED_MEMORY_NAME_PREFIX "BackBone_"
+
+// the control block of a ring, the indexes are on their own cache line
+// the indexes are the total number of bytes written and read (modulo 2^32)
+struct SharedRingHeader
+{
+   // the number of bytes written, only moved by the producer
+   boost::atomic< boost::uint32_t > tail;
+   char tailPadding[ 64 - sizeof( boost::atomic< boost::uint32_t > ) ];
+
+   // the number of bytes read, only moved by the consumer
+   boost::atomic< boost::uint32_t > head;
+   char headPadding[ 64 - sizeof( boost::atomic< boost::uint32_t > ) ];
+
+   // 1 when the consumer sleeps until a doorbell tells new bytes are written
+   boost::atomic< boost::uint32_t > readerWaiting;
+
+   // 1 when the producer sleeps until a doorbell tells bytes are read
+   boost::atomic< boost::uint32_t > writerWaiting;
+   char waitingPadding[ 64 - 2 * sizeof( boost::atomic< boost::uint32_t > ) ];
+};
+
+// a lock free single producer single consumer byte ring living in shared memory
+// the sides sleep on a doorbell (a byte sent on the unix domain socket of the link)
+// and the waiting flags tell the other side when to ring it
+// this class is fully inline to ease the sharing
+class SharedMemoryRing
+{
+   // the control block in the shared memory
+   SharedRingHeader* header;
+
+   // the bytes of the ring in the shared memory
+   char* data;
+
+public:
+   // use the ring at the given address
+   explicit SharedMemoryRing( void* address = NULL )
+   :
+      header( static_cast< SharedRingHeader* >( address ) ),
+      data( static_cast< char* >( address ) + sizeof( SharedRingHeader ) )
+   {
+   }
+
+   // the size of a ring in the shared memory
+   static size_t getMappedSize()
+   {
+      return sizeof( SharedRingHeader ) + SHARED_RING_SIZE;
+   }
+
+   // initialize the control block of a new ring
+   void initialize()
+   {
+      new ( header ) SharedRingHeader();
+      header->tail.store( 0 );
+      header->head.store( 0 );
+      header->readerWaiting.store( 0 );
+      header->writerWaiting.store( 0 );
+   }
+
+   // return the number of readable bytes (consumer side)
+   size_t size() const
+   {
+      return header->tail.load( boost::memory_order_seq_cst ) - header->head.load( boost::memory_order_relaxed );
+   }
+
+   // return the number of bytes that can be written (producer side)
+   size_t available() const
+   {
+      return SHARED_RING_SIZE - ( header->tail.load( boost::memory_order_relaxed ) - header->head.load( boost::memory_order_acquire ) );
+   }
+
+   // write at most numberOfBytes of source, return the number of bytes written (producer side)
+   size_t write( const char* source,
+                 size_t numberOfBytes )
+   {
+      boost::uint32_t tail = header->tail.load( boost::memory_order_relaxed );
+      size_t written = std::min( numberOfBytes, available() );
+      size_t start = tail & ( SHARED_RING_SIZE - 1 );
+      size_t firstPart = std::min( written, static_cast< size_t >( SHARED_RING_SIZE ) - start );
+      memcpy( data + start, source, firstPart );
+      memcpy( data, source + firstPart, written - firstPart );
+      header->tail.store( tail + static_cast< boost::uint32_t >( written ),
+                          boost::memory_order_seq_cst );
+      return written;
+   }
+
+   // move all the readable bytes at the end of the ring buffer, return the number of bytes read (consumer side)
+   size_t read( RingBuffer& out )
+   {
+      boost::uint32_t head = header->head.load( boost::memory_order_relaxed );
+      size_t readable = header->tail.load( boost::memory_order_acquire ) - head;
+      if ( readable == 0 )
+      {
+         return 0;
+      }
+
+      RingBuffer::MutableRegion region = out.prepare( readable );
+      size_t offset = 0;
+      for ( size_t i = 0;
+            (  ( i < region.size() )
+             &&( offset < readable )  );
+            ++i )
+      {
+         size_t length = std::min( boost::asio::buffer_size( region[ i ] ), readable - offset );
+         copy( head + offset,
+               boost::asio::buffer_cast< char* >( region[ i ] ),
+               length );
+         offset += length;
+      }
+      out.commit( readable );
+
+      header->head.store( head + static_cast< boost::uint32_t >( readable ),
+                          boost::memory_order_seq_cst );
+      return readable;
+   }
+
+   // tell the producer the consumer sleeps, return false if bytes arrived meanwhile (consumer side)
+   bool waitForData()
+   {
+      header->readerWaiting.store( 1, boost::memory_order_seq_cst );
+      if ( size() > 0 )
+      {
+         header->readerWaiting.store( 0, boost::memory_order_seq_cst );
+         return false;
+      }
+      return true;
+   }
+
+   // tell the consumer the producer sleeps, return false if space was freed meanwhile (producer side)
+   bool waitForSpace()
+   {
+      header->writerWaiting.store( 1, boost::memory_order_seq_cst );
+      if ( available() > 0 )
+      {
+         header->writerWaiting.store( 0, boost::memory_order_seq_cst );
+         return false;
+      }
+      return true;
+   }
+
+   // return true if the consumer must be woken up after a write (producer side)
+   bool wakeReader()
+   {
+      return header->readerWaiting.exchange( 0, boost::memory_order_seq_cst ) == 1;
+   }
+
+   // return true if the producer must be woken up after a read (consumer side)
+   bool wakeWriter()
+   {
+      return header->writerWaiting.exchange( 0, boost::memory_order_seq_cst ) == 1;
+   }
+
+private:
+   // copy numberOfBytes starting at the index in the out buffer
+   void copy( boost::uint32_t index,
+              char* out,
+              size_t numberOfBytes ) const
+   {
+      size_t start = index & ( SHARED_RING_SIZE - 1 );
+      size_t firstPart = std::min( numberOfBytes, static_cast< size_t >( SHARED_RING_SIZE ) - start );
+      memcpy( out, data + start, firstPart );
+      memcpy( out + firstPart, data, numberOfBytes - firstPart );
+   }
+};
+
+// the shared memory of a link between two processes of the same host: a ring in each direction
+// the accepting side creates the memory under its own pid and gives its name to the connecting side,
+// so a peer never makes the server map a memory it did not create
+// the connecting side removes the name once mapped, so the memory goes away with the last process using it
+// the memory is only readable and writable by the user of the creating process
+// this class is fully inline to ease the sharing
+class SharedMemoryLink : private boost::noncopyable
+{
+   // the name of the memory
+   std::string name;
+
+   // the memory mapped in the process
+   boost::interprocess::mapped_region region;
+
+   // the ring read by this side
+   SharedMemoryRing inbound;
+
+   // the ring written by this side
+   SharedMemoryRing outbound;
+
+   // true on the side which created the memory
+   bool owner;
+
+public:
+   // get the name of the memory of a new link of the process, the key is unique in the process (a connection)
+   static std::string makeName( const void* key )
+   {
+      std::stringstream name;
+      name << SHARED_MEMORY_NAME_PREFIX << ::getpid() << "_" << key;
+      return name.str();
+   }
+
+   // return true if the name is the one of a link (see makeName)
+   static bool isValidName( const std::string& name )
+   {
+      return (  ( name.compare( 0, sizeof( SHARED_MEMORY_NAME_PREFIX ) - 1, SHARED_MEMORY_NAME_PREFIX ) == 0 )
+              &&( name.find( '/' ) == std::string::npos )  );
+   }
+
+   // create the memory of a new link (accepting side)
+   static SharedMemoryLink* create( const std::string& name )
+   {
+      boost::interprocess::shared_memory_object::remove( name.c_str() );
+      boost::interprocess::shared_memory_object memory( boost::interprocess::create_only,
+                                                        name.c_str(),
+                                                        boost::interprocess::read_write,
+                                                        boost::interprocess::permissions( 0600 ) );
+      memory.truncate( 2 * SharedMemoryRing::getMappedSize() );
+
+      // the accepting side writes the first ring and reads the second one
+      SharedMemoryLink* link = new SharedMemoryLink( name,
+                                                     memory,
+                                                     1,
+                                                     0 );
+      link->inbound.initialize();
+      link->outbound.initialize();
+      link->owner = true;
+      return link;
+   }
+
+   // map the memory of a link created by the other side (connecting side)
+   // throw an interprocess_exception if the name is not the one of a link
+   static SharedMemoryLink* open( const std::string& name )
+   {
+      if ( isValidName( name ) == false )
+      {
+         throw boost::interprocess::interprocess_exception( "not the name of a shared memory link" );
+      }
+      boost::interprocess::shared_memory_object memory( boost::interprocess::open_only,
+                                                        name.c_str(),
+                                                        boost::interprocess::read_write );
+
+      SharedMemoryLink* link = new SharedMemoryLink( name,
+                                                     memory,
+                                                     0,
+                                                     1 );
+      boost::interprocess::shared_memory_object::remove( name.c_str() );
+      return link;
+   }
+
+   // remove the name if the other side never mapped it
+   ~SharedMemoryLink()
+   {
+      if ( owner == true )
+      {
+         boost::interprocess::shared_memory_object::remove( name.c_str() );
+      }
+   }
+
+   // get the name of the memory
+   const std::string& getName() const
+   {
+      return name;
+   }
+
+   // get the ring read by this side
+   SharedMemoryRing& getInbound()
+   {
+      return inbound;
+   }
+
+   // get the ring written by this side
+   SharedMemoryRing& getOutbound()
+   {
+      return outbound;
+   }
+
+private:
+   // map the memory and find the rings
+   SharedMemoryLink( const std::string& name,
+                     boost::interprocess::shared_memory_object& memory,
+                     size_t inboundIndex,
+                     size_t outboundIndex )
+   :
+      name( name ),
+      region( memory,
+              boost::interprocess::read_write ),
+      inbound( static_cast< char* >( region.get_address() ) + inboundIndex * SharedMemoryRing::getMappedSize() ),
+      outbound( static_cast< char* >( region.get_address() ) + outboundIndex * SharedMemoryRing::getMappedSize() ),
+      owner( false )
+   {
+   }
+};
@@ -1,41 +1,258 @@
-#pragma once 
+#pragma once
 
 #include <boost/asio.hpp>
+#include <boost/bind.hpp>
 #include <boost/tuple/tuple.hpp>
 #include <boost/array.hpp>
 #include <boost/thread/mutex.hpp>
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <sstream>
+#include "RingBuffer.hpp"
+#include "BufferPool.hpp"
+#include "HandlerMemory.hpp"
+#include "SocketTuning.hpp"
+#include "UringReadService.hpp"
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+#include <boost/scoped_ptr.hpp>
+#include "SharedMemoryRing.hpp"
+#endif
 #include "../logger/asyncLogger.hpp"
+#include "../container/RingQueue.hpp"
 
 #define SOCKET_READ_SIZE 1024
 
+// the size of the length prefix of a frame (32 bits big endian)
+#define FRAME_HEADER_SIZE 4
+
+// the biggest frame accepted on the network
+// keep it under 2^24 so the first byte of a length prefix is always 0,
+// which is how a length prefixed stream is told apart from a NUL terminated one
+#define MAX_FRAME_SIZE ( 1 << 24 )
+
+// the maximum number of queued messages sent in one gather write
+#define MAX_GATHER_WRITE 64
+
+// the prefix of the addresses of the unix domain sockets ('unix:/tmp/backbone.sock')
+#define LOCAL_ADDRESS_PREFIX "unix:"
+
+// the prefix of the addresses of the unix domain sockets upgraded to shared memory ('shm:/tmp/backbone.sock')
+#define SHARED_MEMORY_ADDRESS_PREFIX "shm:"
+
+// the first byte sent by a connection asking to be upgraded to shared memory, followed by a '\0'
+// the accepting side answers with the same byte, the name of the memory it created and a '\0'
+// (a length prefixed stream starts with 0 and a NUL terminated one with a letter)
+#define SHARED_MEMORY_PREAMBLE '\x01'
+
+// the maximum size of the answer to the shared memory preamble
+#define SHARED_MEMORY_MAX_ANSWER 256
+
 // this class is used to encapsulate asynchronous read / write on the network
+// the connection runs over tcp or over a unix domain socket for the peers on the same host
+// all the socket operations and their callbacks run in the strand of the connection
+// so a connection is handled in order even if the reactor is run by many threads
+// the connection must be owned by a shared pointer, the handlers posted from other threads keep it alive
 // this class is fully inline to ease the sharing
-class SimpleTcpConnection
+class SimpleTcpConnection : public boost::enable_shared_from_this< SimpleTcpConnection >
 {
+public:
+   // the way messages are delimited on the socket
+   enum FramingMode
+   {
+      // decide on the first received byte (server side)
+      FRAMING_AUTO = 0,
+      // legacy format, each message is followed by a '\0'
+      FRAMING_NUL_TERMINATED,
+      // each message is preceded by its size on FRAME_HEADER_SIZE bytes
+      FRAMING_LENGTH_PREFIXED
+   };
+
+   // the socket carrying the connection
+   enum Transport
+   {
+      // tcp socket
+      TRANSPORT_TCP = 0,
+      // unix domain socket (only where boost asio supports them)
+      TRANSPORT_LOCAL,
+      // a ring in shared memory for each direction, the unix domain socket only carries the doorbells
+      TRANSPORT_SHARED_MEMORY
+   };
+
+   // the callback of a write
+   typedef boost::function< void ( const boost::system::error_code& ) > WriteHandler;
+
 private:
+   // a message waiting to be written with its framing and its callback
+   struct PendingWrite
+   {
+      // the length prefix (unused for NUL terminated framing)
+      boost::array< char, FRAME_HEADER_SIZE > header;
+
+      // the message itself, shared with the other connections it is sent to
+      SharedMessage payload;
+
+      // the framing decided when the message was queued
+      FramingMode framing;
+
+      // the callback to invoke once written
+      WriteHandler handler;
+   };
+
+   // the messages in the order they are written, in rings which stop allocating once they reached the longest queue
+   typedef RingQueue< PendingWrite > WriteQueue;
+
+   // the buffers of a gather write, a view on the array of the connection
+   // the write operation keeps a copy of the buffer sequence, the view is copied instead of the buffers
+   class GatherBuffers
+   {
+      // the buffers
+      const boost::asio::const_buffer* first;
+      const boost::asio::const_buffer* last;
+
+   public:
+      // the sequence requirements of boost asio
+      typedef boost::asio::const_buffer value_type;
+      typedef const boost::asio::const_buffer* const_iterator;
+
+      // view on the buffers of the range
+      GatherBuffers( const boost::asio::const_buffer* first,
+                     const boost::asio::const_buffer* last )
+      :
+         first( first ),
+         last( last )
+      {
+      }
+
+      // get the first buffer
+      const_iterator begin() const
+      {
+         return first;
+      }
+
+      // get the end of the buffers
+      const_iterator end() const
+      {
+         return last;
+      }
+   };
+
+   // the boost reactor running the connection
+   boost::asio::io_service& boostReactor;
 
 	// the socket used for communication
 	boost::asio::ip::tcp::socket connectionSocket;
 
-   // the buffer used to send message
-	std::string       outMessage;
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+   // the socket used for communication with a local peer
+   boost::asio::local::stream_protocol::socket localSocket;
+#endif
+
+   // the socket used by the connection
+   Transport transport;
+
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+   // the rings of a shared memory connection (NULL for the other transports)
+   boost::scoped_ptr< SharedMemoryLink > sharedLink;
+
+   // the doorbells received on the socket of a shared memory connection
+   boost::array< char, 64 > doorbells;
+
+   // the number of bytes of the head of the queue already in the outbound ring
+   size_t sharedWriteOffset;
+
+   // true while the writes wait for the reader to free space in the outbound ring
+   bool sharedWriteBlocked;
+#endif
+
+   // the strand serializing the operations on the socket
+   boost::asio::io_service::strand strand;
+
+   // the messages waiting for the socket
+   WriteQueue writeQueue;
 
-   // the buffer used to read incoming message
-   std::vector< char > readBuffer;
+   // the messages currently written on the socket
+   WriteQueue inFlight;
 
-   // the buffer sued to store message grater than SOCKET_READ_SIZE
-   std::string readMessage;
+   // the messages written, kept between the writes so their callbacks are called without allocating (used in the strand)
+   WriteQueue written;
 
-   // the write mutex
-   boost::mutex writeMutex;
+   // the buffers of the gather write in flight, a header (or a trailer) and a payload by message
+   boost::array< boost::asio::const_buffer, 2 * MAX_GATHER_WRITE > gatherBuffers;
+
+   // the range of the gather buffers not written yet (used in the strand)
+   size_t gatherFirst;
+   size_t gatherLast;
+
+   // the memory of the operations of the connection, one for each kind as a single one of each is pending at a time
+   // the start of the writes is posted by the threads queuing the messages (a single one while writeInProgress),
+   // the read and the write run on the socket then in the strand
+   HandlerMemory startWriteMemory;
+   HandlerMemory readMemory;
+   HandlerMemory writeMemory;
+
+   // true while a gather write is running on the socket
+   bool writeInProgress;
+
+   // the number of bytes queued or in flight
+   size_t bytesPending;
+
+   // the ring used to read incoming message, the socket reads directly in it
+   RingBuffer readBuffer;
+
+   // the framing used on this connection
+   FramingMode framingMode;
+
+   // true if TCP_QUICKACK is set again after each read (see SocketProfile::quickAckRearm)
+   bool quickAckRearm;
+
+#ifdef BACKBONE_IO_URING
+   // the ring reading the tcp socket, NULL while the reads are on the reactor (decided on the first read)
+   UringReadService* uringReads;
+   bool uringDecided;
+#endif
+
+   // the write mutex, guards the queues and the pending counters
+   mutable boost::mutex writeMutex;
 
 public:
    // Create a cimple tcp connection to exchange async message
-	SimpleTcpConnection( boost::asio::io_service& boostReactor )
-   : 
+	SimpleTcpConnection( boost::asio::io_service& boostReactor,
+                        FramingMode framingMode = FRAMING_LENGTH_PREFIXED,
+                        Transport transport = TRANSPORT_TCP )
+   :
+      boostReactor( boostReactor ),
       connectionSocket( boostReactor ),
-      readBuffer(),
-      readMessage()
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+      localSocket( boostReactor ),
+#endif
+      transport( transport ),
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+      sharedLink(),
+      doorbells(),
+      sharedWriteOffset( 0 ),
+      sharedWriteBlocked( false ),
+#endif
+      strand( boostReactor ),
+      writeQueue(),
+      inFlight(),
+      written(),
+      gatherBuffers(),
+      gatherFirst( 0 ),
+      gatherLast( 0 ),
+      startWriteMemory(),
+      readMemory(),
+      writeMemory(),
+      writeInProgress( false ),
+      bytesPending( 0 ),
+      readBuffer( SOCKET_READ_SIZE ),
+      framingMode( framingMode ),
+      quickAckRearm( false )
+#ifdef BACKBONE_IO_URING
+      ,
+      uringReads( NULL ),
+      uringDecided( false )
+#endif
    {
       AsyncLogger::getInstance()->log( "SimpleTcpConnection> SimpleTcpConnection created" );
    }
@@ -49,73 +266,830 @@ public:
       writeMutex.unlock();
    }
 
+   // get the boost reactor running the connection
+   boost::asio::io_service& getReactor()
+   {
+      return boostReactor;
+   }
+
    // get the current boost socket
 	boost::asio::ip::tcp::socket& getSocket()
    {
 	   return connectionSocket;
    }
 
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+   // get the current boost socket of a local connection
+   boost::asio::local::stream_protocol::socket& getLocalSocket()
+   {
+      return localSocket;
+   }
+#endif
+
+   // get the socket used by the connection
+   Transport getTransport() const
+   {
+      return transport;
+   }
+
+   // return true if the address is the one of a unix domain socket ('unix:<path>')
+   static bool isLocalAddress( const std::string& address )
+   {
+      return address.compare( 0, sizeof( LOCAL_ADDRESS_PREFIX ) - 1, LOCAL_ADDRESS_PREFIX ) == 0;
+   }
+
+   // return true if the address is the one of a unix domain socket upgraded to shared memory ('shm:<path>')
+   static bool isSharedMemoryAddress( const std::string& address )
+   {
+      return address.compare( 0, sizeof( SHARED_MEMORY_ADDRESS_PREFIX ) - 1, SHARED_MEMORY_ADDRESS_PREFIX ) == 0;
+   }
+
+   // return the path of the unix domain socket of the address
+   static std::string getLocalPath( const std::string& address )
+   {
+      return address.substr( address.find( ':' ) + 1 );
+   }
+
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+   // ask the accepting side for a shared memory and map the one it created
+   // called on a shared memory connection once connected, before any message (the answer is read synchronously,
+   // byte per byte so no doorbell following it is taken)
+   // throw if the answer is not the name of a link or the memory can't be mapped
+   void startSharedMemory()
+   {
+      const char preamble[] = { SHARED_MEMORY_PREAMBLE, '\0' };
+      boost::asio::write( localSocket,
+                          boost::asio::buffer( preamble ) );
+
+      std::string answer;
+      char byte = SHARED_MEMORY_PREAMBLE;
+      while (  ( byte != '\0' )
+             &&( answer.size() < SHARED_MEMORY_MAX_ANSWER )  )
+      {
+         boost::asio::read( localSocket,
+                            boost::asio::buffer( &byte, 1 ) );
+         answer += byte;
+      }
+      if (  ( answer.size() < 2 )
+          ||( answer[ 0 ] != SHARED_MEMORY_PREAMBLE )
+          ||( byte != '\0' )  )
+      {
+         throw boost::interprocess::interprocess_exception( "invalid answer to the shared memory preamble" );
+      }
+
+      sharedLink.reset( SharedMemoryLink::open( answer.substr( 1, answer.size() - 2 ) ) );
+      framingMode = FRAMING_LENGTH_PREFIXED;
+   }
+#endif
+
+   // apply the options of the profile on the tcp socket once connected (ignored for the other transports)
+   // the options are set in the strand and their effective values are logged
+   void applySocketProfile( const SocketProfile& profile )
+   {
+      strand.post( boost::bind( &SimpleTcpConnection::applySocketProfileInStrand,
+                                shared_from_this(),
+                                profile ) );
+   }
+
+   // get the strand of the connection
+   boost::asio::io_service::strand& getStrand()
+   {
+      return strand;
+   }
+
+   // get the framing used on the connection
+   FramingMode getFramingMode() const
+   {
+      return framingMode;
+   }
+
    // close the connection
    void close()
    {
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+      if ( transport != TRANSPORT_TCP )
+      {
+         localSocket.close();
+         return;
+      }
+#endif
+#ifdef BACKBONE_IO_URING
+      // the ring holds the socket until its read is cancelled, closing the descriptor alone would not end it
+      if (  ( uringReads != NULL )
+          &&( connectionSocket.is_open() == true )  )
+      {
+         uringReads->cancel( connectionSocket.native_handle() );
+      }
+#endif
       connectionSocket.close();
    }
 
-   // write the message on the socket and use the templated Handler for callback
-	template< typename Handler >
-	void asyncWrite( const std::string& message, 
-                    Handler handler )
+   // return the number of messages queued or in flight
+   size_t getQueueDepth() const
+   {
+      boost::mutex::scoped_lock lock( writeMutex );
+      return writeQueue.size() + inFlight.size();
+   }
+
+   // return the number of bytes queued or in flight (framing included)
+   size_t getBytesPending() const
+   {
+      boost::mutex::scoped_lock lock( writeMutex );
+      return bytesPending;
+   }
+
+   // stop the pending read on the socket, the read completes with operation_aborted
+   // nothing is done while a write runs as the cancellation would abort it too
+   void cancelRead()
+   {
+      strand.post( boost::bind( &SimpleTcpConnection::cancelReadInStrand,
+                                shared_from_this() ) );
+   }
+
+   // get the bytes received but not extracted yet (the start of a frame)
+   // only valid while no read is pending
+   std::string getUnreadInput() const
+   {
+      std::string input;
+      readBuffer.copy( 0,
+                       input,
+                       readBuffer.size() );
+      return input;
+   }
+
+   // put back the bytes received on the socket by another process, before the first read
+   void restoreInput( const std::string& input )
+   {
+      boost::asio::buffer_copy( readBuffer.prepare( input.size() ),
+                                boost::asio::buffer( input ) );
+      readBuffer.commit( input.size() );
+   }
+
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+   // get the descriptor of the socket of the transport
+   int getNativeHandle()
+   {
+      if ( transport != TRANSPORT_TCP )
+      {
+         return localSocket.native_handle();
+      }
+      return connectionSocket.native_handle();
+   }
+
+   // take an open socket of the transport, received from another process
+   void adopt( int descriptor )
+   {
+      if ( transport != TRANSPORT_TCP )
+      {
+         localSocket.assign( boost::asio::local::stream_protocol(),
+                             descriptor );
+         return;
+      }
+
+      // the socket may be on ipv4 or ipv6
+      struct sockaddr_storage address;
+      socklen_t size = sizeof( address );
+      memset( &address, 0, sizeof( address ) );
+      ::getsockname( descriptor,
+                     reinterpret_cast< struct sockaddr* >( &address ),
+                     &size );
+      connectionSocket.assign( ( address.ss_family == AF_INET6 ) ? boost::asio::ip::tcp::v6() : boost::asio::ip::tcp::v4(),
+                               descriptor );
+   }
+#endif
+
+   // queue the message for the socket and use the handler for callback
+   // the message is framed according to the framing mode of the connection
+   // can be called from any thread, the queued messages are sent in order with gather writes
+	void asyncWrite( const std::string& message,
+                    WriteHandler handler )
+   {
+      asyncWrite( SharedMessage( BufferPool::getInstance().copy( message ) ),
+                  handler );
+   }
+
+   // queue a shared message for the socket and use the handler for callback
+   // the message is not copied so the same buffer can be queued on many connections
+	void asyncWrite( SharedMessage message,
+                    WriteHandler handler )
    {
       writeMutex.lock();
-      /*|*/ // write the message on the socket
-	   /*|*/ outMessage = message;
-	   /*|*/ boost::asio::async_write( connectionSocket, 
-      /*|*/                           boost::asio::buffer( outMessage ),
-      /*|*/                           handler );
+      /*|*/ // queue the message with its framing
+      /*|*/ PendingWrite& pending = writeQueue.push_back();
+      /*|*/ pending.payload = message;
+      /*|*/ pending.framing = framingMode;
+      /*|*/ pending.handler = handler;
+      /*|*/ frame( pending );
+      /*|*/ bytesPending += frameSize( pending );
+      /*|*/
+      /*|*/ // and start the socket writing in the strand if it's idle
+      /*|*/ if ( writeInProgress == false )
+      /*|*/ {
+      /*|*/    writeInProgress = true;
+      /*|*/    strand.post( makeMemoryHandler( startWriteMemory,
+      /*|*/                                    boost::bind( &SimpleTcpConnection::startWrite,
+      /*|*/                                                 this ) ) );
+      /*|*/ }
       writeMutex.unlock();
    }
 
 	// asynchronous read using the handler for callback
+   // the handler is called once all the complete frames of the read are stored in messages
+   // each frame is in a buffer of the pool so it can be relayed without copy
 	template< typename Handler >
-	void asyncRead( std::string& message, 
+	void asyncRead( std::vector< SharedMessage >& messages,
                    Handler handler )
    {
 #ifdef __DEBUG__
       AsyncLogger::getInstance()->log( "SimpleTcpConnection> Reading on the socket ..." );
 #endif
 
-      // initialize the buffer 
-      readBuffer.clear();
-      readBuffer.resize( SOCKET_READ_SIZE );
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+      // a shared memory connection reads its ring, the socket only wakes it up
+      if ( transport == TRANSPORT_SHARED_MEMORY )
+      {
+         void (SimpleTcpConnection::*poll)( std::vector< SharedMessage >&,
+                                            boost::tuple< Handler > ) = &SimpleTcpConnection::pollShared< Handler >;
 
-      // call the async read
-	   void (SimpleTcpConnection::*callback)( const boost::system::error_code&, 
-                                             size_t,         
-                                             std::string&, 
+         strand.post( boost::bind( poll,
+                                   this,
+                                   boost::ref( messages ),
+                                   boost::make_tuple( handler ) ) );
+         return;
+      }
+#endif
+
+      // call the async read directly in the free area of the ring
+	   void (SimpleTcpConnection::*callback)( const boost::system::error_code&,
+                                             size_t,
+                                             std::vector< SharedMessage >&,
                                              boost::tuple< Handler > ) = &SimpleTcpConnection::handleRead< Handler >;
 
-      boost::asio::async_read( connectionSocket, 
-                               boost::asio::buffer( readBuffer ),
-                               boost::asio::transfer_at_least(1), // at least 1 charactrers on the socket before reading the buffer
-		                         boost::bind( callback, 
-                                            this,
-		                                      boost::asio::placeholders::error,
-                                            boost::asio::placeholders::bytes_transferred,
-                                            boost::ref( message ), 
-                                            boost::make_tuple( handler ) ) );
+      readSome( readBuffer.prepare( SOCKET_READ_SIZE ),
+		          strand.wrap( makeMemoryHandler( readMemory,
+                                                boost::bind( callback,
+                                                             this,
+		                                                       boost::asio::placeholders::error,
+                                                             boost::asio::placeholders::bytes_transferred,
+                                                             boost::ref( messages ),
+                                                             boost::make_tuple( handler ) ) ) ) );
    }
 
 private:
+   // stop the pending read on the socket if no write runs, run in the strand
+   void cancelReadInStrand()
+   {
+      boost::system::error_code ignored;
+
+      writeMutex.lock();
+#ifdef BACKBONE_IO_URING
+      /*|*/ // the read on the ring is cancelled alone, the writes on the reactor go on
+      /*|*/ if ( uringReads != NULL )
+      /*|*/ {
+      /*|*/    uringReads->cancel( connectionSocket.native_handle() );
+      /*|*/ }
+      /*|*/ else
+#endif
+      /*|*/ if ( writeInProgress == false )
+      /*|*/ {
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+      /*|*/    if ( transport != TRANSPORT_TCP )
+      /*|*/    {
+      /*|*/       localSocket.cancel( ignored );
+      /*|*/    }
+      /*|*/    else
+#endif
+      /*|*/    {
+      /*|*/       connectionSocket.cancel( ignored );
+      /*|*/    }
+      /*|*/ }
+      writeMutex.unlock();
+   }
+
+   // apply the options of the profile on the tcp socket, run in the strand
+   void applySocketProfileInStrand( const SocketProfile& profile )
+   {
+      if (  ( transport != TRANSPORT_TCP )
+          ||( connectionSocket.is_open() == false )  )
+      {
+         return;
+      }
+
+      quickAckRearm = (  ( profile.quickAck == true )
+                       &&( profile.quickAckRearm == true )  );
+      AsyncLogger::getInstance()->log( "SimpleTcpConnection> Socket tuned> " + SocketTuning::apply( connectionSocket,
+                                                                                                   profile ) );
+   }
+
+   // start an asynchronous read on the socket of the transport
+   template< typename Buffers, typename Handler >
+   void readSome( const Buffers& buffers,
+                  Handler handler )
+   {
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+      if ( transport != TRANSPORT_TCP )
+      {
+         localSocket.async_read_some( buffers,
+                                      handler );
+         return;
+      }
+#endif
+#ifdef BACKBONE_IO_URING
+      // the connection reads through the ring of the reactor if it's enabled and set up, for its whole life
+      if ( uringDecided == false )
+      {
+         uringDecided = true;
+         if ( UringReadService::isEnabled() == true )
+         {
+            UringReadService& service = boost::asio::use_service< UringReadService >( boostReactor );
+            uringReads = ( service.isReady() == true ) ? &service : NULL;
+         }
+      }
+      if ( uringReads != NULL )
+      {
+         uringReads->read( connectionSocket.native_handle(),
+                           buffers,
+                           handler );
+         return;
+      }
+#endif
+      connectionSocket.async_read_some( buffers,
+                                        handler );
+   }
+
+   // start an asynchronous write of some of the buffers on the socket of the transport
+   template< typename Buffers, typename Handler >
+   void writeSome( const Buffers& buffers,
+                   Handler handler )
+   {
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+      if ( transport != TRANSPORT_TCP )
+      {
+         localSocket.async_write_some( buffers,
+                                       handler );
+         return;
+      }
+#endif
+      connectionSocket.async_write_some( buffers,
+                                         handler );
+   }
+
+   // compute the length prefix of the pending message
+   // nothing received yet on an auto connection means a legacy peer is assumed
+   static void frame( PendingWrite& pending )
+   {
+      if ( pending.framing == FRAMING_AUTO )
+      {
+         pending.framing = FRAMING_NUL_TERMINATED;
+      }
+      else if ( pending.framing == FRAMING_LENGTH_PREFIXED )
+      {
+         size_t size = pending.payload->size();
+         pending.header[ 0 ] = static_cast< char >( ( size >> 24 ) & 0xFF );
+         pending.header[ 1 ] = static_cast< char >( ( size >> 16 ) & 0xFF );
+         pending.header[ 2 ] = static_cast< char >( ( size >> 8 ) & 0xFF );
+         pending.header[ 3 ] = static_cast< char >( size & 0xFF );
+      }
+   }
+
+   // return the number of bytes written on the socket for the pending message
+   static size_t frameSize( const PendingWrite& pending )
+   {
+      return pending.payload->size() + ( ( pending.framing == FRAMING_LENGTH_PREFIXED ) ? FRAME_HEADER_SIZE : 1 );
+   }
+
+   // start writing the queue on the socket, run in the strand
+   void startWrite()
+   {
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+      if ( transport == TRANSPORT_SHARED_MEMORY )
+      {
+         writeShared();
+         return;
+      }
+#endif
+
+      writeMutex.lock();
+      /*|*/ writeQueued();
+      writeMutex.unlock();
+   }
+
+   // move the head of the queue in flight and write it on the socket with a gather write
+   // should be call inside the write mutex and in the strand
+   void writeQueued()
+   {
+      static const char NUL_TRAILER = '\0';
+
+      while (  ( writeQueue.empty() == false )
+             &&( inFlight.size() < MAX_GATHER_WRITE )  )
+      {
+         std::swap( inFlight.push_back(), writeQueue.front() );
+         writeQueue.pop_front();
+      }
+
+      // the buffers point in the ring of the messages in flight, only once it is filled as it may grow
+      size_t numberOfBuffers = 0;
+      for ( size_t i = 0;
+            i < inFlight.size();
+            ++i )
+      {
+         const PendingWrite& pending = inFlight[ i ];
+         if ( pending.framing == FRAMING_LENGTH_PREFIXED )
+         {
+            gatherBuffers[ numberOfBuffers++ ] = boost::asio::buffer( pending.header );
+            gatherBuffers[ numberOfBuffers++ ] = boost::asio::buffer( *pending.payload );
+         }
+         else
+         {
+            gatherBuffers[ numberOfBuffers++ ] = boost::asio::buffer( *pending.payload );
+            gatherBuffers[ numberOfBuffers++ ] = boost::asio::buffer( &NUL_TRAILER, 1 );
+         }
+      }
+
+      gatherFirst = 0;
+      gatherLast = numberOfBuffers;
+      writeGathered();
+   }
+
+   // write what is left of the gather buffers, run in the strand
+   // the operation of async_write holds a copy of 64 buffers (1 KB), the writes are continued here on the view
+   // so the operation fits in the memory of the writes
+   void writeGathered()
+   {
+      writeSome( GatherBuffers( gatherBuffers.data() + gatherFirst,
+                                gatherBuffers.data() + gatherLast ),
+                 strand.wrap( makeMemoryHandler( writeMemory,
+                                                 boost::bind( &SimpleTcpConnection::handleWrite,
+                                                              this,
+                                                              boost::asio::placeholders::error,
+                                                              boost::asio::placeholders::bytes_transferred ) ) ) );
+   }
+
+   // handle the end of a gather write, alert the callers and write the next messages
+   void handleWrite( const boost::system::error_code& error,
+                     size_t bytesTransferred )
+   {
+      // a part of the buffers is written, continue with the rest
+      if ( !error )
+      {
+         while (  ( gatherFirst < gatherLast )
+                &&( bytesTransferred >= gatherBuffers[ gatherFirst ].size() )  )
+         {
+            bytesTransferred -= gatherBuffers[ gatherFirst ].size();
+            gatherFirst++;
+         }
+         if ( gatherFirst < gatherLast )
+         {
+            gatherBuffers[ gatherFirst ] = gatherBuffers[ gatherFirst ] + bytesTransferred;
+            writeGathered();
+            return;
+         }
+      }
+
+      writeMutex.lock();
+      /*|*/ // get back the written messages, the rings are exchanged to keep both
+      /*|*/ written.swap( inFlight );
+      /*|*/ for ( size_t i = 0;
+      /*|*/       i < written.size();
+      /*|*/       ++i )
+      /*|*/ {
+      /*|*/    bytesPending -= frameSize( written[ i ] );
+      /*|*/ }
+      /*|*/
+      /*|*/ // on error the queued messages will never be sent, fail them too
+      /*|*/ if ( error )
+      /*|*/ {
+      /*|*/    while ( writeQueue.empty() == false )
+      /*|*/    {
+      /*|*/       std::swap( written.push_back(), writeQueue.front() );
+      /*|*/       writeQueue.pop_front();
+      /*|*/    }
+      /*|*/    bytesPending = 0;
+      /*|*/ }
+      /*|*/
+      /*|*/ // and continue with the next ones
+      /*|*/ if ( writeQueue.empty() == false )
+      /*|*/ {
+      /*|*/    writeQueued();
+      /*|*/ }
+      /*|*/ else
+      /*|*/ {
+      /*|*/    writeInProgress = false;
+      /*|*/ }
+      writeMutex.unlock();
+
+      // alert the callers outside the lock as they can queue new messages
+      for ( size_t i = 0;
+            i < written.size();
+            ++i )
+      {
+         if ( written[ i ].handler )
+         {
+            written[ i ].handler( error );
+         }
+      }
+      written.clear();
+   }
+
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+   // write the queue in the outbound ring, run in the strand
+   // the callers are alerted once their message is in the ring
+   void writeShared()
+   {
+      SharedMemoryRing& outbound = sharedLink->getOutbound();
+
+      writeMutex.lock();
+      /*|*/ while ( writeQueue.empty() == false )
+      /*|*/ {
+      /*|*/    // write what is left of the length prefix and of the message
+      /*|*/    PendingWrite& pending = writeQueue.front();
+      /*|*/    size_t size = frameSize( pending );
+      /*|*/    while ( sharedWriteOffset < size )
+      /*|*/    {
+      /*|*/       const char* source = ( sharedWriteOffset < FRAME_HEADER_SIZE ) ? &pending.header[ sharedWriteOffset ] : pending.payload->data() + sharedWriteOffset - FRAME_HEADER_SIZE;
+      /*|*/       size_t length = ( sharedWriteOffset < FRAME_HEADER_SIZE ) ? FRAME_HEADER_SIZE - sharedWriteOffset : size - sharedWriteOffset;
+      /*|*/       size_t done = outbound.write( source,
+      /*|*/                                     length );
+      /*|*/       sharedWriteOffset += done;
+      /*|*/       if ( done < length )
+      /*|*/       {
+      /*|*/          break;
+      /*|*/       }
+      /*|*/    }
+      /*|*/
+      /*|*/    // the ring is full, wait for the reader unless it freed space meanwhile
+      /*|*/    if ( sharedWriteOffset < size )
+      /*|*/    {
+      /*|*/       if ( outbound.waitForSpace() == true )
+      /*|*/       {
+      /*|*/          sharedWriteBlocked = true;
+      /*|*/          break;
+      /*|*/       }
+      /*|*/       continue;
+      /*|*/    }
+      /*|*/
+      /*|*/    // the message is in the ring
+      /*|*/    sharedWriteOffset = 0;
+      /*|*/    bytesPending -= size;
+      /*|*/    std::swap( written.push_back(), pending );
+      /*|*/    writeQueue.pop_front();
+      /*|*/ }
+      /*|*/
+      /*|*/ if ( writeQueue.empty() == true )
+      /*|*/ {
+      /*|*/    writeInProgress = false;
+      /*|*/ }
+      writeMutex.unlock();
+
+      // wake up the reader if it sleeps
+      if ( outbound.wakeReader() == true )
+      {
+         ringDoorbell();
+      }
+
+      // alert the callers outside the lock as they can queue new messages
+      for ( size_t i = 0;
+            i < written.size();
+            ++i )
+      {
+         if ( written[ i ].handler )
+         {
+            written[ i ].handler( boost::system::error_code() );
+         }
+      }
+      written.clear();
+   }
+
+   // continue the writes waiting for space in the outbound ring, run in the strand
+   void resumeSharedWrite()
+   {
+      writeMutex.lock();
+      /*|*/ bool blocked = sharedWriteBlocked;
+      /*|*/ sharedWriteBlocked = false;
+      writeMutex.unlock();
+
+      if ( blocked == true )
+      {
+         writeShared();
+      }
+   }
+
+   // wake up the other side of a shared memory connection
+   void ringDoorbell()
+   {
+      static const char DOORBELL = 'D';
+      boost::asio::async_write( localSocket,
+                                boost::asio::buffer( &DOORBELL, 1 ),
+                                boost::bind( &SimpleTcpConnection::handleDoorbellWrite,
+                                             boost::asio::placeholders::error ) );
+   }
+
+   // nothing to do once a doorbell is sent, a failure shows on the reads
+   static void handleDoorbellWrite( const boost::system::error_code& error )
+   {
+   }
+
+   // answer the preamble received on a unix domain socket with the name of a shared memory created for it, run in the strand
+   // the memory is always created here under the pid of the process, whatever the peer sent before the '\0'
+   // (an older peer sending the name of its own memory) is ignored so it never makes us map a memory of its choice
+   // return false if the preamble is not valid or the memory can't be created
+   bool attachSharedMemory()
+   {
+      // wait for the end of the preamble
+      size_t end = readBuffer.find( '\0' );
+      if ( end == std::string::npos )
+      {
+         return readBuffer.size() < SOCKET_READ_SIZE;
+      }
+
+      // the peer sends nothing more before the answer
+      readBuffer.consume( readBuffer.size() );
+
+      std::string name = SharedMemoryLink::makeName( this );
+      try
+      {
+         sharedLink.reset( SharedMemoryLink::create( name ) );
+      }
+      catch ( boost::interprocess::interprocess_exception& exception )
+      {
+         AsyncLogger::getInstance()->log( "SimpleTcpConnection> unable to create the shared memory " + name + ": " + exception.what() );
+         return false;
+      }
+
+      // nothing else is written on the socket yet, the answer is short enough to be sent at once
+      std::string answer( 1, SHARED_MEMORY_PREAMBLE );
+      answer += name;
+      answer += '\0';
+      boost::system::error_code error;
+      boost::asio::write( localSocket,
+                          boost::asio::buffer( answer ),
+                          error );
+      if ( error )
+      {
+         AsyncLogger::getInstance()->log( "SimpleTcpConnection> unable to send the shared memory " + name + ": " + error.message() );
+         return false;
+      }
+
+      transport = TRANSPORT_SHARED_MEMORY;
+      framingMode = FRAMING_LENGTH_PREFIXED;
+      return true;
+   }
+
+   // move the inbound ring in the read buffer and signal the complete frames to the caller, run in the strand
+   // sleep on the doorbell when the ring is empty
+   template< typename Handler >
+   void pollShared( std::vector< SharedMessage >& messages,
+                    boost::tuple< Handler > handler )
+   {
+      SharedMemoryRing& inbound = sharedLink->getInbound();
+
+      // get the received bytes and wake up the other side if it waits for space
+      inbound.read( readBuffer );
+      if ( inbound.wakeWriter() == true )
+      {
+         ringDoorbell();
+      }
+
+      // the reader of the other side may have freed space for our writes
+      resumeSharedWrite();
+
+      messages.clear();
+      if ( extractFrames( messages ) == false )
+      {
+         boost::get< 0 >( handler )( boost::asio::error::message_size );
+      }
+      else if ( messages.empty() == false )
+      {
+         boost::get< 0 >( handler )( boost::system::error_code() );
+      }
+      else if ( inbound.waitForData() == false )
+      {
+         // bytes arrived meanwhile, poll again
+         asyncRead( messages,
+                    boost::get< 0 >( handler ) );
+      }
+      else
+      {
+         // sleep until the doorbell (or the closure of the socket)
+         void (SimpleTcpConnection::*callback)( const boost::system::error_code&,
+                                                size_t,
+                                                std::vector< SharedMessage >&,
+                                                boost::tuple< Handler > ) = &SimpleTcpConnection::handleDoorbell< Handler >;
+
+         localSocket.async_read_some( boost::asio::buffer( doorbells ),
+                                      strand.wrap( boost::bind( callback,
+                                                                this,
+                                                                boost::asio::placeholders::error,
+                                                                boost::asio::placeholders::bytes_transferred,
+                                                                boost::ref( messages ),
+                                                                handler ) ) );
+      }
+   }
+
+   // handle a doorbell of the other side, run in the strand
+   template< typename Handler >
+   void handleDoorbell( const boost::system::error_code& error,
+                        size_t numberOfBytes,
+                        std::vector< SharedMessage >& messages,
+                        boost::tuple< Handler > handler )
+   {
+      if ( error )
+      {
+         boost::get< 0 >( handler )( error );
+      }
+      else
+      {
+         pollShared( messages,
+                     handler );
+      }
+   }
+#endif
+
+   // extract all the complete frames of the ring in messages
+   // return false if the stream is corrupted
+   bool extractFrames( std::vector< SharedMessage >& messages )
+   {
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+      // a local peer asking for shared memory
+      if (  ( framingMode == FRAMING_AUTO )
+          &&( readBuffer.size() > 0 )
+          &&( readBuffer.at( 0 ) == SHARED_MEMORY_PREAMBLE )  )
+      {
+         return (  ( transport == TRANSPORT_LOCAL )
+                 &&( attachSharedMemory() == true )  );
+      }
+#endif
+
+      // decide the framing on the first byte received
+      if (  ( framingMode == FRAMING_AUTO )
+          &&( readBuffer.size() > 0 )  )
+      {
+         framingMode = ( readBuffer.at( 0 ) == 0 ) ? FRAMING_LENGTH_PREFIXED : FRAMING_NUL_TERMINATED;
+      }
+
+      if ( framingMode == FRAMING_LENGTH_PREFIXED )
+      {
+         while ( readBuffer.size() >= FRAME_HEADER_SIZE )
+         {
+            unsigned char header[ FRAME_HEADER_SIZE ];
+            readBuffer.copy( 0,
+                             reinterpret_cast< char* >( header ),
+                             FRAME_HEADER_SIZE );
+            size_t size = ( static_cast< size_t >( header[ 0 ] ) << 24 )
+                        | ( static_cast< size_t >( header[ 1 ] ) << 16 )
+                        | ( static_cast< size_t >( header[ 2 ] ) << 8 )
+                        | static_cast< size_t >( header[ 3 ] );
+            if ( size > MAX_FRAME_SIZE )
+            {
+               return false;
+            }
+
+            // wait for the end of the frame
+            if ( readBuffer.size() < FRAME_HEADER_SIZE + size )
+            {
+               break;
+            }
+
+            SharedBuffer message = BufferPool::getInstance().acquire( size );
+            readBuffer.copy( FRAME_HEADER_SIZE,
+                             *message,
+                             size );
+            readBuffer.consume( FRAME_HEADER_SIZE + size );
+            messages.push_back( message );
+         }
+      }
+      else if ( framingMode == FRAMING_NUL_TERMINATED )
+      {
+         size_t end;
+         while ( ( end = readBuffer.find( '\0' ) ) != std::string::npos )
+         {
+            SharedBuffer message = BufferPool::getInstance().acquire( end );
+            readBuffer.copy( 0,
+                             *message,
+                             end );
+            readBuffer.consume( end + 1 );
+            messages.push_back( message );
+         }
+
+         if ( readBuffer.size() > MAX_FRAME_SIZE )
+         {
+            return false;
+         }
+      }
+
+      return true;
+   }
+
    // handle message reception and signal it to the caller
    template< typename Handler >
    void handleRead( const boost::system::error_code& error,
                     size_t numberOfBytes,
-	                 std::string& message, 
+	                 std::vector< SharedMessage >& messages,
                     boost::tuple< Handler > handler )
    {
 #ifdef __DEBUG
       std::stringstream stream;
-      stream << "SimpleTcpConnection> Message received (" << readBuffer.size() << ") - (" << numberOfBytes << "): '@'" << readBuffer.data() << "'@'" << std::endl;
+      stream << "SimpleTcpConnection> Data received (" << numberOfBytes << ") - buffered (" << readBuffer.size() << ")" << std::endl;
       AsyncLogger::getInstance()->log( stream.str() );
 #endif
       // check if an error occurs
@@ -126,25 +1100,28 @@ private:
       }
       else
       {
-         for ( size_t i = 0; i < numberOfBytes; i++)
+         readBuffer.commit( numberOfBytes );
+
+         // stay in quick ack mode, the kernel leaves it after a few segments (a system call, only if the profile asks)
+         if ( quickAckRearm == true )
          {
-            if ( readBuffer[ i ] == 0 )
-               break;
-            readMessage += readBuffer[ i ];
+            SocketTuning::rearmQuickAck( connectionSocket );
          }
 
+         // get all the complete frames from the ring
+         messages.clear();
+         if ( extractFrames( messages ) == false )
+         {
+            boost::get< 0 >( handler )( boost::asio::error::message_size );
+         }
          // check if there is still something to read
-         if ( numberOfBytes == readBuffer.size() )
+         else if ( messages.empty() == true )
          {
-            asyncRead( message,
+            asyncRead( messages,
                        boost::get< 0 >( handler ) );
          }
          else
          {
-            // get the message from the socket
-            message = readMessage;
-            readMessage.clear();
-
             // alert the caller that something can be done with the readed data
             boost::get< 0 >( handler )( error );
          }
@@ -0,0 +1,262 @@
+#define _WIN32_WINNT 0x0501
+
+#include <string.h>
+#include <errno.h>
+#include <algorithm>
+#include <boost/asio.hpp>
+#include "SocketHandoff.hpp"
+
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+// write all the bytes, retrying on the interruptions
+static bool writeAll( int socket,
+                      const char* data,
+                      size_t size )
+{
+   while ( size > 0 )
+   {
+      ssize_t written = ::send( socket, data, size, MSG_NOSIGNAL );
+      if (  ( written < 0 )
+          &&( errno == EINTR )  )
+      {
+         continue;
+      }
+      if ( written <= 0 )
+      {
+         return false;
+      }
+      data += written;
+      size -= written;
+   }
+   return true;
+}
+
+// read exactly size bytes, never more so the next descriptors are not swallowed
+static bool readAll( int socket,
+                     char* data,
+                     size_t size )
+{
+   while ( size > 0 )
+   {
+      ssize_t received = ::recv( socket, data, size, 0 );
+      if (  ( received < 0 )
+          &&( errno == EINTR )  )
+      {
+         continue;
+      }
+      if ( received <= 0 )
+      {
+         return false;
+      }
+      data += received;
+      size -= received;
+   }
+   return true;
+}
+
+// write a 32 bits big endian integer at the end of out
+static void writeSize( std::string& out,
+                       size_t value )
+{
+   out += static_cast< char >( ( value >> 24 ) & 0xFF );
+   out += static_cast< char >( ( value >> 16 ) & 0xFF );
+   out += static_cast< char >( ( value >> 8 ) & 0xFF );
+   out += static_cast< char >( value & 0xFF );
+}
+
+// read a 32 bits big endian integer
+static size_t readSize( const unsigned char* in )
+{
+   return ( static_cast< size_t >( in[ 0 ] ) << 24 )
+        | ( static_cast< size_t >( in[ 1 ] ) << 16 )
+        | ( static_cast< size_t >( in[ 2 ] ) << 8 )
+        | static_cast< size_t >( in[ 3 ] );
+}
+#endif
+
+// send the descriptors then the data on the socket
+// return false if the peer is gone
+bool SocketHandoff::send( int socket,
+                          const std::vector< int >& descriptors,
+                          const std::string& data )
+{
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+   std::string header;
+   writeSize( header, descriptors.size() );
+   writeSize( header, data.size() );
+   if ( writeAll( socket, header.data(), header.size() ) == false )
+   {
+      return false;
+   }
+
+   // each message carries its number of descriptors in its only byte
+   for ( size_t first = 0;
+         first < descriptors.size();
+         first += MAX_DESCRIPTORS_PER_MESSAGE )
+   {
+      size_t count = std::min( descriptors.size() - first, static_cast< size_t >( MAX_DESCRIPTORS_PER_MESSAGE ) );
+      char countByte = static_cast< char >( count );
+      struct iovec vector;
+      vector.iov_base = &countByte;
+      vector.iov_len = 1;
+
+      char control[ CMSG_SPACE( MAX_DESCRIPTORS_PER_MESSAGE * sizeof( int ) ) ];
+      memset( control, 0, sizeof( control ) );
+      struct msghdr message;
+      memset( &message, 0, sizeof( message ) );
+      message.msg_iov = &vector;
+      message.msg_iovlen = 1;
+      message.msg_control = control;
+      message.msg_controllen = CMSG_SPACE( count * sizeof( int ) );
+
+      struct cmsghdr* rights = CMSG_FIRSTHDR( &message );
+      rights->cmsg_level = SOL_SOCKET;
+      rights->cmsg_type = SCM_RIGHTS;
+      rights->cmsg_len = CMSG_LEN( count * sizeof( int ) );
+      memcpy( CMSG_DATA( rights ), &descriptors[ first ], count * sizeof( int ) );
+
+      ssize_t sent;
+      do
+      {
+         sent = ::sendmsg( socket, &message, MSG_NOSIGNAL );
+      }
+      while (  ( sent < 0 )
+             &&( errno == EINTR )  );
+      if ( sent != 1 )
+      {
+         return false;
+      }
+   }
+
+   return writeAll( socket, data.data(), data.size() );
+#else
+   return false;
+#endif
+}
+
+// receive the descriptors and the data sent by send, in the same order
+// return false if the stream is broken, the descriptors already received are closed
+bool SocketHandoff::receive( int socket,
+                             std::vector< int >& descriptors,
+                             std::string& data )
+{
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+   unsigned char header[ 8 ];
+   if ( readAll( socket, reinterpret_cast< char* >( header ), sizeof( header ) ) == false )
+   {
+      return false;
+   }
+   size_t expected = readSize( header );
+   size_t size = readSize( header + 4 );
+
+   while ( descriptors.size() < expected )
+   {
+      char countByte = 0;
+      struct iovec vector;
+      vector.iov_base = &countByte;
+      vector.iov_len = 1;
+
+      char control[ CMSG_SPACE( MAX_DESCRIPTORS_PER_MESSAGE * sizeof( int ) ) ];
+      struct msghdr message;
+      memset( &message, 0, sizeof( message ) );
+      message.msg_iov = &vector;
+      message.msg_iovlen = 1;
+      message.msg_control = control;
+      message.msg_controllen = sizeof( control );
+
+      ssize_t received;
+      do
+      {
+         received = ::recvmsg( socket, &message, 0 );
+      }
+      while (  ( received < 0 )
+             &&( errno == EINTR )  );
+      if ( received != 1 )
+      {
+         closeAll( descriptors );
+         return false;
+      }
+
+      // keep the descriptors even if the message is not the expected one, so they are closed
+      size_t count = 0;
+      for ( struct cmsghdr* rights = CMSG_FIRSTHDR( &message );
+            rights != NULL;
+            rights = CMSG_NXTHDR( &message, rights ) )
+      {
+         if (  ( rights->cmsg_level == SOL_SOCKET )
+             &&( rights->cmsg_type == SCM_RIGHTS )  )
+         {
+            size_t passed = ( rights->cmsg_len - CMSG_LEN( 0 ) ) / sizeof( int );
+            const int* first = reinterpret_cast< const int* >( CMSG_DATA( rights ) );
+            descriptors.insert( descriptors.end(),
+                                first,
+                                first + passed );
+            count += passed;
+         }
+      }
+      if (  ( ( message.msg_flags & MSG_CTRUNC ) != 0 )
+          ||( count != static_cast< unsigned char >( countByte ) )  )
+      {
+         closeAll( descriptors );
+         return false;
+      }
+   }
+
+   data.resize( size );
+   if (  ( size > 0 )
+       &&( readAll( socket, &data[ 0 ], size ) == false )  )
+   {
+      closeAll( descriptors );
+      return false;
+   }
+   return true;
+#else
+   return false;
+#endif
+}
+
+// return true if the process at the other end of the socket runs as the same user as this one (SO_PEERCRED)
+bool SocketHandoff::isSameUser( int socket )
+{
+#if defined( BOOST_ASIO_HAS_LOCAL_SOCKETS ) && defined( SO_PEERCRED )
+   struct ucred credentials;
+   socklen_t size = sizeof( credentials );
+   if ( ::getsockopt( socket, SOL_SOCKET, SO_PEERCRED, &credentials, &size ) != 0 )
+   {
+      return false;
+   }
+   return ( credentials.uid == ::geteuid() );
+#else
+   return false;
+#endif
+}
+
+// bound the blocking sends and receives on the socket to the number of seconds
+void SocketHandoff::setTimeout( int socket,
+                                long seconds )
+{
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+   struct timeval timeout;
+   timeout.tv_sec = seconds;
+   timeout.tv_usec = 0;
+   ::setsockopt( socket, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof( timeout ) );
+   ::setsockopt( socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof( timeout ) );
+#endif
+}
+
+// close the descriptors and clear the list
+void SocketHandoff::closeAll( std::vector< int >& descriptors )
+{
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+   for ( size_t i = 0;
+         i < descriptors.size();
+         ++i )
+   {
+      ::close( descriptors[ i ] );
+   }
+#endif
+   descriptors.clear();
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// the most descriptors passed by a single message (the kernel limit is higher, SCM_MAX_FD)
+#define MAX_DESCRIPTORS_PER_MESSAGE 64
+
+// pass open sockets and a block of data to another process over a connected unix domain socket (SCM_RIGHTS)
+// the sockets stay open during the handoff so their peers see nothing
+//     descriptor count and data size (32 bits big endian each)
+//     the descriptors by messages of MAX_DESCRIPTORS_PER_MESSAGE, each carried by one byte
+//     the data
+// only where unix domain sockets exist, the calls fail elsewhere
+class SocketHandoff
+{
+public:
+   // send the descriptors then the data on the socket
+   // return false if the peer is gone
+   static bool send( int socket,
+                     const std::vector< int >& descriptors,
+                     const std::string& data );
+
+   // receive the descriptors and the data sent by send, in the same order
+   // return false if the stream is broken, the descriptors already received are closed
+   static bool receive( int socket,
+                        std::vector< int >& descriptors,
+                        std::string& data );
+
+   // return true if the process at the other end of the socket runs as the same user as this one (SO_PEERCRED)
+   static bool isSameUser( int socket );
+
+   // bound the blocking sends and receives on the socket to the number of seconds
+   static void setTimeout( int socket,
+                           long seconds );
+
+   // close the descriptors and clear the list
+   static void closeAll( std::vector< int >& descriptors );
+};
@@ -0,0 +1,139 @@
+#define _WIN32_WINNT 0x0501
+
+#include <sstream>
+#include <boost/asio.hpp>
+#include "SocketTuning.hpp"
+
+#ifdef __linux__
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+// set then read back an integer option of the socket, write 'label=value' in the stream
+static void applyIntegerOption( boost::asio::ip::tcp::socket& socket,
+                                int level,
+                                int option,
+                                int value,
+                                const char* label,
+                                std::ostream& stream )
+{
+   int effective = 0;
+   socklen_t length = sizeof( effective );
+   if (  ( ::setsockopt( socket.native_handle(), level, option, &value, sizeof( value ) ) != 0 )
+       ||( ::getsockopt( socket.native_handle(), level, option, &effective, &length ) != 0 )  )
+   {
+      stream << " " << label << "=refused";
+   }
+   else
+   {
+      stream << " " << label << "=" << effective;
+   }
+}
+#endif
+
+// the profile of the links between the server and the providers
+// the kernel doubles the buffer sizes for its own bookkeeping
+SocketProfile SocketTuning::getProviderProfile()
+{
+   SocketProfile profile;
+   profile.name = "provider";
+   profile.noDelay = true;
+   profile.sendBufferSize = 1024 * 1024;
+   profile.receiveBufferSize = 1024 * 1024;
+   profile.quickAck = false;
+   profile.quickAckRearm = false;
+   profile.keepAlive = true;
+   profile.keepAliveIdle = 10;
+   profile.keepAliveInterval = 5;
+   profile.keepAliveCount = 3;
+   profile.busyPoll = 50;
+   return profile;
+}
+
+// the profile of the links between the server and the consumers
+// the buffers are left to the kernel auto tuning, there are many consumers
+// the quick ack is not rearmed after each read: the peers send with TCP_NODELAY so no send waits for an ack
+SocketProfile SocketTuning::getConsumerProfile()
+{
+   SocketProfile profile;
+   profile.name = "consumer";
+   profile.noDelay = true;
+   profile.sendBufferSize = 0;
+   profile.receiveBufferSize = 0;
+   profile.quickAck = true;
+   profile.quickAckRearm = false;
+   profile.keepAlive = true;
+   profile.keepAliveIdle = 60;
+   profile.keepAliveInterval = 10;
+   profile.keepAliveCount = 5;
+   profile.busyPoll = 0;
+   return profile;
+}
+
+// apply the profile on the socket
+// return the effective values read back from the socket ('refused' for an option the kernel rejected)
+std::string SocketTuning::apply( boost::asio::ip::tcp::socket& socket,
+                                 const SocketProfile& profile )
+{
+   std::stringstream stream;
+   stream << profile.name << ":";
+   boost::system::error_code error;
+
+   boost::asio::ip::tcp::no_delay noDelay( profile.noDelay );
+   socket.set_option( noDelay, error );
+   socket.get_option( noDelay, error );
+   stream << " nodelay=" << ( ( error ) ? "refused" : ( noDelay.value() == true ) ? "on" : "off" );
+
+   if ( profile.sendBufferSize > 0 )
+   {
+      socket.set_option( boost::asio::socket_base::send_buffer_size( profile.sendBufferSize ), error );
+   }
+   boost::asio::socket_base::send_buffer_size sendBufferSize;
+   socket.get_option( sendBufferSize, error );
+   stream << " sndbuf=" << sendBufferSize.value();
+
+   if ( profile.receiveBufferSize > 0 )
+   {
+      socket.set_option( boost::asio::socket_base::receive_buffer_size( profile.receiveBufferSize ), error );
+   }
+   boost::asio::socket_base::receive_buffer_size receiveBufferSize;
+   socket.get_option( receiveBufferSize, error );
+   stream << " rcvbuf=" << receiveBufferSize.value();
+
+   boost::asio::socket_base::keep_alive keepAlive( profile.keepAlive );
+   socket.set_option( keepAlive, error );
+   socket.get_option( keepAlive, error );
+   stream << " keepalive=" << ( ( error ) ? "refused" : ( keepAlive.value() == true ) ? "on" : "off" );
+
+#ifdef __linux__
+   if ( profile.keepAlive == true )
+   {
+      applyIntegerOption( socket, IPPROTO_TCP, TCP_KEEPIDLE, profile.keepAliveIdle, "keepidle", stream );
+      applyIntegerOption( socket, IPPROTO_TCP, TCP_KEEPINTVL, profile.keepAliveInterval, "keepintvl", stream );
+      applyIntegerOption( socket, IPPROTO_TCP, TCP_KEEPCNT, profile.keepAliveCount, "keepcnt", stream );
+   }
+   if ( profile.quickAck == true )
+   {
+      applyIntegerOption( socket, IPPROTO_TCP, TCP_QUICKACK, 1, "quickack", stream );
+      stream << " rearm=" << ( ( profile.quickAckRearm == true ) ? "on" : "off" );
+   }
+#ifdef SO_BUSY_POLL
+   if ( profile.busyPoll > 0 )
+   {
+      applyIntegerOption( socket, SOL_SOCKET, SO_BUSY_POLL, profile.busyPoll, "busypoll", stream );
+   }
+#endif
+#endif
+
+   return stream.str();
+}
+
+// set TCP_QUICKACK again, the kernel leaves the quick ack mode on its own
+// a system call, only made after the reads of a profile asking for it (see SocketProfile::quickAckRearm)
+void SocketTuning::rearmQuickAck( boost::asio::ip::tcp::socket& socket )
+{
+#ifdef __linux__
+   int value = 1;
+   ::setsockopt( socket.native_handle(), IPPROTO_TCP, TCP_QUICKACK, &value, sizeof( value ) );
+#endif
+}
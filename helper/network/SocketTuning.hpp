@@ -0,0 +1,82 @@
+#pragma once
+
+#include <string>
+#include <boost/asio/ip/tcp.hpp>
+
+// the options applied to a tcp socket once connected
+// an option at 0 (or false) keeps the kernel default
+struct SocketProfile
+{
+   // the name of the profile, used in the logs
+   std::string name;
+
+   // disable the Nagle algorithm so the small messages leave at once (TCP_NODELAY)
+   bool noDelay;
+
+   // the size of the kernel buffers in bytes (SO_SNDBUF / SO_RCVBUF)
+   // the receive window scale is announced in the SYN from the receive buffer, so the buffers must be set
+   // on the listening socket or before connecting (see SocketTuning::applyBuffers), a buffer set once connected
+   // can't open the window past what was announced
+   int sendBufferSize;
+   int receiveBufferSize;
+
+   // acknowledge the received segments at once instead of delaying the ack (TCP_QUICKACK, linux only)
+   // set once connected, the kernel leaves the quick ack mode on its own after a few segments
+   bool quickAck;
+
+   // set TCP_QUICKACK again after each read to stay in quick ack mode
+   // it costs a setsockopt system call per read (about a microsecond, as much as the read itself for a small message)
+   // and the delayed acks only add latency when the peer waits for them (Nagle, a full send window),
+   // so it is only worth it for request / response traffic without TCP_NODELAY on the peer
+   bool quickAckRearm;
+
+   // detect the dead peers (SO_KEEPALIVE), with the idle time and the probe interval in seconds
+   // and the number of probes before the connection is dropped (linux only)
+   bool keepAlive;
+   int keepAliveIdle;
+   int keepAliveInterval;
+   int keepAliveCount;
+
+   // the time in microseconds the receive may busy poll the device before sleeping (SO_BUSY_POLL, linux only)
+   // raising it over the net.core.busy_read sysctl needs CAP_NET_ADMIN
+   int busyPoll;
+};
+
+// apply the socket profiles and report the values the kernel really kept
+// the links with the providers carry most of the traffic: big buffers, fast dead peer detection
+// the links with the consumers carry small interactive messages: no delay and quick acks
+class SocketTuning
+{
+public:
+   // the profile of the links between the server and the providers
+   static SocketProfile getProviderProfile();
+
+   // the profile of the links between the server and the consumers
+   static SocketProfile getConsumerProfile();
+
+   // apply the profile on the socket
+   // return the effective values read back from the socket ('refused' for an option the kernel rejected)
+   static std::string apply( boost::asio::ip::tcp::socket& socket,
+                             const SocketProfile& profile );
+
+   // set the kernel buffers of the profile on an open socket not connected yet or on a listening socket
+   // (the accepted sockets inherit them), so the window announced in the SYN matches the receive buffer
+   // a failure keeps the kernel default, the effective values are logged by apply once connected
+   template< typename Socket >
+   static void applyBuffers( Socket& socket,
+                             const SocketProfile& profile )
+   {
+      boost::system::error_code error;
+      if ( profile.sendBufferSize > 0 )
+      {
+         socket.set_option( boost::asio::socket_base::send_buffer_size( profile.sendBufferSize ), error );
+      }
+      if ( profile.receiveBufferSize > 0 )
+      {
+         socket.set_option( boost::asio::socket_base::receive_buffer_size( profile.receiveBufferSize ), error );
+      }
+   }
+
+   // set TCP_QUICKACK again, the kernel leaves the quick ack mode on its own
+   static void rearmQuickAck( boost::asio::ip::tcp::socket& socket );
+};
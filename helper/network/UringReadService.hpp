@@ -0,0 +1,715 @@
+#pragma once
+
+#include "ReactorBackend.hpp"
+
+#ifdef BACKBONE_IO_URING
+
+#include <new>
+#include <string>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/eventfd.h>
+#include <linux/io_uring.h>
+#include <boost/asio.hpp>
+#include <boost/array.hpp>
+#include <boost/atomic.hpp>
+#include <boost/bind.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/thread/mutex.hpp>
+#include "HandlerMemory.hpp"
+#include "../logger/asyncLogger.hpp"
+
+#if !defined( IORING_ASYNC_CANCEL_FD )
+#error "the io_uring reads need the linux/io_uring.h of linux 5.19 or newer (buffer rings, cancellation by descriptor)"
+#endif
+
+// the number of entries of the submission ring, the completion ring has twice as many
+// (the kernel keeps the completions overflowing it, see IORING_FEAT_NODROP)
+#define URING_ENTRIES 4096
+
+// the registered buffers the kernel receives in, their number is a power of 2
+#define URING_BUFFER_COUNT 4096
+#define URING_BUFFER_SIZE 4096
+
+// the group of the registered buffers
+#define URING_BUFFER_GROUP 0
+
+// a read submitted to the ring, allocated with the memory of its handler
+// the pending reads are linked so the ones still in the kernel are destroyed with the service
+class UringReadOperation
+{
+public:
+   // the receiving buffers of the caller (the free area of its ring buffer)
+   boost::array< boost::asio::mutable_buffer, 2 > buffers;
+   size_t numberOfBuffers;
+
+   // the socket read
+   int descriptor;
+
+   // the neighbours in the list of the pending reads
+   UringReadOperation* previous;
+   UringReadOperation* next;
+
+   // an operation without buffers
+   UringReadOperation()
+   :
+      buffers(),
+      numberOfBuffers( 0 ),
+      descriptor( -1 ),
+      previous( NULL ),
+      next( NULL )
+   {
+   }
+
+   // copy the received bytes in the buffers of the caller, return the number of bytes copied
+   size_t copy( const char* data,
+                size_t numberOfBytes )
+   {
+      return boost::asio::buffer_copy( boost::asio::mutable_buffers_1( buffers[ 0 ] ),
+                                       boost::asio::buffer( data, numberOfBytes ) )
+           + (  ( numberOfBuffers > 1 )
+              ? boost::asio::buffer_copy( boost::asio::mutable_buffers_1( buffers[ 1 ] ),
+                                          boost::asio::buffer( data, numberOfBytes ) + boost::asio::buffer_size( buffers[ 0 ] ) )
+              : 0 );
+   }
+
+   // get the number of bytes the buffers of the caller can take
+   size_t capacity() const
+   {
+      size_t size = 0;
+      for ( size_t i = 0;
+            i < numberOfBuffers;
+            ++i )
+      {
+         size += boost::asio::buffer_size( buffers[ i ] );
+      }
+      return size;
+   }
+
+   // give back the memory and call the handler with the result of the read
+   virtual void complete( const boost::system::error_code& error,
+                          size_t numberOfBytes ) = 0;
+
+   // give back the memory without calling the handler
+   virtual void destroy() = 0;
+
+protected:
+   ~UringReadOperation()
+   {
+   }
+};
+
+// the read of a handler, the memory is taken from the handler as boost asio does for its own operations
+template< typename Handler >
+class UringReadOperationOf : public UringReadOperation
+{
+   // the handler of the read
+   Handler handler;
+
+public:
+   // the read of the handler
+   explicit UringReadOperationOf( const Handler& handler )
+   :
+      UringReadOperation(),
+      handler( handler )
+   {
+   }
+
+   // allocate a read with the memory of the handler
+   static UringReadOperationOf* create( const Handler& handler )
+   {
+      Handler owner( handler );
+      void* memory = boost_asio_handler_alloc_helpers::allocate( sizeof( UringReadOperationOf ),
+                                                                 owner );
+      return new ( memory ) UringReadOperationOf( handler );
+   }
+
+   // the memory is given back before the call, so the handler can start the next read with it
+   void complete( const boost::system::error_code& error,
+                  size_t numberOfBytes )
+   {
+      Handler local( handler );
+      release( local );
+      local( error,
+             numberOfBytes );
+   }
+
+   // give back the memory without calling the handler
+   void destroy()
+   {
+      Handler local( handler );
+      release( local );
+   }
+
+private:
+   // destroy the operation and give back its memory to the handler
+   void release( Handler& local )
+   {
+      this->~UringReadOperationOf();
+      boost_asio_handler_alloc_helpers::deallocate( this,
+                                                    sizeof( UringReadOperationOf ),
+                                                    local );
+   }
+};
+
+// reads of the tcp sockets of an io_service through an io_uring instance (see ReactorBackend.hpp)
+// the ring is driven with the raw system calls of linux/io_uring.h (io_uring_setup, io_uring_enter, io_uring_register)
+// the reads queued while the reactor runs its handlers are submitted together by a single io_uring_enter
+// posted once per batch, the kernel receives in registered buffers (a buffer ring it picks from when data arrives,
+// so an idle connection holds no buffer), the completions ring an eventfd waited on by the reactor
+// and are all reaped on a single wake up, the bytes are copied in the ring buffer of the connection
+// the writes, accepts and connects stay on the reactor
+// a ring which can't be set up (old kernel, io_uring disabled) leaves the reads to the reactor
+// this class is fully inline to ease the sharing
+class UringReadService : public boost::asio::detail::service_base< UringReadService >
+{
+   // the reactor running the submissions and the completions
+   boost::asio::io_service& boostReactor;
+
+   // the mutex of the submission ring and the list of the pending reads
+   boost::mutex submitMutex;
+
+   // the descriptor of the ring, -1 if it could not be set up
+   int ringDescriptor;
+
+   // the mapped rings and the entries of the submissions
+   void* submissionMemory;
+   size_t submissionSize;
+   void* completionMemory;
+   size_t completionSize;
+   io_uring_sqe* entries;
+   size_t entriesSize;
+
+   // the indexes of the submission ring
+   unsigned* submissionHead;
+   unsigned* submissionTail;
+   unsigned submissionMask;
+   unsigned submissionEntries;
+
+   // the indexes and the entries of the completion ring
+   unsigned* completionHead;
+   unsigned* completionTail;
+   unsigned completionMask;
+   io_uring_cqe* completions;
+
+   // the registered buffers and the ring giving them to the kernel
+   char* buffers;
+   io_uring_buf_ring* bufferRing;
+   size_t bufferRingSize;
+
+   // the eventfd rung by the completions, waited on by the reactor
+   boost::asio::posix::stream_descriptor completionEvent;
+   boost::uint64_t completionCount;
+
+   // true while a submission of the queued reads is posted
+   bool submissionPosted;
+
+   // the pending reads
+   UringReadOperation* pending;
+
+   // the memory of the posted submission and of the wait on the eventfd
+   HandlerMemory submitMemory;
+   HandlerMemory waitMemory;
+
+public:
+   // set up the ring of the io_service
+   explicit UringReadService( boost::asio::io_service& boostReactor )
+   :
+      boost::asio::detail::service_base< UringReadService >( boostReactor ),
+      boostReactor( boostReactor ),
+      submitMutex(),
+      ringDescriptor( -1 ),
+      submissionMemory( MAP_FAILED ),
+      submissionSize( 0 ),
+      completionMemory( MAP_FAILED ),
+      completionSize( 0 ),
+      entries( NULL ),
+      entriesSize( 0 ),
+      submissionHead( NULL ),
+      submissionTail( NULL ),
+      submissionMask( 0 ),
+      submissionEntries( 0 ),
+      completionHead( NULL ),
+      completionTail( NULL ),
+      completionMask( 0 ),
+      completions( NULL ),
+      buffers( NULL ),
+      bufferRing( NULL ),
+      bufferRingSize( 0 ),
+      completionEvent( boostReactor ),
+      completionCount( 0 ),
+      submissionPosted( false ),
+      pending( NULL ),
+      submitMemory(),
+      waitMemory()
+   {
+      std::string failure = setUp();
+      if ( failure.empty() == false )
+      {
+         AsyncLogger::getInstance()->log( "UringReadService> io_uring unavailable (" + failure + "), the reads stay on the reactor" );
+         tearDown();
+         return;
+      }
+      waitForCompletions();
+   }
+
+   // give back the ring
+   ~UringReadService()
+   {
+      tearDown();
+   }
+
+   // enable or disable the io_uring reads of the connections created from now (enabled by default)
+   static void setEnabled( bool enabled )
+   {
+      getEnabled().store( enabled );
+   }
+
+   // return true if the connections created from now read through io_uring
+   static bool isEnabled()
+   {
+      return getEnabled().load();
+   }
+
+   // return true if the ring is set up
+   bool isReady() const
+   {
+      return ringDescriptor >= 0;
+   }
+
+   // queue a read of the socket in the buffers (at most 2), the handler is called with the error and the bytes read
+   // as for an async_read_some, the read is submitted with the other reads queued meanwhile
+   template< typename Buffers, typename Handler >
+   void read( int descriptor,
+              const Buffers& receiveBuffers,
+              Handler handler )
+   {
+      UringReadOperationOf< Handler >* operation = UringReadOperationOf< Handler >::create( handler );
+      operation->descriptor = descriptor;
+      for ( typename Buffers::const_iterator it = receiveBuffers.begin();
+            (  ( it != receiveBuffers.end() )
+             &&( operation->numberOfBuffers < operation->buffers.size() )  );
+            ++it )
+      {
+         operation->buffers[ operation->numberOfBuffers++ ] = *it;
+      }
+
+      submitMutex.lock();
+      /*|*/ link( operation );
+      /*|*/ queueRead( operation );
+      /*|*/ if ( submissionPosted == false )
+      /*|*/ {
+      /*|*/    submissionPosted = true;
+      /*|*/    boostReactor.post( makeMemoryHandler( submitMemory,
+      /*|*/                                              boost::bind( &UringReadService::submitQueued,
+      /*|*/                                                           this ) ) );
+      /*|*/ }
+      submitMutex.unlock();
+   }
+
+   // cancel the reads of the socket, they complete with operation_aborted
+   // submitted at once so it's done before the descriptor is closed
+   void cancel( int descriptor )
+   {
+      submitMutex.lock();
+      /*|*/ io_uring_sqe* entry = nextEntry();
+      /*|*/ entry->opcode = IORING_OP_ASYNC_CANCEL;
+      /*|*/ entry->fd = descriptor;
+      /*|*/ entry->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+      /*|*/ entry->user_data = 0;
+      /*|*/ pushEntry();
+      /*|*/ submit();
+      submitMutex.unlock();
+   }
+
+private:
+   // the switch of the io_uring reads
+   static boost::atomic< bool >& getEnabled()
+   {
+      static boost::atomic< bool > enabled( true );
+      return enabled;
+   }
+
+   // the system calls of io_uring, not wrapped by the libc
+   static int setupRing( unsigned numberOfEntries,
+                         io_uring_params* parameters )
+   {
+      return static_cast< int >( ::syscall( __NR_io_uring_setup, numberOfEntries, parameters ) );
+   }
+   static int enterRing( int descriptor,
+                         unsigned toSubmit,
+                         unsigned minimumCompletions,
+                         unsigned flags )
+   {
+      return static_cast< int >( ::syscall( __NR_io_uring_enter, descriptor, toSubmit, minimumCompletions, flags, NULL, 0 ) );
+   }
+   static int registerRing( int descriptor,
+                            unsigned operation,
+                            void* argument,
+                            unsigned numberOfArguments )
+   {
+      return static_cast< int >( ::syscall( __NR_io_uring_register, descriptor, operation, argument, numberOfArguments ) );
+   }
+
+   // create the ring, map it, register the buffers and the eventfd, return the failure if any
+   std::string setUp()
+   {
+      io_uring_params parameters;
+      memset( &parameters, 0, sizeof( parameters ) );
+      ringDescriptor = setupRing( URING_ENTRIES, &parameters );
+      if ( ringDescriptor < 0 )
+      {
+         return std::string( "io_uring_setup: " ) + strerror( errno );
+      }
+
+      // the submission and completion rings share a mapping on the recent kernels
+      submissionSize = parameters.sq_off.array + parameters.sq_entries * sizeof( unsigned );
+      completionSize = parameters.cq_off.cqes + parameters.cq_entries * sizeof( io_uring_cqe );
+      bool singleMapping = ( parameters.features & IORING_FEAT_SINGLE_MMAP ) != 0;
+      if ( singleMapping == true )
+      {
+         submissionSize = std::max( submissionSize, completionSize );
+      }
+      submissionMemory = ::mmap( NULL, submissionSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                 ringDescriptor, IORING_OFF_SQ_RING );
+      if ( submissionMemory == MAP_FAILED )
+      {
+         return std::string( "mmap of the submission ring: " ) + strerror( errno );
+      }
+      if ( singleMapping == false )
+      {
+         completionMemory = ::mmap( NULL, completionSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                    ringDescriptor, IORING_OFF_CQ_RING );
+         if ( completionMemory == MAP_FAILED )
+         {
+            return std::string( "mmap of the completion ring: " ) + strerror( errno );
+         }
+      }
+      entriesSize = parameters.sq_entries * sizeof( io_uring_sqe );
+      void* entriesMemory = ::mmap( NULL, entriesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                    ringDescriptor, IORING_OFF_SQES );
+      if ( entriesMemory == MAP_FAILED )
+      {
+         return std::string( "mmap of the submission entries: " ) + strerror( errno );
+      }
+      entries = static_cast< io_uring_sqe* >( entriesMemory );
+
+      char* submissionBase = static_cast< char* >( submissionMemory );
+      char* completionBase = static_cast< char* >( ( singleMapping == true ) ? submissionMemory : completionMemory );
+      submissionHead = reinterpret_cast< unsigned* >( submissionBase + parameters.sq_off.head );
+      submissionTail = reinterpret_cast< unsigned* >( submissionBase + parameters.sq_off.tail );
+      submissionMask = *reinterpret_cast< unsigned* >( submissionBase + parameters.sq_off.ring_mask );
+      submissionEntries = parameters.sq_entries;
+      completionHead = reinterpret_cast< unsigned* >( completionBase + parameters.cq_off.head );
+      completionTail = reinterpret_cast< unsigned* >( completionBase + parameters.cq_off.tail );
+      completionMask = *reinterpret_cast< unsigned* >( completionBase + parameters.cq_off.ring_mask );
+      completions = reinterpret_cast< io_uring_cqe* >( completionBase + parameters.cq_off.cqes );
+
+      // the entries are used in order, each slot of the array points to its own entry
+      unsigned* array = reinterpret_cast< unsigned* >( submissionBase + parameters.sq_off.array );
+      for ( unsigned i = 0;
+            i < submissionEntries;
+            ++i )
+      {
+         array[ i ] = i;
+      }
+
+      // the registered buffers, given to the kernel through a buffer ring (page aligned)
+      bufferRingSize = URING_BUFFER_COUNT * sizeof( io_uring_buf );
+      void* ringMemory = ::mmap( NULL, bufferRingSize + URING_BUFFER_COUNT * URING_BUFFER_SIZE, PROT_READ | PROT_WRITE,
+                                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+      if ( ringMemory == MAP_FAILED )
+      {
+         return std::string( "mmap of the buffers: " ) + strerror( errno );
+      }
+      bufferRing = static_cast< io_uring_buf_ring* >( ringMemory );
+      buffers = static_cast< char* >( ringMemory ) + bufferRingSize;
+
+      io_uring_buf_reg registration;
+      memset( &registration, 0, sizeof( registration ) );
+      registration.ring_addr = reinterpret_cast< boost::uint64_t >( bufferRing );
+      registration.ring_entries = URING_BUFFER_COUNT;
+      registration.bgid = URING_BUFFER_GROUP;
+      if ( registerRing( ringDescriptor, IORING_REGISTER_PBUF_RING, &registration, 1 ) < 0 )
+      {
+         return std::string( "registration of the buffers: " ) + strerror( errno );
+      }
+      for ( unsigned i = 0;
+            i < URING_BUFFER_COUNT;
+            ++i )
+      {
+         giveBuffer( i,
+                     i );
+      }
+      __atomic_store_n( &bufferRing->tail, static_cast< __u16 >( URING_BUFFER_COUNT ), __ATOMIC_RELEASE );
+
+      // the completions ring the eventfd
+      int event = ::eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+      if ( event < 0 )
+      {
+         return std::string( "eventfd: " ) + strerror( errno );
+      }
+      completionEvent.assign( event );
+      if ( registerRing( ringDescriptor, IORING_REGISTER_EVENTFD, &event, 1 ) < 0 )
+      {
+         return std::string( "registration of the eventfd: " ) + strerror( errno );
+      }
+      return std::string();
+   }
+
+   // destroy the pending reads and give back the ring
+   void tearDown()
+   {
+      boost::system::error_code ignored;
+      completionEvent.close( ignored );
+      while ( pending != NULL )
+      {
+         UringReadOperation* operation = pending;
+         unlink( operation );
+         operation->destroy();
+      }
+      if ( bufferRing != NULL )
+      {
+         ::munmap( bufferRing, bufferRingSize + URING_BUFFER_COUNT * URING_BUFFER_SIZE );
+         bufferRing = NULL;
+      }
+      if ( entries != NULL )
+      {
+         ::munmap( entries, entriesSize );
+         entries = NULL;
+      }
+      if ( completionMemory != MAP_FAILED )
+      {
+         ::munmap( completionMemory, completionSize );
+         completionMemory = MAP_FAILED;
+      }
+      if ( submissionMemory != MAP_FAILED )
+      {
+         ::munmap( submissionMemory, submissionSize );
+         submissionMemory = MAP_FAILED;
+      }
+      if ( ringDescriptor >= 0 )
+      {
+         ::close( ringDescriptor );
+         ringDescriptor = -1;
+      }
+   }
+
+   // the pending reads are destroyed with the io_service, before the service itself
+   void shutdown_service()
+   {
+      boost::system::error_code ignored;
+      completionEvent.close( ignored );
+      submitMutex.lock();
+      /*|*/ while ( pending != NULL )
+      /*|*/ {
+      /*|*/    UringReadOperation* operation = pending;
+      /*|*/    unlink( operation );
+      /*|*/    operation->destroy();
+      /*|*/ }
+      submitMutex.unlock();
+   }
+
+   // add the read to the pending ones
+   // should be call inside the submit mutex
+   void link( UringReadOperation* operation )
+   {
+      operation->previous = NULL;
+      operation->next = pending;
+      if ( pending != NULL )
+      {
+         pending->previous = operation;
+      }
+      pending = operation;
+   }
+
+   // remove the read from the pending ones
+   // should be call inside the submit mutex
+   void unlink( UringReadOperation* operation )
+   {
+      if ( operation->previous != NULL )
+      {
+         operation->previous->next = operation->next;
+      }
+      else
+      {
+         pending = operation->next;
+      }
+      if ( operation->next != NULL )
+      {
+         operation->next->previous = operation->previous;
+      }
+   }
+
+   // get the next free submission entry, cleared, the queued ones are submitted first if the ring is full
+   // should be call inside the submit mutex
+   io_uring_sqe* nextEntry()
+   {
+      unsigned tail = *submissionTail;
+      while ( tail - __atomic_load_n( submissionHead, __ATOMIC_ACQUIRE ) >= submissionEntries )
+      {
+         submit();
+      }
+      io_uring_sqe* entry = &entries[ tail & submissionMask ];
+      memset( entry, 0, sizeof( io_uring_sqe ) );
+      return entry;
+   }
+
+   // make the entry given by nextEntry visible to the kernel
+   // should be call inside the submit mutex
+   void pushEntry()
+   {
+      __atomic_store_n( submissionTail, *submissionTail + 1, __ATOMIC_RELEASE );
+   }
+
+   // queue the receive of the read in a buffer picked by the kernel, at most the size the caller can take
+   // should be call inside the submit mutex
+   void queueRead( UringReadOperation* operation )
+   {
+      io_uring_sqe* entry = nextEntry();
+      entry->opcode = IORING_OP_RECV;
+      entry->fd = operation->descriptor;
+      entry->len = static_cast< __u32 >( std::min( operation->capacity(), static_cast< size_t >( URING_BUFFER_SIZE ) ) );
+      entry->flags = IOSQE_BUFFER_SELECT;
+      entry->buf_group = URING_BUFFER_GROUP;
+      entry->user_data = reinterpret_cast< boost::uint64_t >( operation );
+      pushEntry();
+   }
+
+   // submit the queued entries to the kernel
+   // should be call inside the submit mutex
+   void submit()
+   {
+      unsigned toSubmit = *submissionTail - __atomic_load_n( submissionHead, __ATOMIC_ACQUIRE );
+      if ( toSubmit > 0 )
+      {
+         enterRing( ringDescriptor,
+                    toSubmit,
+                    0,
+                    0 );
+      }
+   }
+
+   // submit the reads queued since the submission was posted, a single system call for all of them
+   void submitQueued()
+   {
+      submitMutex.lock();
+      /*|*/ submissionPosted = false;
+      /*|*/ submit();
+      submitMutex.unlock();
+   }
+
+   // give the registered buffer back to the kernel at the position after the tail of the buffer ring
+   void giveBuffer( unsigned bufferId,
+                    unsigned offset )
+   {
+      // the entries are taken from the start of the ring, its tail overlapping the first one: in c++ the flexible
+      // array of linux/io_uring.h is placed after an empty struct, so bufferRing->bufs is 8 bytes too far
+      unsigned short tail = __atomic_load_n( &bufferRing->tail, __ATOMIC_RELAXED );
+      io_uring_buf& buffer = reinterpret_cast< io_uring_buf* >( bufferRing )[ ( tail + offset ) & ( URING_BUFFER_COUNT - 1 ) ];
+      buffer.addr = reinterpret_cast< boost::uint64_t >( buffers + bufferId * URING_BUFFER_SIZE );
+      buffer.len = URING_BUFFER_SIZE;
+      buffer.bid = static_cast< __u16 >( bufferId );
+   }
+
+   // sleep until the eventfd tells completions arrived
+   void waitForCompletions()
+   {
+      completionEvent.async_read_some( boost::asio::buffer( &completionCount, sizeof( completionCount ) ),
+                                       makeMemoryHandler( waitMemory,
+                                                          boost::bind( &UringReadService::handleCompletions,
+                                                                       this,
+                                                                       boost::asio::placeholders::error ) ) );
+   }
+
+   // reap all the completions and call the handlers of the reads, then wait again
+   // a single wait is pending, so the completion ring is only read here
+   void handleCompletions( const boost::system::error_code& error )
+   {
+      if ( error == boost::asio::error::operation_aborted )
+      {
+         return;
+      }
+
+      unsigned head = *completionHead;
+      unsigned tail = __atomic_load_n( completionTail, __ATOMIC_ACQUIRE );
+      while ( head != tail )
+      {
+         for ( ;
+               head != tail;
+               ++head )
+         {
+            const io_uring_cqe& completion = completions[ head & completionMask ];
+            UringReadOperation* operation = reinterpret_cast< UringReadOperation* >( completion.user_data );
+            if ( operation != NULL )
+            {
+               complete( operation,
+                         completion.res,
+                         completion.flags );
+            }
+         }
+         __atomic_store_n( completionHead, head, __ATOMIC_RELEASE );
+         tail = __atomic_load_n( completionTail, __ATOMIC_ACQUIRE );
+      }
+
+      waitForCompletions();
+   }
+
+   // copy the received bytes to the caller and give the buffer back, then call the handler of the read
+   // a read without free buffer is queued again (the buffers are given back as the completions are reaped)
+   void complete( UringReadOperation* operation,
+                  int result,
+                  unsigned flags )
+   {
+      if ( result == -ENOBUFS )
+      {
+         submitMutex.lock();
+         /*|*/ queueRead( operation );
+         /*|*/ if ( submissionPosted == false )
+         /*|*/ {
+         /*|*/    submissionPosted = true;
+         /*|*/    boostReactor.post( makeMemoryHandler( submitMemory,
+         /*|*/                                              boost::bind( &UringReadService::submitQueued,
+         /*|*/                                                           this ) ) );
+         /*|*/ }
+         submitMutex.unlock();
+         return;
+      }
+
+      boost::system::error_code error;
+      size_t numberOfBytes = 0;
+      if ( result > 0 )
+      {
+         unsigned bufferId = flags >> IORING_CQE_BUFFER_SHIFT;
+         numberOfBytes = operation->copy( buffers + bufferId * URING_BUFFER_SIZE,
+                                          static_cast< size_t >( result ) );
+         giveBuffer( bufferId,
+                     0 );
+         __atomic_store_n( &bufferRing->tail, static_cast< __u16 >( bufferRing->tail + 1 ), __ATOMIC_RELEASE );
+      }
+      else if ( result == 0 )
+      {
+         error = boost::asio::error::eof;
+      }
+      else if ( result == -ECANCELED )
+      {
+         error = boost::asio::error::operation_aborted;
+      }
+      else
+      {
+         error = boost::system::error_code( -result,
+                                            boost::system::system_category() );
+      }
+
+      submitMutex.lock();
+      /*|*/ unlink( operation );
+      submitMutex.unlock();
+      operation->complete( error,
+                           numberOfBytes );
+   }
+};
+
+#endif
@@ -4,18 +4,49 @@
 #include <boost/bind.hpp>
 #include <boost/thread.hpp>
 #include "network/NetworkMessage.hpp"
+#include "network/FrameCompressor.hpp"
 #include "network/client/NetworkClient.hpp"
 #include "string/StringUtils.hpp"
 #include "logger/asyncLogger.hpp"
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+#include <unistd.h>
+#endif
 
 ConnectionToServer::ConnectionToServer( const std::string& name,
-                                        connection_ptr connection )
+                                        connection_ptr connection,
+                                        Executor& executor,
+                                        bool binaryRequested,
+                                        bool compressionRequested )
 :
    name( name ),
    connection( connection ),
-   message(),
+   mailbox( SerialMailbox::create( executor ) ),
+   messages(),
    client( NULL ),
-   status( INIT )
+   status( INIT ),
+   binaryRequested( binaryRequested ),
+   binaryProtocol( false ),
+   compressionRequested( compressionRequested ),
+   compression( false ),
+   socketProfile( SocketTuning::getConsumerProfile() ),
+   framingMode( connection->getFramingMode() ),
+   transport( connection->getTransport() ),
+   serverEndpoint(),
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+   localServerEndpoint(),
+#endif
+   resumable( false ),
+   sessionToken(),
+   resuming( false ),
+   closing( false ),
+   reconnectTimer( connection->getReactor() ),
+   holding( false ),
+   heldMessages(),
+   heldBytes( 0 ),
+   droppedHeldMessages( 0 ),
+   pendingRequests(),
+   lastRequestId( NO_REQUEST_ID ),
+   gameIds()
 {
 	AsyncLogger::getInstance()->log( "ConnectionToServer> New client conncection created> " + name );
 }
@@ -31,6 +62,18 @@ void ConnectionToServer::setNetworkClient( NetworkClient* client )
    this->client = client;
 }
 
+// set the socket options applied once connected over tcp
+void ConnectionToServer::setSocketProfile( const SocketProfile& profile )
+{
+   socketProfile = profile;
+}
+
+// open a session once logged so a lost link is resumed on a new connection, keeping the games
+void ConnectionToServer::setResumable( bool resumable )
+{
+   this->resumable = resumable;
+}
+
 const std::string& ConnectionToServer::getName() const
 {
    return name;
@@ -38,11 +81,32 @@ const std::string& ConnectionToServer::getName() const
 
 void ConnectionToServer::close()
 {
-   connection->close();
+   closing.store( true );
+   reconnectTimer.cancel();
+   getConnection()->close();
+}
+
+// get the current connection, replaced on reconnection
+connection_ptr ConnectionToServer::getConnection() const
+{
+   boost::mutex::scoped_lock lock( connectionMutex );
+   return connection;
 }
 
 void ConnectionToServer::connect( boost::asio::ip::tcp::endpoint& endpoint )
 {
+      serverEndpoint = endpoint;
+      connection_ptr connection = getConnection();
+
+      // the buffers are set before the SYN so the window announced matches them
+      boost::system::error_code error;
+      if ( connection->getSocket().is_open() == false )
+      {
+         connection->getSocket().open( endpoint.protocol(),
+                                       error );
+      }
+      SocketTuning::applyBuffers( connection->getSocket(),
+                                  socketProfile );
 		connection->getSocket().async_connect( endpoint,
 			                                    boost::bind( &ConnectionToServer::handleConnect, 
                                                           this,
@@ -50,34 +114,170 @@ void ConnectionToServer::connect( boost::asio::ip::tcp::endpoint& endpoint )
                                                           boost::asio::placeholders::error ) );
 }
 
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+void ConnectionToServer::connect( boost::asio::local::stream_protocol::endpoint& endpoint )
+{
+      localServerEndpoint = endpoint;
+      connection_ptr connection = getConnection();
+		connection->getLocalSocket().async_connect( endpoint,
+			                                         boost::bind( &ConnectionToServer::handleConnect, 
+                                                               this,
+                                                               connection,
+                                                               boost::asio::placeholders::error ) );
+}
+#endif
+
 void ConnectionToServer::waitForData()
 {
 	// Call the async listen using the connection
-	connection->asyncRead( message, 
-		                    boost::bind( &ConnectionToServer::handleRead, 
+	getConnection()->asyncRead( messages, 
+		                         boost::bind( &ConnectionToServer::handleRead, 
                                        shared_from_this(),
 		                                 boost::asio::placeholders::error ) );
 }
 
 void ConnectionToServer::sendMessage(const std::string& message)
 {
+   sendMessage( message,
+                true );
+}
+
+// encode and write the message in the negotiated protocol
+void ConnectionToServer::sendMessage( const std::string& message,
+                                      bool holdable )
+{
+#ifdef __DEBUG__
    AsyncLogger::getInstance()->log( "WRITING ON ConnectionToServer (" + name + ") : " + message );
+#endif
+
+   // binary protocol, encode the message (the handshake of a new connection is in text)
+   if (  (  ( holdable == true )
+          &&( isBinaryProtocol() == true )  )
+       ||(  ( binaryProtocol == true )
+          &&( status == CONNECTED )  )  )
+   {
+      SharedBuffer frame = BufferPool::getInstance().acquire( message.size() );
+      BinaryTranscoder::encode( message,
+                                *frame );
+      write( SharedMessage( frame ),
+             holdable );
+      return;
+   }
 
    // send the message on the network
-   connection->asyncWrite( message + '\0',
+   write( message,
+          holdable );
+}
+
+// send a control message in a request, the handler is called with its reply
+RequestId ConnectionToServer::sendRequest( const std::string& message,
+                                           const ReplyHandler& handler )
+{
+   // the handler is known before the reply may come
+   requestMutex.lock();
+   /*|*/ RequestId requestId = ++lastRequestId;
+   /*|*/ pendingRequests.insert( std::make_pair( requestId,
+   /*|*/                                         handler ) );
+   requestMutex.unlock();
+
+   std::stringstream stream;
+   stream << SYSTEM_REQUEST << " " << requestId << " " << message;
+   sendMessage( stream.str() );
+   return requestId;
+}
+
+// send a frame already in the binary form (only when isBinaryProtocol is true)
+void ConnectionToServer::sendBinaryMessage( SharedMessage frame )
+{
+   if ( compression == true )
+   {
+      frame = FrameCompressor::getInstance().compress( frame );
+   }
+
+   write( frame,
+          true );
+}
+
+// write the message, held while the link is lost if holdable (the messages of the handshake are not)
+void ConnectionToServer::write( const std::string& message,
+                                bool holdable )
+{
+   boost::mutex::scoped_lock lock( connectionMutex );
+
+   if (  ( holdable == true )
+       &&( holdIfLinkLost( BufferPool::getInstance().copy( message ) ) == true )  )
+   {
+      return;
+   }
+
+   connection->asyncWrite( message,
 		                     boost::bind( &ConnectionToServer::handleWrite, 
                                         shared_from_this(),
 		                                  boost::asio::placeholders::error ) );
 }
 
+// write the shared message, held while the link is lost if holdable
+void ConnectionToServer::write( SharedMessage message,
+                                bool holdable )
+{
+   boost::mutex::scoped_lock lock( connectionMutex );
+
+   if (  ( holdable == true )
+       &&( holdIfLinkLost( message ) == true )  )
+   {
+      return;
+   }
+
+   connection->asyncWrite( message,
+		                     boost::bind( &ConnectionToServer::handleWrite, 
+                                        shared_from_this(),
+		                                  boost::asio::placeholders::error ) );
+}
+
+// hold the message if the link is lost, return false if it can be written
+// the held messages are bounded, the newest ones are dropped beyond MAX_HELD_BYTES
+// should be call inside the connection mutex
+bool ConnectionToServer::holdIfLinkLost( SharedMessage message )
+{
+   if ( holding.load() == false )
+   {
+      return false;
+   }
+
+   if ( heldBytes + message->size() > MAX_HELD_BYTES )
+   {
+      droppedHeldMessages++;
+   }
+   else
+   {
+      heldMessages.push_back( message );
+      heldBytes += message->size();
+   }
+   return true;
+}
+
+// return true if the messages are exchanged in the binary form
+// the messages held while the link is lost are in the form of the session
+bool ConnectionToServer::isBinaryProtocol() const
+{
+   return (  ( binaryProtocol == true )
+           &&(  ( status == CONNECTED )
+              ||( holding.load() == true )  )  );
+}
+
 void ConnectionToServer::handleRead( const boost::system::error_code& error )
 {
 	if ( error == 0)
 	{
-      // invoke a thread to handle the message
-      boost::thread worker( &ConnectionToServer::handleMessageInThread,
-                            this,
-                            message );
+      // queue each message of the read in the mailbox to keep them in order
+      for ( std::vector< SharedMessage >::const_iterator it = messages.begin();
+            it != messages.end();
+            it++ )
+      {
+         mailbox->post( boost::bind( &ConnectionToServer::handleMessageInThread,
+                                     shared_from_this(),
+                                     *it ) );
+      }
 
 		// and back to listen
 		waitForData();
@@ -87,22 +287,93 @@ void ConnectionToServer::handleRead( const boost::system::error_code& error )
       std::stringstream stream;
       stream << "ConnectionToServer (" << name << ") > handleRead call with error code: " << error.value() << " --> " << error.message();
       AsyncLogger::getInstance()->log( stream.str() );
+
+      // resume the session on a new connection if any, after the messages already received
+      if ( closing.load() == false )
+      {
+         mailbox->post( boost::bind( &ConnectionToServer::handleLinkLost,
+                                     shared_from_this() ) );
+      }
    }
 }
 
-// thread used to decipher and manage the message
-void ConnectionToServer::handleMessageInThread( const std::string& messageToTreat )
+// the link is lost, keep the messages of the client and reconnect, run in the mailbox
+void ConnectionToServer::handleLinkLost()
 {
+   if ( sessionToken.empty() == true )
+   {
+      return;
+   }
+
+   AsyncLogger::getInstance()->log( "ConnectionToServer (" + name + ") > link lost, resuming the session" );
+   connectionMutex.lock();
+   /*|*/ holding = true;
+   connectionMutex.unlock();
+   status = INIT;
+   resuming = false;
+   waitForReconnection();
+}
+
+// wait before the next reconnection
+void ConnectionToServer::waitForReconnection()
+{
+   reconnectTimer.expires_from_now( boost::posix_time::seconds( 1 ) );
+   reconnectTimer.async_wait( boost::bind( &ConnectionToServer::handleReconnection,
+                                           shared_from_this(),
+                                           boost::asio::placeholders::error ) );
+}
+
+// open a new connection to the server to resume the session
+void ConnectionToServer::handleReconnection( const boost::system::error_code& error )
+{
+   if (  ( error == boost::asio::error::operation_aborted )
+       ||( closing.load() == true )  )
+   {
+      return;
+   }
+
+   // a new connection with the framing and the transport of the first one
+   connection_ptr newConnection( new SimpleTcpConnection( getConnection()->getReactor(),
+                                                          framingMode,
+                                                          transport ) );
+   connectionMutex.lock();
+   /*|*/ connection = newConnection;
+   connectionMutex.unlock();
+
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+   if ( transport != SimpleTcpConnection::TRANSPORT_TCP )
+   {
+      connect( localServerEndpoint );
+      return;
+   }
+#endif
+   connect( serverEndpoint );
+}
+
+// decipher and manage the message, run in the mailbox of the connection
+void ConnectionToServer::handleMessageInThread( SharedMessage message )
+{
+   const std::string& messageToTreat = *message;
+
+#ifdef __DEBUG__
    // log the message if needed
-   AsyncLogger::getInstance()->log( "RECEIVE FROM ConnectionToServer (" + name + ") : " + message );
+   AsyncLogger::getInstance()->log( "RECEIVE FROM ConnectionToServer (" + name + ") : " + messageToTreat );
+#endif
 
    // check if its the init process
    if (  ( status == INIT )
-       &&( messageToTreat == MESSAGE_LOGIN_ASKED )  )
+       &&(  ( messageToTreat == MESSAGE_LOGIN_ASKED )
+          ||( messageToTreat == MESSAGE_LOGIN_ASKED + " " + BINARY_PROTOCOL )
+          ||( messageToTreat == MESSAGE_LOGIN_ASKED + " " + BINARY_PROTOCOL + " " + COMPRESSION )  )  )
    {
+      // the server tells if it accepts the binary protocol and the compression
+      binaryProtocol = ( messageToTreat != MESSAGE_LOGIN_ASKED );
+      compression = ( messageToTreat == MESSAGE_LOGIN_ASKED + " " + BINARY_PROTOCOL + " " + COMPRESSION );
+
       // manage the login message
       status = LOGIN;
-      sendMessage( client->getLogin() + ":" + client->getPassword() );
+      sendMessage( client->getLogin() + ":" + client->getPassword(),
+                   false );
    }
    // waiting for the login response
    else if ( status == LOGIN )
@@ -110,8 +381,25 @@ void ConnectionToServer::handleMessageInThread( const std::string& messageToTrea
       // check the status
       if ( messageToTreat == MESSAGE_LOGIN_ACCEPTED )
       {
-         // forward the success to the client
          status = CONNECTED;
+
+         // a new connection of a session, resume it
+         if ( sessionToken.empty() == false )
+         {
+            resuming = true;
+            sendMessage( SYSTEM_RESUME_SESSION + " " + sessionToken,
+                         false );
+            return;
+         }
+
+         // ask for a session
+         if ( resumable == true )
+         {
+            sendMessage( SYSTEM_OPEN_SESSION,
+                         false );
+         }
+
+         // forward the success to the client
          client->onLoginSucced();
       }
       else if ( messageToTreat == MESSAGE_LOGIN_REFUSED )
@@ -121,54 +409,295 @@ void ConnectionToServer::handleMessageInThread( const std::string& messageToTrea
       }
    }
    // forward the day to day message
+   else if (  ( status == CONNECTED )
+            &&( binaryProtocol == true )  )
+   {
+      handleBinaryMessage( message );
+   }
    else if ( status == CONNECTED )
    {
-      // explode the message to get the < kind, [ action | gameId ], remaining message >
-      std::vector< std::string > messagePart;
-      StringUtils::explode( messageToTreat,
-                            ' ',
-                            messagePart,
-                            3 );
-      // check for game message
-      if ( messagePart[ 0 ] == GAME_MESSAGE )
-      {
-         // game creation
-         if ( messagePart[ 1 ] == GAME_CREATED )
-         {
-            // retrieve the message informatio
-            std::vector< std::string > messageInformation;
-            StringUtils::explode( messagePart[ 2 ],
-                                  ' ',
-                                  messageInformation,
-                                  2 );
-
-            client->onNewGameCreation( messageInformation[ 0 ],
-                                       messageInformation[ 1 ] );
-         }
-         // game destruction
-         else if ( messagePart[ 1 ] == CLOSE_MESSAGE )
-         {
-            // retrieve the message informatio
-            std::vector< std::string > messageInformation;
-            StringUtils::explode( messagePart[ 2 ],
-                                  ' ',
-                                  messageInformation,
-                                  2 );
-
-            // and close the game
-            client->onGameClose( messageInformation[ 0 ],
-                                 messageInformation[ 1 ] );
-         }
-         // forward the message to the client
-         else 
+      handleTextMessage( messageToTreat );
+   }
+}
+
+// manage a text message once connected
+void ConnectionToServer::handleTextMessage( const std::string& messageToTreat )
+{
+   // the server checks the connection is alive
+   if ( messageToTreat == MESSAGE_PING )
+   {
+      sendMessage( MESSAGE_PONG,
+                   false );
+      return;
+   }
+
+   // the reply of a request
+   if ( messageToTreat.compare( 0, SYSTEM_REPLY.size() + 1, SYSTEM_REPLY + " " ) == 0 )
+   {
+      handleReply( messageToTreat );
+      return;
+   }
+
+   // the session of the connection
+   if (  ( messageToTreat == SYSTEM_SESSION_EXPIRED )
+       ||( messageToTreat.compare( 0, SYSTEM_SESSION.size() + 1, SYSTEM_SESSION + " " ) == 0 )  )
+   {
+      handleSessionMessage( messageToTreat );
+      return;
+   }
+
+   // explode the message to get the < kind, [ action | gameId ], remaining message >
+   std::vector< std::string > messagePart;
+   StringUtils::explode( messageToTreat,
+                         ' ',
+                         messagePart,
+                         3 );
+   // check for game message
+   if ( messagePart[ 0 ] == GAME_MESSAGE )
+   {
+      // game creation
+      if ( messagePart[ 1 ] == GAME_CREATED )
+      {
+         // retrieve the message informatio
+         std::vector< std::string > messageInformation;
+         StringUtils::explode( messagePart[ 2 ],
+                               ' ',
+                               messageInformation,
+                               2 );
+
+         client->onNewGameCreation( messageInformation[ 0 ],
+                                    messageInformation[ 1 ] );
+      }
+      // game destruction
+      else if ( messagePart[ 1 ] == CLOSE_MESSAGE )
+      {
+         // retrieve the message informatio
+         std::vector< std::string > messageInformation;
+         StringUtils::explode( messagePart[ 2 ],
+                               ' ',
+                               messageInformation,
+                               2 );
+
+         // and close the game
+         client->onGameClose( messageInformation[ 0 ],
+                              messageInformation[ 1 ] );
+      }
+      // forward the message to the client
+      else 
+      {
+         client->onHandleMessage( messagePart[ 1 ], 
+                                  messagePart[ 2 ] );
+      }
+   }
+}
+
+// give the reply to the handler of its request, handle it as any message if the request is unknown
+//     'SYSTEM_REPLY id <reply>'
+void ConnectionToServer::handleReply( const std::string& messageToTreat )
+{
+   size_t idStart = SYSTEM_REPLY.size() + 1;
+   size_t idEnd = messageToTreat.find( ' ', idStart );
+   if ( idEnd == std::string::npos )
+   {
+      return;
+   }
+   RequestId requestId = BinaryProtocol::parseRequestId( messageToTreat.substr( idStart,
+                                                                                idEnd - idStart ) );
+   std::string reply = messageToTreat.substr( idEnd + 1 );
+
+   ReplyHandler handler;
+   requestMutex.lock();
+   /*|*/ std::map< RequestId, ReplyHandler >::iterator it = pendingRequests.find( requestId );
+   /*|*/ if ( it != pendingRequests.end() )
+   /*|*/ {
+   /*|*/    handler = it->second;
+   /*|*/    pendingRequests.erase( it );
+   /*|*/ }
+   requestMutex.unlock();
+
+   if ( handler.empty() == false )
+   {
+      handler( reply );
+   }
+   else
+   {
+      handleTextMessage( reply );
+   }
+}
+
+// handle a session message from the server
+//     'SYSTEM_SESSION token'
+//     'SYSTEM_SESSION_EXPIRED'
+void ConnectionToServer::handleSessionMessage( const std::string& messageToTreat )
+{
+   // a new session or the current one resumed
+   if ( messageToTreat != SYSTEM_SESSION_EXPIRED )
+   {
+      sessionToken = messageToTreat.substr( SYSTEM_SESSION.size() + 1 );
+      if ( resuming == false )
+      {
+         return;
+      }
+
+      // send the messages held during the gap before any new one
+      resuming = false;
+      std::stringstream stream;
+      connectionMutex.lock();
+      /*|*/ stream << "ConnectionToServer (" << name << ") > session resumed, " << heldMessages.size() << " held messages sent, " << droppedHeldMessages << " dropped";
+      /*|*/ holding = false;
+      /*|*/ for ( std::deque< SharedMessage >::const_iterator it = heldMessages.begin();
+      /*|*/       it != heldMessages.end();
+      /*|*/       it++ )
+      /*|*/ {
+      /*|*/    connection->asyncWrite( *it,
+      /*|*/                            boost::bind( &ConnectionToServer::handleWrite, 
+      /*|*/                                         shared_from_this(),
+      /*|*/                                         boost::asio::placeholders::error ) );
+      /*|*/ }
+      /*|*/ heldMessages.clear();
+      /*|*/ heldBytes = 0;
+      /*|*/ droppedHeldMessages = 0;
+      connectionMutex.unlock();
+      AsyncLogger::getInstance()->log( stream.str() );
+      return;
+   }
+
+   // the sessions are disabled by the server
+   if ( resuming == false )
+   {
+      AsyncLogger::getInstance()->log( "ConnectionToServer (" + name + ") > no session given by the server" );
+      return;
+   }
+
+   // the session expired, its games are closed: start again as a new client
+   AsyncLogger::getInstance()->log( "ConnectionToServer (" + name + ") > session expired, its games are lost" );
+   resuming = false;
+   sessionToken.clear();
+   gameIds.clear();
+   connectionMutex.lock();
+   /*|*/ holding = false;
+   /*|*/ heldMessages.clear();
+   /*|*/ heldBytes = 0;
+   /*|*/ droppedHeldMessages = 0;
+   connectionMutex.unlock();
+
+   // the requests sent before will never get their reply
+   std::map< RequestId, ReplyHandler > lostRequests;
+   requestMutex.lock();
+   /*|*/ lostRequests.swap( pendingRequests );
+   requestMutex.unlock();
+   for ( std::map< RequestId, ReplyHandler >::const_iterator it = lostRequests.begin();
+         it != lostRequests.end();
+         it++ )
+   {
+      it->second( SYSTEM_SESSION_EXPIRED );
+   }
+
+   client->onSessionLost();
+   sendMessage( SYSTEM_OPEN_SESSION,
+                false );
+   client->onLoginSucced();
+}
+
+// manage a binary frame once connected, the game messages are given as is to the client
+void ConnectionToServer::handleBinaryMessage( SharedMessage frame )
+{
+   BinaryReader reader( *frame );
+   BinaryProtocol::Opcode opcode = reader.readOpcode();
+   switch ( opcode )
+   {
+   case BinaryProtocol::OP_GAME_CREATED:
+   {
+      boost::uint64_t number = reader.readUInt();
+      std::string gameKind = reader.readString();
+      if ( reader.isValid() == true )
+      {
+         // remember the id of the game for its next messages
+         std::string& gameId = gameIds[ number ];
+         gameId = BinaryProtocol::makeGameId( gameKind,
+                                              number );
+         client->onNewGameCreation( gameId,
+                                    gameKind );
+      }
+      break;
+   }
+   case BinaryProtocol::OP_GAME_CLOSE:
+   {
+      std::string closedGameIds;
+      boost::uint64_t count = reader.readUInt();
+      for ( boost::uint64_t i = 0;
+            (  ( i < count )
+             &&( reader.isValid() == true )  );
+            ++i )
+      {
+         boost::uint64_t number = reader.readUInt();
+         if ( i > 0 )
          {
-            client->onHandleMessage( messagePart[ 1 ], 
-                                     messagePart[ 2 ] );
+            closedGameIds += "|";
          }
+         closedGameIds += resolveGameId( number );
+         gameIds.erase( number );
+      }
+      std::string reason = reader.readString();
+      if ( reader.isValid() == true )
+      {
+         client->onGameClose( closedGameIds,
+                              reason );
       }
+      break;
+   }
+   case BinaryProtocol::OP_GAME_MESSAGE:
+   {
+      std::string gameId = resolveGameId( reader.readUInt() );
+      if ( reader.isValid() == true )
+      {
+         client->onHandleBinaryMessage( gameId,
+                                        frame,
+                                        frame->size() - reader.remaining() );
+      }
+      break;
+   }
+   case BinaryProtocol::OP_COMPRESSED_GAME_MESSAGE:
+   {
+      // handled as the game frame it was before compression
+      SharedMessage inflated = FrameCompressor::getInstance().decompress( frame );
+      if ( inflated != NULL )
+      {
+         handleBinaryMessage( inflated );
+      }
+      else
+      {
+         AsyncLogger::getInstance()->log( "ConnectionToServer (" + name + ") > corrupted compressed frame" );
+      }
+      break;
+   }
+   default:
+   {
+      // the other messages are rare, handle their text form
+      std::string message;
+      if ( BinaryTranscoder::decode( *frame,
+                                     boost::bind( &ConnectionToServer::resolveGameId,
+                                                  this,
+                                                  _1 ),
+                                     message ) == true )
+      {
+#ifdef __DEBUG__
+         AsyncLogger::getInstance()->log( "RECEIVE FROM ConnectionToServer (" + name + ") : " + message );
+#endif
+         handleTextMessage( message );
+      }
+      break;
+   }
    }
 }
 
+// return the text id of a game given its number
+std::string ConnectionToServer::resolveGameId( boost::uint64_t number ) const
+{
+   std::map< boost::uint64_t, std::string >::const_iterator it = gameIds.find( number );
+   return ( it != gameIds.end() ) ? it->second : BinaryProtocol::makeGameId( "", number );
+}
+
 void ConnectionToServer::handleWrite( const boost::system::error_code& error )
 {
    // if an error occurs, close the connection
@@ -188,11 +717,32 @@ void ConnectionToServer::handleConnect( connection_ptr new_connection,
    // check the error status
 	if ( error == 0)
 	{
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+      // move the messages in shared memory, the socket only carries the doorbells
+      if ( new_connection->getTransport() == SimpleTcpConnection::TRANSPORT_SHARED_MEMORY )
+      {
+         new_connection->startSharedMemory();
+      }
+#endif
+
+      // tune the socket for the role of the client
+      new_connection->applySocketProfile( socketProfile );
+
       // alert the client
       client->onConnection();
 
-      // send the init message
-      sendMessage( MESSAGE_INIT );
+      // send the init message, asking for the binary protocol and the compression if needed
+      std::string init = MESSAGE_INIT;
+      if ( binaryRequested == true )
+      {
+         init += " " + BINARY_PROTOCOL;
+         if ( compressionRequested == true )
+         {
+            init += " " + COMPRESSION;
+         }
+      }
+      sendMessage( init,
+                   false );
 
       // call the async reading
 		waitForData();
@@ -202,13 +752,33 @@ void ConnectionToServer::handleConnect( connection_ptr new_connection,
       std::stringstream stream;
       stream << "ConnectionToServer (" << name << ") > handleConnect call with error code: " << error.value() << " --> " << error.message();
       AsyncLogger::getInstance()->log( stream.str() );
+
+      // the server is not back yet, try again while the session is alive
+      if (  ( holding.load() == true )
+          &&( closing.load() == false )  )
+      {
+         waitForReconnection();
+      }
    }
 }
 
 // return the localendpoint as string host:port
+// a unix domain socket has no local name, the process id is used instead
 std::string ConnectionToServer::getLocalEndPointAsString() const
 {
    char result[ 1024 ];
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+   connection_ptr connection = getConnection();
+   if ( connection->getTransport() != SimpleTcpConnection::TRANSPORT_TCP )
+   {
+      sprintf_s( result,
+                 1024,
+                 "local@%d",
+                 static_cast< int >( ::getpid() ) );
+
+      return std::string( result );
+   }
+#endif
    sprintf_s( result,
               1024,
               "%s@%d",
@@ -218,3 +788,14 @@ std::string ConnectionToServer::getLocalEndPointAsString() const
    return std::string( result );
 }
 
+// get the number of messages waiting to be sent
+size_t ConnectionToServer::getOutboundQueueDepth() const
+{
+   return getConnection()->getQueueDepth();
+}
+
+// get the number of bytes waiting to be sent
+size_t ConnectionToServer::getOutboundBytesPending() const
+{
+   return getConnection()->getBytesPending();
+}
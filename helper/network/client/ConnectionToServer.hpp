@@ -2,7 +2,14 @@
 
 #include <boost/asio/ip/tcp.hpp>
 #include <boost/enable_shared_from_this.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/atomic.hpp>
+#include <boost/function.hpp>
+#include <map>
+#include <deque>
 #include "network/SimpleTcpConnection.hpp"
+#include "network/BinaryProtocol.hpp"
+#include "thread/SerialMailbox.hpp"
 
 class NetworkClient;
 
@@ -20,19 +27,96 @@ private:
    };
    int status;
 
-   // the buffer used to receive message
-   std::string message;
+   // the buffer used to receive the messages of a read
+   std::vector< SharedMessage > messages;
 
    // the connection use to read / write on the network
 	connection_ptr connection;
 
+   // the mailbox running the received messages in order on the executor
+   // so the client callbacks never run concurrently for this connection
+   SerialMailboxPtr mailbox;
+
    // the name of the connection (internal id)
    std::string name;
 
    // the client using the connection
    NetworkClient* client;
 
+   // true if the binary protocol is asked in the init message
+   bool binaryRequested;
+
+   // true if the server accepted the binary protocol (the messages are binary once connected)
+   bool binaryProtocol;
+
+   // true if the compression of the big game frames is asked with the binary protocol
+   bool compressionRequested;
+
+   // true if the server accepted the compression
+   bool compression;
+
+   // the socket options applied once connected (consumer profile by default)
+   SocketProfile socketProfile;
+
+   // the framing and the transport of the connection, used again to reconnect
+   SimpleTcpConnection::FramingMode framingMode;
+   SimpleTcpConnection::Transport transport;
+
+   // the endpoint of the server, kept to reconnect
+   boost::asio::ip::tcp::endpoint serverEndpoint;
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+   boost::asio::local::stream_protocol::endpoint localServerEndpoint;
+#endif
+
+   // true if a session is opened once logged so a lost link is resumed on a new connection
+   bool resumable;
+
+   // the token of the session given by the server (empty if none), only used in the mailbox
+   std::string sessionToken;
+
+   // true while the session is being resumed on a new connection, only used in the mailbox
+   bool resuming;
+
+   // true once the connection is closed by its client, the lost link is not resumed
+   boost::atomic< bool > closing;
+
+   // the timer of the next reconnection
+   boost::asio::deadline_timer reconnectTimer;
+
+   // true while the link is lost, the messages of the client are held until the session is resumed
+   boost::atomic< bool > holding;
+
+   // the maximum size of the held messages
+   static const size_t MAX_HELD_BYTES = 4 * 1024 * 1024;
+
+   // the messages held while the link is lost and their size
+   std::deque< SharedMessage > heldMessages;
+   size_t heldBytes;
+
+   // the number of messages dropped as too many were held
+   size_t droppedHeldMessages;
+
+   // the mutex of the connection, replaced on reconnection, and of the held messages
+   mutable boost::mutex connectionMutex;
+
+   // the callbacks of the requests waiting for their reply indexed by their id
+   std::map< RequestId, boost::function< void ( const std::string& ) > > pendingRequests;
+
+   // the id of the last request sent
+   RequestId lastRequestId;
+
+   // the mutex of the requests, sent by any thread
+   boost::mutex requestMutex;
+
+   // the text ids of the games known by the connection indexed by their number
+   // filled by the binary game creation messages, only used in the mailbox
+   std::map< boost::uint64_t, std::string > gameIds;
+
 public:
+   // the callback of a request, given the text form of its reply in the mailbox of the connection
+   // ('SYSTEM_REQUEST_DONE' for a request without answer, 'SYSTEM_SESSION_EXPIRED' if the session was lost before the reply)
+   typedef boost::function< void ( const std::string& reply ) > ReplyHandler;
+
    // auto reference fir enable shared
    typedef boost::shared_ptr< ConnectionToServer > InternalConnectionToServerPtr;
 
@@ -40,17 +124,39 @@ public:
 	~ConnectionToServer();
 
    // creator for the shared ptr mechanism
+   // the received messages are handled on the executor, by default inline in the reactor thread
+   // the binary protocol is asked to the server if binaryRequested is true, with the compression if compressionRequested is true
 	static InternalConnectionToServerPtr create( const std::string& name,
-                                                connection_ptr tcp_connection)
+                                                connection_ptr tcp_connection,
+                                                Executor& executor = InlineExecutor::getInstance(),
+                                                bool binaryRequested = false,
+                                                bool compressionRequested = false )
 	{
 		InternalConnectionToServerPtr session( new ConnectionToServer( name,
-                                                                     tcp_connection ) );
+                                                                     tcp_connection,
+                                                                     executor,
+                                                                     binaryRequested,
+                                                                     compressionRequested ) );
 		return session;
 	}
 
    // send a message on the network
 	void sendMessage(const std::string& message);
 
+   // send a control message in a request, the handler is called with its reply
+   // many requests may be sent without waiting for the previous replies
+   //     'SYSTEM_REQUEST id <message>'
+   //             'SYSTEM_REPLY id <reply>'
+   RequestId sendRequest( const std::string& message,
+                          const ReplyHandler& handler );
+
+   // send a frame already in the binary form (only when isBinaryProtocol is true)
+   // the big game frames are compressed if the compression was accepted
+	void sendBinaryMessage( SharedMessage frame );
+
+   // return true if the messages are exchanged in the binary form
+   bool isBinaryProtocol() const;
+
    // return the client name
    const std::string& getName() const;
 
@@ -60,28 +166,95 @@ public:
    // connect to the server known by its endpoint
    void connect( boost::asio::ip::tcp::endpoint& endpoint );
 
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+   // connect to the server on the same host known by its unix domain socket
+   // the connection must have been created with the local or the shared memory transport
+   void connect( boost::asio::local::stream_protocol::endpoint& endpoint );
+#endif
+
    // set the client user of this connection
    void setNetworkClient( NetworkClient* client );
 
+   // open a session once logged so a lost link is resumed on a new connection, keeping the games
+   void setResumable( bool resumable );
+
+   // set the socket options applied once connected over tcp
+   void setSocketProfile( const SocketProfile& profile );
+
    // return the localendpoint as string host:port
    std::string getLocalEndPointAsString() const;
 
+   // get the number of messages waiting to be sent
+   size_t getOutboundQueueDepth() const;
+
+   // get the number of bytes waiting to be sent
+   size_t getOutboundBytesPending() const;
+
 private:
    // the real ctor in the private zone as we use the shared ptr mechanism
 	ConnectionToServer( const std::string& name,
-                       connection_ptr connection );
+                       connection_ptr connection,
+                       Executor& executor,
+                       bool binaryRequested,
+                       bool compressionRequested );
 
    // listen on the socket using the tcp connection
 	void	waitForData	(); 
 
+   // get the current connection, replaced on reconnection
+   connection_ptr getConnection() const;
+
+   // write the message, held while the link is lost if holdable (the messages of the handshake are not)
+   void write( const std::string& message,
+               bool holdable );
+
+   // write the shared message, held while the link is lost if holdable
+   void write( SharedMessage message,
+               bool holdable );
+
+   // hold the message if the link is lost, return false if it can be written
+   // should be call inside the connection mutex
+   bool holdIfLinkLost( SharedMessage message );
+
+   // encode and write the message in the negotiated protocol
+   void sendMessage( const std::string& message,
+                     bool holdable );
+
+   // give the reply to the handler of its request, handle it as any message if the request is unknown
+   //     'SYSTEM_REPLY id <reply>'
+   void handleReply( const std::string& messageToTreat );
+
+   // handle a session message from the server
+   //     'SYSTEM_SESSION token'
+   //     'SYSTEM_SESSION_EXPIRED'
+   void handleSessionMessage( const std::string& messageToTreat );
+
+   // the link is lost, keep the messages of the client and reconnect, run in the mailbox
+   void handleLinkLost();
+
+   // wait before the next reconnection
+   void waitForReconnection();
+
+   // open a new connection to the server to resume the session
+   void handleReconnection( const boost::system::error_code& error );
+
    // callback of write result
 	void handleWrite( const boost::system::error_code& error );
 
    // callback of read result
 	void handleRead( const boost::system::error_code& error );
 
-   // thread used to decipher and manage the message
-   void handleMessageInThread( const std::string& messageToTreat );
+   // decipher and manage the message, run in the mailbox of the connection
+   void handleMessageInThread( SharedMessage message );
+
+   // manage a text message once connected
+   void handleTextMessage( const std::string& messageToTreat );
+
+   // manage a binary frame once connected, the game messages are given as is to the client
+   void handleBinaryMessage( SharedMessage frame );
+
+   // return the text id of a game given its number
+   std::string resolveGameId( boost::uint64_t number ) const;
 
    // callback of connect result
 	void handleConnect( connection_ptr new_connection, 
@@ -1,6 +1,8 @@
 #pragma once
 
 #include <string>
+#include "network/BinaryProtocol.hpp"
+#include "network/BufferPool.hpp"
 
 // this class is the abstraction of a client on the network
 class NetworkClient
@@ -27,7 +29,27 @@ public:
    virtual void onGameClose( const std::string& gameId,
                              const std::string& reason ) = 0;
 
+   // callback when the session of the connection expired before its link was back
+   // the games of the client are closed by the server, the login sequence goes on as for a new client
+   virtual void onSessionLost()
+   {
+   }
+
    // callback used to handle the message when logon
    virtual void onHandleMessage( const std::string& gameId,
                                  const std::string& message ) = 0;
+
+   // callback used to handle a game message received in the binary form
+   // the payload of the frame starts at payloadOffset, by default its text form is given to onHandleMessage
+   virtual void onHandleBinaryMessage( const std::string& gameId,
+                                       SharedMessage frame,
+                                       size_t payloadOffset )
+   {
+      std::string message;
+      BinaryReader reader( *frame,
+                           payloadOffset );
+      reader.readTokens( message );
+      onHandleMessage( gameId,
+                       message );
+   }
 };
\ No newline at end of file
@@ -2,12 +2,14 @@
 
 #include "AbstractProviderManager.hpp"
 #include "AbstractGameProvider.hpp"
+#include "network/BinaryProtocol.hpp"
 #include "logger/asyncLogger.hpp"
 
 // default ctor
 AbstractGameProvider::AbstractGameProvider()
 :
-   manager( NULL )
+   manager( NULL ),
+   gameNumber( 0 )
 {
 }
 
@@ -25,6 +27,23 @@ void AbstractGameProvider::setNetworkInformation( AbstractProviderManager* manag
 {
    this->manager = manager;
    this->gameId = gameId;
+   // the ids given by the server always end with the number of the game
+   boost::uint64_t number = 0;
+   BinaryProtocol::parseGameNumber( gameId,
+                                    number );
+   this->gameNumber = static_cast< size_t >( number );
+}
+
+// call back for message management in the binary form, the payload starts at payloadOffset
+// by default the payload is given as text to handleGameMessage
+void AbstractGameProvider::handleBinaryGameMessage( SharedMessage frame,
+                                                    size_t payloadOffset )
+{
+   std::string message;
+   BinaryReader reader( *frame,
+                        payloadOffset );
+   reader.readTokens( message );
+   handleGameMessage( message );
 }
 
 // callback used to handle the message of game closure
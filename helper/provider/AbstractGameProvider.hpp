@@ -1,6 +1,7 @@
 #pragma once
 
 #include <string>
+#include "network/BufferPool.hpp"
 
 class AbstractProviderManager;
 
@@ -14,6 +15,9 @@ protected:
    // the id used to identify the instance of the game on the network
    std::string gameId;
 
+   // the number of the game, its id in the binary protocol
+   size_t gameNumber;
+
 public:
    // default ctor
    AbstractGameProvider();
@@ -34,6 +38,11 @@ public:
    // call back for message managmeent
    virtual void handleGameMessage( const std::string& message ) = 0;
 
+   // call back for message management in the binary form, the payload starts at payloadOffset
+   // by default the payload is given as text to handleGameMessage
+   virtual void handleBinaryGameMessage( SharedMessage frame,
+                                         size_t payloadOffset );
+
    // get the name of the provider
    virtual const std::string& getName() = 0;
 };
\ No newline at end of file
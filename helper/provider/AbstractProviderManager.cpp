@@ -2,26 +2,47 @@
 
 #include <boost/asio.hpp>
 #include <boost/thread.hpp>
+#include <boost/bind.hpp>
 
 #include "AbstractProviderManager.hpp"
 #include "AbstractGameProvider.hpp"
 #include "network/NetworkMessage.hpp"
+#include "network/FrameCompressor.hpp"
 #include "string/StringUtils.hpp"
 
 // default ctor
-AbstractProviderManager::AbstractProviderManager( ConnectionToServerPtr connection )
+AbstractProviderManager::AbstractProviderManager( ConnectionToServerPtr connection,
+                                                  size_t numberOfGameWorkers )
 :
    connection( connection ),
    login(),
-   gamePool()
+   gamePool(),
+   gameWorkers( numberOfGameWorkers > 0 ? numberOfGameWorkers : boost::thread::hardware_concurrency() )
 {
    connection->setNetworkClient( this );
+   connection->setSocketProfile( SocketTuning::getProviderProfile() );
+
+   // a lost link is resumed so the games survive a network glitch
+   connection->setResumable( true );
 }
 
 // connect to the BBServer
+// a 'unix:<path>' or 'shm:<path>' host is the unix domain socket of a server on the same host (the port is ignored)
 void AbstractProviderManager::connect( const std::string& host,
                                  int port )
 {
+   if (  ( SimpleTcpConnection::isLocalAddress( host ) == true )
+       ||( SimpleTcpConnection::isSharedMemoryAddress( host ) == true )  )
+   {
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+      boost::asio::local::stream_protocol::endpoint endpoint( SimpleTcpConnection::getLocalPath( host ) );
+      connection->connect( endpoint );
+#else
+      AsyncLogger::getInstance()->log( "AbstractProviderManager> unix domain sockets are not supported: " + host );
+#endif
+      return;
+   }
+
    connection->connect( boost::asio::ip::tcp::endpoint( boost::asio::ip::address::from_string( host ),
                                                         port ) );
 }
@@ -67,12 +88,17 @@ void AbstractProviderManager::onNewGameCreation( const std::string& gameId,
       game->setNetworkInformation( this,
                                    gameId );
 
+      // give it its own mailbox
+      GameActor actor;
+      actor.game = game;
+      actor.mailbox = SerialMailbox::create( gameWorkers );
+
       // get the lock
       gamePoolMutex.lock();
       /*|*/ 
       /*|*/ // store the game
       /*|*/ gamePool.insert( GamePool::value_type( gameId,
-      /*|*/                                        game ) );
+      /*|*/                                        actor ) );
       /*|*/ 
       // and release the kraken
       gamePoolMutex.unlock();
@@ -113,11 +139,12 @@ void AbstractProviderManager::onGameClose( const std::string& gameIds,
    /*|*/    GamePool::iterator itGame = gamePool.find( *it );
    /*|*/    if ( itGame != gamePool.end() )
    /*|*/    {
-   /*|*/       // close the game
-   /*|*/       itGame->second->close( reason );
+   /*|*/       // close the game after the messages already in its mailbox
+   /*|*/       itGame->second.mailbox->post( boost::bind( &AbstractProviderManager::closeGame,
+   /*|*/                                                  itGame->second.game,
+   /*|*/                                                  reason ) );
    /*|*/ 
-   /*|*/       // and get back the memory
-   /*|*/       delete itGame->second;
+   /*|*/       // and forget it
    /*|*/       gamePool.erase( itGame );
    /*|*/    }
    /*|*/ }
@@ -129,6 +156,28 @@ void AbstractProviderManager::onGameClose( const std::string& gameIds,
    gamePoolMutex.unlock();
 }
 
+// callback when the session expired before the link was back, close all the games
+void AbstractProviderManager::onSessionLost()
+{
+   std::string gameIds;
+
+   gamePoolMutex.lock();
+   /*|*/ for ( GamePool::const_iterator it = gamePool.begin();
+   /*|*/       it != gamePool.end();
+   /*|*/       it++ )
+   /*|*/ {
+   /*|*/    if ( gameIds.empty() == false )
+   /*|*/    {
+   /*|*/       gameIds += "|";
+   /*|*/    }
+   /*|*/    gameIds += it->first;
+   /*|*/ }
+   gamePoolMutex.unlock();
+
+   onGameClose( gameIds,
+                "Session expired" );
+}
+
 // callback used to handle the message when logon
 void AbstractProviderManager::onHandleMessage( const std::string& gameId,
                                        const std::string& message )
@@ -140,22 +189,88 @@ void AbstractProviderManager::onHandleMessage( const std::string& gameId,
    /*|*/ GamePool::iterator itGame = gamePool.find( gameId );
    /*|*/ if ( itGame != gamePool.end() )
    /*|*/ {
-   /*|*/    // spwan a thread to manage the message and avoid locking the gamePool for nothing
-   /*|*/    boost::thread worker( &AbstractGameProvider::handleGameMessage,
-   /*|*/                          itGame->second,
-   /*|*/                          message );
+   /*|*/    // queue the message in the mailbox of the game, the game handles its messages one by one
+   /*|*/    itGame->second.mailbox->post( boost::bind( &AbstractGameProvider::handleGameMessage,
+   /*|*/                                               itGame->second.game,
+   /*|*/                                               message ) );
    /*|*/ }
    /*|*/ 
    // and release the lock
    gamePoolMutex.unlock();
 }
 
+// callback used to handle a game message received in the binary form
+void AbstractProviderManager::onHandleBinaryMessage( const std::string& gameId,
+                                                     SharedMessage frame,
+                                                     size_t payloadOffset )
+{
+   // get the lock
+   gamePoolMutex.lock();
+   /*|*/ 
+   /*|*/ // check if the game is managed
+   /*|*/ GamePool::iterator itGame = gamePool.find( gameId );
+   /*|*/ if ( itGame != gamePool.end() )
+   /*|*/ {
+   /*|*/    // queue the received buffer in the mailbox of the game, the game reads it without copy nor text conversion
+   /*|*/    itGame->second.mailbox->post( boost::bind( &AbstractGameProvider::handleBinaryGameMessage,
+   /*|*/                                               itGame->second.game,
+   /*|*/                                               frame,
+   /*|*/                                               payloadOffset ) );
+   /*|*/ }
+   /*|*/ 
+   // and release the lock
+   gamePoolMutex.unlock();
+}
+
+// close the game and get back its memory, run in the mailbox of the game
+void AbstractProviderManager::closeGame( AbstractGameProvider* game,
+                                         const std::string& reason )
+{
+   game->close( reason );
+   delete game;
+}
+
+// get the number of messages waiting in the mailbox of each game
+std::map< std::string, size_t > AbstractProviderManager::getBacklogByGame()
+{
+   std::map< std::string, size_t > backlog;
+
+   gamePoolMutex.lock();
+   /*|*/ for ( GamePool::const_iterator it = gamePool.begin();
+   /*|*/       it != gamePool.end();
+   /*|*/       it++ )
+   /*|*/ {
+   /*|*/    backlog[ it->first ] = it->second.mailbox->getBacklog();
+   /*|*/ }
+   gamePoolMutex.unlock();
+
+   return backlog;
+}
+
+// get the statistics of the game workers
+WorkerPoolStatistics AbstractProviderManager::getGameWorkersStatistics() const
+{
+   return gameWorkers.getStatistics();
+}
+
 // forward the message on the network
 void AbstractProviderManager::sendMessage( const std::string& message )
 {
    connection->sendMessage( message );
 }
 
+// forward a binary frame on the network (only when isBinaryProtocol is true)
+void AbstractProviderManager::sendBinaryMessage( SharedMessage frame )
+{
+   connection->sendBinaryMessage( frame );
+}
+
+// return true if the messages are exchanged in the binary form
+bool AbstractProviderManager::isBinaryProtocol() const
+{
+   return connection->isBinaryProtocol();
+}
+
 // dump the current state of the server
 // should be call inside the mutex
 void AbstractProviderManager::dumpCurrentState()
@@ -164,12 +279,17 @@ void AbstractProviderManager::dumpCurrentState()
    stream << std::endl;
    stream << "----------------------------------------------------------------------------------------" << std::endl;
    stream << "games: " << gamePool.size() << " / " << getMaxGameInPool() << std::endl;
+   WorkerPoolStatistics statistics = gameWorkers.getStatistics();
+   stream << "workers: " << statistics.workers << " (queue: " << statistics.queueLength << " / max " << statistics.maxQueueLength << ", executed: " << statistics.executedTasks << ", stolen: " << statistics.stolenTasks << ", mean service: " << statistics.meanServiceTime << " us)" << std::endl;
+   CompressionStatistics compressionStatistics = FrameCompressor::getInstance().getStatistics();
+   stream << "compression: " << compressionStatistics.compressedFrames << " frames (ratio: " << compressionStatistics.ratio << ", mean time: " << compressionStatistics.meanCompressionTime << " us), " << compressionStatistics.decompressedFrames << " decompressed (mean time: " << compressionStatistics.meanDecompressionTime << " us)" << std::endl;
+   stream << "buffer pool hit rate: " << BufferPool::getInstance().getHitRate() << std::endl;
    stream << "----------------------------------------------------------------------------------------" << std::endl;
    for ( GamePool::const_iterator it = gamePool.begin();
          it != gamePool.end();
          it++ )
    {
-      stream << "\t" << it->first << std::endl;
+      stream << "\t" << it->first << "\tbacklog: " << it->second.mailbox->getBacklog() << std::endl;
    }
    stream << "----------------------------------------------------------------------------------------" << std::endl;
    AsyncLogger::getInstance()->log( stream.str() );
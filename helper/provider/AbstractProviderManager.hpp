@@ -2,6 +2,8 @@
 
 #include "network/client/ConnectionToServer.hpp"
 #include "network/client/NetworkClient.hpp"
+#include "thread/SerialMailbox.hpp"
+#include "thread/WorkStealingPool.hpp"
 #include "boost/thread/mutex.hpp"
 
 class AbstractGameProvider;
@@ -16,18 +18,39 @@ class AbstractProviderManager : public NetworkClient
    // the login to store name + connection info
    std::string login;
 
+   // a game with the mailbox running its messages one after the other
+   struct GameActor
+   {
+      // the game (owned)
+      AbstractGameProvider* game;
+
+      // the mailbox of the game on the worker pool
+      SerialMailboxPtr mailbox;
+   };
+
    // the game storer
-   typedef std::map< std::string, AbstractGameProvider* > GamePool;
+   typedef std::map< std::string, GameActor > GamePool;
    GamePool gamePool;
 
    // the mutex of the game storer
    // allow many reader and 1 writer
    boost::mutex gamePoolMutex;
 
+   // the workers running the game mailboxes
+   // different games run in parallel, the messages of a game run in order
+   WorkStealingPool gameWorkers;
+
 public:
 
-   // ctor with the connection
-   AbstractProviderManager( ConnectionToServerPtr connection );
+   // ctor with the connection and the number of game workers (0 means one per core)
+   AbstractProviderManager( ConnectionToServerPtr connection,
+                            size_t numberOfGameWorkers = 0 );
+
+   // get the number of messages waiting in the mailbox of each game
+   std::map< std::string, size_t > getBacklogByGame();
+
+   // get the statistics of the game workers
+   WorkerPoolStatistics getGameWorkersStatistics() const;
 
    // connect to the BBServer
    void connect( const std::string& host,
@@ -36,11 +59,21 @@ public:
    // forward the message on the network
    void sendMessage( const std::string& message );
 
+   // forward a binary frame on the network (only when isBinaryProtocol is true)
+   void sendBinaryMessage( SharedMessage frame );
+
+   // return true if the messages are exchanged in the binary form
+   bool isBinaryProtocol() const;
+
 private:
    // dump the current state of the manager
    // should be call inside the mutex
    void dumpCurrentState();
 
+   // close the game and get back its memory, run in the mailbox of the game
+   static void closeGame( AbstractGameProvider* game,
+                          const std::string& reason );
+
    // coming from Network Client
    //---------------------------
 
@@ -65,10 +98,18 @@ private:
    virtual void onGameClose( const std::string& gameIds,
                              const std::string& reason );
 
+   // callback when the session expired before the link was back, close all the games
+   virtual void onSessionLost();
+
    // callback used to handle the message when logon
    virtual void onHandleMessage( const std::string& gameId,
                                  const std::string& message );
 
+   // callback used to handle a game message received in the binary form
+   virtual void onHandleBinaryMessage( const std::string& gameId,
+                                       SharedMessage frame,
+                                       size_t payloadOffset );
+
    // the abstract part
    //------------------
 
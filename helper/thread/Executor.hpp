@@ -0,0 +1,37 @@
+#pragma once
+
+#include <boost/function.hpp>
+
+// a unit of work given to an executor
+typedef boost::function< void () > Task;
+
+// this class is the abstraction of something able to run tasks
+class Executor
+{
+public:
+   // dtor
+   virtual ~Executor()
+   {
+   }
+
+   // run the task, now or later depending on the executor
+   virtual void post( const Task& task ) = 0;
+};
+
+// executor running the task directly in the calling thread
+class InlineExecutor : public Executor
+{
+public:
+   // the shared instance, the executor has no state
+   static InlineExecutor& getInstance()
+   {
+      static InlineExecutor instance;
+      return instance;
+   }
+
+   // run the task now
+   virtual void post( const Task& task )
+   {
+      task();
+   }
+};
@@ -0,0 +1,83 @@
+#define _WIN32_WINNT 0x0501
+
+#include <boost/bind.hpp>
+#include "SerialMailbox.hpp"
+
+// the real ctor in the private zone as we use the shared ptr mechanism
+SerialMailbox::SerialMailbox( Executor& executor )
+:
+   executor( executor ),
+   tasks(),
+   scheduled( false )
+{
+}
+
+// queue the task in the mailbox
+void SerialMailbox::post( const Task& task )
+{
+   bool needSchedule = false;
+
+   mailboxMutex.lock();
+   /*|*/ tasks.push_back( task );
+   /*|*/ if ( scheduled == false )
+   /*|*/ {
+   /*|*/    scheduled = true;
+   /*|*/    needSchedule = true;
+   /*|*/ }
+   mailboxMutex.unlock();
+
+   // schedule the mailbox outside the lock as the executor may run it inline
+   if ( needSchedule == true )
+   {
+      executor.post( boost::bind( &SerialMailbox::drainMailbox,
+                                  shared_from_this() ) );
+   }
+}
+
+// get the number of tasks waiting in the mailbox
+size_t SerialMailbox::getBacklog() const
+{
+   boost::mutex::scoped_lock lock( mailboxMutex );
+   return tasks.size();
+}
+
+// return true if no task of the mailbox waits or runs
+bool SerialMailbox::isIdle() const
+{
+   boost::mutex::scoped_lock lock( mailboxMutex );
+   return scheduled == false;
+}
+
+// run the waiting tasks in order, reschedule itself if there are too many
+void SerialMailbox::drain()
+{
+   for ( size_t i = 0;
+         i < TASKS_PER_DRAIN;
+         ++i )
+   {
+      Task task;
+
+      mailboxMutex.lock();
+      /*|*/ if ( tasks.empty() == true )
+      /*|*/ {
+      /*|*/    scheduled = false;
+      /*|*/    mailboxMutex.unlock();
+      /*|*/    return;
+      /*|*/ }
+      /*|*/ task.swap( tasks.front() );
+      /*|*/ tasks.pop_front();
+      mailboxMutex.unlock();
+
+      task();
+   }
+
+   // still scheduled, give the worker back to the other mailboxes
+   executor.post( boost::bind( &SerialMailbox::drainMailbox,
+                               shared_from_this() ) );
+}
+
+// the task given to the executor to drain the mailbox
+void SerialMailbox::drainMailbox( SerialMailboxPtr mailbox )
+{
+   mailbox->drain();
+}
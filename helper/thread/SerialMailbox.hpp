@@ -0,0 +1,62 @@
+#pragma once
+
+#include <boost/thread/mutex.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include "Executor.hpp"
+#include "../container/RingQueue.hpp"
+
+// ordered mailbox running its tasks one after the other on a shared executor
+// two tasks of the same mailbox never run at the same time and run in the posting order,
+// while different mailboxes run in parallel on the executor
+class SerialMailbox : public Executor,
+                      public boost::enable_shared_from_this< SerialMailbox >
+{
+   // the executor running the mailbox (not owned)
+   Executor& executor;
+
+   // the tasks waiting in the mailbox, in a ring which stops allocating once it reached the longest backlog
+   RingQueue< Task > tasks;
+
+   // true while the mailbox is scheduled on the executor
+   bool scheduled;
+
+   // the mutex of the mailbox
+   mutable boost::mutex mailboxMutex;
+
+   // the number of tasks run by a drain before giving back the worker
+   static const size_t TASKS_PER_DRAIN = 32;
+
+public:
+   // auto reference for enable shared
+   typedef boost::shared_ptr< SerialMailbox > SerialMailboxPtr;
+
+   // creator for the shared ptr mechanism
+   static SerialMailboxPtr create( Executor& executor )
+   {
+      return SerialMailboxPtr( new SerialMailbox( executor ) );
+   }
+
+   // queue the task in the mailbox
+   virtual void post( const Task& task );
+
+   // get the number of tasks waiting in the mailbox
+   size_t getBacklog() const;
+
+   // return true if no task of the mailbox waits or runs
+   bool isIdle() const;
+
+private:
+   // the real ctor in the private zone as we use the shared ptr mechanism
+   SerialMailbox( Executor& executor );
+
+   // run the waiting tasks in order, reschedule itself if there are too many
+   void drain();
+
+   // the task given to the executor to drain the mailbox
+   // a function and the shared pointer fit in the buffer of a Task, so scheduling the mailbox allocates nothing
+   static void drainMailbox( SerialMailboxPtr mailbox );
+};
+
+// typedef to ease the coding
+typedef SerialMailbox::SerialMailboxPtr SerialMailboxPtr;
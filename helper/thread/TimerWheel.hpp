@@ -0,0 +1,130 @@
+#pragma once
+
+#include <vector>
+#include <utility>
+#include <boost/array.hpp>
+#include <boost/cstdint.hpp>
+
+// the number of slots of a level of the wheel (a power of 2) and its log
+#define TIMER_WHEEL_SLOTS 64
+#define TIMER_WHEEL_SLOT_BITS 6
+
+// the number of levels, the wheel covers 64^4 ticks
+#define TIMER_WHEEL_LEVELS 4
+
+// hierarchical timer wheel giving back the keys whose deadline is reached
+// a key is scheduled at a tick in O(1): level 0 holds the next 64 ticks, level 1 the next 64 * 64 ...
+// the slots of a level are moved to the level below when it comes round, so a key moves at most
+// TIMER_WHEEL_LEVELS times and advancing the wheel only costs the expired keys
+// there is no cancellation, the owner checks the expired keys and schedules them again if needed
+// the wheel is not thread safe
+// this class is fully inline to ease the sharing
+template< typename Key >
+class TimerWheel
+{
+   // a key with its deadline
+   typedef std::pair< boost::uint64_t, Key > Entry;
+   typedef std::vector< Entry > Slot;
+
+   // the slots of each level
+   boost::array< boost::array< Slot, TIMER_WHEEL_SLOTS >, TIMER_WHEEL_LEVELS > levels;
+
+   // the last tick handled
+   boost::uint64_t currentTick;
+
+   // the number of keys in the wheel
+   size_t numberOfKeys;
+
+public:
+   // an empty wheel at the tick 0
+   TimerWheel()
+   :
+      levels(),
+      currentTick( 0 ),
+      numberOfKeys( 0 )
+   {
+   }
+
+   // get the last tick handled
+   boost::uint64_t getCurrentTick() const
+   {
+      return currentTick;
+   }
+
+   // get the number of keys in the wheel
+   size_t size() const
+   {
+      return numberOfKeys;
+   }
+
+   // schedule the key at the deadline, a deadline already reached expires at the next tick
+   void schedule( const Key& key,
+                  boost::uint64_t deadline )
+   {
+      if ( deadline <= currentTick )
+      {
+         deadline = currentTick + 1;
+      }
+      insert( Entry( deadline,
+                     key ) );
+      numberOfKeys++;
+   }
+
+   // move the wheel up to the tick and append the keys whose deadline is reached to expired
+   void advance( boost::uint64_t tick,
+                 std::vector< Key >& expired )
+   {
+      while ( currentTick < tick )
+      {
+         currentTick++;
+
+         // bring down the slots of the upper levels coming round
+         for ( size_t level = 1;
+               (  ( level < TIMER_WHEEL_LEVELS )
+                &&( ( currentTick & ( ( static_cast< boost::uint64_t >( 1 ) << ( level * TIMER_WHEEL_SLOT_BITS ) ) - 1 ) ) == 0 )  );
+               ++level )
+         {
+            Slot cascaded;
+            cascaded.swap( levels[ level ][ ( currentTick >> ( level * TIMER_WHEEL_SLOT_BITS ) ) & ( TIMER_WHEEL_SLOTS - 1 ) ] );
+            for ( typename Slot::const_iterator it = cascaded.begin();
+                  it != cascaded.end();
+                  it++ )
+            {
+               insert( *it );
+            }
+         }
+
+         // the keys of the tick
+         Slot& slot = levels[ 0 ][ currentTick & ( TIMER_WHEEL_SLOTS - 1 ) ];
+         for ( typename Slot::const_iterator it = slot.begin();
+               it != slot.end();
+               it++ )
+         {
+            expired.push_back( it->second );
+         }
+         numberOfKeys -= slot.size();
+         slot.clear();
+      }
+   }
+
+private:
+   // store the entry in the level matching its distance to the current tick
+   void insert( const Entry& entry )
+   {
+      boost::uint64_t delta = entry.first - currentTick;
+      size_t level = 0;
+      while (  ( level < TIMER_WHEEL_LEVELS - 1 )
+             &&( delta >= ( static_cast< boost::uint64_t >( 1 ) << ( ( level + 1 ) * TIMER_WHEEL_SLOT_BITS ) ) )  )
+      {
+         level++;
+      }
+
+      // the deadlines beyond the wheel wait in the last level and are moved again when it comes round
+      boost::uint64_t deadline = entry.first;
+      if ( delta >= ( static_cast< boost::uint64_t >( 1 ) << ( TIMER_WHEEL_LEVELS * TIMER_WHEEL_SLOT_BITS ) ) )
+      {
+         deadline = currentTick + ( static_cast< boost::uint64_t >( 1 ) << ( TIMER_WHEEL_LEVELS * TIMER_WHEEL_SLOT_BITS ) ) - 1;
+      }
+      levels[ level ][ ( deadline >> ( level * TIMER_WHEEL_SLOT_BITS ) ) & ( TIMER_WHEEL_SLOTS - 1 ) ].push_back( entry );
+   }
+};
@@ -0,0 +1,196 @@
+#define _WIN32_WINNT 0x0501
+
+#include <boost/bind.hpp>
+#include "WorkStealingPool.hpp"
+
+// create the pool and start its workers
+WorkStealingPool::WorkStealingPool( size_t numberOfWorkers )
+:
+   queues(),
+   workers(),
+   pendingTasks( 0 ),
+   nextQueue( 0 ),
+   stopped( false ),
+   maxQueueLength( 0 ),
+   executedTasks( 0 ),
+   stolenTasks( 0 ),
+   totalServiceTime( 0 )
+{
+   if ( numberOfWorkers == 0 )
+   {
+      numberOfWorkers = 1;
+   }
+
+   // create all the queues before starting the workers as they look at each other
+   for ( size_t i = 0;
+         i < numberOfWorkers;
+         ++i )
+   {
+      queues.push_back( WorkerQueuePtr( new WorkerQueue() ) );
+   }
+
+   for ( size_t i = 0;
+         i < numberOfWorkers;
+         ++i )
+   {
+      workers.create_thread( boost::bind( &WorkStealingPool::run,
+                                          this,
+                                          i ) );
+   }
+}
+
+// stop the workers and wait for them
+WorkStealingPool::~WorkStealingPool()
+{
+   poolMutex.lock();
+   /*|*/ stopped = true;
+   poolMutex.unlock();
+
+   taskAvailable.notify_all();
+   workers.join_all();
+}
+
+// queue the task on the queue of the current worker or on the next queue
+void WorkStealingPool::post( const Task& task )
+{
+   size_t index;
+
+   // count the task before it's visible so a worker never sees more tasks than counted
+   poolMutex.lock();
+   /*|*/ pendingTasks++;
+   /*|*/ if ( pendingTasks > maxQueueLength )
+   /*|*/ {
+   /*|*/    maxQueueLength = pendingTasks;
+   /*|*/ }
+   /*|*/
+   /*|*/ if ( workerIndex.get() != NULL )
+   /*|*/ {
+   /*|*/    index = *workerIndex;
+   /*|*/ }
+   /*|*/ else
+   /*|*/ {
+   /*|*/    index = nextQueue;
+   /*|*/    nextQueue = ( nextQueue + 1 ) % queues.size();
+   /*|*/ }
+   poolMutex.unlock();
+
+   WorkerQueue& queue = *queues[ index ];
+   queue.queueMutex.lock();
+   /*|*/ queue.tasks.push_back( task );
+   queue.queueMutex.unlock();
+
+   taskAvailable.notify_one();
+}
+
+// get the current statistics of the pool
+WorkerPoolStatistics WorkStealingPool::getStatistics() const
+{
+   boost::mutex::scoped_lock lock( poolMutex );
+
+   WorkerPoolStatistics statistics;
+   statistics.workers = queues.size();
+   statistics.queueLength = pendingTasks;
+   statistics.maxQueueLength = maxQueueLength;
+   statistics.executedTasks = executedTasks;
+   statistics.stolenTasks = stolenTasks;
+   statistics.meanServiceTime = ( executedTasks > 0 ) ? ( totalServiceTime.count() / 1000.0 ) / executedTasks : 0.0;
+   return statistics;
+}
+
+// the worker loop
+void WorkStealingPool::run( size_t index )
+{
+   workerIndex.reset( new size_t( index ) );
+
+   while ( true )
+   {
+      Task task;
+      bool stolen = false;
+
+      if ( popLocal( index, task ) == false )
+      {
+         stolen = steal( index, task );
+      }
+
+      if ( task )
+      {
+         // run it and measure the service time
+         boost::chrono::steady_clock::time_point start = boost::chrono::steady_clock::now();
+         task();
+         boost::chrono::nanoseconds serviceTime = boost::chrono::steady_clock::now() - start;
+
+         poolMutex.lock();
+         /*|*/ executedTasks++;
+         /*|*/ totalServiceTime += serviceTime;
+         /*|*/ if ( stolen == true )
+         /*|*/ {
+         /*|*/    stolenTasks++;
+         /*|*/ }
+         poolMutex.unlock();
+      }
+      else
+      {
+         // nothing to do anywhere, sleep until a task is posted
+         boost::mutex::scoped_lock lock( poolMutex );
+         while (  ( stopped == false )
+                &&( pendingTasks == 0 )  )
+         {
+            taskAvailable.wait( lock );
+         }
+
+         if ( stopped == true )
+         {
+            return;
+         }
+      }
+   }
+}
+
+// take the next task of the worker queue
+bool WorkStealingPool::popLocal( size_t index,
+                                 Task& task )
+{
+   WorkerQueue& queue = *queues[ index ];
+
+   queue.queueMutex.lock();
+   /*|*/ if ( queue.tasks.empty() == true )
+   /*|*/ {
+   /*|*/    queue.queueMutex.unlock();
+   /*|*/    return false;
+   /*|*/ }
+   /*|*/ task.swap( queue.tasks.front() );
+   /*|*/ queue.tasks.pop_front();
+   queue.queueMutex.unlock();
+
+   poolMutex.lock();
+   /*|*/ pendingTasks--;
+   poolMutex.unlock();
+   return true;
+}
+
+// take the oldest task of another queue
+bool WorkStealingPool::steal( size_t index,
+                              Task& task )
+{
+   for ( size_t i = 1;
+         i < queues.size();
+         ++i )
+   {
+      WorkerQueue& queue = *queues[ ( index + i ) % queues.size() ];
+
+      queue.queueMutex.lock();
+      /*|*/ if ( queue.tasks.empty() == false )
+      /*|*/ {
+      /*|*/    task.swap( queue.tasks.front() );
+      /*|*/    queue.tasks.pop_front();
+      /*|*/    queue.queueMutex.unlock();
+      /*|*/
+      /*|*/    poolMutex.lock();
+      /*|*/    pendingTasks--;
+      /*|*/    poolMutex.unlock();
+      /*|*/    return true;
+      /*|*/ }
+      queue.queueMutex.unlock();
+   }
+   return false;
+}
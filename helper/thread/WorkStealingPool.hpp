@@ -0,0 +1,82 @@
+#pragma once
+
+#include <deque>
+#include <vector>
+#include <boost/thread.hpp>
+#include <boost/thread/tss.hpp>
+#include <boost/chrono.hpp>
+#include <boost/shared_ptr.hpp>
+#include "Executor.hpp"
+#include "WorkerPool.hpp"
+
+// fixed size pool of threads where each worker owns its queue of tasks
+// a task posted by a worker goes in its own queue, the other ones are spread on all the queues
+// an idle worker takes the oldest task of another queue before going to sleep
+class WorkStealingPool : public Executor
+{
+   // the queue of a worker
+   struct WorkerQueue
+   {
+      // the mutex of the queue
+      boost::mutex queueMutex;
+
+      // the tasks of the worker
+      std::deque< Task > tasks;
+   };
+   typedef boost::shared_ptr< WorkerQueue > WorkerQueuePtr;
+
+   // the queues, one per worker
+   std::vector< WorkerQueuePtr > queues;
+
+   // the worker threads
+   boost::thread_group workers;
+
+   // the index of the queue of the current thread (not set outside the workers)
+   boost::thread_specific_ptr< size_t > workerIndex;
+
+   // the mutex used to sleep and to guard the counters
+   mutable boost::mutex poolMutex;
+
+   // signaled when a task is posted or the pool is stopped
+   boost::condition_variable taskAvailable;
+
+   // the number of tasks waiting in all the queues
+   size_t pendingTasks;
+
+   // the next queue used for a task posted from outside the pool
+   size_t nextQueue;
+
+   // true when the workers must leave
+   bool stopped;
+
+   // statistics
+   size_t maxQueueLength;
+   size_t executedTasks;
+   size_t stolenTasks;
+   boost::chrono::nanoseconds totalServiceTime;
+
+public:
+   // create the pool and start its workers
+   explicit WorkStealingPool( size_t numberOfWorkers );
+
+   // stop the workers and wait for them
+   virtual ~WorkStealingPool();
+
+   // queue the task on the queue of the current worker or on the next queue
+   virtual void post( const Task& task );
+
+   // get the current statistics of the pool
+   WorkerPoolStatistics getStatistics() const;
+
+private:
+   // the worker loop
+   void run( size_t index );
+
+   // take the next task of the worker queue
+   bool popLocal( size_t index,
+                  Task& task );
+
+   // take the oldest task of another queue
+   bool steal( size_t index,
+               Task& task );
+};
@@ -0,0 +1,101 @@
+#define _WIN32_WINNT 0x0501
+
+#include <boost/bind.hpp>
+#include "WorkerPool.hpp"
+
+// create the pool and start its workers
+WorkerPool::WorkerPool( size_t numberOfWorkers )
+:
+   workers(),
+   numberOfWorkers( numberOfWorkers > 0 ? numberOfWorkers : 1 ),
+   tasks(),
+   stopped( false ),
+   maxQueueLength( 0 ),
+   executedTasks( 0 ),
+   totalServiceTime( 0 )
+{
+   for ( size_t i = 0;
+         i < this->numberOfWorkers;
+         ++i )
+   {
+      workers.create_thread( boost::bind( &WorkerPool::run,
+                                          this ) );
+   }
+}
+
+// stop the workers and wait for them
+WorkerPool::~WorkerPool()
+{
+   poolMutex.lock();
+   /*|*/ stopped = true;
+   poolMutex.unlock();
+
+   taskAvailable.notify_all();
+   workers.join_all();
+}
+
+// queue the task for the next available worker
+void WorkerPool::post( const Task& task )
+{
+   poolMutex.lock();
+   /*|*/ tasks.push_back( task );
+   /*|*/ if ( tasks.size() > maxQueueLength )
+   /*|*/ {
+   /*|*/    maxQueueLength = tasks.size();
+   /*|*/ }
+   poolMutex.unlock();
+
+   taskAvailable.notify_one();
+}
+
+// get the current statistics of the pool
+WorkerPoolStatistics WorkerPool::getStatistics() const
+{
+   boost::mutex::scoped_lock lock( poolMutex );
+
+   WorkerPoolStatistics statistics;
+   statistics.workers = numberOfWorkers;
+   statistics.queueLength = tasks.size();
+   statistics.maxQueueLength = maxQueueLength;
+   statistics.executedTasks = executedTasks;
+   statistics.stolenTasks = 0;
+   statistics.meanServiceTime = ( executedTasks > 0 ) ? ( totalServiceTime.count() / 1000.0 ) / executedTasks : 0.0;
+   return statistics;
+}
+
+// the worker loop
+void WorkerPool::run()
+{
+   while ( true )
+   {
+      Task task;
+
+      // wait for a task
+      {
+         boost::mutex::scoped_lock lock( poolMutex );
+         while (  ( stopped == false )
+                &&( tasks.empty() == true )  )
+         {
+            taskAvailable.wait( lock );
+         }
+
+         if ( stopped == true )
+         {
+            return;
+         }
+
+         task.swap( tasks.front() );
+         tasks.pop_front();
+      }
+
+      // run it and measure the service time
+      boost::chrono::steady_clock::time_point start = boost::chrono::steady_clock::now();
+      task();
+      boost::chrono::nanoseconds serviceTime = boost::chrono::steady_clock::now() - start;
+
+      poolMutex.lock();
+      /*|*/ executedTasks++;
+      /*|*/ totalServiceTime += serviceTime;
+      poolMutex.unlock();
+   }
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <boost/thread.hpp>
+#include <boost/chrono.hpp>
+#include "Executor.hpp"
+#include "../container/RingQueue.hpp"
+
+// the statistics of a worker pool, used to size it
+struct WorkerPoolStatistics
+{
+   // the number of worker threads
+   size_t workers;
+
+   // the number of tasks waiting for a worker
+   size_t queueLength;
+
+   // the highest number of tasks waiting for a worker
+   size_t maxQueueLength;
+
+   // the number of tasks executed
+   size_t executedTasks;
+
+   // the number of tasks taken from the queue of another worker (work stealing pools only)
+   size_t stolenTasks;
+
+   // the mean time spent running a task (in microseconds)
+   double meanServiceTime;
+};
+
+// fixed size pool of threads running the posted tasks
+class WorkerPool : public Executor
+{
+   // the worker threads
+   boost::thread_group workers;
+
+   // the number of worker threads
+   size_t numberOfWorkers;
+
+   // the tasks waiting for a worker, in a ring which stops allocating once it reached the longest queue
+   RingQueue< Task > tasks;
+
+   // the mutex of the pool
+   mutable boost::mutex poolMutex;
+
+   // signaled when a task is posted or the pool is stopped
+   boost::condition_variable taskAvailable;
+
+   // true when the workers must leave
+   bool stopped;
+
+   // statistics
+   size_t maxQueueLength;
+   size_t executedTasks;
+   boost::chrono::nanoseconds totalServiceTime;
+
+public:
+   // create the pool and start its workers
+   explicit WorkerPool( size_t numberOfWorkers );
+
+   // stop the workers and wait for them
+   virtual ~WorkerPool();
+
+   // queue the task for the next available worker
+   virtual void post( const Task& task );
+
+   // get the current statistics of the pool
+   WorkerPoolStatistics getStatistics() const;
+
+private:
+   // the worker loop
+   void run();
+};